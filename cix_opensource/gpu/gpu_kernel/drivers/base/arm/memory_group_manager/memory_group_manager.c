@@ -27,8 +27,8 @@
 #include <linux/module.h>
 #if IS_ENABLED(CONFIG_DEBUG_FS)
 #include <linux/debugfs.h>
-#include <linux/version_compat_defs.h>
 #endif
+#include <linux/version_compat_defs.h>
 #include <linux/mm.h>
 #include <linux/memory_group_manager.h>
 #include <linux/acpi.h>
@@ -266,6 +266,30 @@ static struct page *example_mgm_alloc_page(struct memory_group_manager_device *m
 	return p;
 }
 
+static unsigned long example_mgm_alloc_pages_bulk(struct memory_group_manager_device *mgm_dev,
+						  unsigned int group_id, gfp_t gfp_mask,
+						  unsigned long nr_pages, struct page **page_array)
+{
+	struct mgm_groups *const data = mgm_dev->data;
+	unsigned long nr_allocated;
+
+	dev_dbg(data->dev, "%s(mgm_dev=%pK, group_id=%u gfp_mask=0x%x nr_pages=%lu\n", __func__,
+		(void *)mgm_dev, group_id, gfp_mask, nr_pages);
+
+	if (WARN_ON(group_id >= MEMORY_GROUP_MANAGER_NR_GROUPS))
+		return 0;
+
+	nr_allocated = kbase_alloc_pages_bulk(gfp_mask, nr_pages, page_array);
+
+	if (nr_allocated)
+		atomic_add(nr_allocated, &data->groups[group_id].size);
+	if (nr_allocated < nr_pages)
+		dev_dbg(data->dev, "alloc_pages_bulk allocated %lu of %lu pages\n", nr_allocated,
+			nr_pages);
+
+	return nr_allocated;
+}
+
 static void example_mgm_free_page(struct memory_group_manager_device *mgm_dev,
 				  unsigned int group_id, struct page *page, unsigned int order)
 {
@@ -415,6 +439,7 @@ static int memory_group_manager_probe(struct platform_device *pdev)
 
 	mgm_dev->owner = THIS_MODULE;
 	mgm_dev->ops.mgm_alloc_page = example_mgm_alloc_page;
+	mgm_dev->ops.mgm_alloc_pages_bulk = example_mgm_alloc_pages_bulk;
 	mgm_dev->ops.mgm_free_page = example_mgm_free_page;
 	mgm_dev->ops.mgm_get_import_memory_id = example_mgm_get_import_memory_id;
 	mgm_dev->ops.mgm_vmf_insert_pfn_prot = example_mgm_vmf_insert_pfn_prot;
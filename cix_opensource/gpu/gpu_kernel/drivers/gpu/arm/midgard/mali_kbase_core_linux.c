@@ -5154,6 +5154,8 @@ static struct dentry *init_debugfs(struct kbase_device *kbdev)
 	if (IS_ERR_OR_NULL(dentry))
 		return dentry;
 
+	kbase_mem_pool_debugfs_dirty_init(kbdev->mali_debugfs_directory, &kbdev->mem_pools);
+
 	if (kbase_hw_has_feature(kbdev, KBASE_HW_FEATURE_PROTECTED_DEBUG_MODE)) {
 		dentry = debugfs_create_file("protected_debug_mode", 0444,
 					     kbdev->mali_debugfs_directory, kbdev,
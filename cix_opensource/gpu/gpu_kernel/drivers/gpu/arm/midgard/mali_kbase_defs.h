@@ -522,8 +522,15 @@ struct kbase_pm_device_data {
  *                             memory group manager, if present. Immutable.
  *                             Valid range is 0..(MEMORY_GROUP_MANAGER_NR_GROUPS-1).
  * @pool_lock:                 Lock protecting the pool - must be held when modifying
- *                             @cur_size and @page_list
- * @page_list:                 List of free pages in the pool
+ *                             @cur_size, @page_list, @dirty_list and @nr_dirty
+ * @page_list:                 List of free pages in the pool that are ready to be
+ *                             handed out
+ * @dirty_list:                List of free pages in the pool that still have to be
+ *                             zeroed before they can be handed out. They are counted
+ *                             in @cur_size as well.
+ * @nr_dirty:                  Number of pages in @dirty_list
+ * @zero_work:                 Work item zeroing the pages of @dirty_list in batches
+ *                             and moving them to @page_list
  * @reclaim:                   Shrinker for kernel reclaim of free pages
  * @isolation_in_progress_cnt: Number of pages in pool undergoing page isolation.
  *                             This is used to avoid race condition between pool termination
@@ -544,6 +551,9 @@ struct kbase_mem_pool {
 	u8 group_id;
 	spinlock_t pool_lock;
 	struct list_head page_list;
+	struct list_head dirty_list;
+	size_t nr_dirty;
+	struct delayed_work zero_work;
 	DEFINE_KBASE_SHRINKER reclaim;
 	atomic_t isolation_in_progress_cnt;
 
@@ -822,6 +832,8 @@ struct kbase_mem_migrate {
  *                         the device
  * @mem_pools:             Global pools of free physical memory pages which can
  *                         be used by all the contexts.
+ * @mem_pool_zero_wq:      Work queue on which the memory pools zero the pages
+ *                         spilled to them in the background.
  * @memdev:                keeps track of the in use physical pages allocated by
  *                         the Driver.
  * @mmu_mode:              Pointer to the object containing methods for programming
@@ -1150,6 +1162,7 @@ struct kbase_device {
 	struct kbase_pm_device_data pm;
 
 	struct kbase_mem_pool_group mem_pools;
+	struct workqueue_struct *mem_pool_zero_wq;
 	struct kbasep_mem_device memdev;
 	struct kbase_mmu_mode const *mmu_mode;
 
@@ -249,6 +249,17 @@ int kbase_mem_init(struct kbase_device *kbdev)
 		return -ENOMEM;
 	}
 
+	/* Bound, so that pages spilled to the device pools are zeroed on the
+	 * CPU that freed them, and freezable as there is no point zeroing
+	 * pages across suspend.
+	 */
+	kbdev->mem_pool_zero_wq = alloc_workqueue("mali_mem_pool_zero_wq", WQ_FREEZABLE, 0);
+	if (kbdev->mem_pool_zero_wq == NULL) {
+		dev_err(kbdev->dev, "Failed to allocate mem_pool_zero_wq\n");
+		err = -ENOMEM;
+		goto mem_pool_zero_wq_fail;
+	}
+
 	kbase_mem_migrate_init(kbdev);
 
 	if ((GPU_PAGES_PER_CPU_PAGE > 1) || kbase_is_page_migration_enabled()) {
@@ -321,6 +332,9 @@ int kbase_mem_init(struct kbase_device *kbdev)
 	kbdev->page_metadata_slab = NULL;
 page_metadata_slab_fail:
 	kbase_mem_migrate_term(kbdev);
+	destroy_workqueue(kbdev->mem_pool_zero_wq);
+	kbdev->mem_pool_zero_wq = NULL;
+mem_pool_zero_wq_fail:
 	kmem_cache_destroy(kbdev->va_region_slab);
 	kbdev->va_region_slab = NULL;
 
@@ -347,6 +361,9 @@ void kbase_mem_term(struct kbase_device *kbdev)
 
 	kbase_mem_pool_group_term(&kbdev->mem_pools);
 
+	destroy_workqueue(kbdev->mem_pool_zero_wq);
+	kbdev->mem_pool_zero_wq = NULL;
+
 	kbase_mem_migrate_term(kbdev);
 
 	kmem_cache_destroy(kbdev->page_metadata_slab);
@@ -2946,8 +2963,8 @@ static int kbase_jit_grow(struct kbase_context *kctx, const struct base_jit_allo
 	 * pool lock to prevent another thread from allocating from the pool
 	 * between the grow and allocation.
 	 */
-	while (kbase_mem_pool_size(pool) < pages_required) {
-		size_t pool_delta = pages_required - kbase_mem_pool_size(pool);
+	while (kbase_mem_pool_clean_size(pool) < pages_required) {
+		size_t pool_delta = pages_required - kbase_mem_pool_clean_size(pool);
 		int ret;
 
 		kbase_mem_pool_unlock(pool);
@@ -393,7 +393,9 @@ struct kbase_mem_phy_alloc {
  *                        soon as it leaves a memory pool.
  * @SPILL_IN_PROGRESS: Transitory state. Corner case where pages in a memory
  *                     pool of a dying context are being moved to the device
- *                     memory pool.
+ *                     memory pool. Also used for pages spilled to the device
+ *                     memory pool that are waiting in its dirty list to be
+ *                     zeroed.
  * @NOT_MOVABLE: Stable state. Page has been allocated for an object that is
  *               not movable, but may return to be movable when the object
  *               is freed.
@@ -1080,8 +1082,9 @@ struct page *kbase_mem_pool_alloc(struct kbase_mem_pool *pool);
  * kbase_mem_pool_alloc_locked - Allocate a page from memory pool
  * @pool:  Memory pool to allocate from
  *
- * If there are free pages in the pool, this function allocates a page from
- * @pool. This function does not use @next_pool.
+ * If there are zeroed pages in the pool, this function allocates a page from
+ * @pool. This function does not use @next_pool. Pages still waiting for the
+ * zero worker are left alone, they are not zeroed under the pool lock.
  *
  * Return: Pointer to allocated page, or NULL if allocation failed.
  *
@@ -1160,11 +1163,12 @@ int kbase_mem_pool_alloc_pages(struct kbase_mem_pool *pool, size_t nr_small_page
  * trigger the OoM killer. Therefore, it can be run while the vm_lock is held.
  *
  * As new pages can not be allocated, the caller must ensure there are
- * sufficient pages in the pool. Usage of this function should look like :
+ * sufficient zeroed pages in the pool. Dirty pages are not zeroed under the
+ * pool lock and do not count. Usage of this function should look like :
  *
  *   kbase_gpu_vm_lock(kctx);
  *   kbase_mem_pool_lock(pool)
- *   while (kbase_mem_pool_size(pool) < pages_required) {
+ *   while (kbase_mem_pool_clean_size(pool) < pages_required) {
  *     kbase_mem_pool_unlock(pool)
  *     kbase_gpu_vm_unlock(kctx);
  *     kbase_mem_pool_grow(pool)
@@ -1231,6 +1235,34 @@ static inline size_t kbase_mem_pool_size(struct kbase_mem_pool *pool)
 	return READ_ONCE(pool->cur_size);
 }
 
+/**
+ * kbase_mem_pool_dirty_size - Get number of free pages in memory pool that
+ *                             are still waiting to be zeroed
+ * @pool:  Memory pool to inspect
+ *
+ * These pages are included in kbase_mem_pool_size().
+ *
+ * Return: Number of dirty pages in the pool
+ */
+static inline size_t kbase_mem_pool_dirty_size(struct kbase_mem_pool *pool)
+{
+	return READ_ONCE(pool->nr_dirty);
+}
+
+/**
+ * kbase_mem_pool_clean_size - Get number of zeroed free pages in memory pool
+ * @pool:  Memory pool to inspect
+ *
+ * Only these pages can be allocated with the pool lock held, see
+ * kbase_mem_pool_alloc_pages_locked().
+ *
+ * Return: Number of zeroed pages in the pool
+ */
+static inline size_t kbase_mem_pool_clean_size(struct kbase_mem_pool *pool)
+{
+	return kbase_mem_pool_size(pool) - kbase_mem_pool_dirty_size(pool);
+}
+
 /**
  * kbase_mem_pool_max_size - Get maximum number of free pages in memory pool
  * @pool:  Memory pool to inspect
@@ -1301,6 +1333,24 @@ void kbase_mem_pool_mark_dying(struct kbase_mem_pool *pool);
  */
 struct page *kbase_mem_alloc_page(struct kbase_mem_pool *pool);
 
+/**
+ * kbase_mem_alloc_pages_bulk - Allocate many new pages for a device
+ * @pool:       Memory pool to allocate the pages for
+ * @nr_pages:   Number of pages wanted, of the order of @pool
+ * @page_array: Array of at least @nr_pages entries, where the pages are stored
+ *
+ * Same as calling kbase_mem_alloc_page() up to @nr_pages times, but small
+ * pages are taken from the memory group manager in one call, their metadata
+ * is taken from the slab in one call and they are DMA mapped in a single pass.
+ * The pages are allocated in batches, so callers loop until they have as
+ * many pages as they need. Large pages come one per call.
+ *
+ * Return: Number of pages allocated, which may be less than @nr_pages, or 0
+ *         if no memory
+ */
+size_t kbase_mem_alloc_pages_bulk(struct kbase_mem_pool *pool, size_t nr_pages,
+				  struct page **page_array);
+
 /**
  * kbase_mem_pool_free_page - Free a page from a memory pool.
  * @pool:  Memory pool to free a page from
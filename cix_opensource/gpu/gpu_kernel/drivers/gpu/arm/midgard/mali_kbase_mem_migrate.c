@@ -52,24 +52,9 @@ bool kbase_is_page_migration_enabled(void)
 }
 KBASE_EXPORT_TEST_API(kbase_is_page_migration_enabled);
 
-bool kbase_alloc_page_metadata(struct kbase_device *kbdev, struct page *p, dma_addr_t dma_addr,
-			       u8 group_id)
+void kbase_init_page_metadata(struct kbase_device *kbdev, struct page *p,
+			      struct kbase_page_metadata *page_md, dma_addr_t dma_addr, u8 group_id)
 {
-	struct kbase_page_metadata *page_md;
-
-	if (!kbase_is_page_migration_enabled())
-		return false;
-
-	/* Composite large-page is excluded from migration, trigger a warn if a development
-	 * wrongly leads to it.
-	 */
-	if (is_huge_head(as_tagged(page_to_phys(p))) || is_partial(as_tagged(page_to_phys(p))))
-		dev_WARN(kbdev->dev, "%s: migration-metadata attempted on large-page.", __func__);
-
-	page_md = kmem_cache_zalloc(kbdev->page_metadata_slab, GFP_KERNEL);
-	if (!page_md)
-		return false;
-
 	SetPagePrivate(p);
 	set_page_private(p, (unsigned long)page_md);
 	page_md->dma_addr = dma_addr;
@@ -106,10 +91,49 @@ bool kbase_alloc_page_metadata(struct kbase_device *kbdev, struct page *p, dma_a
 	}
 #endif
 	unlock_page(p);
+}
+
+bool kbase_alloc_page_metadata(struct kbase_device *kbdev, struct page *p, dma_addr_t dma_addr,
+			       u8 group_id)
+{
+	struct kbase_page_metadata *page_md;
+
+	if (!kbase_is_page_migration_enabled())
+		return false;
+
+	/* Composite large-page is excluded from migration, trigger a warn if a development
+	 * wrongly leads to it.
+	 */
+	if (is_huge_head(as_tagged(page_to_phys(p))) || is_partial(as_tagged(page_to_phys(p))))
+		dev_WARN(kbdev->dev, "%s: migration-metadata attempted on large-page.", __func__);
+
+	page_md = kmem_cache_zalloc(kbdev->page_metadata_slab, GFP_KERNEL);
+	if (!page_md)
+		return false;
+
+	kbase_init_page_metadata(kbdev, p, page_md, dma_addr, group_id);
 
 	return true;
 }
 
+bool kbase_alloc_page_metadata_bulk(struct kbase_device *kbdev, size_t nr_pages,
+				    struct kbase_page_metadata **page_mds)
+{
+	if (!kbase_is_page_migration_enabled())
+		return false;
+
+	/* The slab allocator hands out either all of the objects or none */
+	return kmem_cache_alloc_bulk(kbdev->page_metadata_slab, GFP_KERNEL | __GFP_ZERO, nr_pages,
+				     (void **)page_mds) == nr_pages;
+}
+
+void kbase_free_page_metadata_bulk(struct kbase_device *kbdev, size_t nr_pages,
+				   struct kbase_page_metadata **page_mds)
+{
+	if (nr_pages)
+		kmem_cache_free_bulk(kbdev->page_metadata_slab, nr_pages, (void **)page_mds);
+}
+
 static void kbase_free_page_metadata(struct kbase_device *kbdev, struct page *p, u8 *group_id)
 {
 	struct device *const dev = kbdev->dev;
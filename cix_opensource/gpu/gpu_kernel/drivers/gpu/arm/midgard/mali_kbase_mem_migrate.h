@@ -28,6 +28,7 @@
 struct kbase_device;
 struct file;
 struct page;
+struct kbase_page_metadata;
 
 /**
  * DOC: Base kernel page migration implementation.
@@ -68,6 +69,46 @@ struct page;
 bool kbase_alloc_page_metadata(struct kbase_device *kbdev, struct page *p, dma_addr_t dma_addr,
 			       u8 group_id);
 
+/**
+ * kbase_init_page_metadata - Initialize the metadata of a page
+ * @kbdev:    Pointer to kbase device.
+ * @p:        Page to assign metadata to.
+ * @page_md:  Zeroed metadata, e.g. from kbase_alloc_page_metadata_bulk().
+ * @dma_addr: DMA address mapped to page.
+ * @group_id: Memory group ID associated with the entity that is
+ *            allocating the page metadata.
+ *
+ * Same as kbase_alloc_page_metadata() with metadata that was already
+ * allocated, the page is marked as movable.
+ */
+void kbase_init_page_metadata(struct kbase_device *kbdev, struct page *p,
+			      struct kbase_page_metadata *page_md, dma_addr_t dma_addr, u8 group_id);
+
+/**
+ * kbase_alloc_page_metadata_bulk - Allocate the metadata of many pages
+ * @kbdev:    Pointer to kbase device.
+ * @nr_pages: Number of metadata objects to allocate.
+ * @page_mds: Array of @nr_pages entries where the zeroed metadata is stored.
+ *
+ * Takes all the objects from the metadata slab in one call, each one is
+ * then given to a page with kbase_init_page_metadata(). Objects left unused
+ * must be released with kbase_free_page_metadata_bulk().
+ *
+ * Return: true if all the metadata was allocated, false otherwise and
+ *         nothing is allocated.
+ */
+bool kbase_alloc_page_metadata_bulk(struct kbase_device *kbdev, size_t nr_pages,
+				    struct kbase_page_metadata **page_mds);
+
+/**
+ * kbase_free_page_metadata_bulk - Release metadata not assigned to a page
+ * @kbdev:    Pointer to kbase device.
+ * @nr_pages: Number of entries of @page_mds.
+ * @page_mds: Metadata from kbase_alloc_page_metadata_bulk().
+ */
+void kbase_free_page_metadata_bulk(struct kbase_device *kbdev, size_t nr_pages,
+				   struct kbase_page_metadata **page_mds);
+
 bool kbase_is_page_migration_enabled(void);
 
 /**
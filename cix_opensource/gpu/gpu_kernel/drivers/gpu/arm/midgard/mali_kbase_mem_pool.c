@@ -42,6 +42,13 @@
 #define NOT_DIRTY false
 #define NOT_RECLAIMED false
 
+/* Number of small pages zeroed by one run of the pool's zero worker */
+#define KBASE_MEM_POOL_ZERO_BATCH ((size_t)256)
+/* Delay before zeroing starts, so that back to back frees are batched */
+#define KBASE_MEM_POOL_ZERO_DELAY_MS (5)
+/* Maximum number of pages taken from the kernel by one bulk allocation */
+#define KBASE_MEM_POOL_BULK_BATCH ((size_t)64)
+
 /**
  * can_alloc_page() - Check if the current thread can allocate a physical page
  *
@@ -96,7 +103,8 @@ static bool kbase_mem_pool_is_empty(struct kbase_mem_pool *pool)
 }
 
 static bool set_pool_new_page_metadata(struct kbase_mem_pool *pool, struct page *p,
-				       struct list_head *page_list, size_t *list_size)
+				       struct list_head *page_list, size_t *list_size,
+				       enum kbase_page_status status)
 {
 	struct kbase_page_metadata *page_md = kbase_page_private(p);
 	bool not_movable = false;
@@ -114,7 +122,7 @@ static bool set_pool_new_page_metadata(struct kbase_mem_pool *pool, struct page
 		if (PAGE_STATUS_GET(page_md->status) == (u8)NOT_MOVABLE) {
 			not_movable = true;
 		} else if (!WARN_ON_ONCE(IS_PAGE_ISOLATED(page_md->status))) {
-			page_md->status = PAGE_STATUS_SET(page_md->status, (u8)MEM_POOL);
+			page_md->status = PAGE_STATUS_SET(page_md->status, (u8)status);
 			page_md->data.mem_pool.pool = pool;
 			page_md->data.mem_pool.kbdev = pool->kbdev;
 			list_add(&p->lru, page_list);
@@ -138,7 +146,8 @@ static void kbase_mem_pool_add_locked(struct kbase_mem_pool *pool, struct page *
 	lockdep_assert_held(&pool->pool_lock);
 
 	if (!pool->order && kbase_is_page_migration_enabled()) {
-		if (set_pool_new_page_metadata(pool, p, &pool->page_list, &pool->cur_size))
+		if (set_pool_new_page_metadata(pool, p, &pool->page_list, &pool->cur_size,
+					       MEM_POOL))
 			queue_work_to_free = true;
 	} else {
 		list_add(&p->lru, &pool->page_list);
@@ -173,7 +182,8 @@ static void kbase_mem_pool_add_list_locked(struct kbase_mem_pool *pool, struct l
 
 		list_for_each_entry_safe(p, tmp, page_list, lru) {
 			list_del_init(&p->lru);
-			if (set_pool_new_page_metadata(pool, p, &pool->page_list, &pool->cur_size))
+			if (set_pool_new_page_metadata(pool, p, &pool->page_list, &pool->cur_size,
+						       MEM_POOL))
 				queue_work_to_free = true;
 		}
 	} else {
@@ -198,71 +208,228 @@ static void kbase_mem_pool_add_list(struct kbase_mem_pool *pool, struct list_hea
 	kbase_mem_pool_unlock(pool);
 }
 
-static struct page *kbase_mem_pool_remove_locked(struct kbase_mem_pool *pool,
-						 enum kbase_page_status status)
+static void kbase_mem_pool_add_dirty_list_locked(struct kbase_mem_pool *pool,
+						 struct list_head *page_list, size_t nr_pages)
+{
+	bool queue_work_to_free = false;
+	size_t nr_added = 0;
+
+	lockdep_assert_held(&pool->pool_lock);
+
+	if (!pool->order && kbase_is_page_migration_enabled()) {
+		struct page *p, *tmp;
+
+		/* Dirty pages are kept out of reach of page isolation, which
+		 * only knows how to take a page off the clean list.
+		 */
+		list_for_each_entry_safe(p, tmp, page_list, lru) {
+			list_del_init(&p->lru);
+			if (set_pool_new_page_metadata(pool, p, &pool->dirty_list, &nr_added,
+						       SPILL_IN_PROGRESS))
+				queue_work_to_free = true;
+		}
+	} else {
+		list_splice(page_list, &pool->dirty_list);
+		nr_added = nr_pages;
+	}
+
+	pool->cur_size += nr_added;
+	pool->nr_dirty += nr_added;
+
+	if (queue_work_to_free) {
+		struct kbase_mem_migrate *mem_migrate = &pool->kbdev->mem_migrate;
+
+		queue_work(mem_migrate->free_pages_workq, &mem_migrate->free_pages_work);
+	}
+
+	if (pool->nr_dirty)
+		queue_delayed_work(pool->kbdev->mem_pool_zero_wq, &pool->zero_work,
+				   msecs_to_jiffies(KBASE_MEM_POOL_ZERO_DELAY_MS));
+
+	pool_dbg(pool, "added %zu dirty pages\n", nr_added);
+}
+
+static void kbase_mem_pool_add_dirty_list(struct kbase_mem_pool *pool,
+					  struct list_head *page_list, size_t nr_pages)
+{
+	kbase_mem_pool_lock(pool);
+	kbase_mem_pool_add_dirty_list_locked(pool, page_list, nr_pages);
+	kbase_mem_pool_unlock(pool);
+}
+
+static void kbase_mem_pool_sync_page(struct kbase_mem_pool *pool, struct page *p)
+{
+	struct device *dev = pool->kbdev->dev;
+	dma_addr_t dma_addr = pool->order ? kbase_dma_addr_as_priv(p) : kbase_dma_addr(p);
+
+	dma_sync_single_for_device(dev, dma_addr, (PAGE_SIZE << pool->order), DMA_BIDIRECTIONAL);
+}
+
+static void kbase_mem_pool_zero_page(struct kbase_mem_pool *pool, struct page *p)
+{
+	uint i;
+
+	for (i = 0; i < (1U << pool->order); i++)
+		clear_highpage(p + i);
+
+	kbase_mem_pool_sync_page(pool, p);
+}
+
+static struct page *kbase_mem_pool_take_locked(struct kbase_mem_pool *pool, bool dirty,
+					       enum kbase_page_status status)
 {
+	struct list_head *page_list = dirty ? &pool->dirty_list : &pool->page_list;
 	struct page *p;
 
 	lockdep_assert_held(&pool->pool_lock);
 
-	if (kbase_mem_pool_is_empty(pool))
+	if (list_empty(page_list))
 		return NULL;
 
-	p = list_first_entry(&pool->page_list, struct page, lru);
+	p = list_first_entry(page_list, struct page, lru);
 
 	if (!pool->order && kbase_is_page_migration_enabled()) {
 		struct kbase_page_metadata *page_md = kbase_page_private(p);
+		u8 const pool_status = dirty ? (u8)SPILL_IN_PROGRESS : (u8)MEM_POOL;
 
 		spin_lock(&page_md->migrate_lock);
-		WARN_ON(PAGE_STATUS_GET(page_md->status) != (u8)MEM_POOL);
+		WARN_ON(PAGE_STATUS_GET(page_md->status) != pool_status);
 		page_md->status = PAGE_STATUS_SET(page_md->status, (u8)status);
 		spin_unlock(&page_md->migrate_lock);
 	}
 
 	list_del_init(&p->lru);
 	pool->cur_size--;
+	if (dirty)
+		pool->nr_dirty--;
 
-	pool_dbg(pool, "removed page\n");
+	pool_dbg(pool, "removed %s page\n", dirty ? "dirty" : "clean");
 
 	return p;
 }
 
+/**
+ * kbase_mem_pool_remove_any_locked() - Remove a page that is going to be used
+ *
+ * @pool:   Pointer to the memory pool.
+ * @status: Page status to set when page migration is enabled.
+ * @dirty:  Set to true if the page was taken from the dirty list, in which
+ *          case the caller has to zero it before handing it out.
+ *
+ * Zeroed pages are preferred, a dirty page is only returned once the clean
+ * list has run dry.
+ *
+ * Return: The page, or NULL if the pool is empty.
+ */
+static struct page *kbase_mem_pool_remove_any_locked(struct kbase_mem_pool *pool,
+						     enum kbase_page_status status, bool *dirty)
+{
+	struct page *p;
+
+	*dirty = false;
+	p = kbase_mem_pool_take_locked(pool, false, status);
+	if (!p) {
+		p = kbase_mem_pool_take_locked(pool, true, status);
+		*dirty = (p != NULL);
+	}
+
+	return p;
+}
+
+/**
+ * kbase_mem_pool_evict_locked() - Remove a page that is leaving the pool
+ *                                 without being used
+ *
+ * @pool:   Pointer to the memory pool.
+ * @status: Page status to set when page migration is enabled.
+ *
+ * Dirty pages go first, there is no point zeroing them.
+ *
+ * Return: The page, or NULL if the pool is empty.
+ */
+static struct page *kbase_mem_pool_evict_locked(struct kbase_mem_pool *pool,
+						enum kbase_page_status status)
+{
+	struct page *p = kbase_mem_pool_take_locked(pool, true, status);
+
+	if (!p)
+		p = kbase_mem_pool_take_locked(pool, false, status);
+
+	return p;
+}
+
+static struct page *kbase_mem_pool_remove_locked(struct kbase_mem_pool *pool,
+						 enum kbase_page_status status)
+{
+	lockdep_assert_held(&pool->pool_lock);
+
+	/* Zeroing a page, let alone a large one, has no place under the pool
+	 * lock: leave the dirty pages to the zero worker, the caller grows the
+	 * pool and tries again.
+	 */
+	return kbase_mem_pool_take_locked(pool, false, status);
+}
+
 static struct page *kbase_mem_pool_remove(struct kbase_mem_pool *pool,
 					  enum kbase_page_status status)
 {
 	struct page *p;
+	bool dirty;
 
 	kbase_mem_pool_lock(pool);
-	p = kbase_mem_pool_remove_locked(pool, status);
+	p = kbase_mem_pool_remove_any_locked(pool, status, &dirty);
 	kbase_mem_pool_unlock(pool);
 
+	/* Zero page after dropping the lock, it is no longer in the pool */
+	if (dirty)
+		kbase_mem_pool_zero_page(pool, p);
+
 	return p;
 }
 
-static void kbase_mem_pool_sync_page(struct kbase_mem_pool *pool, struct page *p)
+static void kbase_mem_pool_zero_worker(struct work_struct *work)
 {
-	struct device *dev = pool->kbdev->dev;
-	dma_addr_t dma_addr = pool->order ? kbase_dma_addr_as_priv(p) : kbase_dma_addr(p);
+	struct kbase_mem_pool *pool = container_of(work, struct kbase_mem_pool, zero_work.work);
+	size_t const nr_batch = max_t(size_t, KBASE_MEM_POOL_ZERO_BATCH >> pool->order, 1);
+	size_t nr_zeroed = 0;
+	LIST_HEAD(zero_list);
+	struct page *p;
 
-	dma_sync_single_for_device(dev, dma_addr, (PAGE_SIZE << pool->order), DMA_BIDIRECTIONAL);
-}
+	/* Pages being zeroed keep their SPILL_IN_PROGRESS status but are not
+	 * counted in the pool, allocations meanwhile fall back to the kernel.
+	 */
+	kbase_mem_pool_lock(pool);
+	while (nr_zeroed < nr_batch && !list_empty(&pool->dirty_list)) {
+		p = list_first_entry(&pool->dirty_list, struct page, lru);
+		list_move(&p->lru, &zero_list);
+		pool->cur_size--;
+		pool->nr_dirty--;
+		nr_zeroed++;
+	}
+	kbase_mem_pool_unlock(pool);
 
-static void kbase_mem_pool_zero_page(struct kbase_mem_pool *pool, struct page *p)
-{
-	uint i;
+	list_for_each_entry(p, &zero_list, lru)
+		kbase_mem_pool_zero_page(pool, p);
 
-	for (i = 0; i < (1U << pool->order); i++)
-		clear_highpage(p + i);
+	kbase_mem_pool_lock(pool);
+	kbase_mem_pool_add_list_locked(pool, &zero_list, nr_zeroed);
+	/* Requeue rather than loop, so that other work on this CPU gets a
+	 * chance to run between batches.
+	 */
+	if (pool->nr_dirty)
+		queue_delayed_work(pool->kbdev->mem_pool_zero_wq, &pool->zero_work, 0);
+	kbase_mem_pool_unlock(pool);
 
-	kbase_mem_pool_sync_page(pool, p);
+	pool_dbg(pool, "zeroed %zu pages\n", nr_zeroed);
 }
 
 static void kbase_mem_pool_spill(struct kbase_mem_pool *next_pool, struct page *p)
 {
-	/* Zero page before spilling */
-	kbase_mem_pool_zero_page(next_pool, p);
+	LIST_HEAD(spill_list);
 
-	kbase_mem_pool_add(next_pool, p);
+	/* Leave zeroing of the page to the worker of next_pool */
+	list_add(&p->lru, &spill_list);
+	kbase_mem_pool_add_dirty_list(next_pool, &spill_list, 1);
 }
 
 struct page *kbase_mem_alloc_page(struct kbase_mem_pool *pool)
@@ -308,6 +475,84 @@ struct page *kbase_mem_alloc_page(struct kbase_mem_pool *pool)
 
 	return p;
 }
+KBASE_EXPORT_TEST_API(kbase_mem_alloc_page);
+
+size_t kbase_mem_alloc_pages_bulk(struct kbase_mem_pool *pool, size_t nr_pages,
+				  struct page **page_array)
+{
+	struct kbase_page_metadata *page_mds[KBASE_MEM_POOL_BULK_BATCH];
+	struct kbase_device *const kbdev = pool->kbdev;
+	struct memory_group_manager_device *const mgm_dev = kbdev->mgm_dev;
+	struct device *const dev = kbdev->dev;
+	bool const migrate = kbase_is_page_migration_enabled();
+	size_t nr_allocated = 0;
+	size_t nr_mapped = 0;
+	size_t i;
+	gfp_t gfp;
+
+	nr_pages = min(nr_pages, KBASE_MEM_POOL_BULK_BATCH);
+
+	/* The kernel only allocates small pages in bulk. Large pages are
+	 * returned one at a time, so the callers check can_alloc_page() before
+	 * each of them as they used to, rather than once per 64 large pages.
+	 */
+	if (pool->order) {
+		page_array[0] = kbase_mem_alloc_page(pool);
+		return page_array[0] ? 1 : 0;
+	}
+
+	gfp = __GFP_ZERO | (migrate ? GFP_HIGHUSER_MOVABLE : GFP_HIGHUSER);
+
+	memset(page_array, 0, nr_pages * sizeof(*page_array));
+	if (mgm_dev->ops.mgm_alloc_pages_bulk) {
+		nr_allocated = mgm_dev->ops.mgm_alloc_pages_bulk(mgm_dev, pool->group_id, gfp,
+								 nr_pages, page_array);
+	} else {
+		for (; nr_allocated < nr_pages; nr_allocated++) {
+			page_array[nr_allocated] =
+				mgm_dev->ops.mgm_alloc_page(mgm_dev, pool->group_id, gfp, 0);
+			if (!page_array[nr_allocated])
+				break;
+		}
+	}
+
+	if (!nr_allocated)
+		return 0;
+
+	/* Setup page metadata for small pages when page migration is enabled */
+	if (migrate && !kbase_alloc_page_metadata_bulk(kbdev, nr_allocated, page_mds))
+		goto free_pages;
+
+	for (; nr_mapped < nr_allocated; nr_mapped++) {
+		struct page *const p = page_array[nr_mapped];
+		dma_addr_t dma_addr = dma_map_page(dev, p, 0, PAGE_SIZE, DMA_BIDIRECTIONAL);
+
+		if (dma_mapping_error(dev, dma_addr))
+			break;
+
+		if (migrate) {
+			INIT_LIST_HEAD(&p->lru);
+			kbase_init_page_metadata(kbdev, p, page_mds[nr_mapped], dma_addr,
+						 pool->group_id);
+		} else {
+			WARN_ON(dma_addr != page_to_phys(p));
+			kbase_set_dma_addr_as_priv(p, dma_addr);
+		}
+	}
+
+	if (migrate)
+		kbase_free_page_metadata_bulk(kbdev, nr_allocated - nr_mapped,
+					      page_mds + nr_mapped);
+
+free_pages:
+	for (i = nr_mapped; i < nr_allocated; i++) {
+		mgm_dev->ops.mgm_free_page(mgm_dev, pool->group_id, page_array[i], 0);
+		page_array[i] = NULL;
+	}
+
+	return nr_mapped;
+}
+KBASE_EXPORT_TEST_API(kbase_mem_alloc_pages_bulk);
 
 static void enqueue_free_pool_pages_work(struct kbase_mem_pool *pool)
 {
@@ -354,7 +599,9 @@ static size_t kbase_mem_pool_shrink_locked(struct kbase_mem_pool *pool, size_t n
 	lockdep_assert_held(&pool->pool_lock);
 
 	for (i = 0; i < nr_to_shrink && !kbase_mem_pool_is_empty(pool); i++) {
-		p = kbase_mem_pool_remove_locked(pool, FREE_IN_PROGRESS);
+		p = kbase_mem_pool_evict_locked(pool, FREE_IN_PROGRESS);
+		if (WARN_ON(!p))
+			break;
 		kbase_mem_pool_free_page(pool, p);
 	}
 
@@ -378,13 +625,16 @@ static size_t kbase_mem_pool_shrink(struct kbase_mem_pool *pool, size_t nr_to_sh
 int kbase_mem_pool_grow(struct kbase_mem_pool *pool, size_t nr_to_grow,
 			struct task_struct *page_owner)
 {
-	struct page *p;
-	size_t i;
+	struct page *page_array[KBASE_MEM_POOL_BULK_BATCH];
+	size_t nr_new;
+	size_t i, j;
 
 	kbase_mem_pool_lock(pool);
 
 	pool->dont_reclaim = true;
-	for (i = 0; i < nr_to_grow; i++) {
+	for (i = 0; i < nr_to_grow; i += nr_new) {
+		LIST_HEAD(new_page_list);
+
 		if (pool->dying) {
 			pool->dont_reclaim = false;
 			kbase_mem_pool_shrink_locked(pool, nr_to_grow);
@@ -400,8 +650,8 @@ int kbase_mem_pool_grow(struct kbase_mem_pool *pool, size_t nr_to_grow,
 		if (unlikely(!can_alloc_page(pool, page_owner)))
 			return -EPERM;
 
-		p = kbase_mem_alloc_page(pool);
-		if (!p) {
+		nr_new = kbase_mem_alloc_pages_bulk(pool, nr_to_grow - i, page_array);
+		if (!nr_new) {
 			kbase_mem_pool_lock(pool);
 			pool->dont_reclaim = false;
 			kbase_mem_pool_unlock(pool);
@@ -409,8 +659,11 @@ int kbase_mem_pool_grow(struct kbase_mem_pool *pool, size_t nr_to_grow,
 			return -ENOMEM;
 		}
 
+		for (j = 0; j < nr_new; j++)
+			list_add(&page_array[j]->lru, &new_page_list);
+
 		kbase_mem_pool_lock(pool);
-		kbase_mem_pool_add_locked(pool, p);
+		kbase_mem_pool_add_list_locked(pool, &new_page_list, nr_new);
 	}
 	pool->dont_reclaim = false;
 	kbase_mem_pool_unlock(pool);
@@ -536,6 +789,9 @@ int kbase_mem_pool_init(struct kbase_mem_pool *pool, const struct kbase_mem_pool
 
 	spin_lock_init(&pool->pool_lock);
 	INIT_LIST_HEAD(&pool->page_list);
+	INIT_LIST_HEAD(&pool->dirty_list);
+	pool->nr_dirty = 0;
+	INIT_DELAYED_WORK(&pool->zero_work, kbase_mem_pool_zero_worker);
 
 	reclaim = KBASE_INIT_RECLAIM(pool, reclaim, "mali-mem-pool");
 	if (!reclaim)
@@ -575,6 +831,9 @@ void kbase_mem_pool_term(struct kbase_mem_pool *pool)
 
 	KBASE_UNREGISTER_SHRINKER(pool->reclaim);
 
+	/* Dirty pages still in the pool are freed or spilled as they are */
+	cancel_delayed_work_sync(&pool->zero_work);
+
 	kbase_mem_pool_lock(pool);
 	pool->max_size = 0;
 
@@ -583,9 +842,9 @@ void kbase_mem_pool_term(struct kbase_mem_pool *pool)
 		nr_to_spill = kbase_mem_pool_capacity(next_pool);
 		nr_to_spill = min(kbase_mem_pool_size(pool), nr_to_spill);
 
-		/* Zero pages first without holding the next_pool lock */
+		/* Take the pages first without holding the next_pool lock */
 		for (i = 0; i < nr_to_spill; i++) {
-			p = kbase_mem_pool_remove_locked(pool, SPILL_IN_PROGRESS);
+			p = kbase_mem_pool_evict_locked(pool, SPILL_IN_PROGRESS);
 			if (p)
 				list_add(&p->lru, &spill_list);
 		}
@@ -593,19 +852,17 @@ void kbase_mem_pool_term(struct kbase_mem_pool *pool)
 
 	while (!kbase_mem_pool_is_empty(pool)) {
 		/* Free remaining pages to kernel */
-		p = kbase_mem_pool_remove_locked(pool, FREE_IN_PROGRESS);
-		if (p)
-			list_add(&p->lru, &free_list);
+		p = kbase_mem_pool_evict_locked(pool, FREE_IN_PROGRESS);
+		if (!p)
+			break;
+		list_add(&p->lru, &free_list);
 	}
 
 	kbase_mem_pool_unlock(pool);
 
 	if (next_pool && nr_to_spill) {
-		list_for_each_entry(p, &spill_list, lru)
-			kbase_mem_pool_zero_page(pool, p);
-
-		/* Add new page list to next_pool */
-		kbase_mem_pool_add_list(next_pool, &spill_list, nr_to_spill);
+		/* Add new page list to next_pool, its worker zeroes them */
+		kbase_mem_pool_add_dirty_list(next_pool, &spill_list, nr_to_spill);
 
 		pool_dbg(pool, "terminate() spilled %zu pages\n", nr_to_spill);
 	}
@@ -701,11 +958,12 @@ int kbase_mem_pool_alloc_pages(struct kbase_mem_pool *pool, size_t nr_small_page
 			       struct tagged_addr *pages, bool partial_allowed,
 			       struct task_struct *page_owner)
 {
-	struct page *p;
+	struct page *p, *tmp;
 	size_t nr_from_pool;
 	size_t i = 0;
 	int err = -ENOMEM;
 	size_t nr_pages_internal;
+	LIST_HEAD(dirty_list);
 
 	nr_pages_internal = nr_small_pages / (1u << (pool->order));
 
@@ -721,8 +979,11 @@ int kbase_mem_pool_alloc_pages(struct kbase_mem_pool *pool, size_t nr_small_page
 
 	while (nr_from_pool--) {
 		uint j;
+		bool dirty;
 
-		p = kbase_mem_pool_remove_locked(pool, ALLOCATE_IN_PROGRESS);
+		p = kbase_mem_pool_remove_any_locked(pool, ALLOCATE_IN_PROGRESS, &dirty);
+		if (dirty)
+			list_add(&p->lru, &dirty_list);
 
 		if (pool->order) {
 			pages[i++] = as_tagged_tag(page_to_phys(p), HUGE_HEAD | HUGE_PAGE);
@@ -735,6 +996,12 @@ int kbase_mem_pool_alloc_pages(struct kbase_mem_pool *pool, size_t nr_small_page
 	}
 	kbase_mem_pool_unlock(pool);
 
+	/* The clean list ran dry, zero the rest without holding the pool lock */
+	list_for_each_entry_safe(p, tmp, &dirty_list, lru) {
+		list_del_init(&p->lru);
+		kbase_mem_pool_zero_page(pool, p);
+	}
+
 	if (i != nr_small_pages && pool->next_pool) {
 		/* Allocate via next pool */
 		err = kbase_mem_pool_alloc_pages(pool->next_pool, nr_small_pages - i, pages + i,
@@ -745,31 +1012,41 @@ int kbase_mem_pool_alloc_pages(struct kbase_mem_pool *pool, size_t nr_small_page
 
 		i += (size_t)err;
 	} else {
+		struct page *page_array[KBASE_MEM_POOL_BULK_BATCH];
+
 		/* Get any remaining pages from kernel */
 		while (i != nr_small_pages) {
+			size_t nr_new, k;
+
 			if (unlikely(!can_alloc_page(pool, page_owner)))
 				goto err_rollback;
 
-			p = kbase_mem_alloc_page(pool);
-			if (!p) {
+			nr_new = kbase_mem_alloc_pages_bulk(pool, (nr_small_pages - i) >> pool->order,
+							    page_array);
+			if (!nr_new) {
 				if (partial_allowed)
 					goto done;
 				else
 					goto err_rollback;
 			}
 
-			if (pool->order) {
-				uint j;
+			for (k = 0; k < nr_new; k++) {
+				p = page_array[k];
 
-				pages[i++] = as_tagged_tag(page_to_phys(p), HUGE_PAGE | HUGE_HEAD);
-				for (j = 1; j < (1u << pool->order); j++) {
-					phys_addr_t phys;
+				if (pool->order) {
+					uint j;
 
-					phys = page_to_phys(p) + PAGE_SIZE * j;
-					pages[i++] = as_tagged_tag(phys, HUGE_PAGE);
+					pages[i++] = as_tagged_tag(page_to_phys(p),
+								   HUGE_PAGE | HUGE_HEAD);
+					for (j = 1; j < (1u << pool->order); j++) {
+						phys_addr_t phys;
+
+						phys = page_to_phys(p) + PAGE_SIZE * j;
+						pages[i++] = as_tagged_tag(phys, HUGE_PAGE);
+					}
+				} else {
+					pages[i++] = as_tagged(page_to_phys(p));
 				}
-			} else {
-				pages[i++] = as_tagged(page_to_phys(p));
 			}
 		}
 	}
@@ -782,6 +1059,7 @@ err_rollback:
 	kbase_mem_pool_free_pages(pool, i, pages, NOT_DIRTY, NOT_RECLAIMED);
 	return err;
 }
+KBASE_EXPORT_TEST_API(kbase_mem_pool_alloc_pages);
 
 int kbase_mem_pool_alloc_pages_locked(struct kbase_mem_pool *pool, size_t nr_small_pages,
 				      struct tagged_addr *pages)
@@ -800,7 +1078,7 @@ int kbase_mem_pool_alloc_pages_locked(struct kbase_mem_pool *pool, size_t nr_sma
 	pool_dbg(pool, "alloc_pages_locked(small=%zu):\n", nr_small_pages);
 	pool_dbg(pool, "alloc_pages_locked(internal=%zu):\n", nr_pages_internal);
 
-	if (kbase_mem_pool_size(pool) < nr_pages_internal) {
+	if (kbase_mem_pool_clean_size(pool) < nr_pages_internal) {
 		pool_dbg(pool, "Failed alloc\n");
 		return -ENOMEM;
 	}
@@ -836,16 +1114,16 @@ static void kbase_mem_pool_add_array(struct kbase_mem_pool *pool, size_t nr_page
 
 	pool_dbg(pool, "add_array(%zu, zero=%d, sync=%d):\n", nr_pages, zero, sync);
 
-	/* Zero/sync pages first without holding the pool lock */
+	/* Sync pages first without holding the pool lock, pages to be zeroed
+	 * are synced by the zero worker once it is done with them.
+	 */
 	for (i = 0; i < nr_pages; i++) {
 		if (unlikely(!is_valid_addr(pages[i])))
 			continue;
 
 		if (is_huge_head(pages[i]) || !is_huge(pages[i])) {
 			p = as_page(pages[i]);
-			if (zero)
-				kbase_mem_pool_zero_page(pool, p);
-			else if (sync)
+			if (!zero && sync)
 				kbase_mem_pool_sync_page(pool, p);
 
 			list_add(&p->lru, &new_page_list);
@@ -855,7 +1133,10 @@ static void kbase_mem_pool_add_array(struct kbase_mem_pool *pool, size_t nr_page
 	}
 
 	/* Add new page list to pool */
-	kbase_mem_pool_add_list(pool, &new_page_list, nr_to_pool);
+	if (zero)
+		kbase_mem_pool_add_dirty_list(pool, &new_page_list, nr_to_pool);
+	else
+		kbase_mem_pool_add_list(pool, &new_page_list, nr_to_pool);
 
 	pool_dbg(pool, "add_array(%zu) added %zu pages\n", nr_pages, nr_to_pool);
 }
@@ -875,16 +1156,14 @@ static void kbase_mem_pool_add_array_locked(struct kbase_mem_pool *pool, size_t
 
 	pool_dbg(pool, "add_array_locked(%zu, zero=%d, sync=%d):\n", nr_pages, zero, sync);
 
-	/* Zero/sync pages first */
+	/* Sync pages first, pages to be zeroed are left to the zero worker */
 	for (i = 0; i < nr_pages; i++) {
 		if (unlikely(!is_valid_addr(pages[i])))
 			continue;
 
 		if (is_huge_head(pages[i]) || !is_huge(pages[i])) {
 			p = as_page(pages[i]);
-			if (zero)
-				kbase_mem_pool_zero_page(pool, p);
-			else if (sync)
+			if (!zero && sync)
 				kbase_mem_pool_sync_page(pool, p);
 
 			list_add(&p->lru, &new_page_list);
@@ -894,7 +1173,10 @@ static void kbase_mem_pool_add_array_locked(struct kbase_mem_pool *pool, size_t
 	}
 
 	/* Add new page list to pool */
-	kbase_mem_pool_add_list_locked(pool, &new_page_list, nr_to_pool);
+	if (zero)
+		kbase_mem_pool_add_dirty_list_locked(pool, &new_page_list, nr_to_pool);
+	else
+		kbase_mem_pool_add_list_locked(pool, &new_page_list, nr_to_pool);
 
 	pool_dbg(pool, "add_array_locked(%zu) added %zu pages\n", nr_pages, nr_to_pool);
 }
@@ -952,6 +1234,7 @@ void kbase_mem_pool_free_pages(struct kbase_mem_pool *pool, size_t nr_pages,
 
 	pool_dbg(pool, "free_pages(%zu) done\n", nr_pages);
 }
+KBASE_EXPORT_TEST_API(kbase_mem_pool_free_pages);
 
 void kbase_mem_pool_free_pages_locked(struct kbase_mem_pool *pool, size_t nr_pages,
 				      struct tagged_addr *pages, bool dirty, bool reclaimed)
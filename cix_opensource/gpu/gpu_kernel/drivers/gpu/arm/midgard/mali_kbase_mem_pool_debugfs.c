@@ -65,6 +65,32 @@ size_t kbase_mem_pool_debugfs_max_size(void *const array, size_t const index)
 	return kbase_mem_pool_max_size(&mem_pools[index]);
 }
 
+size_t kbase_mem_pool_debugfs_clean_size(void *const array, size_t const index)
+{
+	struct kbase_mem_pool *const mem_pools = array;
+	size_t size, dirty;
+
+	if (WARN_ON(!mem_pools) || WARN_ON(index >= MEMORY_GROUP_MANAGER_NR_GROUPS))
+		return 0;
+
+	kbase_mem_pool_lock(&mem_pools[index]);
+	size = kbase_mem_pool_size(&mem_pools[index]);
+	dirty = kbase_mem_pool_dirty_size(&mem_pools[index]);
+	kbase_mem_pool_unlock(&mem_pools[index]);
+
+	return size - dirty;
+}
+
+size_t kbase_mem_pool_debugfs_dirty_size(void *const array, size_t const index)
+{
+	struct kbase_mem_pool *const mem_pools = array;
+
+	if (WARN_ON(!mem_pools) || WARN_ON(index >= MEMORY_GROUP_MANAGER_NR_GROUPS))
+		return 0;
+
+	return kbase_mem_pool_dirty_size(&mem_pools[index]);
+}
+
 void kbase_mem_pool_config_debugfs_set_max_size(void *const array, size_t const index,
 						size_t const value)
 {
@@ -150,6 +176,64 @@ static const struct file_operations kbase_mem_pool_debugfs_max_size_fops = {
 	.release = single_release,
 };
 
+static int kbase_mem_pool_debugfs_clean_size_show(struct seq_file *sfile, void *data)
+{
+	CSTD_UNUSED(data);
+	return kbase_debugfs_helper_seq_read(sfile, MEMORY_GROUP_MANAGER_NR_GROUPS,
+					     kbase_mem_pool_debugfs_clean_size);
+}
+
+static int kbase_mem_pool_debugfs_clean_size_open(struct inode *in, struct file *file)
+{
+	return single_open(file, kbase_mem_pool_debugfs_clean_size_show, in->i_private);
+}
+
+static const struct file_operations kbase_mem_pool_debugfs_clean_size_fops = {
+	.owner = THIS_MODULE,
+	.open = kbase_mem_pool_debugfs_clean_size_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int kbase_mem_pool_debugfs_dirty_size_show(struct seq_file *sfile, void *data)
+{
+	CSTD_UNUSED(data);
+	return kbase_debugfs_helper_seq_read(sfile, MEMORY_GROUP_MANAGER_NR_GROUPS,
+					     kbase_mem_pool_debugfs_dirty_size);
+}
+
+static int kbase_mem_pool_debugfs_dirty_size_open(struct inode *in, struct file *file)
+{
+	return single_open(file, kbase_mem_pool_debugfs_dirty_size_show, in->i_private);
+}
+
+static const struct file_operations kbase_mem_pool_debugfs_dirty_size_fops = {
+	.owner = THIS_MODULE,
+	.open = kbase_mem_pool_debugfs_dirty_size_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+void kbase_mem_pool_debugfs_dirty_init(struct dentry *parent,
+				       struct kbase_mem_pool_group *mem_pools)
+{
+	const mode_t mode = 0444;
+
+	debugfs_create_file("mem_pool_clean_size", mode, parent, &mem_pools->small,
+			    &kbase_mem_pool_debugfs_clean_size_fops);
+
+	debugfs_create_file("mem_pool_dirty_size", mode, parent, &mem_pools->small,
+			    &kbase_mem_pool_debugfs_dirty_size_fops);
+
+	debugfs_create_file("lp_mem_pool_clean_size", mode, parent, &mem_pools->large,
+			    &kbase_mem_pool_debugfs_clean_size_fops);
+
+	debugfs_create_file("lp_mem_pool_dirty_size", mode, parent, &mem_pools->large,
+			    &kbase_mem_pool_debugfs_dirty_size_fops);
+}
+
 void kbase_mem_pool_debugfs_init(struct dentry *parent, struct kbase_context *kctx)
 {
 	const mode_t mode = 0644;
@@ -165,4 +249,6 @@ void kbase_mem_pool_debugfs_init(struct dentry *parent, struct kbase_context *kc
 
 	debugfs_create_file("lp_mem_pool_max_size", mode, parent, &kctx->mem_pools.large,
 			    &kbase_mem_pool_debugfs_max_size_fops);
+
+	kbase_mem_pool_debugfs_dirty_init(parent, &kctx->mem_pools);
 }
@@ -34,9 +34,27 @@
  * - mem_pool_max_size: get/set the max sizes of @kctx: mem_pools
  * - lp_mem_pool_size: get/set the current sizes of @kctx: lp_mem_pool
  * - lp_mem_pool_max_size: get/set the max sizes of @kctx:lp_mem_pool
+ *
+ * plus the ones added by kbase_mem_pool_debugfs_dirty_init().
  */
 void kbase_mem_pool_debugfs_init(struct dentry *parent, struct kbase_context *kctx);
 
+/**
+ * kbase_mem_pool_debugfs_dirty_init - add debugfs files showing how many
+ *                                     pages of @mem_pools are zeroed
+ * @parent:    Parent debugfs dentry
+ * @mem_pools: The set of memory pools
+ *
+ * Adds four read-only debugfs files under @parent:
+ * - mem_pool_clean_size: number of zeroed pages in the small page pools
+ * - mem_pool_dirty_size: number of pages waiting to be zeroed in the small
+ *                        page pools
+ * - lp_mem_pool_clean_size: same as mem_pool_clean_size for 2 MiB pages
+ * - lp_mem_pool_dirty_size: same as mem_pool_dirty_size for 2 MiB pages
+ */
+void kbase_mem_pool_debugfs_dirty_init(struct dentry *parent,
+				       struct kbase_mem_pool_group *mem_pools);
+
 /**
  * kbase_mem_pool_debugfs_trim - Grow or shrink a memory pool to a new size
  *
@@ -90,6 +108,30 @@ size_t kbase_mem_pool_debugfs_size(void *array, size_t index);
  */
 size_t kbase_mem_pool_debugfs_max_size(void *array, size_t index);
 
+/**
+ * kbase_mem_pool_debugfs_clean_size - Get number of zeroed free pages in a
+ *                                     memory pool
+ *
+ * @array: Address of the first in an array of physical memory pools.
+ * @index: A memory group ID to be used as an index into the array of memory
+ *         pools. Valid range is 0..(MEMORY_GROUP_MANAGER_NR_GROUPS-1).
+ *
+ * Return: Number of free pages in the pool that can be handed out as they are
+ */
+size_t kbase_mem_pool_debugfs_clean_size(void *array, size_t index);
+
+/**
+ * kbase_mem_pool_debugfs_dirty_size - Get number of free pages in a memory
+ *                                     pool still waiting to be zeroed
+ *
+ * @array: Address of the first in an array of physical memory pools.
+ * @index: A memory group ID to be used as an index into the array of memory
+ *         pools. Valid range is 0..(MEMORY_GROUP_MANAGER_NR_GROUPS-1).
+ *
+ * Return: Number of dirty pages in the pool
+ */
+size_t kbase_mem_pool_debugfs_dirty_size(void *array, size_t index);
+
 /**
  * kbase_mem_pool_config_debugfs_set_max_size - Set maximum number of free pages
  *                                              in initial configuration of pool
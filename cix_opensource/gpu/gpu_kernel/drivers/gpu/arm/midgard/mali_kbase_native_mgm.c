@@ -69,6 +69,32 @@ static struct page *kbase_native_mgm_alloc(struct memory_group_manager_device *m
 	return alloc_pages(gfp_mask, order);
 }
 
+/**
+ * kbase_native_mgm_alloc_bulk - Native method to allocate many small pages
+ *
+ * @mgm_dev:    The memory group manager the request is being made through.
+ * @group_id:   A physical memory group ID, which must be valid but is not used.
+ *              Its valid range is 0 .. MEMORY_GROUP_MANAGER_NR_GROUPS-1.
+ * @gfp_mask:   Bitmask of Get Free Page flags affecting allocator behavior.
+ * @nr_pages:   Number of small pages to allocate.
+ * @page_array: Array of @nr_pages entries, all NULL on entry.
+ *
+ * Delegates the request to the kernel's bulk page allocator, which takes
+ * the pages from the per-CPU lists under a single lock.
+ *
+ * Return: Number of pages allocated, stored in the first entries of
+ *         @page_array.
+ */
+static unsigned long kbase_native_mgm_alloc_bulk(struct memory_group_manager_device *mgm_dev,
+						 unsigned int group_id, gfp_t gfp_mask,
+						 unsigned long nr_pages, struct page **page_array)
+{
+	CSTD_UNUSED(mgm_dev);
+	CSTD_UNUSED(group_id);
+
+	return kbase_alloc_pages_bulk(gfp_mask, nr_pages, page_array);
+}
+
 /**
  * kbase_native_mgm_free - Native physical memory freeing method
  *
@@ -166,6 +192,7 @@ static bool kbase_native_mgm_get_import_memory_cached_access_permitted(
 
 struct memory_group_manager_device kbase_native_mgm_dev = {
 	.ops = { .mgm_alloc_page = kbase_native_mgm_alloc,
+		 .mgm_alloc_pages_bulk = kbase_native_mgm_alloc_bulk,
 		 .mgm_free_page = kbase_native_mgm_free,
 		 .mgm_get_import_memory_id = NULL,
 		 .mgm_vmf_insert_pfn_prot = kbase_native_mgm_vmf_insert_pfn_prot,
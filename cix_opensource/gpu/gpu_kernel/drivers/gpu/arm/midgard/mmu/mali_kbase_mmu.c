@@ -875,7 +875,7 @@ static size_t estimate_pool_space_required(struct kbase_mem_pool *pool, const si
 
 		kbase_mem_pool_lock(pool);
 
-		pool_size_small = kbase_mem_pool_size(pool) << pool->order;
+		pool_size_small = kbase_mem_pool_clean_size(pool) << pool->order;
 		if (pool_size_small >= pages_still_required)
 			pages_still_required = 0;
 		else
@@ -969,7 +969,7 @@ static bool page_fault_try_alloc(struct kbase_context *kctx, struct kbase_va_reg
 		kbase_mem_pool_lock(pool);
 
 		/* Allocate as much as possible from this pool*/
-		pool_size_small = kbase_mem_pool_size(pool) << pool->order;
+		pool_size_small = kbase_mem_pool_clean_size(pool) << pool->order;
 		total_mempools_free_small += pool_size_small;
 		pages_to_alloc_small = MIN(pages_still_required, pool_size_small);
 		if (region->gpu_alloc == region->cpu_alloc)
@@ -0,0 +1,486 @@
+// SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note
+/*
+ *
+ * (C) COPYRIGHT 2024 ARM Limited. All rights reserved.
+ *
+ * This program is free software and is provided to you under the terms of the
+ * GNU General Public License version 2 as published by the Free Software
+ * Foundation, and any use by you of this program is subject to the terms
+ * of such GNU license.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, you can access it online at
+ * http://www.gnu.org/licenses/gpl-2.0.html.
+ *
+ */
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/string.h>
+#include <linux/version_compat_defs.h>
+#include "mali_kbase.h"
+#include <kutf/kutf_suite.h>
+#include <kutf/kutf_utils.h>
+
+#define MINOR_FOR_FIRST_KBASE_DEV (-1)
+
+#define MEM_POOL_SUITE_NAME "mem_pool"
+#define MEM_POOL_REALLOC_INLINE "realloc_zeroed_inline"
+#define MEM_POOL_REALLOC_BACKGROUND "realloc_zeroed_background"
+
+#define MEM_POOL_BENCH_SUITE_NAME "alloc_bench"
+#define MEM_POOL_BENCH_PER_PAGE "per_page"
+#define MEM_POOL_BENCH_BULK "bulk"
+
+/* Size of the buffer freed and reallocated by the tests */
+#define MEM_POOL_TEST_NR_PAGES ((size_t)(SZ_32M >> PAGE_SHIFT))
+#define MEM_POOL_TEST_PATTERN 0xa5
+
+/* Number of pages allocated from an empty pool by the benchmarks */
+#define MEM_POOL_BENCH_NR_PAGES ((size_t)SZ_64K)
+
+static char msg_buf[KUTF_MAX_LINE_LENGTH];
+
+/* KUTF test application pointer for this test */
+static struct kutf_application *mem_pool_app;
+
+/**
+ * struct kutf_mem_pool_fixture_data - test fixture used by test functions
+ * @kbdev:         kbase device for the GPU.
+ * @dev_pool:      Device pool of small pages for group 0, where the pages
+ *                 freed by the tests are spilled to.
+ * @dev_max_size:  Maximum size of @dev_pool before the test raised it.
+ * @pool:          Pool standing in for the pool of a context. Its maximum size
+ *                 is 0 so every page freed to it spills to @dev_pool.
+ * @pages:         Array of MEM_POOL_TEST_NR_PAGES pages used by the tests.
+ */
+struct kutf_mem_pool_fixture_data {
+	struct kbase_device *kbdev;
+	struct kbase_mem_pool *dev_pool;
+	size_t dev_max_size;
+	struct kbase_mem_pool pool;
+	struct tagged_addr *pages;
+};
+
+/**
+ * mem_pool_test_fill() - Write a pattern to all the test pages
+ * @data: Fixture data.
+ */
+static void mem_pool_test_fill(struct kutf_mem_pool_fixture_data *data)
+{
+	size_t i;
+
+	for (i = 0; i < MEM_POOL_TEST_NR_PAGES; i++) {
+		struct page *p = as_page(data->pages[i]);
+		void *addr = kbase_kmap(p);
+
+		memset(addr, MEM_POOL_TEST_PATTERN, PAGE_SIZE);
+		kbase_kunmap(p, addr);
+	}
+}
+
+/**
+ * mem_pool_test_count_dirty() - Count the test pages that are not all zero
+ * @data: Fixture data.
+ *
+ * Return: Number of pages with at least one non zero byte.
+ */
+static size_t mem_pool_test_count_dirty(struct kutf_mem_pool_fixture_data *data)
+{
+	size_t nr_dirty = 0;
+	size_t i;
+
+	for (i = 0; i < MEM_POOL_TEST_NR_PAGES; i++) {
+		struct page *p = as_page(data->pages[i]);
+		void *addr = kbase_kmap(p);
+
+		if (memchr_inv(addr, 0, PAGE_SIZE))
+			nr_dirty++;
+		kbase_kunmap(p, addr);
+	}
+
+	return nr_dirty;
+}
+
+/**
+ * mem_pool_test_realloc() - Free a dirty buffer and allocate it again
+ * @context:        KUTF context within which to perform the test.
+ * @wait_for_zero:  If true wait for the device pool to zero all its dirty
+ *                  pages before allocating again, otherwise allocate right
+ *                  away so that pages still dirty are zeroed inline.
+ *
+ * The buffer is allocated through the stand-in context pool, filled with a
+ * pattern and freed so that it spills to the device pool. Every page of the
+ * buffer allocated again must be zero, whichever way it was zeroed.
+ *
+ * Allocations prefer zeroed pages, so when @wait_for_zero is false the device
+ * pool is emptied first and its zero worker held off until the reallocation:
+ * the pool then only holds the dirty pages of the buffer and the reallocation
+ * has to zero them inline.
+ */
+static void mem_pool_test_realloc(struct kutf_context *context, bool wait_for_zero)
+{
+	struct kutf_mem_pool_fixture_data *data = context->fixture;
+	size_t max_size = kbase_mem_pool_max_size(data->dev_pool);
+	size_t nr_spilled_dirty;
+	size_t nr_dirty;
+	int err;
+
+	if (!wait_for_zero) {
+		/* Give the clean pages of the device pool back to the kernel */
+		kbase_mem_pool_set_max_size(data->dev_pool, 0);
+		kbase_mem_pool_set_max_size(data->dev_pool, max_size);
+	}
+
+	err = kbase_mem_pool_alloc_pages(&data->pool, MEM_POOL_TEST_NR_PAGES, data->pages, false,
+					 NULL);
+	if (err != (int)MEM_POOL_TEST_NR_PAGES) {
+		kutf_test_fail(context, "Failed to allocate the test buffer");
+		return;
+	}
+
+	mem_pool_test_fill(data);
+	kbase_mem_pool_free_pages(&data->pool, MEM_POOL_TEST_NR_PAGES, data->pages, true, false);
+	if (!wait_for_zero)
+		cancel_delayed_work_sync(&data->dev_pool->zero_work);
+	nr_spilled_dirty = kbase_mem_pool_dirty_size(data->dev_pool);
+
+	if (wait_for_zero) {
+		while (kbase_mem_pool_dirty_size(data->dev_pool))
+			flush_delayed_work(&data->dev_pool->zero_work);
+	} else if (!nr_spilled_dirty) {
+		kutf_test_fail(context, "No dirty page in the device pool to zero inline");
+		return;
+	}
+
+	err = kbase_mem_pool_alloc_pages(&data->pool, MEM_POOL_TEST_NR_PAGES, data->pages, false,
+					 NULL);
+
+	/* Let the zero worker have whatever the reallocation left dirty */
+	if (!wait_for_zero && kbase_mem_pool_dirty_size(data->dev_pool))
+		queue_delayed_work(data->kbdev->mem_pool_zero_wq, &data->dev_pool->zero_work, 0);
+
+	if (err != (int)MEM_POOL_TEST_NR_PAGES) {
+		kutf_test_fail(context, "Failed to reallocate the test buffer");
+		return;
+	}
+
+	nr_dirty = mem_pool_test_count_dirty(data);
+
+	/* Give the pages back to the kernel */
+	kbase_mem_pool_free_pages(&data->pool, MEM_POOL_TEST_NR_PAGES, data->pages, false, true);
+
+	if (nr_dirty) {
+		snprintf(msg_buf, sizeof(msg_buf), "%zu of %zu reallocated pages not zeroed",
+			 nr_dirty, MEM_POOL_TEST_NR_PAGES);
+		kutf_test_fail(context, msg_buf);
+		return;
+	}
+
+	snprintf(msg_buf, sizeof(msg_buf), "%zu pages zeroed, %zu dirty in device pool after free",
+		 MEM_POOL_TEST_NR_PAGES, nr_spilled_dirty);
+	kutf_test_pass(context, msg_buf);
+}
+
+/**
+ * mali_kutf_mem_pool_realloc_inline_test() - Reallocate a freed buffer before
+ *                                            the device pool zeroed it
+ * @context: KUTF context within which to perform the test.
+ */
+static void mali_kutf_mem_pool_realloc_inline_test(struct kutf_context *context)
+{
+	mem_pool_test_realloc(context, false);
+}
+
+/**
+ * mali_kutf_mem_pool_realloc_background_test() - Reallocate a freed buffer
+ *                                                once the device pool zeroed it
+ * @context: KUTF context within which to perform the test.
+ */
+static void mali_kutf_mem_pool_realloc_background_test(struct kutf_context *context)
+{
+	mem_pool_test_realloc(context, true);
+}
+
+/**
+ * mali_kutf_mem_pool_create_fixture() - Creates the fixture data required for
+ *                                       all tests in the mem pool suite.
+ * @context: KUTF context.
+ *
+ * Return: Fixture data created on success or NULL on failure
+ */
+static void *mali_kutf_mem_pool_create_fixture(struct kutf_context *context)
+{
+	struct kutf_mem_pool_fixture_data *data;
+	struct kbase_mem_pool_config config;
+	struct kbase_device *kbdev;
+	size_t dev_size;
+
+	pr_debug("Finding kbase device\n");
+	kbdev = kbase_find_device(MINOR_FOR_FIRST_KBASE_DEV);
+	if (kbdev == NULL) {
+		kutf_test_fail(context, "Failed to find kbase device");
+		return NULL;
+	}
+	pr_debug("Creating fixture\n");
+
+	data = kutf_mempool_alloc(&context->fixture_pool, sizeof(*data));
+	if (!data)
+		goto fail;
+
+	data->pages = kvcalloc(MEM_POOL_TEST_NR_PAGES, sizeof(*data->pages), GFP_KERNEL);
+	if (!data->pages)
+		goto fail;
+
+	kbase_mem_pool_config_set_max_size(&config, 0);
+	if (kbase_mem_pool_init(&data->pool, &config, KBASE_MEM_POOL_SMALL_PAGE_TABLE_ORDER, 0,
+				kbdev, &kbdev->mem_pools.small[0])) {
+		kvfree(data->pages);
+		goto fail;
+	}
+
+	/* Make room for the whole buffer in the device pool */
+	data->kbdev = kbdev;
+	data->dev_pool = &kbdev->mem_pools.small[0];
+	data->dev_max_size = kbase_mem_pool_max_size(data->dev_pool);
+	dev_size = kbase_mem_pool_size(data->dev_pool);
+	if (data->dev_max_size < dev_size + MEM_POOL_TEST_NR_PAGES)
+		kbase_mem_pool_set_max_size(data->dev_pool, dev_size + MEM_POOL_TEST_NR_PAGES);
+
+	pr_debug("Fixture created\n");
+	return data;
+
+fail:
+	kbase_release_device(kbdev);
+	return NULL;
+}
+
+/**
+ * mali_kutf_mem_pool_remove_fixture() - Destroy fixture data previously created
+ *                                       by mali_kutf_mem_pool_create_fixture.
+ * @context: KUTF context.
+ */
+static void mali_kutf_mem_pool_remove_fixture(struct kutf_context *context)
+{
+	struct kutf_mem_pool_fixture_data *data = context->fixture;
+	struct kbase_device *kbdev = data->kbdev;
+
+	kbase_mem_pool_term(&data->pool);
+	kbase_mem_pool_set_max_size(data->dev_pool, data->dev_max_size);
+	kvfree(data->pages);
+
+	kbase_release_device(kbdev);
+}
+
+/**
+ * struct kutf_mem_pool_bench_fixture_data - fixture used by the benchmarks
+ * @kbdev:  kbase device for the GPU.
+ * @pool:   Empty pool of small pages without a next pool, so that every page
+ *          allocated from it comes from the kernel.
+ * @pages:  Array of MEM_POOL_BENCH_NR_PAGES pages allocated by the benchmarks.
+ */
+struct kutf_mem_pool_bench_fixture_data {
+	struct kbase_device *kbdev;
+	struct kbase_mem_pool pool;
+	struct tagged_addr *pages;
+};
+
+/**
+ * mem_pool_bench_report() - Report the allocation rate of a benchmark
+ * @context:   KUTF context within which the benchmark ran.
+ * @nr_pages:  Number of pages allocated.
+ * @duration:  Time taken to allocate them, in nanoseconds.
+ */
+static void mem_pool_bench_report(struct kutf_context *context, size_t nr_pages, u64 duration)
+{
+	u64 const rate = div64_u64((u64)nr_pages * NSEC_PER_SEC, max_t(u64, duration, 1));
+
+	snprintf(msg_buf, sizeof(msg_buf), "%zu pages in %llu us, %llu pages/s", nr_pages,
+		 div_u64(duration, NSEC_PER_USEC), rate);
+	kutf_test_pass(context, msg_buf);
+}
+
+/**
+ * mali_kutf_mem_pool_bench_per_page_test() - Allocate pages from the kernel
+ *                                            one at a time
+ * @context: KUTF context within which to perform the test.
+ *
+ * Baseline for the bulk benchmark: each page is allocated, DMA mapped and
+ * given its metadata on its own, the way an empty pool did it before pages
+ * were allocated in bulk.
+ */
+static void mali_kutf_mem_pool_bench_per_page_test(struct kutf_context *context)
+{
+	struct kutf_mem_pool_bench_fixture_data *data = context->fixture;
+	u64 start, duration;
+	size_t i;
+
+	start = ktime_get_ns();
+	for (i = 0; i < MEM_POOL_BENCH_NR_PAGES; i++) {
+		struct page *p = kbase_mem_alloc_page(&data->pool);
+
+		if (!p)
+			break;
+		data->pages[i] = as_tagged(page_to_phys(p));
+	}
+	duration = ktime_get_ns() - start;
+
+	kbase_mem_pool_free_pages(&data->pool, i, data->pages, false, true);
+
+	if (i != MEM_POOL_BENCH_NR_PAGES) {
+		snprintf(msg_buf, sizeof(msg_buf), "Allocated only %zu of %zu pages", i,
+			 MEM_POOL_BENCH_NR_PAGES);
+		kutf_test_fail(context, msg_buf);
+		return;
+	}
+
+	mem_pool_bench_report(context, i, duration);
+}
+
+/**
+ * mali_kutf_mem_pool_bench_bulk_test() - Allocate pages from an empty pool
+ * @context: KUTF context within which to perform the test.
+ *
+ * The pool is empty and has no next pool, so all the pages are taken from
+ * the kernel in bulk by kbase_mem_pool_alloc_pages().
+ */
+static void mali_kutf_mem_pool_bench_bulk_test(struct kutf_context *context)
+{
+	struct kutf_mem_pool_bench_fixture_data *data = context->fixture;
+	u64 start, duration;
+	int err;
+
+	start = ktime_get_ns();
+	err = kbase_mem_pool_alloc_pages(&data->pool, MEM_POOL_BENCH_NR_PAGES, data->pages, false,
+					 NULL);
+	duration = ktime_get_ns() - start;
+
+	if (err != (int)MEM_POOL_BENCH_NR_PAGES) {
+		kutf_test_fail(context, "Failed to allocate the benchmark pages");
+		return;
+	}
+
+	kbase_mem_pool_free_pages(&data->pool, MEM_POOL_BENCH_NR_PAGES, data->pages, false, true);
+
+	mem_pool_bench_report(context, MEM_POOL_BENCH_NR_PAGES, duration);
+}
+
+/**
+ * mali_kutf_mem_pool_bench_create_fixture() - Creates the fixture data required
+ *                                             for all the benchmarks.
+ * @context: KUTF context.
+ *
+ * Return: Fixture data created on success or NULL on failure
+ */
+static void *mali_kutf_mem_pool_bench_create_fixture(struct kutf_context *context)
+{
+	struct kutf_mem_pool_bench_fixture_data *data;
+	struct kbase_mem_pool_config config;
+	struct kbase_device *kbdev;
+
+	kbdev = kbase_find_device(MINOR_FOR_FIRST_KBASE_DEV);
+	if (kbdev == NULL) {
+		kutf_test_fail(context, "Failed to find kbase device");
+		return NULL;
+	}
+
+	data = kutf_mempool_alloc(&context->fixture_pool, sizeof(*data));
+	if (!data)
+		goto fail;
+
+	data->pages = kvcalloc(MEM_POOL_BENCH_NR_PAGES, sizeof(*data->pages), GFP_KERNEL);
+	if (!data->pages)
+		goto fail;
+
+	kbase_mem_pool_config_set_max_size(&config, 0);
+	if (kbase_mem_pool_init(&data->pool, &config, KBASE_MEM_POOL_SMALL_PAGE_TABLE_ORDER, 0,
+				kbdev, NULL)) {
+		kvfree(data->pages);
+		goto fail;
+	}
+
+	data->kbdev = kbdev;
+	return data;
+
+fail:
+	kbase_release_device(kbdev);
+	return NULL;
+}
+
+/**
+ * mali_kutf_mem_pool_bench_remove_fixture() - Destroy fixture data previously
+ *                                             created by
+ *                                             mali_kutf_mem_pool_bench_create_fixture.
+ * @context: KUTF context.
+ */
+static void mali_kutf_mem_pool_bench_remove_fixture(struct kutf_context *context)
+{
+	struct kutf_mem_pool_bench_fixture_data *data = context->fixture;
+	struct kbase_device *kbdev = data->kbdev;
+
+	kbase_mem_pool_term(&data->pool);
+	kvfree(data->pages);
+
+	kbase_release_device(kbdev);
+}
+
+/**
+ * mali_kutf_mem_pool_test_main_init() - Module entry point for this test.
+ *
+ * Return: 0 on success, error code on failure.
+ */
+static int __init mali_kutf_mem_pool_test_main_init(void)
+{
+	struct kutf_suite *suite;
+
+	mem_pool_app = kutf_create_application("mem_pool");
+
+	if (mem_pool_app == NULL) {
+		pr_warn("Creation of mem_pool KUTF app failed!\n");
+		return -ENOMEM;
+	}
+	suite = kutf_create_suite(mem_pool_app, MEM_POOL_SUITE_NAME, 1,
+				  mali_kutf_mem_pool_create_fixture,
+				  mali_kutf_mem_pool_remove_fixture);
+	if (suite == NULL) {
+		pr_warn("Creation of %s suite failed!\n", MEM_POOL_SUITE_NAME);
+		kutf_destroy_application(mem_pool_app);
+		return -ENOMEM;
+	}
+	kutf_add_test(suite, 0x0, MEM_POOL_REALLOC_INLINE, mali_kutf_mem_pool_realloc_inline_test);
+	kutf_add_test(suite, 0x1, MEM_POOL_REALLOC_BACKGROUND,
+		      mali_kutf_mem_pool_realloc_background_test);
+
+	suite = kutf_create_suite(mem_pool_app, MEM_POOL_BENCH_SUITE_NAME, 1,
+				  mali_kutf_mem_pool_bench_create_fixture,
+				  mali_kutf_mem_pool_bench_remove_fixture);
+	if (suite == NULL) {
+		pr_warn("Creation of %s suite failed!\n", MEM_POOL_BENCH_SUITE_NAME);
+		kutf_destroy_application(mem_pool_app);
+		return -ENOMEM;
+	}
+	kutf_add_test(suite, 0x0, MEM_POOL_BENCH_PER_PAGE, mali_kutf_mem_pool_bench_per_page_test);
+	kutf_add_test(suite, 0x1, MEM_POOL_BENCH_BULK, mali_kutf_mem_pool_bench_bulk_test);
+	return 0;
+}
+
+/**
+ * mali_kutf_mem_pool_test_main_exit() - Module exit point for this test.
+ */
+static void __exit mali_kutf_mem_pool_test_main_exit(void)
+{
+	kutf_destroy_application(mem_pool_app);
+}
+
+module_init(mali_kutf_mem_pool_test_main_init);
+module_exit(mali_kutf_mem_pool_test_main_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("ARM Ltd.");
+MODULE_VERSION("1.0");
@@ -50,6 +50,8 @@ enum mgm_pte_flags {
  *                                   operations
  *
  * @mgm_alloc_page:           Callback to allocate physical memory in a group
+ * @mgm_alloc_pages_bulk:     Callback to allocate many small pages of physical
+ *                            memory in a group at once
  * @mgm_free_page:            Callback to free physical memory in a group
  * @mgm_get_import_memory_id: Callback to get the group ID for imported memory
  * @mgm_update_gpu_pte:       Callback to modify a GPU page table entry
@@ -82,6 +84,37 @@ struct memory_group_manager_ops {
 	struct page *(*mgm_alloc_page)(struct memory_group_manager_device *mgm_dev,
 				       unsigned int group_id, gfp_t gfp_mask, unsigned int order);
 
+	/*
+	 * mgm_alloc_pages_bulk - Allocate a number of small physical memory
+	 *                        pages in a group
+	 *
+	 * @mgm_dev:    The memory group manager through which the request is
+	 *              being made.
+	 * @group_id:   A physical memory group ID. The meaning of this is defined
+	 *              by the systems integrator. Its valid range is
+	 *              0 .. MEMORY_GROUP_MANAGER_NR_GROUPS-1.
+	 * @gfp_mask:   Bitmask of Get Free Page flags affecting allocator
+	 *              behavior.
+	 * @nr_pages:   Number of pages to allocate.
+	 * @page_array: Array of @nr_pages entries, all NULL on entry.
+	 *
+	 * Same as calling mgm_alloc_page @nr_pages times with an order of 0,
+	 * but lets the manager batch the requests, e.g. with the kernel's
+	 * alloc_pages_bulk_array function. Each page is freed on its own by
+	 * calling the mgm_free_page method with the same @group_id and an
+	 * order of 0.
+	 *
+	 * Note that provision of this call back is optional, where it is not
+	 * provided this call back pointer must be set to NULL to indicate it
+	 * is not in use.
+	 *
+	 * Return: Number of pages allocated, stored in the first entries of
+	 *         @page_array. May be less than @nr_pages.
+	 */
+	unsigned long (*mgm_alloc_pages_bulk)(struct memory_group_manager_device *mgm_dev,
+					      unsigned int group_id, gfp_t gfp_mask,
+					      unsigned long nr_pages, struct page **page_array);
+
 	/*
 	 * mgm_free_page - Free a physical memory page in a group
 	 *
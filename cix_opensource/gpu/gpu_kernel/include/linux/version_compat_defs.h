@@ -171,6 +171,30 @@ static inline void kbase_kunmap_atomic(void *address)
 #endif /* KERNEL_VERSION(5, 11, 0) */
 }
 
+/* Fills the NULL entries of page_array, returns the number of entries that
+ * hold a page. The fallback stops at the first failed allocation.
+ */
+static inline unsigned long kbase_alloc_pages_bulk(gfp_t gfp, unsigned long nr_pages,
+						   struct page **page_array)
+{
+#if KERNEL_VERSION(6, 14, 0) <= LINUX_VERSION_CODE
+	return alloc_pages_bulk(gfp, nr_pages, page_array);
+#elif KERNEL_VERSION(5, 13, 0) <= LINUX_VERSION_CODE
+	return alloc_pages_bulk_array(gfp, nr_pages, page_array);
+#else
+	unsigned long i;
+
+	for (i = 0; i < nr_pages; i++) {
+		if (!page_array[i])
+			page_array[i] = alloc_page(gfp);
+		if (!page_array[i])
+			break;
+	}
+
+	return i;
+#endif /* KERNEL_VERSION(5, 13, 0) */
+}
+
 /* Some of the older 4.4 kernel patch versions do
  * not contain the overflow check functions. However,
  * they are based on compiler instrinsics, so they
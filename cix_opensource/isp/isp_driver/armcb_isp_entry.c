@@ -22,6 +22,8 @@
 #include "bus/i2c/system_i2c.h"
 #include "bus/spi/system_spi.h"
 #include "cix_vi_hw.h"
+#include "isp_hw_ops.h"
+#include "system_debugfs.h"
 #include "linux/kern_levels.h"
 #include "linux/kernel.h"
 
@@ -45,6 +47,7 @@ struct armcb_ko_entry g_ko_entries[] = {
 	{ armcb_get_motor_driver_instance,       armcb_motor_driver_destroy,       NULL, false },
 	{ armcb_get_cam_io_drv_instance,         armcb_cam_io_drv_destroy,         NULL, false },
 	{ cix_vi_hw_instance,                    cix_vi_hw_destroy,                NULL, false },
+	{ armcb_get_isp_hw_ops_instance,         armcb_isp_hw_ops_destroy,         NULL, false },
 };
 #else
 struct armcb_ko_entry g_ko_entries[] = {
@@ -56,6 +59,7 @@ struct armcb_ko_entry g_ko_entries[] = {
 	{ armcb_get_isp_driver_instance,         armcb_isp_driver_destroy,         NULL, false },
 	{ armcb_get_motor_driver_instance,       armcb_motor_driver_destroy,       NULL, false },
 	{ cix_vi_hw_instance,                    cix_vi_hw_destroy,                NULL, false },
+	{ armcb_get_isp_hw_ops_instance,         armcb_isp_hw_ops_destroy,         NULL, false },
 };
 #endif
 
@@ -91,6 +95,7 @@ static void __exit armcb_isp_submodule_exit(void)
 #if (KERNEL_VERSION(4, 17, 0) > LINUX_VERSION_CODE)
 	armcb_cam_instance_destroy();
 #endif
+	system_debugfs_destroy();
 }
 
 module_init(armcb_isp_submodules_init);
@@ -16,6 +16,7 @@
 #include <linux/delay.h>
 #include <linux/dma-buf.h>
 #include <linux/dma-mapping.h>
+#include <linux/fs.h>
 #include <linux/ftrace.h>
 #include <linux/miscdevice.h>
 #include <linux/mman.h>
@@ -24,14 +25,19 @@
 #include <linux/of_iommu.h>
 #include <linux/of_reserved_mem.h>
 #include <linux/pm_runtime.h>
+#include <linux/seq_file.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 
 #include "armcb_camera_io_drv.h"
+#include "armcb_isp_driver.h"
 #include "armcb_platform.h"
 #include "armcb_register.h"
 #include "armcb_sensor.h"
 #include "isp_hw_ops.h"
+#include "isp_hw_trace.h"
+#include "system_debugfs.h"
 #include "system_dma.h"
 #include "system_logger.h"
 
@@ -240,73 +246,239 @@ static void ispmem_cma_dump(struct cmamem_block *memory_block)
 }
 #endif
 
-static long ispmem_cma_alloc(struct file *file, unsigned long arg)
+/*
+ * Blocks given back by CMEM_FREE (or on close) are parked on
+ * cma_buf_ctl.pool instead of being returned to CMA, so the next request of
+ * the same size skips dma_alloc_*. Beyond this many megabytes of idle blocks
+ * a freed block is released for real.
+ */
+static uint ispmem_pool_max_mb = 64;
+module_param(ispmem_pool_max_mb, uint, 0644);
+MODULE_PARM_DESC(ispmem_pool_max_mb, "Max MB of freed ispmem blocks kept for reuse");
+
+static struct cmamem_block *ispmem_block_create(unsigned int size, bool cached)
 {
-	struct cmamem_block *memory_block;
-	struct mem_block cma_info_temp;
-	int size;
-	if (copy_from_user(&cma_info_temp, (void __user *)arg,
-					sizeof(struct mem_block))) {
-		LOG(LOG_ERR, "copy_from_user error");
-		return -1;
+	struct cmamem_block *block = NULL;
+	dma_addr_t dma = 0;
+
+	block = kzalloc(sizeof(*block), GFP_KERNEL);
+	if (!block)
+		return NULL;
+
+	if (cached) {
+		block->page = dma_alloc_pages(cmamem_dev.pddev, size, &dma,
+					      DMA_BIDIRECTIONAL, GFP_KERNEL);
+		if (block->page)
+			block->kernel_addr = page_address(block->page);
+	} else {
+		block->kernel_addr = dma_alloc_coherent(cmamem_dev.pddev, size,
+							&dma, GFP_KERNEL);
+	}
+
+	if (!block->kernel_addr) {
+		kfree(block);
+		return NULL;
 	}
 
-	if (cma_info_temp.len > 0) {
+	block->id = -1;
+	block->cached = cached;
+	block->phy_addr = dma;
+	block->len = size;
+	kref_init(&block->ref);
+	INIT_LIST_HEAD(&block->memqueue_list);
 
-		size = PAGE_ALIGN(cma_info_temp.len);
-		cma_info_temp.len = size;
-		cma_info_temp.kernel_addr = dma_alloc_coherent(
-				cmamem_dev.pddev, size,
-				(dma_addr_t *)(&(cma_info_temp.phy_addr)),
-				GFP_KERNEL);
+	return block;
+}
 
-		if (!cma_info_temp.phy_addr) {
-			return -ENOMEM;
-		}
+static void ispmem_block_destroy(struct cmamem_block *block)
+{
+	if (block->cached)
+		dma_free_pages(cmamem_dev.pddev, block->len, block->page,
+			       block->phy_addr, DMA_BIDIRECTIONAL);
+	else
+		dma_free_coherent(cmamem_dev.pddev, block->len,
+				  block->kernel_addr, block->phy_addr);
+	kfree(block);
+}
+
+/// cma_buf_ctl.m_lock must be held
+static void ispmem_pool_put(struct cmamem_block *block)
+{
+	unsigned long max = (unsigned long)ispmem_pool_max_mb << 20;
 
-		cmamem_status.vir_addr = cma_info_temp.kernel_addr;
-		cmamem_status.phy_addr = cma_info_temp.phy_addr;
-		cmamem_status.id_count = cma_info_temp.id;
-		cmamem_status.status = HAVE_ALLOCED;
-		cma_info_temp.usr_addr = vm_mmap(
-				file, 0, size, PROT_READ | PROT_WRITE, MAP_SHARED, 0);
+	if (cma_buf_ctl.pool_bytes + block->len > max) {
+		ispmem_block_destroy(block);
+		return;
+	}
 
-		if (cma_info_temp.usr_addr < 0) {
-			return -ENOMEM;
+	block->id = -1;
+	block->is_busy = 0;
+	block->usr_addr = 0;
+	list_add(&block->memqueue_list, &cma_buf_ctl.pool[block->cached]);
+	cma_buf_ctl.pool_bytes += block->len;
+}
+
+/// last reference gone, called with cma_buf_ctl.m_lock held
+static void ispmem_block_release(struct kref *ref)
+{
+	struct cmamem_block *block =
+		container_of(ref, struct cmamem_block, ref);
+
+	ispmem_pool_put(block);
+	mutex_unlock(&cma_buf_ctl.m_lock);
+}
+
+/// drop a reference, the block is recycled once nothing maps it anymore
+static void ispmem_block_put(struct cmamem_block *block)
+{
+	kref_put_mutex(&block->ref, ispmem_block_release, &cma_buf_ctl.m_lock);
+}
+
+/**
+ * @description: take an idle block of exactly @size from the pool, or
+ *               allocate a new one
+ * @param {unsigned int} size: page aligned length
+ * @param {bool} cached: cacheable pages instead of a coherent buffer
+ * @return {struct cmamem_block *} NULL on allocation failure
+ */
+static struct cmamem_block *ispmem_block_get(unsigned int size, bool cached)
+{
+	struct cmamem_block *block = NULL;
+	struct cmamem_block *pos = NULL;
+
+	mutex_lock(&cma_buf_ctl.m_lock);
+	list_for_each_entry(pos, &cma_buf_ctl.pool[cached], memqueue_list) {
+		if (pos->len == size) {
+			list_del_init(&pos->memqueue_list);
+			cma_buf_ctl.pool_bytes -= size;
+			block = pos;
+			break;
 		}
-		mutex_lock(&cma_buf_ctl.m_lock);
+	}
+	mutex_unlock(&cma_buf_ctl.m_lock);
+
+	if (!block)
+		return ispmem_block_create(size, cached);
 
-		cma_info_temp.id = cma_buf_ctl.buf_count;
+	/* the pool is shared by every opener, don't leak the last contents */
+	kref_init(&block->ref);
+	memset(block->kernel_addr, 0, size);
+	if (block->cached)
+		dma_sync_single_for_device(cmamem_dev.pddev, block->phy_addr,
+					   size, DMA_TO_DEVICE);
+
+	return block;
+}
+
+static void ispmem_pool_drain(void)
+{
+	struct cmamem_block *block = NULL;
+	struct cmamem_block *next = NULL;
+	int i = 0;
 
-		/* setup the memory block */
-		memory_block = kmalloc(
-				sizeof(struct cmamem_block), GFP_KERNEL);
-		if (memory_block == NULL) {
-			return -1;
+	mutex_lock(&cma_buf_ctl.m_lock);
+	for (i = 0; i < ARRAY_SIZE(cma_buf_ctl.pool); i++) {
+		list_for_each_entry_safe(block, next, &cma_buf_ctl.pool[i],
+					 memqueue_list) {
+			list_del(&block->memqueue_list);
+			ispmem_block_destroy(block);
 		}
+	}
+	cma_buf_ctl.pool_bytes = 0;
+	mutex_unlock(&cma_buf_ctl.m_lock);
+}
+
+/*
+ * Drop the user mapping vm_mmap()ed at allocation time, unless userspace
+ * already unmapped it and something else lives at that address now.
+ */
+static void ispmem_block_unmap_user(struct cmamem_block *block)
+{
+	struct mm_struct *mm = current->mm;
+	struct vm_area_struct *vma = NULL;
+	bool mapped = false;
 
-		memory_block->id            =   cma_info_temp.id;
-		memory_block->is_busy       =   1;
-		memory_block->is_use_buffer =   cma_info_temp.is_use_buffer;
-		memory_block->usr_addr      =   cma_info_temp.usr_addr;
-		memory_block->kernel_addr   =   cma_info_temp.kernel_addr;
-		memory_block->phy_addr      =   cma_info_temp.phy_addr;
-		memory_block->len           =   cma_info_temp.len;
+	if (!mm || !block->usr_addr)
+		return;
 
-		cma_buf_ctl.bitMap[cma_buf_ctl.buf_count] = 1;
-		cma_buf_ctl.bufq[cma_buf_ctl.buf_count] = memory_block;
-		cma_buf_ctl.buf_count++;
+	mmap_read_lock(mm);
+	vma = find_vma(mm, block->usr_addr);
+	mapped = vma && vma->vm_start == block->usr_addr &&
+		 vma->vm_private_data == block;
+	mmap_read_unlock(mm);
 
-		mutex_unlock(&cma_buf_ctl.m_lock);
+	if (mapped)
+		vm_munmap(block->usr_addr, block->len);
+}
+
+static long ispmem_cma_alloc(struct file *file, unsigned long arg, bool cached)
+{
+	struct cmamem_block *memory_block;
+	struct mem_block cma_info_temp;
+	unsigned long usr_addr;
+	unsigned int size;
+	int id;
 
-		if (copy_to_user((void __user *)arg, (void *)(&cma_info_temp),
+	if (copy_from_user(&cma_info_temp, (void __user *)arg,
 					sizeof(struct mem_block))) {
-			return -EFAULT;
-		}
+		LOG(LOG_ERR, "copy_from_user error");
+		return -EFAULT;
+	}
 
-	} else {
+	if (cma_info_temp.len == 0)
+		return -EINVAL;
 
-		return -1;
+	size = PAGE_ALIGN(cma_info_temp.len);
+	memory_block = ispmem_block_get(size, cached);
+	if (!memory_block)
+		return -ENOMEM;
+
+	/* ispmem_cma_mmap() maps whatever block was handed out last */
+	mutex_lock(&cma_buf_ctl.m_lock);
+	cmamem_status.block = memory_block;
+	cmamem_status.vir_addr = memory_block->kernel_addr;
+	cmamem_status.phy_addr = memory_block->phy_addr;
+	cmamem_status.status = HAVE_ALLOCED;
+	mutex_unlock(&cma_buf_ctl.m_lock);
+
+	usr_addr = vm_mmap(file, 0, size, PROT_READ | PROT_WRITE, MAP_SHARED, 0);
+	if (IS_ERR_VALUE(usr_addr)) {
+		mutex_lock(&cma_buf_ctl.m_lock);
+		if (cmamem_status.block == memory_block)
+			cmamem_status.block = NULL;
+		mutex_unlock(&cma_buf_ctl.m_lock);
+		ispmem_block_put(memory_block);
+		return (long)usr_addr;
+	}
+
+	mutex_lock(&cma_buf_ctl.m_lock);
+	id = idr_alloc(&cma_buf_ctl.idr, memory_block, 0, CAM_MEM_BUFQ_MAX,
+		       GFP_KERNEL);
+	if (id < 0) {
+		if (cmamem_status.block == memory_block)
+			cmamem_status.block = NULL;
+		mutex_unlock(&cma_buf_ctl.m_lock);
+		vm_munmap(usr_addr, size);
+		ispmem_block_put(memory_block);
+		return id;
+	}
+
+	memory_block->id            =   id;
+	memory_block->is_busy       =   1;
+	memory_block->is_use_buffer =   cma_info_temp.is_use_buffer;
+	memory_block->usr_addr      =   usr_addr;
+	cmamem_status.id_count      =   id;
+	mutex_unlock(&cma_buf_ctl.m_lock);
+
+	cma_info_temp.id = id;
+	cma_info_temp.len = size;
+	cma_info_temp.usr_addr = usr_addr;
+	cma_info_temp.kernel_addr = memory_block->kernel_addr;
+	cma_info_temp.phy_addr = memory_block->phy_addr;
+
+	if (copy_to_user((void __user *)arg, (void *)(&cma_info_temp),
+				sizeof(struct mem_block))) {
+		return -EFAULT;
 	}
 
 	return 0;
@@ -314,19 +486,30 @@ static long ispmem_cma_alloc(struct file *file, unsigned long arg)
 
 static int ispmem_cma_free(struct file *file, unsigned long arg)
 {
-	return 0;
-}
+	struct cmamem_block *memory_block = NULL;
+	struct mem_block cma_info_temp;
 
-static int ispmem_cma_find_buffer_by_id(int id)
-{
-	if(id > cma_buf_ctl.buf_count)
-		return -1;
+	if (copy_from_user(&cma_info_temp, (void __user *)arg,
+					sizeof(struct mem_block))) {
+		LOG(LOG_ERR, "copy_from_user error");
+		return -EFAULT;
+	}
 
-	if(cma_buf_ctl.bitMap[id] != 1)
-		return -1;
+	mutex_lock(&cma_buf_ctl.m_lock);
+	memory_block = idr_remove(&cma_buf_ctl.idr, cma_info_temp.id);
+	mutex_unlock(&cma_buf_ctl.m_lock);
+	if (!memory_block)
+		return -EINVAL;
 
-	if(cma_buf_ctl.bufq[id] == NULL)
-		return -1;
+	ispmem_block_unmap_user(memory_block);
+
+	mutex_lock(&cma_buf_ctl.m_lock);
+	if (cmamem_status.block == memory_block)
+		cmamem_status.block = NULL;
+	mutex_unlock(&cma_buf_ctl.m_lock);
+
+	/* mappings left by fork, mremap or a partial munmap keep it alive */
+	ispmem_block_put(memory_block);
 
 	return 0;
 }
@@ -335,7 +518,6 @@ static int ispmem_cma_import(struct file *file, unsigned long arg)
 {
 	struct cmamem_block *memory_block = NULL;
 	struct mem_block cma_info_temp;
-	int ret;
 
 	if (copy_from_user(&cma_info_temp, (void __user *)arg,
 						sizeof(struct mem_block))) {
@@ -343,11 +525,9 @@ static int ispmem_cma_import(struct file *file, unsigned long arg)
 		return -1;
 	}
 
-	ret = ispmem_cma_find_buffer_by_id(cma_info_temp.id);
-	if(ret == 0) {
-
-		memory_block = cma_buf_ctl.bufq[cma_info_temp.id];
-
+	mutex_lock(&cma_buf_ctl.m_lock);
+	memory_block = idr_find(&cma_buf_ctl.idr, cma_info_temp.id);
+	if (memory_block) {
 		cma_info_temp.is_use_buffer =
 			memory_block->is_use_buffer;
 		cma_info_temp.usr_addr =
@@ -357,58 +537,222 @@ static int ispmem_cma_import(struct file *file, unsigned long arg)
 		cma_info_temp.phy_addr =
 			memory_block->phy_addr;
 		cma_info_temp.len = memory_block->len;
+	}
+	mutex_unlock(&cma_buf_ctl.m_lock);
 
-		if (copy_to_user((void __user *)arg, (void *)(&cma_info_temp),
-							sizeof(struct mem_block))) {
-			return -EFAULT;
-		}
-	} else {
+	if (!memory_block)
 		return -1;
+
+	if (copy_to_user((void __user *)arg, (void *)(&cma_info_temp),
+						sizeof(struct mem_block))) {
+		return -EFAULT;
 	}
 
 	return 0;
 }
 
-static int ispmem_cma_free_all(void)
+/**
+ * @description: cache maintenance around a CPU access to a cached block,
+ *               limited to [offset, offset + len)
+ * @param {unsigned long} arg: user pointer to struct mem_sync
+ * @param {bool} begin: CMEM_SYNC_BEGIN (to cpu) or CMEM_SYNC_END (to device)
+ * @return {int} 0 on success, a no-op for coherent blocks
+ */
+static int ispmem_cma_sync(unsigned long arg, bool begin)
 {
 	struct cmamem_block *memory_block = NULL;
-	int loop;
+	enum dma_data_direction dir;
+	struct mem_sync sync;
+	int ret = 0;
+
+	if (copy_from_user(&sync, (void __user *)arg, sizeof(sync)))
+		return -EFAULT;
+
+	switch (sync.flags & CMEM_SYNC_RW) {
+	case CMEM_SYNC_READ:
+		dir = DMA_FROM_DEVICE;
+		break;
+	case CMEM_SYNC_WRITE:
+		dir = DMA_TO_DEVICE;
+		break;
+	case CMEM_SYNC_RW:
+		dir = DMA_BIDIRECTIONAL;
+		break;
+	default:
+		return -EINVAL;
+	}
 
 	mutex_lock(&cma_buf_ctl.m_lock);
+	memory_block = idr_find(&cma_buf_ctl.idr, sync.id);
+	if (!memory_block || sync.offset > memory_block->len ||
+	    sync.len > memory_block->len - sync.offset) {
+		ret = -EINVAL;
+		goto unlock;
+	}
 
-	for(loop = 0; loop < cma_buf_ctl.buf_count;loop++) {
+	if (!memory_block->cached || !sync.len)
+		goto unlock;
 
-		memory_block = cma_buf_ctl.bufq[loop];
-		//1. release dma buffer
-		dma_free_coherent(cmamem_dev.pddev,
-				memory_block->len,
-				memory_block->kernel_addr,
-				memory_block->phy_addr);
+	if (begin)
+		dma_sync_single_for_cpu(cmamem_dev.pddev,
+					memory_block->phy_addr + sync.offset,
+					sync.len, dir);
+	else
+		dma_sync_single_for_device(cmamem_dev.pddev,
+					   memory_block->phy_addr + sync.offset,
+					   sync.len, dir);
+unlock:
+	mutex_unlock(&cma_buf_ctl.m_lock);
+	return ret;
+}
 
-		//2. release kmalloc buffer
-		kfree(memory_block);
+/**
+ * @description: time fresh and pooled allocation, free, and a CPU fill of
+ *               one block; the block is left in the pool afterwards
+ * @param {unsigned long} arg: user pointer to struct mem_bench
+ * @return {int} 0 on success
+ */
+static int ispmem_cma_bench(unsigned long arg)
+{
+	struct cmamem_block *block = NULL;
+	struct mem_bench bench;
+	unsigned int size = 0;
+	unsigned int i = 0;
+	void *src = NULL;
+	u64 start = 0;
+	u64 copy_ns = 0;
+
+	/* up to 64 MB x 1000 copies, not for every camera client */
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (copy_from_user(&bench, (void __user *)arg, sizeof(bench)))
+		return -EFAULT;
+
+	size = PAGE_ALIGN(bench.len);
+	if (!size || size > SZ_64M)
+		return -EINVAL;
+	bench.iters = clamp(bench.iters, 1U, 1000U);
+
+	src = vmalloc(size);
+	if (!src)
+		return -ENOMEM;
+	memset(src, 0x5a, size);
 
-		cma_buf_ctl.bitMap[loop] = 0;
-		cma_buf_ctl.bufq[loop] = NULL;
+	start = ktime_get_ns();
+	block = ispmem_block_create(size, bench.cached);
+	bench.alloc_ns = ktime_get_ns() - start;
+	if (!block) {
+		vfree(src);
+		return -ENOMEM;
+	}
+
+	start = ktime_get_ns();
+	for (i = 0; i < bench.iters; i++) {
+		memcpy(block->kernel_addr, src, size);
+		/* what a real producer pays before handing it to the ISP */
+		if (block->cached)
+			dma_sync_single_for_device(cmamem_dev.pddev,
+						   block->phy_addr, size,
+						   DMA_TO_DEVICE);
 	}
+	copy_ns = ktime_get_ns() - start;
+	bench.copy_mbps = div64_u64((u64)size * bench.iters * 1000,
+				    max_t(u64, copy_ns, 1));
 
-	cma_buf_ctl.buf_count = 0;
+	start = ktime_get_ns();
+	mutex_lock(&cma_buf_ctl.m_lock);
+	ispmem_pool_put(block);
 	mutex_unlock(&cma_buf_ctl.m_lock);
+	bench.free_ns = ktime_get_ns() - start;
+
+	start = ktime_get_ns();
+	block = ispmem_block_get(size, bench.cached);
+	bench.pool_alloc_ns = ktime_get_ns() - start;
+	if (block) {
+		mutex_lock(&cma_buf_ctl.m_lock);
+		ispmem_pool_put(block);
+		mutex_unlock(&cma_buf_ctl.m_lock);
+	}
+
+	vfree(src);
+
+	if (copy_to_user((void __user *)arg, &bench, sizeof(bench)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int ispmem_cma_free_all(void)
+{
+	struct cmamem_block *memory_block = NULL;
+	int id;
+
+	do {
+		id = 0;
+		mutex_lock(&cma_buf_ctl.m_lock);
+		memory_block = idr_get_next(&cma_buf_ctl.idr, &id);
+		if (memory_block) {
+			idr_remove(&cma_buf_ctl.idr, id);
+		} else {
+			cmamem_status.block = NULL;
+			cmamem_status.status = UNKNOW_STATUS;
+		}
+		mutex_unlock(&cma_buf_ctl.m_lock);
+
+		/* blocks still mapped by another opener stay until unmapped */
+		if (memory_block)
+			ispmem_block_put(memory_block);
+	} while (memory_block);
 
 	return 0;
 }
 
+/* fork, mremap and partial munmap duplicate the vma, each holds the block */
+static void ispmem_vm_open(struct vm_area_struct *vma)
+{
+	struct cmamem_block *block = vma->vm_private_data;
+
+	kref_get(&block->ref);
+}
+
+static void ispmem_vm_close(struct vm_area_struct *vma)
+{
+	ispmem_block_put(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct ispmem_vm_ops = {
+	.open = ispmem_vm_open,
+	.close = ispmem_vm_close,
+};
+
 static int ispmem_cma_mmap(struct file *filp, struct vm_area_struct *vma)
 {
 	unsigned long size = vma->vm_end - vma->vm_start;
-	if (cmamem_status.status != HAVE_ALLOCED) {
+	struct cmamem_block *block = NULL;
+	int ret;
+
+	mutex_lock(&cma_buf_ctl.m_lock);
+	block = cmamem_status.block;
+	if (cmamem_status.status != HAVE_ALLOCED || !block ||
+	    size > block->len) {
+		mutex_unlock(&cma_buf_ctl.m_lock);
 		LOG(LOG_ERR, "you should allocated memory firstly.");
 		return -EINVAL;
 	}
+	kref_get(&block->ref);
+	mutex_unlock(&cma_buf_ctl.m_lock);
 
-	if (dma_mmap_coherent(cam_mem_info->pddev, vma, cmamem_status.vir_addr,
-				cmamem_status.phy_addr, size)) {
+	if (block->cached)
+		ret = dma_mmap_pages(cam_mem_info->pddev, vma, size,
+				     block->page);
+	else
+		ret = dma_mmap_coherent(cam_mem_info->pddev, vma,
+					block->kernel_addr, block->phy_addr,
+					size);
+	if (ret) {
 		LOG(LOG_ERR, "dma mmap failed .");
+		ispmem_block_put(block);
 		return -EIO;
 	}
 
@@ -419,8 +763,12 @@ static int ispmem_cma_mmap(struct file *filp, struct vm_area_struct *vma)
 	vma->vm_flags &= ~VM_IO;
 	vma->vm_flags |= (VM_DONTEXPAND | VM_DONTDUMP);
 #endif
+	vma->vm_private_data = block;
+	vma->vm_ops = &ispmem_vm_ops;
 
+	mutex_lock(&cma_buf_ctl.m_lock);
 	cmamem_status.status = HAVE_MMAPED;
+	mutex_unlock(&cma_buf_ctl.m_lock);
 	return 0;
 }
 
@@ -430,12 +778,10 @@ static int ispmem_cma_mem_init(void)
 
 	mutex_lock(&cma_buf_ctl.m_lock);
 
-	cma_buf_ctl.buf_count = 0;
-
-	for (i = 0; i < CAM_MEM_BUFQ_MAX; i++) {
-		cma_buf_ctl.bitMap[i] = 0;
-		cma_buf_ctl.bufq[i] = NULL;
-	}
+	idr_init(&cma_buf_ctl.idr);
+	for (i = 0; i < ARRAY_SIZE(cma_buf_ctl.pool); i++)
+		INIT_LIST_HEAD(&cma_buf_ctl.pool[i]);
+	cma_buf_ctl.pool_bytes = 0;
 
 	mutex_unlock(&cma_buf_ctl.m_lock);
 
@@ -529,56 +875,58 @@ static int ispmem_xdma_test(void *arg)
 	return res;
 }
 #endif
+/*
+ * Idle mappings stay attached, mapped and vmapped on buf_tbl.lru so that a
+ * buffer mapped again (by any fd) skips the whole dma-buf setup. Beyond this
+ * many idle entries the least recently released one is torn down.
+ */
+static uint mem_cache_max = 32;
+module_param(mem_cache_max, uint, 0644);
+MODULE_PARM_DESC(mem_cache_max, "Max idle dma-buf mappings kept cached");
+
+static unsigned long cam_mem_hash_key(struct dma_buf *dmabuf)
+{
+	return file_inode(dmabuf->file)->i_ino;
+}
+
+/// buf_tbl.m_lock must be held
 static int cam_mem_get_avaliable_buf_idx(void)
 {
 	int idx = 0;
 
-	for (idx = 0; idx < CAM_MEM_BUFQ_MAX; idx++) {
-		if (!buf_tbl.bitMap[idx]) {
-			buf_tbl.bitMap[idx] = 1;
-			break;
-		}
-	}
-
+	idx = find_first_zero_bit(buf_tbl.bitMap, CAM_MEM_BUFQ_MAX);
 	if (idx >= CAM_MEM_BUFQ_MAX) {
 		idx = -1;
 		LOG(LOG_ERR, "Error! No available buffer\n");
+	} else {
+		set_bit(idx, buf_tbl.bitMap);
 	}
 
 	return idx;
 }
 
+/// buf_tbl.m_lock must be held
 static void cam_mem_put_bux_idx(int idx)
 {
-	mutex_lock(&buf_tbl.m_lock);
-	buf_tbl.bitMap[idx] = 0;
+	clear_bit(idx, buf_tbl.bitMap);
 	buf_tbl.bufq[idx].fd = -1;
 	buf_tbl.bufq[idx].bufIdx = -1;
 	buf_tbl.bufq[idx].flags = 0;
-	mutex_unlock(&buf_tbl.m_lock);
+	buf_tbl.bufq[idx].dma = NULL;
 }
 
-static int cam_mem_get_avaliable_fd_idx(int fd)
+/// buf_tbl.m_lock must be held
+static int cam_mem_lookup_idx(struct dma_buf *dmabuf)
 {
-	int loop;
-	int idx = -1;
-
-	mutex_lock(&buf_tbl.m_lock);
-
-	for (loop = 0; loop < CAM_MEM_BUFQ_MAX; loop++) {
-		if (buf_tbl.bufq[loop].fd == fd) {
-			idx = loop;
-			break;
-		}
-	}
+	struct cam_mem_buf *buf = NULL;
 
-	if(loop == CAM_MEM_BUFQ_MAX) {
-		idx = -1;
+	hash_for_each_possible(buf_tbl.hash, buf, hnode,
+			       cam_mem_hash_key(dmabuf)) {
+		if (buf->dma == dmabuf)
+			return buf->bufIdx;
 	}
 
-	mutex_unlock(&buf_tbl.m_lock);
-
-	return idx;
+	return -1;
 }
 
 static int cam_mem_tbl_init(void)
@@ -588,11 +936,16 @@ static int cam_mem_tbl_init(void)
 
 	mutex_lock(&buf_tbl.m_lock);
 
+	bitmap_zero(buf_tbl.bitMap, CAM_MEM_BUFQ_MAX);
+	hash_init(buf_tbl.hash);
+	INIT_LIST_HEAD(&buf_tbl.lru);
+	buf_tbl.idle_cnt = 0;
+
 	for (i = 0; i < CAM_MEM_BUFQ_MAX; i++) {
-		buf_tbl.bitMap[i] = 0;
 		buf_tbl.bufq[i].fd = -1;
 		buf_tbl.bufq[i].bufIdx = -1;
 		buf_tbl.bufq[i].flags = 0;
+		INIT_LIST_HEAD(&buf_tbl.bufq[i].lru);
 	}
 
 	mutex_unlock(&buf_tbl.m_lock);
@@ -600,172 +953,374 @@ static int cam_mem_tbl_init(void)
 	return ret;
 }
 
-void cam_mem_buf_force_release(int idx)
+/// Tear down the mapping in slot @idx, buf_tbl.m_lock must be held
+static void __cam_mem_buf_release(int idx)
 {
+	struct cam_mem_buf *buf = &buf_tbl.bufq[idx];
 	struct iosys_map map;
 
-	map.is_iomem = false;
-	map.vaddr = (void *)buf_tbl.bufq[idx].kvaddr;
+	if (!list_empty(&buf->lru)) {
+		list_del_init(&buf->lru);
+		buf_tbl.idle_cnt--;
+	}
+	hash_del(&buf->hnode);
 
-	dma_buf_unmap_attachment(buf_tbl.bufq[idx].attachment,
-							buf_tbl.bufq[idx].table,
-							DMA_BIDIRECTIONAL);
+	iosys_map_set_vaddr(&map, (void *)buf->kvaddr);
 
-	dma_buf_detach(buf_tbl.bufq[idx].dma,
-			buf_tbl.bufq[idx].attachment);
-	dma_buf_vunmap(buf_tbl.bufq[idx].dma, &map);
-	dma_buf_put(buf_tbl.bufq[idx].dma);
+	dma_buf_vunmap(buf->dma, &map);
+	dma_buf_unmap_attachment(buf->attachment, buf->table,
+				 DMA_BIDIRECTIONAL);
+	dma_buf_detach(buf->dma, buf->attachment);
+	dma_buf_put(buf->dma);
 	cam_mem_put_bux_idx(idx);
 }
 
+void cam_mem_buf_force_release(int idx)
+{
+	mutex_lock(&buf_tbl.m_lock);
+	__cam_mem_buf_release(idx);
+	mutex_unlock(&buf_tbl.m_lock);
+}
+
+/// Evict idle mappings down to @max entries, buf_tbl.m_lock must be held
+static void cam_mem_lru_trim(unsigned int max)
+{
+	struct cam_mem_buf *buf = NULL;
+
+	while (buf_tbl.idle_cnt > max) {
+		buf = list_first_entry(&buf_tbl.lru, struct cam_mem_buf, lru);
+		__cam_mem_buf_release(buf->bufIdx);
+		buf_tbl.stats.evictions++;
+	}
+}
+
 static int cam_mem_release_all(void)
 {
 	int ret = 0;
 	int i = 0;
 
-	for (i = 0; i < CAM_MEM_BUFQ_MAX; i++) {
-		if (buf_tbl.bitMap[i]) {
-			cam_mem_buf_force_release(i);
-		}
-	}
+	mutex_lock(&buf_tbl.m_lock);
+	for_each_set_bit(i, buf_tbl.bitMap, CAM_MEM_BUFQ_MAX)
+		__cam_mem_buf_release(i);
+	mutex_unlock(&buf_tbl.m_lock);
 
 	return ret;
 }
 
-static int cam_mem_buf_map(unsigned long arg)
+/*
+ * The ISP addresses a buffer through a single base address, so the DMA
+ * mapping must be one contiguous range. Returns its length, or 0 when the
+ * buffer is scattered.
+ */
+static unsigned long cam_mem_contig_len(struct sg_table *table)
+{
+	struct scatterlist *sg = NULL;
+	dma_addr_t next = sg_dma_address(table->sgl);
+	unsigned long len = 0;
+	int i = 0;
+
+	for_each_sgtable_dma_sg(table, sg, i) {
+		if (sg_dma_address(sg) != next)
+			return 0;
+		next += sg_dma_len(sg);
+		len += sg_dma_len(sg);
+	}
+
+	return len;
+}
+
+/// Attach, map and vmap @dmabuf into a new slot, buf_tbl.m_lock must be held
+static int cam_mem_buf_map_new(struct dma_buf *dmabuf, int fd)
 {
 	int ret = 0;
-	struct sg_table *table;
-	//struct device *dev = cam_mem_info->pddev;
-	struct dma_buf *dmabuf;
-	unsigned long phy_addr;
+	int idx = -1;
 	unsigned long size;
-	struct hw_mem_map_cmd map_cmd;
+	struct sg_table *table;
 	struct dma_buf_attachment *attachment;
-	int idx;
-	unsigned long kvaddr;
 	struct iosys_map map;
-	if (copy_from_user(&map_cmd, (void __user *)arg,
-			   sizeof(struct hw_mem_map_cmd))) {
-		LOG(LOG_ERR, "copy_from_user error !\n");
-		return -EINVAL;
+
+	attachment = dma_buf_attach(dmabuf, cam_mem_info->pddev);
+	if (IS_ERR(attachment)) {
+		ret = PTR_ERR(attachment);
+		LOG(LOG_ERR, "Attach failed: %d\n", ret);
+		return ret;
 	}
 
-	idx = cam_mem_get_avaliable_fd_idx(map_cmd.fd);
-	if (idx == -1) {
-		/*not map*/
-		dmabuf = dma_buf_get(map_cmd.fd);
-		if (IS_ERR(dmabuf)) {
-			LOG(LOG_ERR, "DMA-BUF get fd error !\n");
-			return PTR_ERR(dmabuf);
-		}
+	table = dma_buf_map_attachment(attachment, DMA_BIDIRECTIONAL);
+	if (IS_ERR(table)) {
+		ret = PTR_ERR(table);
+		LOG(LOG_ERR, "DMA-BUF map failed,ret:%d\n", ret);
+		goto dma_attach_failed;
+	}
 
-		attachment = dma_buf_attach(dmabuf, cam_mem_info->pddev);
-		if (IS_ERR(attachment)) {
-			ret = PTR_ERR(attachment);
-			LOG(LOG_ERR, "Attach failed: %d\n", ret);
-			goto dma_buf_get_failed;
-		}
+	size = cam_mem_contig_len(table);
+	if (!size) {
+		LOG(LOG_ERR, "DMA-BUF fd %d has %u non contiguous segments\n",
+		    fd, table->nents);
+		ret = -EINVAL;
+		goto dma_map_failed;
+	}
 
-		table = dma_buf_map_attachment(attachment, DMA_BIDIRECTIONAL);
-		if (IS_ERR(table)) {
-			ret = PTR_ERR(table);
-			LOG(LOG_ERR, "DMA-BUF map failed,ret:%d\n", ret);
-			goto dma_attach_failed;
-		}
+	if (dma_buf_vmap(dmabuf, &map)) {
+		LOG(LOG_ERR, "Mapping failed");
+		ret = -EFAULT;
+		goto dma_map_failed;
+	}
+
+	idx = cam_mem_get_avaliable_buf_idx();
+	if (idx < 0 && buf_tbl.idle_cnt) {
+		cam_mem_lru_trim(buf_tbl.idle_cnt - 1);
+		idx = cam_mem_get_avaliable_buf_idx();
+	}
+	if (idx < 0) {
+		ret = -ENOMEM;
+		goto dma_kmap_failed;
+	}
 
-		phy_addr = sg_dma_address(table->sgl);
+	buf_tbl.bufq[idx].dma = dmabuf;
+	buf_tbl.bufq[idx].bufIdx = idx;
+	buf_tbl.bufq[idx].len = size;
+	buf_tbl.bufq[idx].phy_addr = sg_dma_address(table->sgl);
+	buf_tbl.bufq[idx].kvaddr = (uintptr_t)map.vaddr;
+	buf_tbl.bufq[idx].attachment = attachment;
+	buf_tbl.bufq[idx].table = table;
+	buf_tbl.bufq[idx].fd = fd;
+	hash_add(buf_tbl.hash, &buf_tbl.bufq[idx].hnode,
+		 cam_mem_hash_key(dmabuf));
 
-		size = sg_dma_len(table->sgl);
-		if(dma_buf_vmap(dmabuf, &map))
-		{
-			LOG(LOG_ERR, "Mapping failed");
-			ret = -EFAULT;
-			goto dma_kmap_failed;
-		}
+	return idx;
 
-		kvaddr = (uintptr_t)map.vaddr;
+dma_kmap_failed:
+	dma_buf_vunmap(dmabuf, &map);
+dma_map_failed:
+	dma_buf_unmap_attachment(attachment, table, DMA_BIDIRECTIONAL);
+dma_attach_failed:
+	dma_buf_detach(dmabuf, attachment);
 
-		mutex_lock(&buf_tbl.m_lock);
+	return ret;
+}
 
-		idx = cam_mem_get_avaliable_buf_idx();
+/*
+ * Map @dmabuf for the ISP and fill @map_cmd->out, the caller's reference is
+ * consumed. A buffer still cached from an earlier map reuses its slot.
+ */
+static int cam_mem_buf_map_dmabuf(struct dma_buf *dmabuf,
+				  struct hw_mem_map_cmd *map_cmd, bool *is_new)
+{
+	struct cam_mem_buf *buf;
+	ktime_t start_time;
+	int idx;
 
-		buf_tbl.bufq[idx].dma = dmabuf;
-		buf_tbl.bufq[idx].bufIdx = idx;
-		buf_tbl.bufq[idx].len = size;
-		buf_tbl.bufq[idx].phy_addr = phy_addr;
-		buf_tbl.bufq[idx].kvaddr = kvaddr;
-		buf_tbl.bufq[idx].attachment = attachment;
-		buf_tbl.bufq[idx].table = table;
-		buf_tbl.bufq[idx].fd = map_cmd.fd;
-		buf_tbl.bufq[idx].table = table;
-
-		mutex_unlock(&buf_tbl.m_lock);
+	start_time = ktime_get();
+	*is_new = false;
+
+	mutex_lock(&buf_tbl.m_lock);
+
+	idx = cam_mem_lookup_idx(dmabuf);
+	if (idx >= 0) {
+		/* alreay mapped, the slot keeps its own reference */
+		dma_buf_put(dmabuf);
+		buf = &buf_tbl.bufq[idx];
+		buf->fd = map_cmd->fd;
+		if (!list_empty(&buf->lru)) {
+			list_del_init(&buf->lru);
+			buf_tbl.idle_cnt--;
+		}
+		buf_tbl.stats.hits++;
+		buf_tbl.stats.hit_ns +=
+			ktime_to_ns(ktime_sub(ktime_get(), start_time));
 	} else {
-	/*alreay map*/
-		phy_addr = buf_tbl.bufq[idx].phy_addr;
-		kvaddr = buf_tbl.bufq[idx].kvaddr;
+		idx = cam_mem_buf_map_new(dmabuf, map_cmd->fd);
+		if (idx < 0) {
+			mutex_unlock(&buf_tbl.m_lock);
+			dma_buf_put(dmabuf);
+			return idx;
+		}
+		buf = &buf_tbl.bufq[idx];
+		*is_new = true;
+		buf_tbl.stats.misses++;
+		buf_tbl.stats.miss_ns +=
+			ktime_to_ns(ktime_sub(ktime_get(), start_time));
 	}
 
-	/// copy to user
-	map_cmd.out.phyAddr = phy_addr;
-	map_cmd.out.kvAddr = kvaddr;
-	map_cmd.out.kBufhandle = idx;
+	map_cmd->out.phyAddr = buf->phy_addr;
+	map_cmd->out.kvAddr = buf->kvaddr;
+	map_cmd->out.kBufhandle = idx;
+
+	mutex_unlock(&buf_tbl.m_lock);
+
+	return idx;
+}
+
+static int cam_mem_buf_map(unsigned long arg)
+{
+	struct dma_buf *dmabuf;
+	struct hw_mem_map_cmd map_cmd;
+	bool is_new = false;
+	int idx;
+
+	if (copy_from_user(&map_cmd, (void __user *)arg,
+			   sizeof(struct hw_mem_map_cmd))) {
+		LOG(LOG_ERR, "copy_from_user error !\n");
+		return -EINVAL;
+	}
+
+	dmabuf = dma_buf_get(map_cmd.fd);
+	if (IS_ERR(dmabuf)) {
+		LOG(LOG_ERR, "DMA-BUF get fd error !\n");
+		return PTR_ERR(dmabuf);
+	}
 
+	idx = cam_mem_buf_map_dmabuf(dmabuf, &map_cmd, &is_new);
+	if (idx < 0)
+		return idx;
+
+	/// copy to user
 	if (copy_to_user((void __user *)arg, &map_cmd,
 			 sizeof(struct hw_mem_map_cmd))) {
 		LOG(LOG_ERR, "CAM_HW_BUFFER_MAP :copy_from_user error !\n");
-		ret = -EINVAL;
-		goto dma_kmap_failed;
+		if (is_new)
+			cam_mem_buf_force_release(idx);
+		return -EINVAL;
 	}
 
-	return ret;
+	return 0;
+}
 
-dma_kmap_failed:
-	dma_buf_unmap_attachment(attachment, table, DMA_BIDIRECTIONAL);
-dma_attach_failed:
-	dma_buf_detach(dmabuf, attachment);
-dma_buf_get_failed:
-	dma_buf_put(dmabuf);
+/// Release the mapping in slot @idx, it stays cached until the LRU evicts it
+static int cam_mem_buf_unmap_idx(int idx)
+{
+	struct cam_mem_buf *buf;
+	int ret = 0;
+
+	mutex_lock(&buf_tbl.m_lock);
+	if (idx >= 0 && idx < CAM_MEM_BUFQ_MAX &&
+	    test_bit(idx, buf_tbl.bitMap)) {
+		buf = &buf_tbl.bufq[idx];
+		if (list_empty(&buf->lru)) {
+			list_add_tail(&buf->lru, &buf_tbl.lru);
+			buf_tbl.idle_cnt++;
+		}
+		cam_mem_lru_trim(mem_cache_max);
+	} else {
+		LOG(LOG_ERR, "error buffer idx");
+		ret = -EINVAL;
+	}
+	mutex_unlock(&buf_tbl.m_lock);
 
 	return ret;
 }
 
 static int cam_mem_buf_release(unsigned long arg)
 {
-	int ret = 0;
-	int idx = 0;
 	struct hw_mem_release_cmd release_cmd;
-	struct iosys_map map;
-	struct sg_table *table;
 
 	if (copy_from_user(&release_cmd, (void __user *)arg,
 				sizeof(struct hw_mem_release_cmd))) {
 		LOG(LOG_ERR, "CAM_HW_BUFFER_MAP :copy_from_user error !");
-		ret = -EINVAL;
+		return -EINVAL;
 	}
 
-	idx = release_cmd.kBufhandle;
-	map.is_iomem = false;
-	map.vaddr = (void *)buf_tbl.bufq[idx].kvaddr;
-	table = buf_tbl.bufq[idx].table;
-	if (idx >= 0) {
-		dma_buf_unmap_attachment(buf_tbl.bufq[idx].attachment,
-					buf_tbl.bufq[idx].table,
-					DMA_BIDIRECTIONAL);
-
-		dma_buf_detach(buf_tbl.bufq[idx].dma,
-				buf_tbl.bufq[idx].attachment);
-		dma_buf_vunmap(buf_tbl.bufq[idx].dma, &map);
-		dma_buf_put(buf_tbl.bufq[idx].dma);
-		cam_mem_put_bux_idx(idx);
-	} else {
-		LOG(LOG_ERR, "error buffer idx");
-		ret = -EINVAL;
+	return cam_mem_buf_unmap_idx(release_cmd.kBufhandle);
+}
+
+static int cam_mem_cache_show(struct seq_file *m, void *v)
+{
+	mutex_lock(&buf_tbl.m_lock);
+	seq_printf(m, "mapped %u idle %u max %u\n",
+		   bitmap_weight(buf_tbl.bitMap, CAM_MEM_BUFQ_MAX),
+		   buf_tbl.idle_cnt, mem_cache_max);
+	seq_printf(m, "hits %llu avg_ns %llu\n", buf_tbl.stats.hits,
+		   buf_tbl.stats.hits ?
+			   div64_u64(buf_tbl.stats.hit_ns, buf_tbl.stats.hits) :
+			   0);
+	seq_printf(m, "misses %llu avg_ns %llu\n", buf_tbl.stats.misses,
+		   buf_tbl.stats.misses ?
+			   div64_u64(buf_tbl.stats.miss_ns,
+				     buf_tbl.stats.misses) :
+			   0);
+	seq_printf(m, "evictions %llu\n", buf_tbl.stats.evictions);
+	mutex_unlock(&buf_tbl.m_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(cam_mem_cache);
+
+/*
+ * Closing and reopening the camera within this delay keeps the block
+ * powered, so back to back sessions don't pay for a power cycle.
+ */
+static uint ispmem_autosuspend_ms = 3000;
+module_param(ispmem_autosuspend_ms, uint, 0444);
+MODULE_PARM_DESC(ispmem_autosuspend_ms, "Runtime PM autosuspend delay of the isp block");
+
+#define ISPMEM_RPM_LAT_BUCKETS 16
+
+/* runtime resume latency, log2 buckets in us */
+struct ispmem_rpm_stats {
+	u64 resumes;
+	u64 resets;
+	u64 hist[ISPMEM_RPM_LAT_BUCKETS];
+	u64 max_ns;
+	u32 last_restored;
+};
+
+static struct ispmem_rpm_stats g_rpm_stats;
+/* the first resume after probe and error recovery cycle the resets */
+static bool g_isp_need_reset = true;
+
+/**
+ * @description: ask the next runtime resume for a full reset cycle, used
+ *               on error recovery
+ * @return {*}
+ */
+void armcb_ispmem_request_reset(void)
+{
+	WRITE_ONCE(g_isp_need_reset, true);
+}
+
+static void ispmem_rpm_record(bool reset, int restored, u64 start)
+{
+	u64 delta = ktime_get_ns() - start;
+	u64 us = div_u64(delta, NSEC_PER_USEC);
+	int bucket = us ? fls64(us) : 0;
+
+	g_rpm_stats.resumes++;
+	if (reset)
+		g_rpm_stats.resets++;
+	g_rpm_stats.hist[min(bucket, ISPMEM_RPM_LAT_BUCKETS - 1)]++;
+	g_rpm_stats.max_ns = max(g_rpm_stats.max_ns, delta);
+	g_rpm_stats.last_restored = restored;
+	trace_armcb_isp_rpm_resume(reset, restored, delta);
+}
+
+static int ispmem_rpm_show(struct seq_file *s, void *unused)
+{
+	int i = 0;
+
+	seq_printf(s, "autosuspend_ms: %u\n", ispmem_autosuspend_ms);
+	seq_printf(s, "resumes:        %llu\n", g_rpm_stats.resumes);
+	seq_printf(s, "resets:         %llu\n", g_rpm_stats.resets);
+	seq_printf(s, "last_restored:  %u\n", g_rpm_stats.last_restored);
+	seq_printf(s, "max_us:         %llu\n",
+		   div_u64(g_rpm_stats.max_ns, NSEC_PER_USEC));
+	seq_puts(s, "resume latency:\n");
+	for (i = 0; i < ISPMEM_RPM_LAT_BUCKETS; i++) {
+		if (i)
+			seq_printf(s, "  >= %6lu us: %llu\n", 1UL << (i - 1),
+				   g_rpm_stats.hist[i]);
+		else
+			seq_printf(s, "  <  %6lu us: %llu\n", 1UL << i,
+				   g_rpm_stats.hist[i]);
 	}
 
 	return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(ispmem_rpm);
+
+/// created by the first probe, removed with the device
+static struct dentry *ispmem_debugfs_cache;
+static struct dentry *ispmem_debugfs_rpm;
 
 static u32 Global_PowerDone;
 int armcb_isp_power(int enable, unsigned long arg)
@@ -818,7 +1373,8 @@ int armcb_isp_power(int enable, unsigned long arg)
 
 	} else if ((enable == 0) && (Global_PowerDone == 1)) {
 		Global_PowerDone = 0;
-		pm_runtime_put(cam_mem_info->pddev);
+		pm_runtime_mark_last_busy(cam_mem_info->pddev);
+		pm_runtime_put_autosuspend(cam_mem_info->pddev);
 	}
 	return 0;
 }
@@ -839,8 +1395,9 @@ static long ispmem_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		armcb_isp_power(0, arg);
 		break;
 	case CMEM_ALLOCATE:
+	case CMEM_ALLOCATE_CACHED:
 		mutex_lock(&cmamem_dev.cmamem_lock);
-		res = ispmem_cma_alloc(filp, arg);
+		res = ispmem_cma_alloc(filp, arg, cmd == CMEM_ALLOCATE_CACHED);
 		if (res < 0)
 			LOG(LOG_ERR, "alloc error!");
 		mutex_unlock(&cmamem_dev.cmamem_lock);
@@ -864,6 +1421,14 @@ static long ispmem_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		res = cam_mem_buf_release(arg);
 		break;
 	}
+	case CMEM_SYNC_BEGIN:
+	case CMEM_SYNC_END:
+		res = ispmem_cma_sync(arg, cmd == CMEM_SYNC_BEGIN);
+		break;
+	case CMEM_BENCH:
+		/* works on a private block, no need to stall allocations */
+		res = ispmem_cma_bench(arg);
+		break;
 #ifdef CONFIG_ARENA_FPGA_PLATFORM
 	case ARMCB_VIDIOC_ISP_XDMA:
 		res = ispmem_xdma((void *)arg);
@@ -1163,6 +1728,9 @@ static int armcb_ispmem_probe(struct platform_device *pdev)
 			LOG(LOG_WARN, "failed to ioremap axi register region.");
 		}
 	}
+
+	system_dma_init(&pdev->dev,
+			platform_get_irq_byname_optional(pdev, "cdma"));
 #endif
 #endif
 
@@ -1227,12 +1795,25 @@ static int armcb_ispmem_probe(struct platform_device *pdev)
 	cmamem_status.id_count = -1;
 	cmamem_status.vir_addr = 0;
 	cmamem_status.phy_addr = 0;
+	cmamem_status.block = NULL;
 
 	mutex_init(&cma_buf_ctl.m_lock);
 	ispmem_cma_mem_init();
 
 	mutex_init(&buf_tbl.m_lock);
 	res = cam_mem_tbl_init();
+	if (!ispmem_debugfs_cache)
+		ispmem_debugfs_cache =
+			debugfs_create_file("mem_map_cache", 0444,
+					    system_debugfs_root(), NULL,
+					    &cam_mem_cache_fops);
+	if (!ispmem_debugfs_rpm)
+		ispmem_debugfs_rpm =
+			debugfs_create_file("rpm_resume", 0444,
+					    system_debugfs_root(), NULL,
+					    &ispmem_rpm_fops);
+	pm_runtime_set_autosuspend_delay(dev, ispmem_autosuspend_ms);
+	pm_runtime_use_autosuspend(dev);
 	pm_runtime_enable(dev);
 
 	return res;
@@ -1244,7 +1825,14 @@ static int armcb_ispmem_remove(struct platform_device *pdev)
 	int ret = 0;
 
 	ispmem_cma_free_all();
+	ispmem_pool_drain();
+	idr_destroy(&cma_buf_ctl.idr);
 	ret = cam_mem_release_all();
+	debugfs_remove(ispmem_debugfs_cache);
+	debugfs_remove(ispmem_debugfs_rpm);
+	ispmem_debugfs_cache = NULL;
+	ispmem_debugfs_rpm = NULL;
+	pm_runtime_dont_use_autosuspend(dev);
 	pm_runtime_disable(dev);
 	mutex_destroy(&buf_tbl.m_lock);
 	misc_deregister(&ispmem_misc);
@@ -1276,7 +1864,7 @@ static int armcb_ispmem_dev_rpm_suspend(struct device *dev)
 
 	clk_disable_unprepare(cam_mem_info->isp_sclk);
 	clk_disable_unprepare(cam_mem_info->isp_aclk);
-	mdelay(1);
+	usleep_range(1000, 1100);
 	reset_control_assert(cam_mem_info->isp_gdcreset);
 	reset_control_assert(cam_mem_info->isp_hreset);
 	reset_control_assert(cam_mem_info->isp_sreset);
@@ -1285,8 +1873,24 @@ static int armcb_ispmem_dev_rpm_suspend(struct device *dev)
 	return 0;
 }
 
+/*
+ * Suspend leaves the block in reset, so a plain resume only needs the clocks
+ * and the deassert before the register shadow is replayed. The assert cycle
+ * is kept for the first resume and for error recovery, where the shadow is
+ * dropped instead of replayed: it holds the configuration the error isr
+ * reset the block away from, and userspace configures it again on the
+ * error event.
+ *
+ * The CSI, DPHY and CSIDMA blocks are not in the shadow. Their clocks and
+ * resets are not touched here, they are only switched by the power
+ * requests of the command lists (cix_set_csi_clk_rate() and friends), and
+ * the list powering them up again is the one programming them.
+ */
 static int armcb_ispmem_dev_rpm_resume(struct device *dev)
 {
+	bool reset = READ_ONCE(g_isp_need_reset);
+	u64 start = ktime_get_ns();
+	int restored = 0;
 	int ret;
 
 	if (!cam_mem_info->isp_sreset || !cam_mem_info->isp_areset ||
@@ -1304,17 +1908,25 @@ static int armcb_ispmem_dev_rpm_resume(struct device *dev)
 		LOG(LOG_ERR, "enable isp_aclk error");
 		return ret;
 	}
-	mdelay(1);
-	reset_control_assert(cam_mem_info->isp_sreset);
-	reset_control_assert(cam_mem_info->isp_areset);
-	reset_control_assert(cam_mem_info->isp_hreset);
-	reset_control_assert(cam_mem_info->isp_gdcreset);
-	mdelay(1);
+	usleep_range(1000, 1100);
+	if (reset) {
+		reset_control_assert(cam_mem_info->isp_sreset);
+		reset_control_assert(cam_mem_info->isp_areset);
+		reset_control_assert(cam_mem_info->isp_hreset);
+		reset_control_assert(cam_mem_info->isp_gdcreset);
+		usleep_range(1000, 1100);
+		WRITE_ONCE(g_isp_need_reset, false);
+		armcb_isp_shadow_clear();
+	}
 	reset_control_deassert(cam_mem_info->isp_sreset);
 	reset_control_deassert(cam_mem_info->isp_areset);
 	reset_control_deassert(cam_mem_info->isp_hreset);
 	reset_control_deassert(cam_mem_info->isp_gdcreset);
 
+	if (!reset)
+		restored = armcb_isp_shadow_restore();
+	ispmem_rpm_record(reset, restored, start);
+
 	return 0;
 }
 #endif
@@ -1401,3 +2013,7 @@ void armcb_cam_io_drv_destroy(void)
 			(struct platform_driver *)g_instance);
 }
 #endif
+
+#ifdef ARMCB_ISP_KUNIT_TEST
+#include "armcb_camera_io_drv_test.c"
+#endif
@@ -19,8 +19,11 @@
 #include "types_utils.h"
 #include <linux/clk.h>
 #include <linux/dma-buf.h>
+#include <linux/hashtable.h>
+#include <linux/idr.h>
 #include <linux/init.h>
 #include <linux/ioctl.h>
+#include <linux/kref.h>
 #include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/module.h>
@@ -33,6 +36,7 @@
 
 #define DISP_BUFFER_SIZE_1080P (2200 * 1125 * 4 * 3)
 #define CAM_MEM_BUFQ_MAX 1024
+#define CAM_MEM_HASH_BITS 7
 #define ISP_PLL_CLK 1200
 
 enum sys_ispmem_type {
@@ -105,21 +109,24 @@ struct cmamem_block {
 	unsigned char name[10];
 	unsigned char is_use_buffer;
 	unsigned char is_busy;
+	bool cached; /// cacheable pages, needs CMEM_SYNC_BEGIN/END
 	int id;
 	unsigned int offset;
 	unsigned int len;
 	unsigned long phy_addr;
 	unsigned long usr_addr;
 	void *kernel_addr;
-	struct list_head memqueue_list;
+	struct page *page; /// first page of a cached block
+	struct kref ref; /// held by the allocation and by each vma mapping it
+	struct list_head memqueue_list; /// cma_mem_ctl.pool link while idle
 	struct device_dma_parameters dma_parms;
 };
 
 struct cma_mem_ctl {
-	int buf_count;
 	struct mutex m_lock;
-	unsigned char bitMap[CAM_MEM_BUFQ_MAX];
-	struct cmamem_block *bufq[CAM_MEM_BUFQ_MAX];
+	struct idr idr; /// id -> allocated cmamem_block
+	struct list_head pool[2]; /// idle blocks, [0] coherent, [1] cached
+	unsigned long pool_bytes;
 };
 
 struct current_status {
@@ -127,6 +134,7 @@ struct current_status {
 	int id_count;
 	void *vir_addr;
 	dma_addr_t phy_addr;
+	struct cmamem_block *block; /// block the next mmap() maps
 };
 
 struct cam_mem_buf {
@@ -140,13 +148,26 @@ struct cam_mem_buf {
 	unsigned long kvaddr; /// kernel virtual address
 	struct dma_buf_attachment *attachment;
 	struct sg_table *table;
+	struct hlist_node hnode; /// cam_buf_table.hash link, keyed by inode
+	struct list_head lru; /// cam_buf_table.lru link while released
+};
+
+struct cam_mem_cache_stats {
+	u64 hits;
+	u64 misses;
+	u64 evictions;
+	u64 hit_ns;
+	u64 miss_ns;
 };
 
 struct cam_buf_table {
 	struct mutex m_lock;
-	/// @TODO use bitmap replace
-	unsigned char bitMap[CAM_MEM_BUFQ_MAX];
+	DECLARE_BITMAP(bitMap, CAM_MEM_BUFQ_MAX);
 	struct cam_mem_buf bufq[CAM_MEM_BUFQ_MAX];
+	DECLARE_HASHTABLE(hash, CAM_MEM_HASH_BITS);
+	struct list_head lru;
+	unsigned int idle_cnt;
+	struct cam_mem_cache_stats stats;
 };
 
 #define XST_SUCCESS 0L
@@ -192,6 +213,7 @@ void __iomem *armcb_apb2_get_addr_base(void);
 void __iomem *armcb_spi_get_addr_base(void);
 
 #ifdef ARMCB_CAM_KO
+void armcb_ispmem_request_reset(void);
 void *armcb_get_cam_io_drv_instance(void);
 void armcb_cam_io_drv_destroy(void);
 #endif
@@ -334,6 +334,30 @@ struct mem_block {
 	void *kernel_addr;
 };
 
+#define CMEM_SYNC_READ (1 << 0)
+#define CMEM_SYNC_WRITE (1 << 1)
+#define CMEM_SYNC_RW (CMEM_SYNC_READ | CMEM_SYNC_WRITE)
+
+/// range of a CMEM_ALLOCATE_CACHED block the CPU is about to access
+struct mem_sync {
+	int id;
+	unsigned int flags; /// CMEM_SYNC_READ and/or CMEM_SYNC_WRITE
+	unsigned int offset;
+	unsigned int len;
+};
+
+/// CMEM_BENCH: in len/iters/cached, out timings of one block
+struct mem_bench {
+	unsigned int len;
+	unsigned int iters;
+	unsigned int cached;
+	unsigned int reserved;
+	unsigned long long alloc_ns;
+	unsigned long long pool_alloc_ns;
+	unsigned long long free_ns;
+	unsigned long long copy_mbps;
+};
+
 struct armcb_isp_stat_isr_info {
 	unsigned int stat_type;
 	unsigned int sensor_id;
@@ -440,6 +464,10 @@ struct hw_mem_release_cmd {
 #define CAM_HW_BUFFER_RELEASE \
 	_IOWR(CMEM_IOCTL_MAGIC, 5, struct hw_mem_release_cmd)
 #define CMEM_CMA_IMPORT _IOWR(CMEM_IOCTL_MAGIC, 6, struct mem_block)
+#define CMEM_ALLOCATE_CACHED _IOWR(CMEM_IOCTL_MAGIC, 7, struct mem_block)
+#define CMEM_SYNC_BEGIN _IOW(CMEM_IOCTL_MAGIC, 8, struct mem_sync)
+#define CMEM_SYNC_END _IOW(CMEM_IOCTL_MAGIC, 9, struct mem_sync)
+#define CMEM_BENCH _IOWR(CMEM_IOCTL_MAGIC, 10, struct mem_bench)
 
 #define ARMCB_VIDIOC_ISP_DMA_COPY 194
 #define ARMCB_VIDIOC_SYS_BUS_TEST 196
@@ -22,6 +22,13 @@
 #include "system_logger.h"
 
 #include "cix_vi_hw.h"
+#include <linux/bsearch.h>
+#include <linux/io.h>
+#include <linux/property.h>
+#include <linux/uaccess.h>
+
+#define CREATE_TRACE_POINTS
+#include "isp_hw_trace.h"
 
 #ifdef LOG_MODULE
 #undef LOG_MODULE
@@ -30,14 +37,38 @@
 
 #define SOF_TIMEOUT (2000)
 
-static unsigned char is_stream_on_list_init;
-static unsigned char is_stream_off_list_init;
-static unsigned char is_stream_powerdown_list_init;
+#define ISP_HW_CMD_ARENA_MIN (16 * 1024)
+#define ISP_HW_CMD_ENTRY_MIN (32)
+
+/*
+ * Deferred streamon/streamoff/powerdown cmds. They are copied back to back
+ * into an arena which keeps its capacity once the list has been applied, so
+ * after the first session queueing and replaying a list doesn't allocate.
+ */
+struct isp_hw_cmd_list {
+	u8 *arena;
+	size_t arena_size;
+	size_t arena_used;
+	struct isp_hw_cmd_buf *entries;
+	unsigned int entry_cnt;
+	unsigned int entry_max;
+};
+
 static unsigned int hw_apply_entry_cnt;
 static unsigned int hw_apply_cam_flag;
-static struct list_head streamon_list;
-static struct list_head streamoff_list;
-static struct list_head powerdown_list;
+static struct isp_hw_cmd_list streamon_list;
+static struct isp_hw_cmd_list streamoff_list;
+static struct isp_hw_cmd_list powerdown_list;
+
+/*
+ * Default auto-increment burst length in data bytes for sensors without a
+ * "cix,i2c-max-burst" property. 0 keeps one register per I2C message; the
+ * messages are still packed into a single i2c_transfer().
+ */
+static uint i2c_max_burst;
+module_param(i2c_max_burst, uint, 0644);
+MODULE_PARM_DESC(i2c_max_burst,
+		 "Default I2C auto-increment burst length in data bytes");
 
 static unsigned int count_bits(unsigned int n)
 {
@@ -50,11 +81,26 @@ static unsigned int count_bits(unsigned int n)
 	return count;
 }
 
+static unsigned int armcb_i2c_max_burst(struct i2c_client *client)
+{
+	u32 max_burst = i2c_max_burst;
+
+	device_property_read_u32(&client->dev, "cix,i2c-max-burst", &max_burst);
+
+	return max_burst;
+}
+
 /// Apply I2C cmd
 static int armcb_i2c_apply(struct cmd_buf *cmd, void *clinet)
 {
 	int i = 0;
 	int ret = 0;
+	int err = 0;
+	int first = 0;
+	int wr_start = -1;
+	ktime_t start_time;
+	unsigned int max_burst = 0;
+	struct armcb_i2c_burst_stats stats = { 0 };
 	struct cmd_i2c_setting *i2c_settings = NULL;
 
 	if (!cmd || !clinet || 0 == cmd->cmd_cnt) {
@@ -63,6 +109,8 @@ static int armcb_i2c_apply(struct cmd_buf *cmd, void *clinet)
 		return -EINVAL;
 	}
 
+	start_time = ktime_get();
+	max_burst = armcb_i2c_max_burst((struct i2c_client *)clinet);
 	i2c_settings = cmd->settings.i2c;
 
 	for (i = 0; i < cmd->cmd_cnt; i++) {
@@ -93,15 +141,10 @@ static int armcb_i2c_apply(struct cmd_buf *cmd, void *clinet)
 				ret = -EINVAL;
 				break;
 			}
-			ret = armcb_i2c_register_write(
-				(struct i2c_client *)clinet, &i2c_settings[i]);
-			if (ret < 0) {
-				LOG(LOG_ERR,
-				    "I2C Write index[%d] reg_addr:0x%x reg_data:0x%x failed, ret = %d",
-				    i, i2c_settings[i].reg_addr,
-				    i2c_settings[i].val, ret);
-				break;
-			}
+
+			/* writes are queued and flushed as bursts */
+			if (wr_start < 0)
+				wr_start = i;
 
 			LOG(LOG_DEBUG,
 			    "I2C Write index[%d]  slave_addr 0x%x ,reg_addr:0x%x reg_data:0x%x "
@@ -110,6 +153,21 @@ static int armcb_i2c_apply(struct cmd_buf *cmd, void *clinet)
 			    i2c_settings[i].reg_addr, i2c_settings[i].val,
 			    i2c_settings[i].channel, i2c_settings[i].delay_us);
 		} else if (i2c_settings[i].direct == DRV_DIRECTION_READ) {
+			if (wr_start >= 0) {
+				first = wr_start;
+				wr_start = -1;
+				ret = armcb_i2c_burst_write(
+					(struct i2c_client *)clinet,
+					&i2c_settings[first], i - first,
+					max_burst, &stats);
+				if (ret < 0) {
+					LOG(LOG_ERR,
+					    "I2C Write index[%d..%d] failed, ret = %d",
+					    first, i - 1, ret);
+					break;
+				}
+			}
+
 			ret = armcb_i2c_register_read(
 				(struct i2c_client *)clinet, &i2c_settings[i]);
 			if (ret < 0 && CMD_TYPE_PROBE != cmd->cmd_type) {
@@ -148,6 +206,22 @@ static int armcb_i2c_apply(struct cmd_buf *cmd, void *clinet)
 		}
 	}
 
+	/* flush the trailing writes, even when a later entry was rejected */
+	if (wr_start >= 0) {
+		err = armcb_i2c_burst_write((struct i2c_client *)clinet,
+					    &i2c_settings[wr_start],
+					    i - wr_start, max_burst, &stats);
+		if (err < 0) {
+			LOG(LOG_ERR, "I2C Write index[%d..%d] failed, ret = %d",
+			    wr_start, i - 1, err);
+			ret = err;
+		}
+	}
+
+	trace_armcb_i2c_apply(cmd->static_info.camId, i, stats.msgs,
+			      stats.xfers,
+			      ktime_to_ns(ktime_sub(ktime_get(), start_time)));
+
 	return ret;
 }
 
@@ -235,320 +309,173 @@ static int armcb_spi_apply(struct cmd_buf *cmd, void *clinet)
 	return ret;
 }
 
-/// Apply AHB cmd
-static int armcb_ahb_apply(struct cmd_buf *cmd, void *clinet)
+/*
+ * AHB register dispatch table, sorted by base address and searched with
+ * bsearch(). Accessors are called with (reg_addr - sub), addresses outside
+ * every range belong to the isp block. Ranges with an iomem getter take
+ * batched writel_relaxed() for runs of consecutive writes.
+ */
+struct armcb_ahb_range {
+	u32 base;
+	u32 end;
+	u32 sub;
+	void (*write)(u32 addr, u32 val);
+	u32 (*read)(u32 addr);
+	void __iomem *(*iomem)(void);
+	void (*shadow)(u32 addr, u32 val); /// records batched writes
+};
+
+#ifdef CONFIG_ARENA_FPGA_PLATFORM
+static void armcb_vdma_write(u32 offset, u32 val)
+{
+	VDMA_Write_Int32(VDMA_REG_BASE, offset, val);
+}
+
+static u32 armcb_vdma_read(u32 offset)
+{
+	return VDMA_Read_Int32(VDMA_REG_BASE, offset);
+}
+#endif
+
+static const struct armcb_ahb_range armcb_ahb_ranges[] = {
+#ifdef ARMCB_CAM_AHB
+	{ AHB_CSIRCSU0_REG_BASE, AHB_CSIRCSU0_REG_END, 0,
+	  cix_ahb_csircsu_write_reg, cix_ahb_csircsu_read_reg, NULL },
+	{ AHB_CSI0_REG_BASE, AHB_CSI1_REG_END, 0,
+	  cix_ahb_csi_write_reg, cix_ahb_csi_read_reg, NULL },
+	{ AHB_DPHY0_REG_BASE, AHB_DPHY0_REG_END, 0,
+	  cix_ahb_dphy_write_reg, cix_ahb_dphy_read_reg, NULL },
+	{ AHB_CSIDMA0_REG_BASE, AHB_CSIDMA1_REG_END, 0,
+	  cix_ahb_csidma_write_reg, cix_ahb_csidma_read_reg, NULL },
+	{ AHB_CSIRCSU1_REG_BASE, AHB_CSIRCSU1_REG_END, 0,
+	  cix_ahb_csircsu_write_reg, cix_ahb_csircsu_read_reg, NULL },
+	{ AHB_CSI2_REG_BASE, AHB_CSI3_REG_END, 0,
+	  cix_ahb_csi_write_reg, cix_ahb_csi_read_reg, NULL },
+	{ AHB_DPHY1_REG_BASE, AHB_DPHY1_REG_END, 0,
+	  cix_ahb_dphy_write_reg, cix_ahb_dphy_read_reg, NULL },
+	{ AHB_CSIDMA2_REG_BASE, AHB_CSIDMA3_REG_END, 0,
+	  cix_ahb_csidma_write_reg, cix_ahb_csidma_read_reg, NULL },
+	{ AHB_PMCTRL_RES_REG_BASE, AHB_PMCTRL_RES_REG_END,
+	  AHB_PMCTRL_RES_REG_BASE, armcb_ahb_pmctrl_res_write_reg,
+	  armcb_ahb_pmctrl_res_read_reg, NULL },
+	/* not real registers, they carry clock/power requests (write only) */
+	{ DPHY_POWER_BASE, DPHY_POWER_END, 0, cix_enable_dphy_clk, NULL, NULL },
+	{ CSI_POWER_BASE, CSI_POWER_END, 0, cix_set_csi_clk_rate, NULL, NULL },
+	{ CSIDMA_POWER_BASE, CSIDMA_POWER_END, 0, cix_enable_csidma_clk, NULL,
+	  NULL },
+	{ ISP_GDC_REG_BASE, U32_MAX, ISP_GDC_REG_BASE, armcb_isp_write_reg2,
+	  armcb_isp_read_reg2, armcb_isp_get_reg_base2, armcb_isp_shadow_reg2 },
+#elif defined(CONFIG_ARENA_FPGA_PLATFORM)
+	{ APB2_REG_BASE, VDMA_REG_BASE - 1, APB2_REG_BASE,
+	  armcb_apb2_write_reg, armcb_apb2_read_reg, NULL },
+	{ VDMA_REG_BASE, ISP_GDC_REG_BASE - 1, VDMA_REG_BASE,
+	  armcb_vdma_write, armcb_vdma_read, NULL },
+	{ ISP_GDC_REG_BASE, XPAR_AXI_CDMA_0_BASEADDR - 1, ISP_GDC_REG_BASE,
+	  armcb_isp_write_reg2, armcb_isp_read_reg2, armcb_isp_get_reg_base2,
+	  armcb_isp_shadow_reg2 },
+	{ XPAR_AXI_CDMA_0_BASEADDR, U32_MAX, XPAR_AXI_CDMA_0_BASEADDR,
+	  CDMA_Write_Int32, CDMA_Read_Int32, NULL },
+#else
+	{ APB2_REG_BASE, U32_MAX, APB2_REG_BASE, armcb_apb2_write_reg,
+	  armcb_apb2_read_reg, NULL },
+#endif
+};
+
+static const struct armcb_ahb_range armcb_ahb_isp_range = {
+	ISP_REG_BASE, U32_MAX, ISP_REG_BASE, armcb_isp_write_reg,
+	armcb_isp_read_reg, armcb_isp_get_reg_base, armcb_isp_shadow_reg
+};
+
+static int armcb_ahb_range_cmp(const void *key, const void *elt)
+{
+	u32 addr = *(const u32 *)key;
+	const struct armcb_ahb_range *range = elt;
+
+	if (addr < range->base)
+		return -1;
+	if (addr > range->end)
+		return 1;
+	return 0;
+}
+
+static const struct armcb_ahb_range *armcb_ahb_lookup(u32 addr)
+{
+	const struct armcb_ahb_range *range = NULL;
+
+	range = bsearch(&addr, armcb_ahb_ranges, ARRAY_SIZE(armcb_ahb_ranges),
+			sizeof(armcb_ahb_ranges[0]), armcb_ahb_range_cmp);
+
+	return range ? range : &armcb_ahb_isp_range;
+}
+
+static bool armcb_ahb_read(const struct cmd_ahb_setting *setting, u32 *val)
+{
+	const struct armcb_ahb_range *range =
+		armcb_ahb_lookup(setting->reg_addr);
+
+	if (!range->read) {
+		LOG(LOG_ERR, "reg_addr 0x%x is write only", setting->reg_addr);
+		return false;
+	}
+
+	*val = range->read(setting->reg_addr - range->sub);
+	return true;
+}
+
+/*
+ * Write the run of settings starting at @start that hit the same block.
+ * Memory mapped blocks get a single barrier up front followed by relaxed
+ * writes, which the device sees in program order. Returns the run length.
+ */
+static int armcb_ahb_write_run(const struct cmd_ahb_setting *settings,
+			       int start, int cnt)
+{
+	const struct armcb_ahb_range *range =
+		armcb_ahb_lookup(settings[start].reg_addr);
+	void __iomem *base = range->iomem ? range->iomem() : NULL;
+	int i = start;
+
+	if (!base) {
+		range->write(settings[i].reg_addr - range->sub,
+			     settings[i].val);
+		return 1;
+	}
+
+	/* order earlier normal memory writes (buffers, tables) before the run */
+	wmb();
+	do {
+		writel_relaxed(settings[i].val,
+			       base + (settings[i].reg_addr - range->sub));
+		if (range->shadow)
+			range->shadow(settings[i].reg_addr - range->sub,
+				      settings[i].val);
+		i++;
+	} while (i < cnt && settings[i].direct == DRV_DIRECTION_WRITE &&
+		 armcb_ahb_lookup(settings[i].reg_addr) == range);
+
+	return i - start;
+}
+
+static int armcb_ahb_apply_settings(struct cmd_ahb_setting *ahb_settings,
+				    int cnt)
 {
 	int i = 0;
 	int ret = 0;
-	struct cmd_ahb_setting *ahb_settings = NULL;
 	unsigned int delay_us = 0;
 	unsigned int expected_val = 0;
 
-	if (!cmd || !clinet || !cmd->cmd_cnt) {
-		LOG(LOG_ERR, "input parameters is invalid, %p %p %d", cmd,
-		    clinet, cmd->cmd_cnt);
-		return -EINVAL;
-	}
-
-	ahb_settings = cmd->settings.ahb;
-
-	for (i = 0; i < cmd->cmd_cnt; i++) {
+	while (i < cnt) {
 		if (ahb_settings[i].direct == DRV_DIRECTION_WRITE) {
-#ifdef CONFIG_ARENA_FPGA_PLATFORM
-			if (ahb_settings[i].reg_addr >=
-			    XPAR_AXI_CDMA_0_BASEADDR)
-				CDMA_Write_Int32(
-					ahb_settings[i].reg_addr -
-						XPAR_AXI_CDMA_0_BASEADDR,
-					ahb_settings[i].val);
-			else if (ahb_settings[i].reg_addr >= ISP_GDC_REG_BASE)
-				armcb_isp_write_reg2(ahb_settings[i].reg_addr -
-							     ISP_GDC_REG_BASE,
-						     ahb_settings[i].val);
-			else if (ahb_settings[i].reg_addr >= VDMA_REG_BASE)
-				VDMA_Write_Int32(VDMA_REG_BASE,
-						 ahb_settings[i].reg_addr -
-							 VDMA_REG_BASE,
-						 ahb_settings[i].val);
-#endif
-#ifdef ARMCB_CAM_AHB
-			if ((ahb_settings[i].reg_addr >=
-					AHB_CSIRCSU0_REG_BASE) &&
-				(ahb_settings[i].reg_addr <=
-					AHB_CSIRCSU0_REG_END)) {
-				cix_ahb_csircsu_write_reg(
-					ahb_settings[i].reg_addr,
-					ahb_settings[i].val);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_CSI0_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_CSI1_REG_END)) {
-				cix_ahb_csi_write_reg(ahb_settings[i].reg_addr,
-						      ahb_settings[i].val);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_DPHY0_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_DPHY0_REG_END)) {
-				cix_ahb_dphy_write_reg(ahb_settings[i].reg_addr,
-						       ahb_settings[i].val);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_CSIDMA0_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_CSIDMA1_REG_END)) {
-				cix_ahb_csidma_write_reg(
-					ahb_settings[i].reg_addr,
-					ahb_settings[i].val);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_CSIRCSU1_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_CSIRCSU1_REG_END)) {
-				cix_ahb_csircsu_write_reg(
-					ahb_settings[i].reg_addr,
-					ahb_settings[i].val);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_CSI2_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_CSI3_REG_END)) {
-				cix_ahb_csi_write_reg(ahb_settings[i].reg_addr,
-						      ahb_settings[i].val);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_DPHY1_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_DPHY1_REG_END)) {
-				cix_ahb_dphy_write_reg(ahb_settings[i].reg_addr,
-						       ahb_settings[i].val);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_CSIDMA2_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_CSIDMA3_REG_END)) {
-				cix_ahb_csidma_write_reg(
-					ahb_settings[i].reg_addr,
-					ahb_settings[i].val);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_PMCTRL_RES_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_PMCTRL_RES_REG_END)) {
-				armcb_ahb_pmctrl_res_write_reg(
-					ahb_settings[i].reg_addr -
-						AHB_PMCTRL_RES_REG_BASE,
-					ahb_settings[i].val);
-			} else if ((ahb_settings[i].reg_addr >=
-				    DPHY_POWER_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    DPHY_POWER_END)) {
-				cix_enable_dphy_clk(ahb_settings[i].reg_addr,
-						    ahb_settings[i].val);
-			} else if ((ahb_settings[i].reg_addr >=
-				    CSI_POWER_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    CSI_POWER_END)) {
-				cix_set_csi_clk_rate(ahb_settings[i].reg_addr,
-						     ahb_settings[i].val);
-			} else if ((ahb_settings[i].reg_addr >=
-				    CSIDMA_POWER_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    CSIDMA_POWER_END)) {
-				cix_enable_csidma_clk(ahb_settings[i].reg_addr,
-						      ahb_settings[i].val);
-			} else if (ahb_settings[i].reg_addr >=
-				   ISP_GDC_REG_BASE) {
-				armcb_isp_write_reg2(ahb_settings[i].reg_addr -
-							     ISP_GDC_REG_BASE,
-						     ahb_settings[i].val);
-			}
-#else
-			if (ahb_settings[i].reg_addr >= APB2_REG_BASE)
-				armcb_apb2_write_reg(ahb_settings[i].reg_addr -
-							     APB2_REG_BASE,
-						     ahb_settings[i].val);
-#endif
-			else
-				armcb_isp_write_reg(ahb_settings[i].reg_addr -
-							    ISP_REG_BASE,
-						    ahb_settings[i].val);
+			i += armcb_ahb_write_run(ahb_settings, i, cnt);
+			continue;
 		} else if (ahb_settings[i].direct == DRV_DIRECTION_READ) {
-#ifdef CONFIG_ARENA_FPGA_PLATFORM
-			if (ahb_settings[i].reg_addr >=
-			    XPAR_AXI_CDMA_0_BASEADDR)
-				ahb_settings[i].val = CDMA_Read_Int32(
-					ahb_settings[i].reg_addr -
-					XPAR_AXI_CDMA_0_BASEADDR);
-			else if (ahb_settings[i].reg_addr >= ISP_GDC_REG_BASE)
-				ahb_settings[i].val = armcb_isp_read_reg2(
-					ahb_settings[i].reg_addr -
-					ISP_GDC_REG_BASE);
-			else if (ahb_settings[i].reg_addr >= VDMA_REG_BASE)
-				ahb_settings[i].val = VDMA_Read_Int32(
-					VDMA_REG_BASE,
-					ahb_settings[i].reg_addr -
-						VDMA_REG_BASE);
-#endif
-#ifdef ARMCB_CAM_AHB
-			if ((ahb_settings[i].reg_addr >=
-					AHB_CSIRCSU0_REG_BASE) &&
-				(ahb_settings[i].reg_addr <=
-					AHB_CSIRCSU0_REG_END)) {
-				ahb_settings[i].val = cix_ahb_csircsu_read_reg(
-				ahb_settings[i].reg_addr);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_CSI0_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_CSI1_REG_END)) {
-				ahb_settings[i].val = cix_ahb_csi_read_reg(
-					ahb_settings[i].reg_addr);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_DPHY0_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_DPHY0_REG_END)) {
-				ahb_settings[i].val = cix_ahb_dphy_read_reg(
-					ahb_settings[i].reg_addr);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_CSIDMA0_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_CSIDMA1_REG_END)) {
-				ahb_settings[i].val = cix_ahb_csidma_read_reg(
-					ahb_settings[i].reg_addr);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_CSIRCSU1_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_CSIRCSU1_REG_END)) {
-				ahb_settings[i].val = cix_ahb_csircsu_read_reg(
-					ahb_settings[i].reg_addr);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_CSI2_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_CSI3_REG_END)) {
-				ahb_settings[i].val = cix_ahb_csi_read_reg(
-					ahb_settings[i].reg_addr);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_DPHY1_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_DPHY1_REG_END)) {
-				ahb_settings[i].val = cix_ahb_dphy_read_reg(
-					ahb_settings[i].reg_addr);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_CSIDMA2_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_CSIDMA3_REG_END)) {
-				ahb_settings[i].val = cix_ahb_csidma_read_reg(
-					ahb_settings[i].reg_addr);
-			} else if ((ahb_settings[i].reg_addr >=
-				    AHB_PMCTRL_RES_REG_BASE) &&
-				   (ahb_settings[i].reg_addr <=
-				    AHB_PMCTRL_RES_REG_END)) {
-				ahb_settings[i].val =
-					armcb_ahb_pmctrl_res_read_reg(
-						ahb_settings[i].reg_addr -
-						AHB_PMCTRL_RES_REG_BASE);
-			} else if (ahb_settings[i].reg_addr >=
-				   ISP_GDC_REG_BASE) {
-				ahb_settings[i].val = armcb_isp_read_reg2(
-					ahb_settings[i].reg_addr -
-					ISP_GDC_REG_BASE);
-			}
-#else
-			if (ahb_settings[i].reg_addr >= APB2_REG_BASE)
-				ahb_settings[i].val = armcb_apb2_read_reg(
-					ahb_settings[i].reg_addr -
-					APB2_REG_BASE);
-#endif
-			else
-				ahb_settings[i].val = armcb_isp_read_reg(
-					ahb_settings[i].reg_addr -
-					ISP_REG_BASE);
+			armcb_ahb_read(&ahb_settings[i], &ahb_settings[i].val);
 		} else if (ahb_settings[i].direct == DRV_DIRECTION_READ_POLL) {
 			expected_val = ahb_settings[i].val;
 			while (1) {
-#ifdef CONFIG_ARENA_FPGA_PLATFORM
-				if (ahb_settings[i].reg_addr >=
-				    XPAR_AXI_CDMA_0_BASEADDR)
-					ahb_settings[i].val = CDMA_Read_Int32(
-						ahb_settings[i].reg_addr -
-						XPAR_AXI_CDMA_0_BASEADDR);
-				else if (ahb_settings[i].reg_addr >=
-					 VDMA_REG_BASE)
-					ahb_settings[i].val = VDMA_Read_Int32(
-						VDMA_REG_BASE,
-						ahb_settings[i].reg_addr -
-							VDMA_REG_BASE);
-#endif
-#ifdef ARMCB_CAM_AHB
-				if ((ahb_settings[i].reg_addr >=
-						AHB_CSIRCSU0_REG_BASE) &&
-					(ahb_settings[i].reg_addr <
-						AHB_CSIRCSU0_REG_END)) {
-					ahb_settings[i]
-						.val = cix_ahb_csircsu_read_reg(
-						ahb_settings[i].reg_addr);
-				} else if ((ahb_settings[i].reg_addr >=
-					    AHB_CSI0_REG_BASE) &&
-					   (ahb_settings[i].reg_addr <
-					    AHB_CSI1_REG_END)) {
-					ahb_settings[i]
-						.val = cix_ahb_csi_read_reg(
-						ahb_settings[i].reg_addr);
-				} else if ((ahb_settings[i].reg_addr >=
-					    AHB_DPHY0_REG_BASE) &&
-					   (ahb_settings[i].reg_addr <
-					    AHB_DPHY0_REG_END)) {
-					ahb_settings[i]
-						.val = cix_ahb_dphy_read_reg(
-						ahb_settings[i].reg_addr);
-				} else if ((ahb_settings[i].reg_addr >=
-					    AHB_CSIDMA0_REG_BASE) &&
-					   (ahb_settings[i].reg_addr <
-					    AHB_CSIDMA1_REG_END)) {
-					ahb_settings[i]
-						.val = cix_ahb_csidma_read_reg(
-						ahb_settings[i].reg_addr);
-				} else if ((ahb_settings[i].reg_addr >=
-					    AHB_CSIRCSU1_REG_BASE) &&
-					   (ahb_settings[i].reg_addr <
-					    AHB_CSIRCSU1_REG_END)) {
-					ahb_settings[i]
-						.val = cix_ahb_csircsu_read_reg(
-						ahb_settings[i].reg_addr);
-				} else if ((ahb_settings[i].reg_addr >=
-					    AHB_CSI2_REG_BASE) &&
-					   (ahb_settings[i].reg_addr <
-					    AHB_CSI3_REG_END)) {
-					ahb_settings[i]
-						.val = cix_ahb_csi_read_reg(
-						ahb_settings[i].reg_addr);
-				} else if ((ahb_settings[i].reg_addr >=
-					    AHB_DPHY1_REG_BASE) &&
-					   (ahb_settings[i].reg_addr <
-					    AHB_DPHY1_REG_END)) {
-					ahb_settings[i]
-						.val = cix_ahb_dphy_read_reg(
-						ahb_settings[i].reg_addr);
-				} else if ((ahb_settings[i].reg_addr >=
-					    AHB_CSIDMA2_REG_BASE) &&
-					   (ahb_settings[i].reg_addr <
-					    AHB_CSIDMA3_REG_END)) {
-					ahb_settings[i]
-						.val = cix_ahb_csidma_read_reg(
-						ahb_settings[i].reg_addr);
-				} else if ((ahb_settings[i].reg_addr >=
-					    AHB_PMCTRL_RES_REG_BASE) &&
-					   (ahb_settings[i].reg_addr <
-					    AHB_PMCTRL_RES_REG_END)) {
-					ahb_settings[i].val =
-						armcb_ahb_pmctrl_res_read_reg(
-							ahb_settings[i].reg_addr -
-							AHB_PMCTRL_RES_REG_BASE);
-				}
-#else
-				if (ahb_settings[i].reg_addr >= APB2_REG_BASE)
-					ahb_settings[i]
-						.val = armcb_apb2_read_reg(
-						ahb_settings[i].reg_addr -
-						APB2_REG_BASE);
-#endif
-				else
-					ahb_settings[i].val = armcb_isp_read_reg(
-						ahb_settings[i].reg_addr -
-						ISP_REG_BASE);
+				if (!armcb_ahb_read(&ahb_settings[i],
+						    &ahb_settings[i].val))
+					break;
 
 				if (expected_val == ahb_settings[i].val)
 					break;
@@ -570,11 +497,24 @@ static int armcb_ahb_apply(struct cmd_buf *cmd, void *clinet)
 		} else {
 			LOG(LOG_ERR, "Unsupported direct");
 		}
+		i++;
 	}
 
 	return ret;
 }
 
+/// Apply AHB cmd
+static int armcb_ahb_apply(struct cmd_buf *cmd, void *clinet)
+{
+	if (!cmd || !clinet || !cmd->cmd_cnt) {
+		LOG(LOG_ERR, "input parameters is invalid, %p %p %d", cmd,
+		    clinet, cmd->cmd_cnt);
+		return -EINVAL;
+	}
+
+	return armcb_ahb_apply_settings(cmd->settings.ahb, cmd->cmd_cnt);
+}
+
 /// Apply AHB Power cmd
 static int armcb_ahb_power_apply(struct cmd_buf *cmd, void *clinet)
 {
@@ -613,120 +553,169 @@ static int armcb_ahb_power_apply(struct cmd_buf *cmd, void *clinet)
 	return ret;
 }
 
+/// Dispatch one cmd buffer to its bus
+static int armcb_isp_hw_dispatch(struct cmd_buf *cmd, void *client)
+{
+	int ret = 0;
+
+	switch (cmd->static_info.bus) {
+	case HW_BUS_I2C:
+#ifndef QEMU_ON_VEXPRESS
+		ret = armcb_i2c_apply(cmd, client);
+#endif
+		break;
+	case HW_BUS_SPI:
+#ifndef QEMU_ON_VEXPRESS
+		ret = armcb_spi_apply(cmd, client);
+#endif
+		break;
+	case HW_BUS_AHB:
+#ifndef QEMU_ON_VEXPRESS
+		ret = armcb_ahb_apply(cmd, client);
+#endif
+		break;
+	case HW_BUS_AHB_POWER:
+#ifndef QEMU_ON_VEXPRESS
+		ret = armcb_ahb_power_apply(cmd, client);
+#endif
+		break;
+	case HW_BUS_DMA_REG:
+	case HW_BUS_XDMA_REG:
+	case HW_BUS_DMA_SRAM:
+	case HW_BUS_XDMA_SRAM:
+		cmd->cmd_cnt = MCFB_TRIG_MAX;
+#ifndef QEMU_ON_VEXPRESS
+		ret = armcb_ahb_apply(cmd, client);
+#endif
+		break;
+	default:
+		LOG(LOG_WARN, "not support hw bus %d!", cmd->static_info.bus);
+		ret = -EINVAL;
+		break;
+	}
+
+	return ret;
+}
+
+/// Copy @cmd to the tail of @cmd_list, growing the arena only when needed
+static int armcb_isp_hw_cmd_list_add(struct isp_hw_cmd_list *cmd_list,
+				     struct cmd_buf *cmd, void *client)
+{
+	size_t size = ALIGN(cmd->static_info.buf_size, sizeof(u64));
+	size_t arena_size = 0;
+	unsigned int entry_max = 0;
+	void *tmp = NULL;
+
+	if (cmd->static_info.buf_size < offsetof(struct cmd_buf, settings)) {
+		LOG(LOG_ERR, "invalid cmd buf size %u",
+		    cmd->static_info.buf_size);
+		return -EINVAL;
+	}
+
+	if (cmd_list->arena_used + size > cmd_list->arena_size) {
+		arena_size = max3(cmd_list->arena_size * 2,
+				  cmd_list->arena_used + size,
+				  (size_t)ISP_HW_CMD_ARENA_MIN);
+		tmp = krealloc(cmd_list->arena, arena_size, GFP_KERNEL);
+		if (!tmp) {
+			LOG(LOG_ERR, "failed to kmalloc memory!");
+			return -ENOMEM;
+		}
+		cmd_list->arena = tmp;
+		cmd_list->arena_size = arena_size;
+	}
+
+	if (cmd_list->entry_cnt == cmd_list->entry_max) {
+		entry_max = max(cmd_list->entry_max * 2,
+				(unsigned int)ISP_HW_CMD_ENTRY_MIN);
+		tmp = krealloc(cmd_list->entries,
+			       entry_max * sizeof(*cmd_list->entries),
+			       GFP_KERNEL);
+		if (!tmp) {
+			LOG(LOG_ERR, "failed to kmalloc memory!");
+			return -ENOMEM;
+		}
+		cmd_list->entries = tmp;
+		cmd_list->entry_max = entry_max;
+	}
+
+	memcpy(cmd_list->arena + cmd_list->arena_used, cmd,
+	       cmd->static_info.buf_size);
+	cmd_list->entries[cmd_list->entry_cnt].offset = cmd_list->arena_used;
+	cmd_list->entries[cmd_list->entry_cnt].client = client;
+	cmd_list->entry_cnt++;
+	cmd_list->arena_used += size;
+
+	return 0;
+}
+
+/// Replay @cmd_list in order and empty it, the storage is kept for reuse
+static int armcb_isp_hw_cmd_list_apply(struct isp_hw_cmd_list *cmd_list)
+{
+	int ret = 0;
+	unsigned int i = 0;
+	struct cmd_buf *cmd = NULL;
+
+	for (i = 0; i < cmd_list->entry_cnt; i++) {
+		cmd = (struct cmd_buf *)(cmd_list->arena +
+					 cmd_list->entries[i].offset);
+
+		LOG_RATELIMITED(
+			LOG_DEBUG,
+			"cam %u, cmd_type %u, order %u, bus %u, dev %u, size %u, addr %p",
+			cmd->static_info.camId, cmd->cmd_type, cmd->order,
+			cmd->static_info.bus, cmd->static_info.dev,
+			cmd->static_info.buf_size, cmd);
+
+		ret = armcb_isp_hw_dispatch(cmd, cmd_list->entries[i].client);
+	}
+
+	cmd_list->entry_cnt = 0;
+	cmd_list->arena_used = 0;
+
+	return ret;
+}
+
+static void armcb_isp_hw_cmd_list_free(struct isp_hw_cmd_list *cmd_list)
+{
+	kfree(cmd_list->arena);
+	kfree(cmd_list->entries);
+	memset(cmd_list, 0, sizeof(*cmd_list));
+}
+
 /// Process ISP HW cmd
 int armcb_isp_hw_apply_list(enum cmd_type type)
 {
-	int ret = 0;
-	struct isp_hw_cmd_buf *hw_cmd_buf = NULL;
-	struct isp_hw_cmd_buf *hw_cmd_buf_next = NULL;
-	struct list_head *cmd_list = NULL;
+	struct isp_hw_cmd_list *cmd_list = NULL;
 
 	switch (type) {
 	case CMD_TYPE_STREAMON:
 		hw_apply_entry_cnt--;
-		if (is_stream_on_list_init && !hw_apply_entry_cnt) {
+		if (streamon_list.entry_cnt && !hw_apply_entry_cnt) {
 			cmd_list = &streamon_list;
-			is_stream_on_list_init = 0;
 			hw_apply_cam_flag = 0;
 		}
 		break;
 	case CMD_TYPE_STREAMOFF:
-		if (is_stream_off_list_init) {
-			cmd_list = &streamoff_list;
-			is_stream_off_list_init = 0;
-		}
+		cmd_list = &streamoff_list;
 		break;
 	case CMD_TYPE_POWERDOWN:
-		if (is_stream_powerdown_list_init) {
-			cmd_list = &powerdown_list;
-			is_stream_powerdown_list_init = 0;
-		}
+		cmd_list = &powerdown_list;
 		break;
 	default:
 		break;
 	}
 
-	if (cmd_list) {
-		list_for_each_entry_safe(hw_cmd_buf, hw_cmd_buf_next, cmd_list,
-					  list) {
-			if (hw_cmd_buf && hw_cmd_buf->cmd) {
-				LOG_RATELIMITED(
-					LOG_DEBUG,
-					"cam %u, cmd_type %u, order %u, bus %u, dev %u, size %u, addr %p",
-					hw_cmd_buf->cmd->static_info.camId,
-					hw_cmd_buf->cmd->cmd_type,
-					hw_cmd_buf->cmd->order,
-					hw_cmd_buf->cmd->static_info.bus,
-					hw_cmd_buf->cmd->static_info.dev,
-					hw_cmd_buf->cmd->static_info.buf_size,
-					hw_cmd_buf);
-
-				switch (hw_cmd_buf->cmd->static_info.bus) {
-				case HW_BUS_I2C:
-#ifndef QEMU_ON_VEXPRESS
-					ret = armcb_i2c_apply(
-						hw_cmd_buf->cmd,
-						hw_cmd_buf->client);
-#endif
-					break;
-				case HW_BUS_SPI:
-#ifndef QEMU_ON_VEXPRESS
-					ret = armcb_spi_apply(
-						hw_cmd_buf->cmd,
-						hw_cmd_buf->client);
-#endif
-					break;
-				case HW_BUS_AHB:
-#ifndef QEMU_ON_VEXPRESS
-					ret = armcb_ahb_apply(
-						hw_cmd_buf->cmd,
-						hw_cmd_buf->client);
-#endif
-					break;
-				case HW_BUS_AHB_POWER:
-#ifndef QEMU_ON_VEXPRESS
-					ret = armcb_ahb_power_apply(
-						hw_cmd_buf->cmd,
-						hw_cmd_buf->client);
-#endif
-					break;
-				case HW_BUS_DMA_REG:
-				case HW_BUS_XDMA_REG:
-				case HW_BUS_DMA_SRAM:
-				case HW_BUS_XDMA_SRAM:
-					hw_cmd_buf->cmd->cmd_cnt =
-						MCFB_TRIG_MAX;
-#ifndef QEMU_ON_VEXPRESS
-					ret = armcb_ahb_apply(
-						hw_cmd_buf->cmd,
-						hw_cmd_buf->client);
-#endif
-					break;
-				default:
-					LOG(LOG_WARN, "not support hw bus %d!",
-					    hw_cmd_buf->cmd->static_info.bus);
-					ret = -EINVAL;
-					break;
-				}
-
-				list_del(&hw_cmd_buf->list);
-
-				kfree(hw_cmd_buf->cmd);
-				hw_cmd_buf->cmd = NULL;
-				kfree(hw_cmd_buf);
-				hw_cmd_buf = NULL;
-			}
-		}
-	}
+	if (!cmd_list)
+		return 0;
 
-	return ret;
+	return armcb_isp_hw_cmd_list_apply(cmd_list);
 }
 
 /// Process ISP HW cmd
 int armcb_isp_hw_apply(struct cmd_buf *cmd, void *client)
 {
 	int ret = 0;
-	struct isp_hw_cmd_buf *p_isp_hw_cmd_buf = NULL;
 
 	if (!cmd) {
 		LOG(LOG_ERR, "input parameters is invalid.");
@@ -745,114 +734,24 @@ int armcb_isp_hw_apply(struct cmd_buf *cmd, void *client)
 	    cmd->cmd_type, cmd->apply_frame_id, cmd->effect_frame_id,
 	    cmd->cmd_cnt);
 
-	if (cmd->cmd_type == CMD_TYPE_STREAMON ||
-	    cmd->cmd_type == CMD_TYPE_POST_STREAMON ||
-	    cmd->cmd_type == CMD_TYPE_STREAMOFF ||
-	    cmd->cmd_type == CMD_TYPE_POWERDOWN) {
-		p_isp_hw_cmd_buf = kmalloc(
-			sizeof(struct isp_hw_cmd_buf), GFP_KERNEL);
-		if (p_isp_hw_cmd_buf == NULL) {
-			LOG(LOG_ERR, "failed to kmalloc memory!");
-			return -ENOMEM;
-		}
-
-		p_isp_hw_cmd_buf->cmd = kmalloc(
-			cmd->static_info.buf_size, GFP_KERNEL);
-		if (p_isp_hw_cmd_buf->cmd == NULL) {
-			LOG(LOG_ERR, "failed to kmalloc memory!");
-			return -ENOMEM;
-		}
-
-		memcpy(p_isp_hw_cmd_buf->cmd, cmd, cmd->static_info.buf_size);
-
-		p_isp_hw_cmd_buf->client = client;
-
-		LOG(LOG_DEBUG,
-		    "cam %u, cmd_type %u, cnt %u, order %u, bus %u, dev %u, size %u, addr "
-		    "%p",
-		    p_isp_hw_cmd_buf->cmd->static_info.camId,
-		    p_isp_hw_cmd_buf->cmd->cmd_type,
-		    p_isp_hw_cmd_buf->cmd->cmd_cnt,
-		    p_isp_hw_cmd_buf->cmd->order,
-		    p_isp_hw_cmd_buf->cmd->static_info.bus,
-		    p_isp_hw_cmd_buf->cmd->static_info.dev,
-		    p_isp_hw_cmd_buf->cmd->static_info.buf_size,
-		    p_isp_hw_cmd_buf);
-
-		/// already sort in userspace
-		switch (cmd->cmd_type) {
-		case CMD_TYPE_STREAMON:
-		case CMD_TYPE_POST_STREAMON:
-			if (cmd->static_info.dev == DRV_DEV_ISP) {
-				hw_apply_cam_flag |=
-					1 << p_isp_hw_cmd_buf->cmd->static_info
-						     .camId;
-				hw_apply_entry_cnt =
-					count_bits(hw_apply_cam_flag);
-			}
-			if (is_stream_on_list_init == 0) {
-				INIT_LIST_HEAD(&streamon_list);
-				is_stream_on_list_init = 1;
-			}
-			list_add_tail(&p_isp_hw_cmd_buf->list, &streamon_list);
-			break;
-		case CMD_TYPE_STREAMOFF:
-			if (is_stream_off_list_init == 0) {
-				INIT_LIST_HEAD(&streamoff_list);
-				is_stream_off_list_init = 1;
-			}
-			list_add_tail(&p_isp_hw_cmd_buf->list, &streamoff_list);
-			break;
-		case CMD_TYPE_POWERDOWN:
-			if (is_stream_powerdown_list_init == 0) {
-				INIT_LIST_HEAD(&powerdown_list);
-				is_stream_powerdown_list_init = 1;
-			}
-			list_add_tail(&p_isp_hw_cmd_buf->list, &powerdown_list);
-			break;
-		default:
-			break;
+	/// already sort in userspace
+	switch (cmd->cmd_type) {
+	case CMD_TYPE_STREAMON:
+	case CMD_TYPE_POST_STREAMON:
+		if (cmd->static_info.dev == DRV_DEV_ISP) {
+			hw_apply_cam_flag |= 1 << cmd->static_info.camId;
+			hw_apply_entry_cnt = count_bits(hw_apply_cam_flag);
 		}
-
-		return ret;
-	}
-
-	switch (cmd->static_info.bus) {
-	case HW_BUS_I2C:
-#ifndef QEMU_ON_VEXPRESS
-		ret = armcb_i2c_apply(cmd, client);
-#endif
-		break;
-	case HW_BUS_SPI:
-#ifndef QEMU_ON_VEXPRESS
-		ret = armcb_spi_apply(cmd, client);
-#endif
-		break;
-	case HW_BUS_AHB:
-#ifndef QEMU_ON_VEXPRESS
-		ret = armcb_ahb_apply(cmd, client);
-#endif
-		break;
-	case HW_BUS_AHB_POWER:
-#ifndef QEMU_ON_VEXPRESS
-		ret = armcb_ahb_power_apply(cmd, client);
-#endif
-		break;
-	case HW_BUS_DMA_REG:
-	case HW_BUS_XDMA_REG:
-	case HW_BUS_DMA_SRAM:
-	case HW_BUS_XDMA_SRAM:
-		cmd->cmd_cnt = MCFB_TRIG_MAX;
-#ifndef QEMU_ON_VEXPRESS
-		ret = armcb_ahb_apply(cmd, client);
-#endif
-		break;
+		return armcb_isp_hw_cmd_list_add(&streamon_list, cmd, client);
+	case CMD_TYPE_STREAMOFF:
+		return armcb_isp_hw_cmd_list_add(&streamoff_list, cmd, client);
+	case CMD_TYPE_POWERDOWN:
+		return armcb_isp_hw_cmd_list_add(&powerdown_list, cmd, client);
 	default:
-		LOG(LOG_WARN, "not support hw bus %d!", cmd->static_info.bus);
-		ret = -EINVAL;
 		break;
 	}
 
+	ret = armcb_isp_hw_dispatch(cmd, client);
 	if (ret < 0 && cmd->cmd_type != CMD_TYPE_PROBE) {
 		LOG(LOG_ERR, "hw bus:%d type:%d action failed ret:%d! ",
 		    cmd->static_info.bus, cmd->cmd_type, ret);
@@ -910,3 +809,21 @@ int armcb_sys_bus_test(struct perf_bus_params *puser_bus_params)
 
 	return ret;
 }
+
+#ifdef ARMCB_CAM_KO
+void *armcb_get_isp_hw_ops_instance(void)
+{
+	return &streamon_list;
+}
+
+void armcb_isp_hw_ops_destroy(void)
+{
+	armcb_isp_hw_cmd_list_free(&streamon_list);
+	armcb_isp_hw_cmd_list_free(&streamoff_list);
+	armcb_isp_hw_cmd_list_free(&powerdown_list);
+}
+#endif
+
+#ifdef ARMCB_ISP_KUNIT_TEST
+#include "isp_hw_ops_test.c"
+#endif
@@ -30,9 +30,9 @@
 #include <linux/slab.h>
 #include <linux/types.h>
 
+/// deferred cmd, @offset locates the cmd_buf copy in its list arena
 struct isp_hw_cmd_buf {
-	struct list_head list;
-	struct cmd_buf *cmd;
+	size_t offset;
 	void *client;
 };
 
@@ -41,5 +41,9 @@ int armcb_isp_hw_write(struct isp_hw_req *req, void *argv);
 int armcb_isp_hw_apply_list(enum cmd_type type);
 int armcb_isp_hw_apply(struct cmd_buf *cmd, void *client);
 int armcb_sys_bus_test(struct perf_bus_params *puser_bus_params);
+#ifdef ARMCB_CAM_KO
+void *armcb_get_isp_hw_ops_instance(void);
+void armcb_isp_hw_ops_destroy(void);
+#endif
 
 #endif
@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM armcb_isp
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE isp_hw_trace
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+
+#if !defined(__ISP_HW_TRACE__) || defined(TRACE_HEADER_MULTI_READ)
+#define __ISP_HW_TRACE__
+
+#include <linux/tracepoint.h>
+
+/// Emitted once per applied I2C cmd buffer with the total programming time.
+TRACE_EVENT(armcb_i2c_apply,
+
+	    TP_PROTO(unsigned int cam_id, unsigned int cmd_cnt,
+		     unsigned int msgs, unsigned int xfers, s64 duration_ns),
+
+	    TP_ARGS(cam_id, cmd_cnt, msgs, xfers, duration_ns),
+
+	    TP_STRUCT__entry(__field(u32, cam_id) __field(u32, cmd_cnt)
+				     __field(u32, msgs) __field(u32, xfers)
+					     __field(s64, duration_ns)),
+
+	    TP_fast_assign(__entry->cam_id = cam_id;
+			   __entry->cmd_cnt = cmd_cnt; __entry->msgs = msgs;
+			   __entry->xfers = xfers;
+			   __entry->duration_ns = duration_ns;),
+
+	    TP_printk("cam=%u regs=%u msgs=%u xfers=%u duration_ns=%lld",
+		      __entry->cam_id, __entry->cmd_cnt, __entry->msgs,
+		      __entry->xfers, __entry->duration_ns));
+
+/// Emitted once per runtime resume of the isp block.
+TRACE_EVENT(armcb_isp_rpm_resume,
+
+	    TP_PROTO(bool reset, unsigned int restored, s64 duration_ns),
+
+	    TP_ARGS(reset, restored, duration_ns),
+
+	    TP_STRUCT__entry(__field(bool, reset) __field(u32, restored)
+				     __field(s64, duration_ns)),
+
+	    TP_fast_assign(__entry->reset = reset;
+			   __entry->restored = restored;
+			   __entry->duration_ns = duration_ns;),
+
+	    TP_printk("reset=%d restored=%u duration_ns=%lld", __entry->reset,
+		      __entry->restored, __entry->duration_ns));
+
+/// Emitted once per frame synchronized sensor update.
+TRACE_EVENT(armcb_sensor_apply,
+
+	    TP_PROTO(unsigned int cam_id, unsigned int order,
+		     unsigned int target, unsigned int landed, s64 duration_ns),
+
+	    TP_ARGS(cam_id, order, target, landed, duration_ns),
+
+	    TP_STRUCT__entry(__field(u32, cam_id) __field(u32, order)
+				     __field(u32, target) __field(u32, landed)
+					     __field(s64, duration_ns)),
+
+	    TP_fast_assign(__entry->cam_id = cam_id; __entry->order = order;
+			   __entry->target = target; __entry->landed = landed;
+			   __entry->duration_ns = duration_ns;),
+
+	    TP_printk("cam=%u order=%u target=%u landed=%u duration_ns=%lld",
+		      __entry->cam_id, __entry->order, __entry->target,
+		      __entry->landed, __entry->duration_ns));
+
+#endif /* __ISP_HW_TRACE__ */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -348,6 +348,135 @@ int armcb_i2c_register_write(struct i2c_client *client,
 	return res;
 }
 
+static unsigned int armcb_i2c_pack_be(u8 *buf, unsigned int val,
+				      unsigned int bytes)
+{
+	unsigned int i = 0;
+
+	for (i = 0; i < bytes; i++)
+		buf[i] = (val >> (8 * (bytes - 1 - i))) & 0xFF;
+
+	return bytes;
+}
+
+/* @next may extend the auto-increment run started at @head */
+static bool armcb_i2c_burst_continues(const struct cmd_i2c_setting *head,
+				      const struct cmd_i2c_setting *next,
+				      unsigned int index, unsigned int data_bytes)
+{
+	return next->slave_addr == head->slave_addr &&
+	       next->reg_addr_type == head->reg_addr_type &&
+	       next->reg_data_type == head->reg_data_type &&
+	       next->reg_addr == head->reg_addr + index * data_bytes;
+}
+
+/*
+ * @description: write @count register settings with as few bus transactions
+ *		as possible. Runs of consecutive register addresses on the same
+ *		slave become one auto-increment write of at most @max_burst data
+ *		bytes (0 disables auto-increment), and the resulting messages
+ *		are packed ARMCB_I2C_XFER_MSGS_MAX at a time into a single
+ *		i2c_transfer(). Adapter quirks further limit both.
+ *		All settings must be writes with a validated address/data type.
+ */
+int armcb_i2c_burst_write(struct i2c_client *client,
+			  struct cmd_i2c_setting *i2c_settings,
+			  unsigned int count, unsigned int max_burst,
+			  struct armcb_i2c_burst_stats *stats)
+{
+	const struct i2c_adapter_quirks *quirks = NULL;
+	struct i2c_msg msgs[ARMCB_I2C_XFER_MSGS_MAX];
+	unsigned int max_msgs = ARMCB_I2C_XFER_MSGS_MAX;
+	unsigned int max_len = ARMCN_I2CSEND_BUFLENS_MAX;
+	unsigned int nmsgs = 0;
+	unsigned int i = 0;
+	u8 *pool = NULL;
+	int ret = 0;
+
+	if (!client || !client->adapter || !i2c_settings) {
+		LOG(LOG_ERR, "Invalid i2c arg !");
+		return -EINVAL;
+	}
+
+	quirks = client->adapter->quirks;
+	if (quirks) {
+		if (quirks->flags & I2C_AQ_NO_REP_START)
+			max_msgs = 1;
+		if (quirks->max_num_msgs && quirks->max_num_msgs < max_msgs)
+			max_msgs = quirks->max_num_msgs;
+		if (quirks->max_write_len && quirks->max_write_len < max_len)
+			max_len = quirks->max_write_len;
+	}
+
+	pool = kmalloc(max_msgs * ARMCN_I2CSEND_BUFLENS_MAX, GFP_KERNEL);
+	if (!pool)
+		return -ENOMEM;
+
+	while (i < count) {
+		struct cmd_i2c_setting *head = &i2c_settings[i];
+		u8 *buf = pool + nmsgs * ARMCN_I2CSEND_BUFLENS_MAX;
+		unsigned int addr_bytes = bytes_of_reg_addr(head->reg_addr_type);
+		unsigned int data_bytes = bytes_of_reg_data(head->reg_data_type);
+		unsigned int limit = max_len;
+		unsigned int len = 0;
+		unsigned int run = 1;
+
+		if (!addr_bytes || !data_bytes ||
+		    addr_bytes + data_bytes > max_len) {
+			LOG(LOG_ERR, "Invalid i2c setting index[%u]", i);
+			ret = -EINVAL;
+			break;
+		}
+
+		if (addr_bytes + max(max_burst, data_bytes) < limit)
+			limit = addr_bytes + max(max_burst, data_bytes);
+
+		len += armcb_i2c_pack_be(buf, head->reg_addr, addr_bytes);
+		len += armcb_i2c_pack_be(buf + len, head->val, data_bytes);
+
+		while (i + run < count && len + data_bytes <= limit &&
+		       armcb_i2c_burst_continues(head, &i2c_settings[i + run],
+						 run, data_bytes)) {
+			len += armcb_i2c_pack_be(buf + len,
+						 i2c_settings[i + run].val,
+						 data_bytes);
+			run++;
+		}
+
+		msgs[nmsgs].addr = head->slave_addr;
+		msgs[nmsgs].flags = 0;
+		msgs[nmsgs].len = len;
+		msgs[nmsgs].buf = buf;
+		nmsgs++;
+		i += run;
+
+		if (nmsgs < max_msgs && i < count)
+			continue;
+
+		ret = i2c_transfer(client->adapter, msgs, nmsgs);
+		if (ret != nmsgs) {
+			LOG(LOG_ERR, "i2c_transfer %u msgs failed, ret = %d",
+			    nmsgs, ret);
+			ret = ret < 0 ? ret : -EIO;
+			break;
+		}
+		ret = 0;
+
+		if (stats) {
+			stats->msgs += nmsgs;
+			stats->xfers++;
+		}
+		nmsgs = 0;
+	}
+
+	/* keep the client pointed at the last slave like the single writer */
+	if (i)
+		client->addr = i2c_settings[i - 1].slave_addr;
+
+	kfree(pool);
+	return ret;
+}
+
 //-------------------------------------------------------------------------
 // Function name: armcb_route_i2c1toslavex()
 // Description:   Mux I2C1 to Slave 0-9 on the XCVU440 FPGA board.
@@ -370,3 +499,7 @@ void armcb_route_i2c1toslavex(u32 unSlaveNo)
 	armcb_register_set_int32(XPAR_REGCTRL16_0_S00_AXI_BASEADDR + 0x1C,
 				 unSlaveNo);
 }
+
+#ifdef ARMCB_ISP_KUNIT_TEST
+#include "isp_hw_utils_test.c"
+#endif
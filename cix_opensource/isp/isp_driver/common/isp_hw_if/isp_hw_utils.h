@@ -19,6 +19,8 @@
 #include <linux/i2c.h>
 
 #define ARMCN_I2CSEND_BUFLENS_MAX 255
+/* max messages packed into one i2c_transfer() by the burst writer */
+#define ARMCB_I2C_XFER_MSGS_MAX 32
 
 struct armcb_i2c_reg_ctrl {
 	struct i2c_client *client;
@@ -31,6 +33,12 @@ struct armcb_i2c_reg_ctrl {
 	unsigned int hw_chnl;
 };
 
+/* what armcb_i2c_burst_write() put on the bus */
+struct armcb_i2c_burst_stats {
+	unsigned int msgs;
+	unsigned int xfers;
+};
+
 struct armcb_spi_reg_ctrl {
 	struct spi_device *client;
 	unsigned int data_bytes;
@@ -52,6 +60,10 @@ int armcb_i2c_register_read(struct i2c_client *client,
 			    struct cmd_i2c_setting *i2c_settings);
 int armcb_i2c_register_write(struct i2c_client *client,
 			     struct cmd_i2c_setting *i2c_settings);
+int armcb_i2c_burst_write(struct i2c_client *client,
+			  struct cmd_i2c_setting *i2c_settings,
+			  unsigned int count, unsigned int max_burst,
+			  struct armcb_i2c_burst_stats *stats);
 int armcb_spi_register_read(struct spi_device *client,
 			    struct cmd_spi_setting *spi_settings);
 int armcb_spi_register_write(struct spi_device *client,
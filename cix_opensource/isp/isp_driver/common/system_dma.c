@@ -13,10 +13,14 @@
  *
  */
 
+#include "system_dma.h"
 #include "armcb_camera_io_drv.h"
 #include "armcb_register.h"
 #include "system_logger.h"
 #include "types_utils.h"
+#include <linux/completion.h>
+#include <linux/interrupt.h>
+#include <linux/iopoll.h>
 
 #ifdef LOG_MODULE
 #undef LOG_MODULE
@@ -25,7 +29,57 @@
 
 #ifdef CONFIG_ARENA_FPGA_PLATFORM
 
-static DEFINE_SPINLOCK(xdma_lock);
+#define CDMA_REG_CR 0x00
+#define CDMA_REG_SR 0x04
+#define CDMA_REG_SA 0x18
+#define CDMA_REG_SA_MSB 0x1c
+#define CDMA_REG_DA 0x20
+#define CDMA_REG_DA_MSB 0x24
+#define CDMA_REG_BTT 0x28
+
+#define CDMA_CR_RESET BIT(2)
+#define CDMA_CR_IOC_IRQ_EN BIT(12)
+#define CDMA_CR_ERR_IRQ_EN BIT(14)
+
+#define CDMA_SR_IDLE BIT(1)
+#define CDMA_SR_ERR_MASK (0x70) // DMAIntErr, DMASlvErr, DMADecErr
+#define CDMA_SR_IOC_IRQ BIT(12)
+#define CDMA_SR_ERR_IRQ BIT(14)
+
+// 0x04000000: Xilinx IP limited.
+#define CDMA_MAX_BYTES (0x04000000 - CACHELINE_SIZE)
+
+// A full chunk takes well under a second on the Arena AXI.
+#define CDMA_POLL_TIMEOUT_US (2 * USEC_PER_SEC)
+
+#define XDMA_PAGE_SHIFT 16
+#define XDMA_PAGE_MASK (0x07 << XDMA_PAGE_SHIFT)
+
+/*
+ * One CDMA engine shared by every caller. Queued transfers run in order;
+ * the engine executes one chunk of at most CDMA_MAX_BYTES and the next
+ * chunk, or the next queued transfer, is chained from the completion
+ * interrupt. Without an interrupt line the same completion path is driven
+ * by one submitter at a time polling the status register, with the engine
+ * lock dropped while it waits.
+ */
+struct system_dma_hw_ops {
+	u32 (*read)(u32 offset);
+	void (*write)(u32 offset, u32 value);
+};
+
+struct system_dma_engine {
+	spinlock_t lock;
+	struct list_head queue;
+	struct system_dma_xfer *active;
+	const struct system_dma_hw_ops *ops; /// CDMA registers
+	u32 max_bytes; /// largest chunk the engine takes
+	u32 poll_timeout_us; /// per chunk, polling mode only
+	bool polling; /// a submitter is draining the queue
+	u32 chunk_bytes;
+	u32 page_bak;
+	int irq;
+};
 
 u32 CDMA_Read_Int32(u32 offset)
 {
@@ -46,88 +100,390 @@ void CDMA_Write_Int32(u32 offset, u32 value)
 	writel(value, virt_addr + offset);
 }
 
-s32 cdma_en(u32 src_addr, u32 dst_addr, u32 bytes)
+static const struct system_dma_hw_ops system_dma_cdma_ops = {
+	.read = CDMA_Read_Int32,
+	.write = CDMA_Write_Int32,
+};
+
+static struct system_dma_engine g_dma_engine = {
+	.lock = __SPIN_LOCK_UNLOCKED(g_dma_engine.lock),
+	.queue = LIST_HEAD_INIT(g_dma_engine.queue),
+	.ops = &system_dma_cdma_ops,
+	.max_bytes = CDMA_MAX_BYTES,
+	.poll_timeout_us = CDMA_POLL_TIMEOUT_US,
+	.irq = -1,
+};
+
+// Address validity check.
+// (src_addr+bytes)/(dst_addr+bytes) can't cross the end address of xc7z020.
+//
+static bool cdma_addr_ok(u32 src_addr, u32 dst_addr, u32 bytes)
+{
+	u32 src_in_7020, dst_in_7020, src_in_440, dst_in_440;
+
+	src_in_7020 = (src_addr < MEM_END_7020) &&
+		      ((src_addr + bytes - 1) <= MEM_END_7020);
+	dst_in_7020 = (dst_addr < MEM_END_7020) &&
+		      ((dst_addr + bytes - 1) <= MEM_END_7020);
+	src_in_440 = (src_addr >= MEM_START_440) &&
+		     ((src_addr + bytes - 1) <=
+		      MEM_END_440); // Assumed MEM_START_440 >= MEM_END_7020.
+	dst_in_440 = (dst_addr >= MEM_START_440) &&
+		     ((dst_addr + bytes - 1) <= MEM_END_440);
+
+	return (src_in_7020 && dst_in_7020) || (src_in_7020 && dst_in_440) ||
+	       (src_in_440 && dst_in_440) || (src_in_440 && dst_in_7020);
+}
+
+static void xdma_page_switch(struct system_dma_engine *eng,
+			     struct system_dma_xfer *xfer)
+{
+	u32 temp = armcb_apb2_read_reg(0x14);
+
+	eng->page_bak = temp & XDMA_PAGE_MASK;
+	if (xfer->page == eng->page_bak)
+		return;
+
+	LOG(LOG_DEBUG, "temp(%x) page_bak(%x) page(%x)", temp, eng->page_bak,
+	    xfer->page);
+	temp &= ~XDMA_PAGE_MASK;
+	temp |= xfer->page;
+	armcb_apb2_write_reg(0x14, temp);
+}
+
+// Resume last page.
+static void xdma_page_restore(struct system_dma_engine *eng,
+			      struct system_dma_xfer *xfer)
 {
-	const u32 dma_max_bytes =
-		(0x04000000 - CACHELINE_SIZE); // 0x04000000: Xilinx IP limited.
 	u32 temp = 0;
-	u32 left = 0;
-	u32 src_in_7020 = 1, dst_in_7020 = 0, src_in_440, dst_in_440, addr_ok;
-	s32 res = 0;
 
-	LOG(LOG_DEBUG, "src_addr 0x%x, dst_addr=0x%x, bytes=0x%x", src_addr,
-		dst_addr, bytes);
-	left = bytes;
+	if (xfer->page == eng->page_bak)
+		return;
 
-	while (left > 0) {
-		if (left > dma_max_bytes)
-			bytes = dma_max_bytes;
-		else
-			bytes = left;
+	temp = armcb_apb2_read_reg(0x14);
+	temp &= ~XDMA_PAGE_MASK;
+	temp |= eng->page_bak;
+	armcb_apb2_write_reg(0x14, temp);
+}
+
+/// Start the next chunk of the active transfer, or the next queued one
+static void system_dma_kick(struct system_dma_engine *eng)
+{
+	struct system_dma_xfer *xfer = eng->active;
+	u32 bytes = 0;
+
+	if (!xfer) {
+		xfer = list_first_entry_or_null(&eng->queue,
+						struct system_dma_xfer, node);
+		if (!xfer)
+			return;
+
+		list_del_init(&xfer->node);
+		eng->active = xfer;
+		if (xfer->page != SYSTEM_DMA_NO_PAGE)
+			xdma_page_switch(eng, xfer);
+	}
+
+	bytes = min_t(u32, xfer->bytes - xfer->done_bytes, eng->max_bytes);
+	eng->chunk_bytes = bytes;
+
+	LOG(LOG_DEBUG, "src_addr 0x%x, dst_addr=0x%x, bytes=0x%x",
+	    xfer->src_addr + xfer->done_bytes,
+	    xfer->dst_addr + xfer->done_bytes, bytes);
+
+	// Set source address.
+	eng->ops->write(CDMA_REG_SA, xfer->src_addr + xfer->done_bytes);
+	eng->ops->write(CDMA_REG_SA_MSB, 0x0); // High 32-bit if address bit >32bit.
+
+	// Set destination address.
+	eng->ops->write(CDMA_REG_DA, xfer->dst_addr + xfer->done_bytes);
+	eng->ops->write(CDMA_REG_DA_MSB, 0x0); // High 32-bit if address bit >32bit.
+
+	// Set BTT and start the tx.
+	eng->ops->write(CDMA_REG_BTT, bytes);
+}
+
+static void system_dma_hw_init(struct system_dma_engine *eng)
+{
+	eng->ops->write(CDMA_REG_CR, CDMA_CR_RESET);
+	while (eng->ops->read(CDMA_REG_CR) & CDMA_CR_RESET)
+		cpu_relax();
 
-		// Wait DMA to be idle.
-		temp = CDMA_Read_Int32(0x04);
-		while (!(temp & 0x2)) { // Bit12: IOC, Bit1: Idle.
-			temp = CDMA_Read_Int32(0x04);
+	if (eng->irq >= 0)
+		eng->ops->write(CDMA_REG_CR,
+				CDMA_CR_IOC_IRQ_EN | CDMA_CR_ERR_IRQ_EN);
+}
+
+/// Finish the active transfer and start the next queued one
+static void system_dma_retire(struct system_dma_engine *eng,
+			      struct list_head *done)
+{
+	struct system_dma_xfer *xfer = eng->active;
+
+	if (xfer->page != SYSTEM_DMA_NO_PAGE)
+		xdma_page_restore(eng, xfer);
+
+	eng->active = NULL;
+	list_add_tail(&xfer->node, done);
+	system_dma_kick(eng);
+}
+
+/*
+ * Account the chunk that just finished with status @sr and chain the next
+ * one. Finished transfers are moved to @done, their callbacks run once the
+ * engine lock is dropped.
+ */
+static void system_dma_chunk_done(struct system_dma_engine *eng, u32 sr,
+				  struct list_head *done)
+{
+	struct system_dma_xfer *xfer = eng->active;
+
+	if (!xfer)
+		return;
+
+	if (sr & CDMA_SR_ERR_MASK) {
+		LOG(LOG_ERR, "cdma error sr 0x%x, src 0x%x, dst 0x%x", sr,
+		    xfer->src_addr + xfer->done_bytes,
+		    xfer->dst_addr + xfer->done_bytes);
+		xfer->status = -EIO;
+		system_dma_hw_init(eng);
+	} else {
+		xfer->done_bytes += eng->chunk_bytes;
+		if (xfer->done_bytes < xfer->bytes) {
+			system_dma_kick(eng);
+			return;
 		}
+		xfer->status = xfer->done_bytes;
+	}
+
+	system_dma_retire(eng, done);
+}
+
+/// The active chunk never went idle, reset the engine and fail its transfer
+static void system_dma_chunk_timeout(struct system_dma_engine *eng,
+				     struct list_head *done)
+{
+	struct system_dma_xfer *xfer = eng->active;
 
-		// Address validity check.
-		// (src_addr+bytes)/(dst_addr+bytes) can't cross the end address of xc7z020.
-		//
-		src_in_7020 = (src_addr < MEM_END_7020) &&
-				  ((src_addr + bytes - 1) <= MEM_END_7020);
-		dst_in_7020 = (dst_addr < MEM_END_7020) &&
-				  ((dst_addr + bytes - 1) <= MEM_END_7020);
-		src_in_440 =
-			(src_addr >= MEM_START_440) &&
-			((src_addr + bytes - 1) <=
-			 MEM_END_440); // Assumed MEM_START_440 >= MEM_END_7020.
-		dst_in_440 = (dst_addr >= MEM_START_440) &&
-				 ((dst_addr + bytes - 1) <= MEM_END_440);
-
-		addr_ok = (src_in_7020 && dst_in_7020) ||
-			  (src_in_7020 && dst_in_440) ||
-			  (src_in_440 && dst_in_440) ||
-			  (src_in_440 && dst_in_7020);
-
-		if (!addr_ok) {
-			LOG(LOG_INFO,
-				"DMA address invalid! src= 0x%x, dest= 0x%x, size 0x%x",
-				src_addr, dst_addr, bytes);
-			res = -1;
-			goto RES_EXIT;
+	if (!xfer)
+		return;
+
+	LOG(LOG_ERR, "cdma timeout, src 0x%x, dst 0x%x, bytes 0x%x",
+	    xfer->src_addr + xfer->done_bytes,
+	    xfer->dst_addr + xfer->done_bytes, eng->chunk_bytes);
+	xfer->status = -ETIMEDOUT;
+	system_dma_hw_init(eng);
+	system_dma_retire(eng, done);
+}
+
+static void system_dma_complete(struct list_head *done)
+{
+	struct system_dma_xfer *xfer = NULL;
+	struct system_dma_xfer *next = NULL;
+
+	list_for_each_entry_safe(xfer, next, done, node) {
+		list_del_init(&xfer->node);
+		if (xfer->complete)
+			xfer->complete(xfer, xfer->priv);
+	}
+}
+
+static irqreturn_t system_dma_isr(int irq, void *data)
+{
+	struct system_dma_engine *eng = data;
+	LIST_HEAD(done);
+	u32 sr = 0;
+
+	spin_lock(&eng->lock);
+	sr = eng->ops->read(CDMA_REG_SR);
+	if (!(sr & (CDMA_SR_IOC_IRQ | CDMA_SR_ERR_IRQ))) {
+		spin_unlock(&eng->lock);
+		return IRQ_NONE;
+	}
+
+	// write 1 to clear
+	eng->ops->write(CDMA_REG_SR, sr & (CDMA_SR_IOC_IRQ | CDMA_SR_ERR_IRQ));
+	system_dma_chunk_done(eng, sr, &done);
+	spin_unlock(&eng->lock);
+
+	system_dma_complete(&done);
+
+	return IRQ_HANDLED;
+}
+
+int system_dma_init(struct device *dev, int irq)
+{
+	struct system_dma_engine *eng = &g_dma_engine;
+	int ret = 0;
+
+	if (!armcb_ispmem_get_cdma_base())
+		return -ENODEV;
+
+	if (irq >= 0) {
+		ret = devm_request_irq(dev, irq, system_dma_isr, 0, "armcb-cdma",
+				       eng);
+		if (ret) {
+			LOG(LOG_WARN, "cdma irq %d unavailable (%d), polling",
+			    irq, ret);
+			irq = -1;
 		}
+	}
 
-		// Set source address.
-		CDMA_Write_Int32(0x18, src_addr);
-		CDMA_Write_Int32(0x1c,
-				 0x0); // High 32-bit if address bit >32bit.
+	eng->irq = irq;
+	system_dma_hw_init(eng);
 
-		// Set destination address.
-		CDMA_Write_Int32(0x20, dst_addr);
-		CDMA_Write_Int32(0x24,
-				 0x0); // High 32-bit if address bit >32bit.
+	return 0;
+}
 
-		// Set BTT and start the tx.
-		CDMA_Write_Int32(0x28, bytes);
+void system_dma_xfer_init(struct system_dma_xfer *xfer, u32 src_addr,
+			  u32 dst_addr, u32 bytes, system_dma_cb complete,
+			  void *priv)
+{
+	INIT_LIST_HEAD(&xfer->node);
+	xfer->src_addr = src_addr;
+	xfer->dst_addr = dst_addr;
+	xfer->bytes = bytes;
+	xfer->page = SYSTEM_DMA_NO_PAGE;
+	xfer->done_bytes = 0;
+	xfer->status = 0;
+	xfer->complete = complete;
+	xfer->priv = priv;
+}
+
+/*
+ * Drain the queue by polling, called with the engine lock held and
+ * eng->polling set. The lock is dropped while waiting for each chunk and
+ * for the callbacks, so other submitters can queue meanwhile. A chunk that
+ * doesn't go idle within poll_timeout_us fails with -ETIMEDOUT.
+ */
+static void system_dma_poll(struct system_dma_engine *eng,
+			    unsigned long *flags)
+{
+	LIST_HEAD(done);
+	bool busy = false;
+	u32 sr = 0;
+	int ret = 0;
+
+	while (eng->active || !list_empty(&done)) {
+		busy = eng->active;
+		spin_unlock_irqrestore(&eng->lock, *flags);
 
-		// Wait DMA done.
-		temp = CDMA_Read_Int32(0x04);
-		temp = CDMA_Read_Int32(0x04);
-		while (!(temp & 0x002)) { // Bit12: IOC, Bit1: Idle.
-			temp = CDMA_Read_Int32(0x04);
+		system_dma_complete(&done);
+		if (busy) {
+			// Wait DMA done, the first read may still see the old idle.
+			eng->ops->read(CDMA_REG_SR);
+			ret = read_poll_timeout(eng->ops->read, sr,
+						sr & CDMA_SR_IDLE, 10,
+						eng->poll_timeout_us, false,
+						CDMA_REG_SR);
 		}
 
-		// For next loop.
-		src_addr += bytes;
-		dst_addr += bytes;
-		left -= bytes;
-		res += bytes;
+		spin_lock_irqsave(&eng->lock, *flags);
+		if (!busy)
+			continue;
+
+		if (ret)
+			system_dma_chunk_timeout(eng, &done);
+		else
+			system_dma_chunk_done(eng, sr, &done);
+	}
+}
+
+/*
+ * Queue @xfer behind the transfers already submitted. With an interrupt
+ * line this returns at once and @xfer->complete runs from the ISR. In
+ * polling mode the first submitter drains the queue, later ones return
+ * at once and are completed by it; this may sleep.
+ */
+s32 cdma_submit(struct system_dma_xfer *xfer)
+{
+	struct system_dma_engine *eng = &g_dma_engine;
+	unsigned long flags = 0;
+
+	if (!xfer->bytes ||
+	    !cdma_addr_ok(xfer->src_addr, xfer->dst_addr, xfer->bytes)) {
+		LOG(LOG_INFO,
+		    "DMA address invalid! src= 0x%x, dest= 0x%x, size 0x%x",
+		    xfer->src_addr, xfer->dst_addr, xfer->bytes);
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&eng->lock, flags);
+	list_add_tail(&xfer->node, &eng->queue);
+	if (!eng->active)
+		system_dma_kick(eng);
+
+	if (eng->irq < 0 && !eng->polling) {
+		eng->polling = true;
+		system_dma_poll(eng, &flags);
+		eng->polling = false;
+	}
+	spin_unlock_irqrestore(&eng->lock, flags);
+
+	return 0;
+}
+
+static void system_dma_sync_cb(struct system_dma_xfer *xfer, void *priv)
+{
+	complete(priv);
+}
+
+static s32 system_dma_sync(struct system_dma_xfer *xfer)
+{
+	struct completion done;
+	s32 res = 0;
+
+	init_completion(&done);
+	xfer->complete = system_dma_sync_cb;
+	xfer->priv = &done;
+
+	res = cdma_submit(xfer);
+	if (res < 0)
+		return res;
+
+	wait_for_completion(&done);
+
+	return xfer->status;
+}
+
+s32 cdma_en(u32 src_addr, u32 dst_addr, u32 bytes)
+{
+	struct system_dma_xfer xfer;
+
+	system_dma_xfer_init(&xfer, src_addr, dst_addr, bytes, NULL, NULL);
+
+	return system_dma_sync(&xfer);
+}
+
+/// Fill @xfer for an xdma() style copy, the page is switched per transfer
+void xdma_xfer_init(struct system_dma_xfer *xfer, u32 rmt_addr,
+		    u32 local_addr, u32 bytes, u32 is_local_to_rmt,
+		    system_dma_cb complete, void *priv)
+{
+	u32 page = 0;
+
+	if (rmt_addr >= 0xC0000000) {
+		page = 3;
+		rmt_addr = rmt_addr - 0xC0000000 + 0x40000000;
+	} else if (rmt_addr >= 0x80000000) {
+		page = 2;
+		rmt_addr = rmt_addr - 0x80000000 + 0x40000000;
+	} else if (rmt_addr >= 0x40000000) {
+		page = 1;
+		rmt_addr = rmt_addr - 0x40000000 + 0x40000000;
+	} else {
+		page = 0;
+		rmt_addr = rmt_addr - 0x00000000 + 0x40000000;
 	}
 
-RES_EXIT:
+	if (is_local_to_rmt)
+		system_dma_xfer_init(xfer, local_addr, rmt_addr, bytes,
+				     complete, priv);
+	else
+		system_dma_xfer_init(xfer, rmt_addr, local_addr, bytes,
+				     complete, priv);
 
-	return res;
+	xfer->page = page << XDMA_PAGE_SHIFT;
 }
 
 //---------------------------------------------------------------------------------------------------------
@@ -161,53 +517,15 @@ RES_EXIT:
 //----------------------------------------------------------------------------------------------------------
 s32 xdma(u32 rmt_addr, u32 local_addr, u32 bytes, u32 is_local_to_rmt)
 {
-	u32 page, page_bak, temp;
-	s32 ret = 0;
+	struct system_dma_xfer xfer;
 
-	spin_lock(&xdma_lock);
+	xdma_xfer_init(&xfer, rmt_addr, local_addr, bytes, is_local_to_rmt,
+		       NULL, NULL);
 
-	if (rmt_addr >= 0xC0000000) {
-		page = 3;
-		rmt_addr = rmt_addr - 0xC0000000 + 0x40000000;
-	} else if (rmt_addr >= 0x80000000) {
-		page = 2;
-		rmt_addr = rmt_addr - 0x80000000 + 0x40000000;
-	} else if (rmt_addr >= 0x40000000) {
-		page = 1;
-		rmt_addr = rmt_addr - 0x40000000 + 0x40000000;
-	} else if (rmt_addr >= 0x00000000) {
-		page = 0;
-		rmt_addr = rmt_addr - 0x00000000 + 0x40000000;
-	}
-	page = (page << 16);
-
-	// Set Page address.
-	temp = armcb_apb2_read_reg(0x14);
-	page_bak = temp & (0x07 << 16);
-	LOG(LOG_DEBUG, "temp(%x) page_bak(%x) page(%x)", temp, page_bak, page);
-
-	if (page != page_bak) {
-		temp &= (~(0x07 << 16));
-		temp |= page;
-
-		armcb_apb2_write_reg(0x14, temp);
-	}
-
-	if (is_local_to_rmt) {
-		ret = cdma_en(local_addr, rmt_addr, bytes);
-	} else {
-		ret = cdma_en(rmt_addr, local_addr,
-			      bytes); // cdma_en(src, dest, size)
-	}
-
-	// Resume last page.
-	if (page != page_bak) {
-		temp = armcb_apb2_read_reg(0x14);
-		temp &= (~(0x07 << 16));
-		temp |= page_bak;
-		armcb_apb2_write_reg(0x14, temp);
-	}
-	spin_unlock(&xdma_lock);
-	return ret;
+	return system_dma_sync(&xfer);
 }
 #endif
+
+#if defined(ARMCB_ISP_KUNIT_TEST) && defined(CONFIG_ARENA_FPGA_PLATFORM)
+#include "system_dma_test.c"
+#endif
@@ -16,12 +16,43 @@
 #ifndef __SYSTEM_DMA_H__
 #define __SYSTEM_DMA_H__
 
+#include <linux/device.h>
+#include <linux/list.h>
+#include <linux/types.h>
+
+#define SYSTEM_DMA_NO_PAGE (~0U)
+
+struct system_dma_xfer;
+typedef void (*system_dma_cb)(struct system_dma_xfer *xfer, void *priv);
+
+/// CDMA transfer descriptor, owned by the caller until @complete runs
+struct system_dma_xfer {
+	struct list_head node;
+	u32 src_addr;
+	u32 dst_addr;
+	u32 bytes;
+	u32 page; /// xdma page of the remote side or SYSTEM_DMA_NO_PAGE
+	u32 done_bytes;
+	s32 status; /// bytes transferred or a negative error code
+	system_dma_cb complete;
+	void *priv;
+};
+
 u32 CDMA_Read_Int32(u32 offset);
 void CDMA_Write_Int32(u32 offset, u32 value);
 
 u32 VDMA_Read_Int32(u32 baseaddr, u32 offset);
 void VDMA_Write_Int32(u32 baseaddr, u32 offset, u32 value);
 
+int system_dma_init(struct device *dev, int irq);
+void system_dma_xfer_init(struct system_dma_xfer *xfer, u32 src_addr,
+			  u32 dst_addr, u32 bytes, system_dma_cb complete,
+			  void *priv);
+void xdma_xfer_init(struct system_dma_xfer *xfer, u32 rmt_addr,
+		    u32 local_addr, u32 bytes, u32 is_local_to_rmt,
+		    system_dma_cb complete, void *priv);
+s32 cdma_submit(struct system_dma_xfer *xfer);
+s32 cdma_en(u32 src_addr, u32 dst_addr, u32 bytes);
 s32 xdma(u32 unRmtAddr, u32 unLocalAddr, u32 unBytes, u32 bLocal2Rmt);
 
 #endif
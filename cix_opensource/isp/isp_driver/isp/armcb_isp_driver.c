@@ -18,6 +18,9 @@
 #include "isp_hw_ops.h"
 #include "system_logger.h"
 #include <linux/of_address.h>
+#ifdef ARMCB_ISP_SW_MODEL
+#include "armcb_isp_sw_model.h"
+#endif
 
 #ifdef LOG_MODULE
 #undef LOG_MODULE
@@ -28,12 +31,26 @@
 
 static struct armcb_isp_subdev *p_isp_subdev;
 
+#ifdef ARMCB_ISP_KUNIT_TEST
+/// fake isp block of the KUnit suites, takes every access while set
+u32 *armcb_isp_kunit_regs;
+#endif
+
 unsigned int armcb_isp_read_reg(unsigned int offset)
 {
 	unsigned int reg_val = 0;
-#ifndef QEMU_ON_VEXPRESS
-	void __iomem *virt_addr = p_isp_subdev->reg_base;
+#if !defined(ARMCB_ISP_SW_MODEL) && !defined(QEMU_ON_VEXPRESS)
+	void __iomem *virt_addr = NULL;
+#endif
 
+#ifdef ARMCB_ISP_KUNIT_TEST
+	if (armcb_isp_kunit_regs && offset < ARMCB_ISP_KUNIT_REG_SIZE)
+		return armcb_isp_kunit_regs[offset / 4];
+#endif
+#ifdef ARMCB_ISP_SW_MODEL
+	reg_val = armcb_isp_sw_model_read(ARMCB_SW_MODEL_BLK_ISP, offset);
+#elif !defined(QEMU_ON_VEXPRESS)
+	virt_addr = p_isp_subdev->reg_base;
 	if (virt_addr != NULL) {
 		/* Ensure read order to prevent hardware register access reordering */
 		rmb();
@@ -50,9 +67,14 @@ unsigned int armcb_isp_read_reg(unsigned int offset)
 unsigned int armcb_isp_read_reg2(unsigned int offset)
 {
 	unsigned int reg_val = 0;
-#ifndef QEMU_ON_VEXPRESS
-	void __iomem *virt_addr = p_isp_subdev->reg_base2;
+#if !defined(ARMCB_ISP_SW_MODEL) && !defined(QEMU_ON_VEXPRESS)
+	void __iomem *virt_addr = NULL;
+#endif
 
+#ifdef ARMCB_ISP_SW_MODEL
+	reg_val = armcb_isp_sw_model_read(ARMCB_SW_MODEL_BLK_GDC, offset);
+#elif !defined(QEMU_ON_VEXPRESS)
+	virt_addr = p_isp_subdev->reg_base2;
 	if (virt_addr != NULL) {
 		/* Ensure read order to prevent hardware register access reordering */
 		rmb();
@@ -66,15 +88,27 @@ unsigned int armcb_isp_read_reg2(unsigned int offset)
 
 void armcb_isp_write_reg(unsigned int offset, unsigned int value)
 {
-#ifndef QEMU_ON_VEXPRESS
-	void __iomem *virt_addr = p_isp_subdev->reg_base;
+#if !defined(ARMCB_ISP_SW_MODEL) && !defined(QEMU_ON_VEXPRESS)
+	void __iomem *virt_addr = NULL;
+#endif
 
+#ifdef ARMCB_ISP_KUNIT_TEST
+	if (armcb_isp_kunit_regs && offset < ARMCB_ISP_KUNIT_REG_SIZE) {
+		armcb_isp_kunit_regs[offset / 4] = value;
+		return;
+	}
+#endif
+#ifdef ARMCB_ISP_SW_MODEL
+	armcb_isp_sw_model_write(ARMCB_SW_MODEL_BLK_ISP, offset, value);
+#elif !defined(QEMU_ON_VEXPRESS)
+	virt_addr = p_isp_subdev->reg_base;
 	if (virt_addr != NULL) {
 		/* Ensure write order to prevent hardware register access reordering */
 		wmb();
 #ifndef ARMCB_CAM_DEBUG
 		writel(value, virt_addr + offset);
 #endif
+		armcb_isp_shadow_reg(offset, value);
 	} else {
 		LOG(LOG_ERR, "read isp reg failed !");
 	}
@@ -83,19 +117,201 @@ void armcb_isp_write_reg(unsigned int offset, unsigned int value)
 
 void armcb_isp_write_reg2(unsigned int offset, unsigned int value)
 {
-#ifndef QEMU_ON_VEXPRESS
-	void __iomem *virt_addr = p_isp_subdev->reg_base2;
+#if !defined(ARMCB_ISP_SW_MODEL) && !defined(QEMU_ON_VEXPRESS)
+	void __iomem *virt_addr = NULL;
+#endif
 
+#ifdef ARMCB_ISP_SW_MODEL
+	armcb_isp_sw_model_write(ARMCB_SW_MODEL_BLK_GDC, offset, value);
+#elif !defined(QEMU_ON_VEXPRESS)
+	virt_addr = p_isp_subdev->reg_base2;
 	if (virt_addr != NULL) {
 		/* Ensure write order to prevent hardware register access reordering */
 		wmb();
 		writel(value, virt_addr + offset);
+		armcb_isp_shadow_reg2(offset, value);
 	} else {
 		LOG(LOG_ERR, "read isp reg failed !");
 	}
 #endif
 }
 
+/// iomem of the isp block for batched relaxed writes, NULL if not mapped
+void __iomem *armcb_isp_get_reg_base(void)
+{
+#if !defined(QEMU_ON_VEXPRESS) && !defined(ARMCB_CAM_DEBUG) && \
+	!defined(ARMCB_ISP_SW_MODEL)
+	if (p_isp_subdev)
+		return p_isp_subdev->reg_base;
+#endif
+	return NULL;
+}
+
+/// iomem of the gdc block for batched relaxed writes, NULL if not mapped
+void __iomem *armcb_isp_get_reg_base2(void)
+{
+#if !defined(QEMU_ON_VEXPRESS) && !defined(ARMCB_ISP_SW_MODEL)
+	if (p_isp_subdev)
+		return p_isp_subdev->reg_base2;
+#endif
+	return NULL;
+}
+
+/* [start, end) of a block the shadow keeps */
+struct armcb_isp_shadow_range {
+	int blk;
+	u32 start;
+	u32 end;
+};
+
+/*
+ * Static configuration of the i7, the only registers replayed on resume:
+ * the interrupt masks and the pipeline modules from the vin on. Left out
+ * are the write one to clear and status registers, the frame count
+ * selects the isr writes before reading them back, and the top and dma
+ * blocks below the vin, whose buffer addresses and dump enables change
+ * every frame and are programmed again by the streamon command list.
+ * The gdc is programmed job by job, start included, so none of it is
+ * kept: replaying it could start a job on freed buffers.
+ */
+static const struct armcb_isp_shadow_range armcb_i7_shadow_static[] = {
+	{ ARMCB_ISP_SHADOW_ISP, I7_INT_MASK_ADDR, I7_INT_MASK_ADDR + 4 },
+	{ ARMCB_ISP_SHADOW_ISP, I7_INT_ERR_MASK_ADDR, I7_INT_ERR_MASK_ADDR + 4 },
+	{ ARMCB_ISP_SHADOW_ISP, I7_VIN_BASE_ADDR, I7_INT_SOF_FRMCNT_SEL_ADDR },
+	{ ARMCB_ISP_SHADOW_ISP, I7_INT_SOF_FRMCNT_SEL_ADDR + 4,
+	  I7_INT_SOF_FRMCNT_ADDR },
+	{ ARMCB_ISP_SHADOW_ISP, I7_INT_SOF_FRMCNT_ADDR + 4,
+	  I7_INT_AFBC_CLEAR_ADDR },
+	{ ARMCB_ISP_SHADOW_ISP, I7_INT_AFBC_STATUS_ADDR + 4,
+	  ARMCB_ISP_SHADOW_MAX_BYTES },
+};
+
+/// allowlist of the isp type probed, nothing is shadowed without one
+static const struct armcb_isp_shadow_range *g_shadow_static;
+static unsigned int g_shadow_nstatic;
+
+void armcb_isp_shadow_enable_i7(void)
+{
+	g_shadow_nstatic = ARRAY_SIZE(armcb_i7_shadow_static);
+	/* pairs with the acquire in armcb_isp_shadow_static() */
+	smp_store_release(&g_shadow_static, armcb_i7_shadow_static);
+}
+
+static bool armcb_isp_shadow_static(int blk, u32 offset)
+{
+	const struct armcb_isp_shadow_range *range =
+		smp_load_acquire(&g_shadow_static);
+	unsigned int i = 0;
+
+	for (i = 0; range && i < g_shadow_nstatic; i++, range++) {
+		if (range->blk == blk && offset >= range->start &&
+		    offset < range->end)
+			return true;
+	}
+
+	return false;
+}
+
+static void armcb_isp_shadow_record(int blk, u32 offset, u32 value)
+{
+	struct armcb_isp_shadow *shadow = NULL;
+
+	if (!p_isp_subdev)
+		return;
+
+	shadow = &p_isp_subdev->shadow[blk];
+	if (!shadow->val || offset / 4 >= shadow->words ||
+	    !armcb_isp_shadow_static(blk, offset))
+		return;
+
+	WRITE_ONCE(shadow->val[offset / 4], value);
+	set_bit(offset / 4, shadow->set);
+}
+
+/// record a write done outside armcb_isp_write_reg, e.g. batched writes
+void armcb_isp_shadow_reg(u32 offset, u32 value)
+{
+	armcb_isp_shadow_record(ARMCB_ISP_SHADOW_ISP, offset, value);
+}
+
+void armcb_isp_shadow_reg2(u32 offset, u32 value)
+{
+	armcb_isp_shadow_record(ARMCB_ISP_SHADOW_GDC, offset, value);
+}
+
+/**
+ * @description: forget the shadow, the block comes back from a reset
+ *               requested on error and its configuration is redone
+ * @return {*}
+ */
+void armcb_isp_shadow_clear(void)
+{
+	struct armcb_isp_shadow *shadow = NULL;
+	int blk = 0;
+
+	if (!p_isp_subdev)
+		return;
+
+	for (blk = 0; blk < ARMCB_ISP_SHADOW_BLKS; blk++) {
+		shadow = &p_isp_subdev->shadow[blk];
+		if (shadow->val)
+			bitmap_zero(shadow->set, shadow->words);
+	}
+}
+
+/**
+ * @description: replay the shadow into the blocks after a power cycle,
+ *               in offset order with a single barrier at the end
+ * @return {int} number of registers written
+ */
+int armcb_isp_shadow_restore(void)
+{
+	struct armcb_isp_shadow *shadow = NULL;
+	void __iomem *base = NULL;
+	unsigned long i = 0;
+	int blk = 0;
+	int cnt = 0;
+
+	if (!p_isp_subdev)
+		return 0;
+
+	for (blk = 0; blk < ARMCB_ISP_SHADOW_BLKS; blk++) {
+		shadow = &p_isp_subdev->shadow[blk];
+		base = blk == ARMCB_ISP_SHADOW_ISP ? armcb_isp_get_reg_base() :
+						     armcb_isp_get_reg_base2();
+		if (!base || !shadow->val)
+			continue;
+
+		for_each_set_bit(i, shadow->set, shadow->words) {
+			writel_relaxed(READ_ONCE(shadow->val[i]), base + i * 4);
+			cnt++;
+		}
+	}
+	/* the block must be configured before anyone starts it */
+	wmb();
+
+	return cnt;
+}
+
+static int armcb_isp_shadow_init(struct armcb_isp_subdev *pisp_sd, int blk,
+				 struct resource *rsr)
+{
+	struct device *dev = &pisp_sd->ppdev->dev;
+	struct armcb_isp_shadow *shadow = &pisp_sd->shadow[blk];
+
+	shadow->words = min_t(resource_size_t, resource_size(rsr),
+			      ARMCB_ISP_SHADOW_MAX_BYTES) / 4;
+	shadow->val = devm_kcalloc(dev, shadow->words, sizeof(u32), GFP_KERNEL);
+	shadow->set = devm_kcalloc(dev, BITS_TO_LONGS(shadow->words),
+				   sizeof(unsigned long), GFP_KERNEL);
+	if (!shadow->val || !shadow->set) {
+		shadow->val = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
 static int armcb_isp_parse(struct armcb_isp_subdev *pisp_sd)
 {
 	struct platform_device *ppdev = pisp_sd->ppdev;
@@ -117,6 +333,12 @@ static int armcb_isp_parse(struct armcb_isp_subdev *pisp_sd)
 		LOG(LOG_ERR, "failed to get and map isp base");
 		goto EXIT_RET;
 	}
+
+	/* without a shadow runtime resume falls back to a cold block */
+	if (armcb_isp_shadow_init(pisp_sd, ARMCB_ISP_SHADOW_ISP,
+				  platform_get_resource(ppdev, IORESOURCE_MEM, 0)) ||
+	    armcb_isp_shadow_init(pisp_sd, ARMCB_ISP_SHADOW_GDC, rsr))
+		LOG(LOG_WARN, "failed to alloc isp register shadow");
 EXIT_RET:
 	return res;
 }
@@ -252,7 +474,10 @@ static int armcb_ispdrv_probe(struct platform_device *pdev)
 	init_waitqueue_head(&p_isp_subdev->state_wait);
 	platform_set_drvdata(pdev, p_isp_subdev);
 
+#ifndef ARMCB_ISP_SW_MODEL
+	/* the software model keeps its registers in memory */
 	res = armcb_isp_parse(p_isp_subdev);
+#endif
 	if (res < 0) {
 		LOG(LOG_ERR, "isp failed to parse dt res = %d", res);
 		goto ERR_FREE_RET2;
@@ -354,3 +579,7 @@ void armcb_isp_driver_destroy(void)
 			(struct platform_driver *)g_instance);
 }
 #endif
+
+#ifdef ARMCB_ISP_KUNIT_TEST
+#include "armcb_isp_driver_test.c"
+#endif
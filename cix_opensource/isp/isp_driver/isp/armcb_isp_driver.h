@@ -27,6 +27,7 @@
 #include <linux/of_irq.h>
 #include <linux/platform_device.h>
 #include <linux/slab.h>
+#include <linux/sizes.h>
 #include <linux/types.h>
 
 #define ISP_NEVENTS (32)
@@ -199,6 +200,22 @@ struct isp_irq_info {
 	unsigned int err_detail_status[ERR_DETAIL_NUM];
 };
 
+/* ISP and GDC register blocks kept in the shadow */
+#define ARMCB_ISP_SHADOW_ISP 0
+#define ARMCB_ISP_SHADOW_GDC 1
+#define ARMCB_ISP_SHADOW_BLKS 2
+#define ARMCB_ISP_SHADOW_MAX_BYTES SZ_256K
+
+/*
+ * last value written to each static configuration register of a block,
+ * see armcb_i7_shadow_static for what is kept
+ */
+struct armcb_isp_shadow {
+	u32 *val;
+	unsigned long *set; /// registers written at least once
+	u32 words;
+};
+
 struct armcb_isp_subdev {
 	struct mutex imutex;
 	spinlock_t sdlock;
@@ -219,12 +236,26 @@ struct armcb_isp_subdev {
 	void __iomem *reg_base;
 
 	void __iomem *reg_base2; /// only for gdc
+
+	struct armcb_isp_shadow shadow[ARMCB_ISP_SHADOW_BLKS];
 };
 
 unsigned int armcb_isp_read_reg(unsigned int offset);
 unsigned int armcb_isp_read_reg2(unsigned int offset);
 void armcb_isp_write_reg(unsigned int offset, unsigned int value);
 void armcb_isp_write_reg2(unsigned int offset, unsigned int value);
+void __iomem *armcb_isp_get_reg_base(void);
+void __iomem *armcb_isp_get_reg_base2(void);
+void armcb_isp_shadow_reg(u32 offset, u32 value);
+void armcb_isp_shadow_reg2(u32 offset, u32 value);
+int armcb_isp_shadow_restore(void);
+void armcb_isp_shadow_clear(void);
+/// shadow the static registers of the i7 map, called once the type is known
+void armcb_isp_shadow_enable_i7(void);
+#ifdef ARMCB_ISP_KUNIT_TEST
+#define ARMCB_ISP_KUNIT_REG_SIZE SZ_64K
+extern u32 *armcb_isp_kunit_regs;
+#endif
 #ifdef ARMCB_CAM_KO
 void *armcb_get_isp_driver_instance(void);
 void armcb_isp_driver_destroy(void);
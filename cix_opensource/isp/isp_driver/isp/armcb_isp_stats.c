@@ -0,0 +1,564 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#include "armcb_isp_stats.h"
+#include "armcb_isp_driver.h"
+#include "armcb_register.h"
+#include "armcb_v4l2_core.h"
+#include "system_logger.h"
+#include <linux/dma-mapping.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#ifdef LOG_MODULE
+#undef LOG_MODULE
+#define LOG_MODULE LOG_MODULE_ISP
+#endif
+
+/* the 3a address is double buffered: one frame in flight, one latched */
+#define ARMCB_STATS_INFLIGHT 2
+#define ARMCB_STATS_MAX_BYTES SZ_16M
+
+struct armcb_stats_inflight {
+	u32 slot;
+	bool drop; /// slot was programmed again for a later frame
+	bool latched; /// a sol since it was programmed, a frame writes it
+};
+
+struct armcb_stats_ring {
+	u32 ctx_id;
+	u32 slots;
+	u32 slot_stride;
+	size_t size;
+	void *vaddr;
+	dma_addr_t dma;
+	struct armcb_stats_ring_hdr *hdr;
+	wait_queue_head_t wq;
+
+	/* slots handed to the ISP, oldest first */
+	struct armcb_stats_inflight inflight[ARMCB_STATS_INFLIGHT];
+	u32 ninflight;
+
+	u32 reg_slot; /// slot last written to the 3a address
+	u32 unlatched_sol; /// sol that pointed the 3a address elsewhere
+	/* fd closed, freed once the ISP is done with the inflight slots */
+	bool retiring;
+	struct list_head node;
+};
+
+extern struct device *mem_dev;
+
+/* protects g_stats_rings, the 3a address and the inflight state */
+static DEFINE_SPINLOCK(g_stats_lock);
+static struct armcb_stats_ring *g_stats_rings[ARMCB_MAX_DEVS];
+/* serializes the setup of a ring against another one on the same fd */
+static DEFINE_MUTEX(g_stats_setup_lock);
+
+/*
+ * The 3a address is a single register shared by every ctx, only written at
+ * sol for the frame of the ctx about to start. g_stats_reg_ring is the ring
+ * it points into, closed rings wait on g_stats_parked until it doesn't and
+ * the frames that latched it are done.
+ */
+static struct armcb_stats_ring *g_stats_reg_ring;
+static u32 g_stats_sol;
+static LIST_HEAD(g_stats_parked);
+
+/* rings retired from the isr, dma_free_coherent() may sleep */
+static LIST_HEAD(g_stats_retired);
+static void armcb_stats_free_work(struct work_struct *work);
+static DECLARE_WORK(g_stats_free_work, armcb_stats_free_work);
+
+static dma_addr_t armcb_stats_slot_dma(struct armcb_stats_ring *ring,
+				       u32 slot)
+{
+	return ring->dma + PAGE_SIZE + (dma_addr_t)slot * ring->slot_stride;
+}
+
+/* first slot neither held by userspace nor handed to the ISP */
+static int armcb_stats_free_slot(struct armcb_stats_ring *ring)
+{
+	struct armcb_stats_ring_hdr *hdr = ring->hdr;
+	unsigned long busy = 0;
+	u32 head = hdr->head;
+	u32 tail = READ_ONCE(hdr->tail);
+	u32 i = 0;
+
+	if (head - tail > ring->slots)
+		tail = head - ring->slots;
+
+	for (i = tail; i != head; i++) {
+		/* the header is shared, don't trust it to index the bitmap */
+		if (hdr->info[i % ring->slots].slot < ring->slots)
+			__set_bit(hdr->info[i % ring->slots].slot, &busy);
+	}
+	for (i = 0; i < ring->ninflight; i++)
+		__set_bit(ring->inflight[i].slot, &busy);
+
+	i = find_first_zero_bit(&busy, ring->slots);
+
+	return i < ring->slots ? i : -ENOSPC;
+}
+
+static void armcb_stats_write_locked(struct armcb_stats_ring *ring,
+				     dma_addr_t dma)
+{
+	struct armcb_stats_ring *prev = g_stats_reg_ring;
+
+	armcb_isp_write_reg(I7_3A_START_ADDR, (u32)dma);
+	g_stats_reg_ring = ring;
+	/* the frame starting latched @prev, it may write it one more frame */
+	if (prev && prev != ring)
+		prev->unlatched_sol = g_stats_sol;
+}
+
+/* hand the parked rings nothing can write anymore to the free work */
+static void armcb_stats_reap_locked(void)
+{
+	struct armcb_stats_ring *ring = NULL;
+	struct armcb_stats_ring *tmp = NULL;
+	bool reaped = false;
+
+	list_for_each_entry_safe(ring, tmp, &g_stats_parked, node) {
+		if (ring == g_stats_reg_ring ||
+		    g_stats_sol - ring->unlatched_sol < ARMCB_STATS_INFLIGHT)
+			continue;
+		list_move_tail(&ring->node, &g_stats_retired);
+		reaped = true;
+	}
+
+	if (reaped)
+		schedule_work(&g_stats_free_work);
+}
+
+/* a closed ring without inflight slots leaves its ctx for good */
+static void armcb_stats_park_locked(struct armcb_stats_ring *ring)
+{
+	if (g_stats_rings[ring->ctx_id] == ring)
+		g_stats_rings[ring->ctx_id] = NULL;
+	list_add_tail(&ring->node, &g_stats_parked);
+	armcb_stats_reap_locked();
+}
+
+static void armcb_stats_program_locked(struct armcb_stats_ring *ring)
+{
+	struct armcb_stats_inflight *last = NULL;
+	int slot = 0;
+	u32 i = 0;
+
+	/* the frame starting latched the address programmed last */
+	for (i = 0; i < ring->ninflight; i++)
+		ring->inflight[i].latched = true;
+
+	/* a done interrupt went missing, forget the oldest frame */
+	if (ring->ninflight == ARMCB_STATS_INFLIGHT) {
+		ring->inflight[0] = ring->inflight[1];
+		ring->ninflight--;
+	}
+
+	if (ring->retiring) {
+		/*
+		 * nothing new for a closed ring, let the inflight slots drain.
+		 * Without a discard buffer the port keeps its slot and the
+		 * ring stays parked until another address replaces it.
+		 */
+		if (discard_buf_addr_dma)
+			armcb_stats_write_locked(NULL, discard_buf_addr_dma);
+		return;
+	}
+
+	slot = armcb_stats_free_slot(ring);
+	if (slot < 0) {
+		/* only a bogus tail gets here, keep the current address */
+		if (!ring->ninflight)
+			return;
+		last = &ring->inflight[ring->ninflight - 1];
+		slot = last->slot;
+		last->drop = true;
+	}
+
+	ring->inflight[ring->ninflight].slot = slot;
+	ring->inflight[ring->ninflight].drop = false;
+	ring->inflight[ring->ninflight].latched = false;
+	ring->ninflight++;
+
+	ring->reg_slot = slot;
+	armcb_stats_write_locked(ring, armcb_stats_slot_dma(ring, slot));
+}
+
+void armcb_isp_stats_ring_program(u32 ctx_id)
+{
+	struct armcb_stats_ring *ring = NULL;
+	unsigned long flags;
+
+	if (ctx_id >= ARMCB_MAX_DEVS)
+		return;
+
+	spin_lock_irqsave(&g_stats_lock, flags);
+	g_stats_sol++;
+	ring = g_stats_rings[ctx_id];
+	if (ring)
+		armcb_stats_program_locked(ring);
+#ifndef ENABLE_RUNTIME_UPDATE_STATS_ADDR
+	/* a ctx without a ring must not write the slots of another one */
+	else if (g_stats_reg_ring && discard_buf_addr_dma)
+		armcb_stats_write_locked(NULL, discard_buf_addr_dma);
+#endif
+	armcb_stats_reap_locked();
+	spin_unlock_irqrestore(&g_stats_lock, flags);
+}
+
+bool armcb_isp_stats_ring_done(u32 ctx_id, u32 frame)
+{
+	struct armcb_stats_ring_hdr *hdr = NULL;
+	struct armcb_stats_ring *ring = NULL;
+	struct armcb_stats_inflight done;
+	struct armcb_stats_slot_info *info = NULL;
+	unsigned long flags;
+	u32 head = 0;
+
+	if (ctx_id >= ARMCB_MAX_DEVS)
+		return false;
+
+	spin_lock_irqsave(&g_stats_lock, flags);
+	ring = g_stats_rings[ctx_id];
+	if (!ring) {
+		spin_unlock_irqrestore(&g_stats_lock, flags);
+		return false;
+	}
+
+	hdr = ring->hdr;
+	/* a frame latched before the ring was set up or streamed on */
+	if (!ring->ninflight || !ring->inflight[0].latched) {
+		hdr->dropped++;
+		goto unlock;
+	}
+
+	done = ring->inflight[0];
+	ring->inflight[0] = ring->inflight[1];
+	ring->ninflight--;
+	if (ring->retiring) {
+		if (!ring->ninflight)
+			armcb_stats_park_locked(ring);
+		goto unlock;
+	}
+	if (done.drop) {
+		hdr->dropped++;
+		goto unlock;
+	}
+
+	/* keep a free slot for the next sol whatever userspace holds */
+	head = hdr->head;
+	if (head - READ_ONCE(hdr->tail) >= ring->slots - ARMCB_STATS_INFLIGHT) {
+		hdr->dropped++;
+		goto unlock;
+	}
+
+	info = &hdr->info[head % ring->slots];
+	info->slot = done.slot;
+	info->frame = frame;
+	info->ts_ns = ktime_get_ns();
+	/* the entry must be visible before userspace sees the new head */
+	smp_store_release(&hdr->head, head + 1);
+	wake_up_interruptible(&ring->wq);
+
+unlock:
+	spin_unlock_irqrestore(&g_stats_lock, flags);
+	return true;
+}
+
+bool armcb_isp_stats_ring_active(u32 ctx_id)
+{
+	return ctx_id < ARMCB_MAX_DEVS && READ_ONCE(g_stats_rings[ctx_id]);
+}
+
+static void armcb_stats_ring_free(struct armcb_stats_ring *ring)
+{
+	dma_free_coherent(mem_dev, ring->size, ring->vaddr, ring->dma);
+	kfree(ring);
+}
+
+static void armcb_stats_free_work(struct work_struct *work)
+{
+	struct armcb_stats_ring *ring = NULL;
+	struct armcb_stats_ring *tmp = NULL;
+	unsigned long flags;
+	LIST_HEAD(retired);
+
+	spin_lock_irqsave(&g_stats_lock, flags);
+	list_splice_init(&g_stats_retired, &retired);
+	spin_unlock_irqrestore(&g_stats_lock, flags);
+
+	list_for_each_entry_safe(ring, tmp, &retired, node) {
+		LOG(LOG_INFO, "ctx %u stats ring retired", ring->ctx_id);
+		armcb_stats_ring_free(ring);
+	}
+}
+
+void armcb_isp_stats_ring_stop(u32 ctx_id)
+{
+	struct armcb_stats_ring *ring = NULL;
+	unsigned long flags;
+
+	if (ctx_id >= ARMCB_MAX_DEVS)
+		return;
+
+	spin_lock_irqsave(&g_stats_lock, flags);
+	ring = g_stats_rings[ctx_id];
+	if (ring) {
+		/* the ISP is stopped, no slot is in flight anymore */
+		ring->ninflight = 0;
+		if (ring->retiring) {
+			armcb_stats_park_locked(ring);
+		} else if (g_stats_reg_ring == ring) {
+			/* the first frame of the next stream on writes it */
+			ring->inflight[0].slot = ring->reg_slot;
+			ring->inflight[0].drop = false;
+			ring->inflight[0].latched = false;
+			ring->ninflight = 1;
+		}
+	}
+
+	/* nothing of this ctx is in flight, only the 3a address holds a ring */
+	list_for_each_entry(ring, &g_stats_parked, node) {
+		if (ring->ctx_id == ctx_id && ring != g_stats_reg_ring)
+			ring->unlatched_sol = g_stats_sol - ARMCB_STATS_INFLIGHT;
+	}
+	armcb_stats_reap_locked();
+	spin_unlock_irqrestore(&g_stats_lock, flags);
+}
+
+/* pairs with the release in armcb_stats_setup() */
+static struct armcb_stats_ring *armcb_stats_file_ring(struct file *file)
+{
+	return smp_load_acquire(&file->private_data);
+}
+
+static int armcb_stats_setup(struct file *file,
+			     struct armcb_stats_setup *setup)
+{
+	struct armcb_stats_ring *ring = NULL;
+	unsigned long flags;
+	size_t size = 0;
+	int ret = 0;
+
+	if (!mem_dev || setup->ctx_id >= ARMCB_MAX_DEVS ||
+	    setup->slots < ARMCB_STATS_MIN_SLOTS ||
+	    setup->slots > ARMCB_STATS_MAX_SLOTS || !setup->slot_size)
+		return -EINVAL;
+
+	size = PAGE_SIZE + (size_t)setup->slots * PAGE_ALIGN(setup->slot_size);
+	if (size > ARMCB_STATS_MAX_BYTES)
+		return -EINVAL;
+
+	mutex_lock(&g_stats_setup_lock);
+	if (file->private_data) {
+		mutex_unlock(&g_stats_setup_lock);
+		return -EBUSY;
+	}
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring) {
+		mutex_unlock(&g_stats_setup_lock);
+		return -ENOMEM;
+	}
+
+	ring->vaddr = dma_alloc_coherent(mem_dev, size, &ring->dma, GFP_KERNEL);
+	if (!ring->vaddr) {
+		kfree(ring);
+		mutex_unlock(&g_stats_setup_lock);
+		return -ENOMEM;
+	}
+
+	ring->ctx_id = setup->ctx_id;
+	ring->slots = setup->slots;
+	ring->slot_stride = PAGE_ALIGN(setup->slot_size);
+	ring->size = size;
+	ring->hdr = ring->vaddr;
+	ring->hdr->slots = ring->slots;
+	ring->hdr->slot_stride = ring->slot_stride;
+	init_waitqueue_head(&ring->wq);
+
+	/* the 3a address is programmed at the next sol of the ctx, not here */
+	spin_lock_irqsave(&g_stats_lock, flags);
+	if (g_stats_rings[ring->ctx_id]) {
+		ret = -EBUSY;
+	} else {
+		/* never latched, nothing to wait for once parked */
+		ring->unlatched_sol = g_stats_sol - ARMCB_STATS_INFLIGHT;
+		g_stats_rings[ring->ctx_id] = ring;
+	}
+	spin_unlock_irqrestore(&g_stats_lock, flags);
+
+	if (ret) {
+		mutex_unlock(&g_stats_setup_lock);
+		armcb_stats_ring_free(ring);
+		return ret;
+	}
+
+	/* poll and mmap don't take the lock, publish the ring initialized */
+	smp_store_release(&file->private_data, ring);
+	mutex_unlock(&g_stats_setup_lock);
+	setup->map_size = size;
+	LOG(LOG_INFO, "ctx %u stats ring %u x %u bytes", ring->ctx_id,
+	    ring->slots, ring->slot_stride);
+
+	return 0;
+}
+
+static long armcb_stats_ioctl(struct file *file, unsigned int cmd,
+			      unsigned long arg)
+{
+	struct armcb_stats_setup setup;
+	int ret = 0;
+
+	switch (cmd) {
+	case ARMCB_STATS_IOC_SETUP:
+		if (copy_from_user(&setup, (void __user *)arg, sizeof(setup)))
+			return -EFAULT;
+		ret = armcb_stats_setup(file, &setup);
+		if (!ret &&
+		    copy_to_user((void __user *)arg, &setup, sizeof(setup)))
+			ret = -EFAULT;
+		break;
+	default:
+		ret = -ENOTTY;
+		break;
+	}
+
+	return ret;
+}
+
+static __poll_t armcb_stats_poll(struct file *file, poll_table *wait)
+{
+	struct armcb_stats_ring *ring = armcb_stats_file_ring(file);
+
+	if (!ring)
+		return EPOLLERR;
+
+	poll_wait(file, &ring->wq, wait);
+	if (smp_load_acquire(&ring->hdr->head) != READ_ONCE(ring->hdr->tail))
+		return EPOLLIN | EPOLLRDNORM;
+
+	return 0;
+}
+
+static int armcb_stats_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct armcb_stats_ring *ring = armcb_stats_file_ring(file);
+
+	if (!ring)
+		return -EINVAL;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != ring->size)
+		return -EINVAL;
+
+	return dma_mmap_coherent(mem_dev, vma, ring->vaddr, ring->dma,
+				 ring->size);
+}
+
+/*
+ * The 3a address may be latched by a frame of another ctx, so it is left
+ * alone here and the next sol of the ring's ctx points it at the discard
+ * buffer. The frames that latched a slot still write it: the ring is freed
+ * once they are done, the address points elsewhere and two more sols went
+ * by, or by stream off. Without a discard buffer the address keeps the
+ * last slot and the ring stays until another one replaces it.
+ */
+static int armcb_stats_release(struct inode *inode, struct file *file)
+{
+	struct armcb_stats_ring *ring = file->private_data;
+	unsigned long flags;
+
+	if (!ring)
+		return 0;
+
+	LOG(LOG_INFO, "ctx %u stats ring released, dropped %u", ring->ctx_id,
+	    ring->hdr->dropped);
+
+	spin_lock_irqsave(&g_stats_lock, flags);
+	ring->retiring = true;
+	if (!ring->ninflight)
+		armcb_stats_park_locked(ring);
+	spin_unlock_irqrestore(&g_stats_lock, flags);
+
+	file->private_data = NULL;
+
+	return 0;
+}
+
+static const struct file_operations armcb_stats_fops = {
+	.owner = THIS_MODULE,
+	.unlocked_ioctl = armcb_stats_ioctl,
+	.poll = armcb_stats_poll,
+	.mmap = armcb_stats_mmap,
+	.release = armcb_stats_release,
+};
+
+static struct miscdevice armcb_stats_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "armcb-isp-stats",
+	.fops = &armcb_stats_fops,
+};
+
+int armcb_isp_stats_init(void)
+{
+	int ret = misc_register(&armcb_stats_misc);
+
+	if (ret)
+		LOG(LOG_ERR, "failed to register stats ring device ret(%d)", ret);
+
+	return ret;
+}
+
+void armcb_isp_stats_exit(void)
+{
+	struct armcb_stats_ring *ring = NULL;
+	struct armcb_stats_ring *tmp = NULL;
+	unsigned long flags;
+	LIST_HEAD(parked);
+	u32 i = 0;
+
+	misc_deregister(&armcb_stats_misc);
+	flush_work(&g_stats_free_work);
+
+	/* every fd is closed, only rings waiting for a stream off are left */
+	for (i = 0; i < ARMCB_MAX_DEVS; i++) {
+		spin_lock_irqsave(&g_stats_lock, flags);
+		ring = g_stats_rings[i];
+		g_stats_rings[i] = NULL;
+		spin_unlock_irqrestore(&g_stats_lock, flags);
+		if (ring)
+			armcb_stats_ring_free(ring);
+	}
+
+	/* the ISP is gone, the 3a address doesn't hold a parked ring anymore */
+	spin_lock_irqsave(&g_stats_lock, flags);
+	list_splice_init(&g_stats_parked, &parked);
+	g_stats_reg_ring = NULL;
+	spin_unlock_irqrestore(&g_stats_lock, flags);
+
+	list_for_each_entry_safe(ring, tmp, &parked, node)
+		armcb_stats_ring_free(ring);
+}
+
+#ifdef ARMCB_ISP_KUNIT_TEST
+#include "armcb_isp_stats_test.c"
+#endif
@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#ifndef __ARMCB_ISP_STATS_H__
+#define __ARMCB_ISP_STATS_H__
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * 3A statistics ring, /dev/armcb-isp-stats
+ *
+ * ARMCB_STATS_IOC_SETUP binds the fd to a ctx and allocates the ring, mmap
+ * of map_size bytes at offset 0 returns the header page followed by the
+ * slot buffers, slot_stride bytes each. The driver publishes an entry by
+ * bumping head, userspace releases it by bumping tail. Both are free
+ * running counters and entry i is info[i % slots], naming the slot buffer
+ * that holds its statistics. Slots named by [tail, head) belong to
+ * userspace and are never written by the ISP, two more are kept for the
+ * frame in flight and the latched one. poll() reports POLLIN while
+ * head != tail. While userspace holds slots - 2 entries new frames are
+ * not published and are counted in dropped.
+ */
+#define ARMCB_STATS_MIN_SLOTS 4
+#define ARMCB_STATS_MAX_SLOTS 16
+
+struct armcb_stats_slot_info {
+	__u32 slot; /// slot buffer holding the statistics
+	__u32 frame; /// 3a frame count of the statistics
+	__u64 ts_ns; /// CLOCK_MONOTONIC time of the 3a done interrupt
+};
+
+struct armcb_stats_ring_hdr {
+	__u32 slots;
+	__u32 slot_stride;
+	__u32 head; /// written by the driver
+	__u32 tail; /// written by userspace
+	__u32 dropped;
+	__u32 reserved[3];
+	struct armcb_stats_slot_info info[ARMCB_STATS_MAX_SLOTS];
+};
+
+struct armcb_stats_setup {
+	__u32 ctx_id;
+	__u32 slots;
+	__u32 slot_size;
+	__u32 map_size; /// out: bytes to mmap
+};
+
+#define ARMCB_STATS_IOC_MAGIC 'S'
+#define ARMCB_STATS_IOC_SETUP \
+	_IOWR(ARMCB_STATS_IOC_MAGIC, 0, struct armcb_stats_setup)
+
+#ifdef __KERNEL__
+/**
+ * @description: publish the slot the ISP just finished, 3a done irq
+ * @param {u32} ctx_id: ctx of the interrupt
+ * @param {u32} frame: 3a frame count
+ * @return {bool} true when a ring owns the 3a port of @ctx_id
+ */
+bool armcb_isp_stats_ring_done(u32 ctx_id, u32 frame);
+
+/**
+ * @description: program the 3a address of the next frame of @ctx_id,
+ *               called from the sol irq next to the vout addresses
+ * @param {u32} ctx_id: ctx about to be processed
+ * @return {*}
+ */
+void armcb_isp_stats_ring_program(u32 ctx_id);
+
+/**
+ * @description: whether a ring owns the 3a port of @ctx_id
+ * @param {u32} ctx_id: ctx index
+ * @return {bool}
+ */
+bool armcb_isp_stats_ring_active(u32 ctx_id);
+
+/**
+ * @description: the ISP stopped writing the 3a port of @ctx_id, retire
+ *               the inflight slots and free the closed rings of @ctx_id
+ *               the 3a address doesn't point into
+ * @param {u32} ctx_id: ctx streamed off
+ * @return {*}
+ */
+void armcb_isp_stats_ring_stop(u32 ctx_id);
+
+int armcb_isp_stats_init(void);
+void armcb_isp_stats_exit(void);
+#endif
+
+#endif
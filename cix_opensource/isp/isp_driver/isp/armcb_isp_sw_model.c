@@ -0,0 +1,415 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * Software model of the I7 register backend, built with
+ * CONFIG_ARMCB_ISP_SW_MODEL=y. The ISP and GDC register blocks are plain
+ * memory and an hrtimer plays the sensor: every frame period it writes a
+ * bar pattern into the output addresses programmed for the started streams
+ * of ctx 0, then raises SOF and SOL through the regular I7 handlers, with
+ * the buffer done bits of the ports that had an address. SOL programs the
+ * first addresses of a fresh stream, as on the hardware. CSI, DPHY and
+ * sensor accesses are not modelled.
+ */
+
+#include "armcb_isp_sw_model.h"
+#include "armcb_isp.h"
+#include "armcb_isp_driver.h"
+#include "armcb_register.h"
+#include "armcb_v4l2_core.h"
+#include "system_debugfs.h"
+#include "system_logger.h"
+#include <linux/dma-direct.h>
+#include <linux/dma-mapping.h>
+#include <linux/highmem.h>
+#include <linux/hrtimer.h>
+#include <linux/iommu.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
+
+#ifdef LOG_MODULE
+#undef LOG_MODULE
+#define LOG_MODULE LOG_MODULE_ISP
+#endif
+
+static uint sw_model_fps = 30;
+module_param(sw_model_fps, uint, 0644);
+MODULE_PARM_DESC(sw_model_fps, "Frame rate of the software isp model");
+
+/* pattern size, clipped to the format of each stream */
+static uint sw_model_width = 1920;
+module_param(sw_model_width, uint, 0644);
+MODULE_PARM_DESC(sw_model_width, "Frame width of the software isp model");
+
+static uint sw_model_height = 1080;
+module_param(sw_model_height, uint, 0644);
+MODULE_PARM_DESC(sw_model_height, "Frame height of the software isp model");
+
+#define ARMCB_SW_MODEL_BARS 8
+
+struct armcb_sw_model_port {
+	isp_output_port_t port;
+	u32 reg1;
+	u32 reg2;
+	u32 done;
+};
+
+static const struct armcb_sw_model_port armcb_sw_model_ports[] = {
+	{ ISP_OUTPUT_PORT_VOUT0, I7_VOUT0_START_ADDR, 0,
+	  I7_INT_VOUT0_BUF_DONE },
+	{ ISP_OUTPUT_PORT_VOUT1, I7_VOUT1_START_ADDR, I7_VOUT2_START_ADDR,
+	  I7_INT_VOUT1_BUF_DONE },
+	{ ISP_OUTPUT_PORT_VOUT3, I7_VOUT3_START_ADDR, I7_VOUT4_START_ADDR,
+	  I7_INT_VOUT3_BUF_DONE },
+	{ ISP_OUTPUT_PORT_VOUT5, I7_VOUT5_START_ADDR, I7_VOUT6_START_ADDR,
+	  I7_INT_VOUT5_BUF_DONE },
+	{ ISP_OUTPUT_PORT_VOUT7, I7_VOUT7_START_ADDR, I7_VOUT8_START_ADDR,
+	  I7_INT_VOUT7_BUF_DONE },
+};
+
+/* luma of the bars, white to black */
+static const u8 armcb_sw_model_bar_y[ARMCB_SW_MODEL_BARS] = {
+	235, 210, 170, 145, 106, 81, 41, 16
+};
+
+struct armcb_sw_model {
+	spinlock_t lock;
+	u32 regs[ARMCB_SW_MODEL_BLK_MAX][ARMCB_SW_MODEL_REG_SIZE / 4];
+	u32 pending;
+
+	struct hrtimer timer;
+	struct work_struct frame_work;
+	struct workqueue_struct *wq;
+	irq_handler_t isr;
+	irq_handler_t thread;
+	void *data;
+
+	u32 frame;
+	u64 frames;
+	u64 overruns;
+	u64 irqs;
+	u64 fill_bytes;
+	u64 fill_ns;
+};
+
+static struct armcb_sw_model g_sw_model = {
+	.lock = __SPIN_LOCK_UNLOCKED(g_sw_model.lock),
+};
+static bool g_sw_model_debugfs_init;
+
+extern struct device *mem_dev;
+
+u32 armcb_isp_sw_model_read(int blk, u32 offset)
+{
+	struct armcb_sw_model *m = &g_sw_model;
+	unsigned long flags;
+	u32 val = 0;
+
+	if (blk >= ARMCB_SW_MODEL_BLK_MAX ||
+	    offset >= ARMCB_SW_MODEL_REG_SIZE) {
+		LOG(LOG_WARN, "read blk %d offset 0x%x out of the model", blk,
+		    offset);
+		return 0;
+	}
+
+	spin_lock_irqsave(&m->lock, flags);
+	if (blk == ARMCB_SW_MODEL_BLK_ISP && offset == I7_INT_STATUS_ADDR)
+		val = m->pending;
+	else
+		val = m->regs[blk][offset / 4];
+	spin_unlock_irqrestore(&m->lock, flags);
+
+	return val;
+}
+
+void armcb_isp_sw_model_write(int blk, u32 offset, u32 val)
+{
+	struct armcb_sw_model *m = &g_sw_model;
+	unsigned long flags;
+
+	if (blk >= ARMCB_SW_MODEL_BLK_MAX ||
+	    offset >= ARMCB_SW_MODEL_REG_SIZE) {
+		LOG(LOG_WARN, "write blk %d offset 0x%x out of the model", blk,
+		    offset);
+		return;
+	}
+
+	spin_lock_irqsave(&m->lock, flags);
+	if (blk == ARMCB_SW_MODEL_BLK_ISP && offset == I7_INT_CLEAR_ADDR)
+		m->pending &= ~val;
+	else
+		m->regs[blk][offset / 4] = val;
+	spin_unlock_irqrestore(&m->lock, flags);
+}
+
+static struct page *armcb_sw_model_dma_page(dma_addr_t addr)
+{
+	struct iommu_domain *domain = iommu_get_domain_for_dev(mem_dev);
+	phys_addr_t phys = 0;
+
+	if (domain)
+		phys = iommu_iova_to_phys(domain, addr);
+	else
+		phys = dma_to_phys(mem_dev, addr);
+
+	if (!phys || !pfn_valid(PHYS_PFN(phys)))
+		return NULL;
+
+	return pfn_to_page(PHYS_PFN(phys));
+}
+
+/* the buffers are only known by their device address, walk them by page */
+static bool armcb_sw_model_memset(dma_addr_t addr, int val, size_t len)
+{
+	struct page *page = NULL;
+	void *vaddr = NULL;
+	size_t off = 0;
+	size_t n = 0;
+
+	while (len) {
+		off = offset_in_page(addr);
+		n = min_t(size_t, len, PAGE_SIZE - off);
+		page = armcb_sw_model_dma_page(addr);
+		if (!page)
+			return false;
+
+		vaddr = kmap_local_page(page);
+		memset(vaddr + off, val, n);
+		kunmap_local(vaddr);
+
+		addr += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+static size_t armcb_sw_model_fill_bars(dma_addr_t addr, u32 bpl, u32 rows,
+				       u32 row_bytes, u32 frame)
+{
+	u32 bar_bytes = max_t(u32, row_bytes / ARMCB_SW_MODEL_BARS, 1);
+	u32 row = 0;
+	u32 col = 0;
+	u32 n = 0;
+
+	for (row = 0; row < rows; row++) {
+		for (col = 0; col < row_bytes; col += n) {
+			n = min(bar_bytes, row_bytes - col);
+			/* bars scroll by one every frame */
+			if (!armcb_sw_model_memset(
+				    addr + (dma_addr_t)row * bpl + col,
+				    armcb_sw_model_bar_y[(col / bar_bytes + frame) %
+							 ARMCB_SW_MODEL_BARS],
+				    n))
+				return 0;
+		}
+	}
+
+	return (size_t)row_bytes * rows;
+}
+
+/**
+ * @description: write one frame of the pattern to the addresses programmed
+ *               for a port
+ * @param {struct armcb_sw_model} *m: model
+ * @param {struct armcb_sw_model_port} *p: port description
+ * @param {u32} *status: gets the buffer done bit of the port when a buffer
+ *                       was written
+ * @return {bool} true when the port has a started stream
+ */
+static bool armcb_sw_model_fill_port(struct armcb_sw_model *m,
+				     const struct armcb_sw_model_port *p,
+				     u32 *status)
+{
+	armcb_v4l2_stream_t *pstream = armcb_v4l2_outport_stream(0, p->port);
+	struct v4l2_pix_format_mplane *pix = NULL;
+	dma_addr_t addr = 0;
+	u32 bpl = 0;
+	u32 rows = 0;
+	u32 row_bytes = 0;
+	size_t chroma = 0;
+
+	if (!pstream || !pstream->stream_started)
+		return false;
+
+	/* nothing programmed yet, the sol of this frame does it */
+	addr = armcb_isp_sw_model_read(ARMCB_SW_MODEL_BLK_ISP, p->reg1);
+	if (!addr)
+		return true;
+
+	*status |= p->done;
+	pix = &pstream->cur_v4l2_fmt.fmt.pix_mp;
+	bpl = pix->plane_fmt[0].bytesperline;
+	if (!bpl || !pix->width)
+		return true;
+
+	rows = min3(sw_model_height, pix->height,
+		    pix->plane_fmt[0].sizeimage / bpl);
+	row_bytes = min(sw_model_width * max(bpl / pix->width, 1U), bpl);
+	m->fill_bytes += armcb_sw_model_fill_bars(addr, bpl, rows, row_bytes,
+						  m->frame);
+
+	addr = p->reg2 ? armcb_isp_sw_model_read(ARMCB_SW_MODEL_BLK_ISP,
+						 p->reg2) :
+			 0;
+	if (addr && pix->num_planes > 1) {
+		/* neutral chroma for the second plane of semi planar formats */
+		chroma = min_t(size_t, pix->plane_fmt[1].sizeimage,
+			       (size_t)pix->plane_fmt[1].bytesperline *
+				       DIV_ROUND_UP(rows, 2));
+		if (armcb_sw_model_memset(addr, 0x80, chroma))
+			m->fill_bytes += chroma;
+	}
+
+	return true;
+}
+
+/* deliver the pending status the way a threaded irq line would */
+static void armcb_sw_model_raise(struct armcb_sw_model *m)
+{
+	irqreturn_t ret = IRQ_NONE;
+
+	local_irq_disable();
+	ret = m->isr(0, m->data);
+	local_irq_enable();
+
+	if (ret == IRQ_WAKE_THREAD && m->thread)
+		m->thread(0, m->data);
+	m->irqs++;
+}
+
+static void armcb_sw_model_frame_work(struct work_struct *work)
+{
+	struct armcb_sw_model *m =
+		container_of(work, struct armcb_sw_model, frame_work);
+	u32 status = 0;
+	u64 start = ktime_get_ns();
+	bool started = false;
+	int i = 0;
+
+	for (i = 0; i < ARRAY_SIZE(armcb_sw_model_ports); i++)
+		started |= armcb_sw_model_fill_port(m, &armcb_sw_model_ports[i],
+						    &status);
+	m->fill_ns += ktime_get_ns() - start;
+
+	/* no started stream, the sensor is idle */
+	if (!started)
+		return;
+
+	spin_lock_irq(&m->lock);
+	m->frame++;
+	m->regs[ARMCB_SW_MODEL_BLK_ISP][I7_INT_SOL_FRMCNT_ADDR / 4] = m->frame;
+	m->regs[ARMCB_SW_MODEL_BLK_ISP][I7_INT_3A_FRMCNT_ADDR / 4] = m->frame;
+	m->regs[ARMCB_SW_MODEL_BLK_ISP][I7_INT_SOF_FRMCNT_ADDR / 4] = m->frame;
+	m->pending |= status | I7_INT_SOF_INT_MASK | I7_INT_SOL_MASK;
+	status = m->pending &
+		 ~m->regs[ARMCB_SW_MODEL_BLK_ISP][I7_INT_MASK_ADDR / 4];
+	spin_unlock_irq(&m->lock);
+
+	m->frames++;
+	if (status)
+		armcb_sw_model_raise(m);
+}
+
+static ktime_t armcb_sw_model_period(void)
+{
+	return ns_to_ktime(NSEC_PER_SEC / max(sw_model_fps, 1U));
+}
+
+static enum hrtimer_restart armcb_sw_model_tick(struct hrtimer *timer)
+{
+	struct armcb_sw_model *m =
+		container_of(timer, struct armcb_sw_model, timer);
+
+	/* the previous frame is still being written */
+	if (!queue_work(m->wq, &m->frame_work))
+		m->overruns++;
+
+	hrtimer_forward_now(timer, armcb_sw_model_period());
+	return HRTIMER_RESTART;
+}
+
+static int armcb_sw_model_show(struct seq_file *s, void *unused)
+{
+	struct armcb_sw_model *m = &g_sw_model;
+	u64 fill_us = div_u64(m->fill_ns, NSEC_PER_USEC);
+
+	seq_printf(s, "mode:       %ux%u@%u\n", sw_model_width, sw_model_height,
+		   sw_model_fps);
+	seq_printf(s, "frames:     %llu\n", m->frames);
+	seq_printf(s, "irqs:       %llu\n", m->irqs);
+	seq_printf(s, "overruns:   %llu\n", m->overruns);
+	seq_printf(s, "fill_bytes: %llu\n", m->fill_bytes);
+	seq_printf(s, "fill_MBps:  %llu\n",
+		   fill_us ? div64_u64(m->fill_bytes, fill_us) : 0);
+	seq_printf(s, "pending:    0x%08x\n", m->pending);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(armcb_sw_model);
+
+int armcb_isp_sw_model_start(irq_handler_t isr, irq_handler_t thread,
+			     void *data)
+{
+	struct armcb_sw_model *m = &g_sw_model;
+
+	if (!isr)
+		return -EINVAL;
+
+	m->wq = alloc_ordered_workqueue("armcb_isp_model", WQ_HIGHPRI);
+	if (!m->wq) {
+		LOG(LOG_ERR, "failed to alloc sw model workqueue");
+		return -ENOMEM;
+	}
+
+	m->isr = isr;
+	m->thread = thread;
+	m->data = data;
+	INIT_WORK(&m->frame_work, armcb_sw_model_frame_work);
+	hrtimer_init(&m->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	m->timer.function = armcb_sw_model_tick;
+	hrtimer_start(&m->timer, armcb_sw_model_period(), HRTIMER_MODE_REL);
+
+	if (!g_sw_model_debugfs_init) {
+		debugfs_create_file("sw_model", 0444, system_debugfs_root(),
+				    NULL, &armcb_sw_model_fops);
+		g_sw_model_debugfs_init = true;
+	}
+
+	LOG(LOG_INFO, "software isp model running %ux%u@%u", sw_model_width,
+	    sw_model_height, sw_model_fps);
+
+	return 0;
+}
+
+void armcb_isp_sw_model_stop(void)
+{
+	struct armcb_sw_model *m = &g_sw_model;
+
+	if (!m->wq)
+		return;
+
+	hrtimer_cancel(&m->timer);
+	destroy_workqueue(m->wq);
+	m->wq = NULL;
+}
+
+void armcb_isp_sw_model_sync(void)
+{
+	struct armcb_sw_model *m = &g_sw_model;
+
+	if (m->wq)
+		flush_work(&m->frame_work);
+}
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#ifndef __ARMCB_ISP_SW_MODEL_H__
+#define __ARMCB_ISP_SW_MODEL_H__
+
+#include <linux/interrupt.h>
+#include <linux/sizes.h>
+#include <linux/types.h>
+
+/* register blocks backed by the model, same split as reg_base/reg_base2 */
+#define ARMCB_SW_MODEL_BLK_ISP 0
+#define ARMCB_SW_MODEL_BLK_GDC 1
+#define ARMCB_SW_MODEL_BLK_MAX 2
+#define ARMCB_SW_MODEL_REG_SIZE SZ_64K
+
+/**
+ * @description: read a register of the in-memory register file
+ * @param {int} blk: ARMCB_SW_MODEL_BLK_ISP or ARMCB_SW_MODEL_BLK_GDC
+ * @param {u32} offset: byte offset inside the block
+ * @return {u32} register value, 0 for offsets outside the block
+ */
+u32 armcb_isp_sw_model_read(int blk, u32 offset);
+
+/**
+ * @description: write a register of the in-memory register file, the
+ *               interrupt clear register is write one to clear
+ * @param {int} blk: ARMCB_SW_MODEL_BLK_ISP or ARMCB_SW_MODEL_BLK_GDC
+ * @param {u32} offset: byte offset inside the block
+ * @param {u32} val: value to write
+ * @return {*}
+ */
+void armcb_isp_sw_model_write(int blk, u32 offset, u32 val);
+
+/**
+ * @description: start generating frames, @isr and @thread are called the
+ *               way a threaded irq would call them
+ * @param {irq_handler_t} isr: hard irq handler
+ * @param {irq_handler_t} thread: threaded handler, may be NULL
+ * @param {void} *data: cookie handed to both handlers
+ * @return {int} 0 on success, negative errno otherwise
+ */
+int armcb_isp_sw_model_start(irq_handler_t isr, irq_handler_t thread,
+			     void *data);
+
+/**
+ * @description: stop the frame timer and wait for the last frame
+ * @return {*}
+ */
+void armcb_isp_sw_model_stop(void);
+
+/**
+ * @description: wait for the frame being generated, including the
+ *               interrupt handlers it calls
+ * @return {*}
+ */
+void armcb_isp_sw_model_sync(void);
+
+#endif
@@ -25,6 +25,7 @@
 #include <linux/font.h>
 #include <linux/mutex.h>
 #include <linux/platform_device.h>
+#include <linux/seq_file.h>
 #include <linux/videodev2.h>
 #include <linux/v4l2-dv-timings.h>
 #include <media/videobuf2-vmalloc.h>
@@ -41,12 +42,18 @@
 #include "system_dma.h"
 #include "armcb_camera_io_drv.h"
 #include "armcb_platform.h"
+#include "armcb_sensor_queue.h"
+#include "armcb_isp_stats.h"
+#ifdef ARMCB_ISP_SW_MODEL
+#include "armcb_isp_sw_model.h"
+#endif
 #include "armcb_register.h"
 #include "isp_hw_ops.h"
 
 #include "armcb_v4l2_config.h"
 #include "armcb_v4l2_core.h"
 #include "system_logger.h"
+#include "system_debugfs.h"
 
 #ifndef CONFIG_PLAT_BBOX
 #include <linux/soc/cix/rdr_pub.h>
@@ -191,13 +198,18 @@ typedef i5_top_top_reg_68_t i5_index_t;
 struct armcb_isp_info {
 	armcb_isp_type_t type;
 	irqreturn_t (*isp_isr)(s32 irq, void *subdev);
+	irqreturn_t (*isp_thread)(s32 irq, void *subdev);
 	irqreturn_t (*isp_err_isr)(s32 irq, void *subdev);
 };
 
+extern int armcb_multi_cam;
 static armcb_v4l2_config_dev_t *p_v4l_config_dev;
+static bool g_irq_debugfs_init;
 
 static irqreturn_t armcb_I5_isp_isr(s32 irq, void *pdev);
 static irqreturn_t armcb_I7_isp_isr(s32 irq, void *pdev);
+static irqreturn_t armcb_I7_isp_thread(s32 irq, void *pdev);
+static void armcb_irq_ring_drain(armcb_v4l2_config_dev_t *dev);
 static irqreturn_t armcb_I7_isp_err_isr(s32 irq, void *pdev);
 
 static int armcb_get_vout_addr_by_outport_i5(uint32_t outport,
@@ -345,7 +357,7 @@ int destroy_buf_queue(struct vb2_queue *q, enum vb2_buffer_state state)
 				  armcb_v4l2_buffer_t, list);
 		if(pbuf) {
 			list_del(&pbuf->list);
-			vb2_buffer_done(&pbuf->vvb.vb2_buf, state);
+			armcb_vb2_buffer_done(pbuf, state);
 		}
 	}
 	while (!list_empty(&pstream->stream_buffer_list_busy)) {
@@ -353,7 +365,7 @@ int destroy_buf_queue(struct vb2_queue *q, enum vb2_buffer_state state)
 				  armcb_v4l2_buffer_t, list);
 		if (pbuf) {
 			list_del(&pbuf->list);
-			vb2_buffer_done(&pbuf->vvb.vb2_buf, state);
+			armcb_vb2_buffer_done(pbuf, state);
 		}
 	}
 
@@ -436,12 +448,14 @@ int armcb_v4l2_config_update_stream_hw_addr(armcb_v4l2_stream_t *pstream)
 	}
 
 #ifdef V4L2_OPT
-	pstream->reserved_buf_addr_dma = discard_buf_addr_dma;
-
 	if (!pbuf) {
 		LOG(LOG_DEBUG, "[Stream#%d] no empty buffers",
 			pstream->stream_id);
-		startaddr = pstream->reserved_buf_addr_dma;
+		armcb_isp_count_underrun(pstream);
+		/* shared discard buffer if the scratch one failed to allocate */
+		startaddr = pstream->reserved_buf_addr_dma ?
+				    pstream->reserved_buf_addr_dma :
+				    discard_buf_addr_dma;
 		if (vout_reg1 && startaddr) {
 			armcb_isp_write_reg(vout_reg1, startaddr);
 		}
@@ -523,6 +537,31 @@ int armcb_v4l2_config_update_stream_hw_addr(armcb_v4l2_stream_t *pstream)
 	return 0;
 }
 
+/*
+ * Route an interrupt to the device of its ctx. A single camera follows the
+ * first opened device, but with several cameras an idle ctx must not hand
+ * its frames to another one.
+ */
+static armcb_v4l2_dev_t *armcb_isp_irq_ctx_dev(uint32_t *ctx_id)
+{
+	armcb_v4l2_dev_t *pdev = NULL;
+
+	if (*ctx_id >= ARMCB_MAX_DEVS)
+		return NULL;
+
+	pdev = armcb_v4l2_core_get_dev(*ctx_id);
+	if (pdev && atomic_read(&pdev->opened) == 0) {
+		if (armcb_multi_cam)
+			return NULL;
+		*ctx_id = armcb_v4l2_core_find_1st_opened_dev();
+		if (*ctx_id >= ARMCB_MAX_DEVS)
+			return NULL;
+		pdev = armcb_v4l2_core_get_dev(*ctx_id);
+	}
+
+	return pdev;
+}
+
 static void armcb_isp_irq_sol_i5(unsigned int ctx_id)
 {
 	int rc = 0;
@@ -594,11 +633,9 @@ static void armcb_isp_irq_sol_i7(unsigned int ctx_id)
 	armcb_v4l2_stream_t *pstream = NULL;
 	armcb_v4l2_dev_t *pdev = NULL;
 
-	pdev = armcb_v4l2_core_get_dev(ctx_id);
-	if (pdev && atomic_read(&pdev->opened) == 0)
-		ctx_id = armcb_v4l2_core_find_1st_opened_dev();
-
-	pdev = armcb_v4l2_core_get_dev(ctx_id);
+	pdev = armcb_isp_irq_ctx_dev(&ctx_id);
+	if (!pdev)
+		return;
 
 	LOG(LOG_DEBUG, "sof ctx_id=%u", ctx_id);
 	for (i = 0; i < V4L2_STREAM_TYPE_MAX; i++) {
@@ -629,22 +666,26 @@ static void armcb_isp_irq_sol_i7(unsigned int ctx_id)
 			}
 		}
 	}
+
+	if (atomic_read(&pdev->upload_streamoff) == 0)
+		armcb_isp_stats_ring_program(ctx_id);
 }
 
-static void armcb_isp_irq_sof_i7(unsigned int ctx_id)
+static void armcb_isp_irq_sof_i7(unsigned int ctx_id, unsigned int frame)
 {
 	int rc = 0;
 	int i = 0;
 	armcb_v4l2_stream_t *pstream = NULL;
 	armcb_v4l2_dev_t *pdev = NULL;
 
-	pdev = armcb_v4l2_core_get_dev(ctx_id);
-	if (pdev && atomic_read(&pdev->opened) == 0)
-		ctx_id = armcb_v4l2_core_find_1st_opened_dev();
+	pdev = armcb_isp_irq_ctx_dev(&ctx_id);
+	if (!pdev)
+		return;
 
-	pdev = armcb_v4l2_core_get_dev(ctx_id);
+	LOG(LOG_DEBUG, "sof ctx_id=%u frame=%u", ctx_id, frame);
+	/* sensor updates due on this frame go out in its blanking */
+	armcb_sensor_queue_sof(ctx_id, frame);
 
-	LOG(LOG_DEBUG, "sof ctx_id=%u", ctx_id);
 	for (i = 0; i < V4L2_STREAM_TYPE_MAX; i++) {
 		/* find stream pointer */
 		rc = armcb_v4l2_find_stream(&pstream, ctx_id, i);
@@ -673,92 +714,6 @@ static void armcb_isp_irq_sof_i7(unsigned int ctx_id)
 	}
 }
 
-static void
-armcb_v4l2_config_queue_event_with_status(struct video_device *pvdev,
-					  struct isp_irq_info *pirq_info,
-					  unsigned int status)
-{
-	unsigned int *pData = NULL;
-	struct v4l2_event ev = {
-		.id = pirq_info->int_type,
-		.type = V4L2_EVENT_CTRL,
-	};
-
-	if (!pvdev || !pirq_info) {
-		LOG(LOG_ERR, "invalid dev is null or pisp_ir is null!");
-		return;
-	}
-
-	pData = (unsigned int *)&ev.u;
-	if (pirq_info->int_type == ISP_NORMAL_INT) {
-		pData[0] = pirq_info->changed;
-		pData[1] = status;
-		pData[2] = pirq_info->id;
-		pData[3] = pirq_info->sen_id;
-		pData[4] = pirq_info->frm_cnt_sof;
-		pData[5] = pirq_info->frm_cnt_sol;
-		pData[6] = pirq_info->frm_cnt_3a;
-		pData[7] = pirq_info->frm_cnt_nxt_sol;
-		pData[8] = 0;
-		pData[9] = 0;
-		pData[10] = 0;
-		pData[11] = 0;
-		pData[12] = 0;
-	} else if (pirq_info->int_type == ISP_MIXTURE_INT) {
-		pData[0] = pirq_info->changed;
-		pData[1] = status;
-		pData[2] = pirq_info->id;
-		pData[3] = pirq_info->sen_id;
-		pData[4] = pirq_info->frm_cnt_sof;
-		pData[5] = pirq_info->frm_cnt_sol;
-		pData[6] = pirq_info->frm_cnt_3a;
-		pData[7] = pirq_info->frm_cnt_nxt_sol;
-		pData[8] = pirq_info->err_detail_status[0];
-		pData[9] = 0;
-		pData[10] = 0;
-		pData[11] = 0;
-		pData[12] = 0;
-	} else if (pirq_info->int_type == ISP_ERROR_INT) {
-		pData[0] = pirq_info->changed;
-		pData[1] = status;
-		pData[2] = pirq_info->id;
-		pData[3] = pirq_info->sen_id;
-		pData[4] = pirq_info->frm_cnt_sof;
-		pData[5] = pirq_info->frm_cnt_sol;
-		pData[6] = pirq_info->frm_cnt_3a;
-		pData[7] = pirq_info->frm_cnt_nxt_sol;
-		pData[8] = pirq_info->err_detail_status[0];
-		pData[9] = pirq_info->err_detail_status[1];
-		pData[10] = pirq_info->err_detail_status[2];
-		pData[11] = pirq_info->err_detail_status[3];
-		pData[12] = pirq_info->err_detail_status[4];
-	} else {
-		pData[0] = 0;
-		pData[1] = 0;
-		pData[2] = 0;
-		pData[3] = 0;
-		pData[4] = 0;
-		pData[5] = 0;
-		pData[6] = 0;
-		pData[7] = 0;
-		pData[8] = 0;
-		pData[9] = 0;
-		pData[10] = 0;
-		pData[11] = 0;
-		pData[12] = 0;
-	}
-
-	if (pData[5] % 30 == 0) {
-		LOG(LOG_DEBUG,
-		    "isp_queue event id(%d) type(%d) mask=0x%x, "
-		    "status=0x%x, id = 0x%x, sen_id = 0x%x, frm_cnt_sof = %u, frm_cnt_sol = %u",
-		    ev.id, ev.type, pData[0], pData[1], pData[2], pData[3],
-		    pData[4], pData[5]);
-	}
-
-	v4l2_event_queue(pvdev, &ev);
-}
-
 static void armcb_v4l2_config_queue_event(struct video_device *pvdev,
 					  struct isp_irq_info *pirq_info)
 {
@@ -1022,25 +977,54 @@ static irqreturn_t armcb_I5_isp_isr(s32 irq, void *pdev)
 	return ret;
 }
 
-static struct isp_irq_info *armcb_irq_msg_ev_alloc(struct armcb_irq_msg_fh *fh)
+static inline u32 armcb_irq_info_ctx(const struct isp_irq_info *info)
 {
-	struct isp_irq_info *info = NULL;
+	return ((info->id & 0x3) << 2) | ((info->id >> 2) & 0x3);
+}
+
+/**
+ * @description: queue an irq event on its ctx ring, producer side
+ * @param {armcb_v4l2_config_dev_t} *dev: config device
+ * @param {struct isp_irq_info} *info: event to copy into the ring
+ * @return {bool} false when the ring is full and the event was dropped
+ */
+static bool armcb_irq_ring_push(armcb_v4l2_config_dev_t *dev,
+				const struct isp_irq_info *info)
+{
+	struct armcb_irq_ring *ring =
+		&dev->irq_ring[armcb_irq_info_ctx(info) % ARMCB_MAX_DEVS];
+	unsigned int head = ring->head;
 	struct armcb_irq_event *ev = NULL;
-	unsigned long flags;
 
-	spin_lock_irqsave(&fh->fh_lock, flags);
-	if (fh->in_use == fh->elems) {
-		fh->in_use--;
-		fh->first = irqev_pos(fh, 1);
-	} else {
-		ev = fh->ev_array + fh->in_use;
-		info = &ev->info;
-		fh->in_use++;
-		memset(info, 0, sizeof(struct isp_irq_info));
-		list_add_tail(&ev->fh_node, &fh->avaliable);
+	if (head - smp_load_acquire(&ring->tail) >= ARMCB_IRQ_RING_SIZE) {
+		ring->dropped++;
+		return false;
 	}
-	spin_unlock_irqrestore(&fh->fh_lock, flags);
-	return info;
+
+	ev = &ring->ev[head & (ARMCB_IRQ_RING_SIZE - 1)];
+	ev->info = *info;
+	ev->ts_ns = ktime_get_ns();
+	ring->pushed++;
+	/* publish the event before the consumer can see the new head */
+	smp_store_release(&ring->head, head + 1);
+
+	return true;
+}
+
+static struct armcb_irq_event *armcb_irq_ring_peek(struct armcb_irq_ring *ring)
+{
+	unsigned int tail = ring->tail;
+
+	if (tail == smp_load_acquire(&ring->head))
+		return NULL;
+
+	return &ring->ev[tail & (ARMCB_IRQ_RING_SIZE - 1)];
+}
+
+static void armcb_irq_ring_pop(struct armcb_irq_ring *ring)
+{
+	/* the slot may be reused once tail moves past it */
+	smp_store_release(&ring->tail, ring->tail + 1);
 }
 
 /**
@@ -1284,7 +1268,7 @@ static irqreturn_t armcb_I7_isp_isr(s32 irq, void *pdev)
 	i7_frm_cnt_ctrl_t frame_cnt_sel = { 0 };
 	unsigned long flags = 0;
 	unsigned int irq_clear = 0;
-	struct isp_irq_info *bh_info = NULL;
+	bool wake = false;
 	i7_index_type_t int_id = { 0 };
 	/*context index occupies 2 bits*/
 	uint32_t cxt_offset = 2;
@@ -1317,6 +1301,11 @@ static irqreturn_t armcb_I7_isp_isr(s32 irq, void *pdev)
 						    &frame_cnt_sel);
 		}
 
+		/*2.2.1 publish the 3a stats slot before sol reprograms it*/
+		if (irq_info.status & I7_INT_3A_INT_MASK)
+			armcb_isp_stats_ring_done(armcb_irq_info_ctx(&irq_info),
+						  irq_info.frm_cnt_3a);
+
 		/*2.3 get next sol frame count for prepare next register
 		* configuration, only in multiple cameras cases, multi-cam
 		* index changes alternately
@@ -1350,7 +1339,8 @@ static irqreturn_t armcb_I7_isp_isr(s32 irq, void *pdev)
 		if (irq_info.status & I7_INT_SOF_INT_MASK) {
 			next_ctx_id = ((int_id.cxt_nxt_idx << cxt_offset) |
 				       (int_id.frm_nxt_idx & frm_cnt_idx_mask));
-			armcb_isp_irq_sof_i7(next_ctx_id);
+			armcb_isp_irq_sof_i7(next_ctx_id,
+					     irq_info.frm_cnt_sof);
 		}
 
 		if (irq_info.status & I7_INT_VIN_EXPX_INT_MASK) {
@@ -1373,18 +1363,14 @@ static irqreturn_t armcb_I7_isp_isr(s32 irq, void *pdev)
 		armcb_i7_clear_normal_int(irq_clear);
 
 		/*4. post irq event to userspace */
-		if (irq_info.status & I7_IRQ_EVENT_POST_MASK) {
-			bh_info = armcb_irq_msg_ev_alloc(
-				&p_v4l_config_dev->isr_fh);
-			memcpy(bh_info, &irq_info, sizeof(struct isp_irq_info));
-			tasklet_schedule(&p_v4l_config_dev->buffer_done_task);
-		}
+		if (irq_info.status & I7_IRQ_EVENT_POST_MASK)
+			wake = armcb_irq_ring_push(p_config_dev, &irq_info);
 
 		/*5. restore interrupt mask bit */
 		armcb_i7_unmask_int(irq_info.mask, irq_info.err_mask);
 		spin_unlock_irqrestore(&p_config_dev->slock, flags);
 
-		ret = IRQ_HANDLED;
+		ret = wake ? IRQ_WAKE_THREAD : IRQ_HANDLED;
 	}
 
 	return ret;
@@ -1460,6 +1446,8 @@ static irqreturn_t armcb_I7_isp_err_isr(s32 irq, void *pdev)
 
 		/*3. clear the interrupt bits*/
 		armcb_i7_clear_error_int(irq_clear);
+		/* the next runtime resume starts from a clean reset */
+		armcb_ispmem_request_reset();
 
 		/*4. post irq event to userspace */
 		if (irq_info.status) {
@@ -1535,6 +1523,7 @@ struct armcb_isp_info i5_cus0_isp_hw_info = {
 struct armcb_isp_info i7_isp_hw_info = {
 	.type = ISP_TYPE_I7,
 	.isp_isr = armcb_I7_isp_isr,
+	.isp_thread = armcb_I7_isp_thread,
 	.isp_err_isr = armcb_I7_isp_err_isr,
 };
 
@@ -1542,13 +1531,9 @@ struct armcb_isp_info i7_isp_hw_info = {
 static int armcb_isp_interrupt_task(void *data)
 {
 	int res = 0;
-	uint32_t outport = 0;
 	uint32_t ctx_id = 0;
-	uint32_t stream_id = 0;
 	armcb_v4l2_config_dev_t *p_config_dev = (armcb_v4l2_config_dev_t *)data;
-	struct video_device *pvdev = NULL;
 	struct isp_irq_info irq_info = { 0 };
-	struct isp_irq_info irq_info_vout = { 0 };
 
 	static int sof_count;
 	static int sol_count;
@@ -1566,7 +1551,6 @@ static int armcb_isp_interrupt_task(void *data)
 		ctx_id = 0;
 
 		if (irq_info.status) {
-			pvdev = &p_config_dev->vid_cap_dev;
 			/*1. record interrupt mask*/
 			irq_info.changed = 1;
 			irq_info.int_type = ISP_NORMAL_INT;
@@ -1594,104 +1578,14 @@ static int armcb_isp_interrupt_task(void *data)
 			}
 
 			if (irq_info.status & I7_INT_SOF_INT_MASK)
-				armcb_isp_irq_sof_i7(ctx_id);
-
-			if (irq_info.status & I7_INT_VOUTX_INT_MASK) {
-				if (irq_info.status & I7_INT_VOUT1_BUF_DONE) {
-					outport = (1 << ISP_OUTPUT_PORT_VOUT1);
-					if (armcb_v4l2_find_ctx_stream_by_outport(
-						    outport, &ctx_id,
-						    &stream_id) < 0) {
-						LOG(LOG_ERR,
-						    "failed to find a valid ctx_id and stream_id for port %d",
-						    outport);
-						goto loop;
-					}
-					armcb_isp_put_frame(
-						ctx_id, stream_id,
-						ISP_OUTPUT_PORT_VOUT1);
-					irq_info_vout = irq_info;
-					irq_info_vout.status =
-						I7_INT_VOUT1_BUF_DONE;
-					armcb_v4l2_config_queue_event(
-						pvdev, &irq_info_vout);
-
-					irq_info.status &=
-						~I7_INT_VOUT1_BUF_DONE;
-				}
-				if (irq_info.status & I7_INT_VOUT3_BUF_DONE) {
-					outport = (1 << ISP_OUTPUT_PORT_VOUT3);
-					if (armcb_v4l2_find_ctx_stream_by_outport(
-						    outport, &ctx_id,
-						    &stream_id) < 0) {
-						LOG(LOG_ERR,
-						    "failed to find a valid ctx_id and stream_id for port %d",
-						    outport);
-						goto loop;
-					}
-					armcb_isp_put_frame(
-						ctx_id, stream_id,
-						ISP_OUTPUT_PORT_VOUT3);
-					irq_info_vout = irq_info;
-					irq_info_vout.status =
-						I7_INT_VOUT3_BUF_DONE;
-					armcb_v4l2_config_queue_event(
-						pvdev, &irq_info_vout);
-
-					irq_info.status &=
-						~I7_INT_VOUT3_BUF_DONE;
-				}
-				if (irq_info.status & I7_INT_VOUT5_BUF_DONE) {
-					outport = (1 << ISP_OUTPUT_PORT_VOUT5);
-					if (armcb_v4l2_find_ctx_stream_by_outport(
-						    outport, &ctx_id,
-						    &stream_id) < 0) {
-						LOG(LOG_ERR,
-						    "failed to find a valid ctx_id and stream_id for port %d",
-						    outport);
-						goto loop;
-					}
-					armcb_isp_put_frame(
-						ctx_id, stream_id,
-						ISP_OUTPUT_PORT_VOUT5);
-					irq_info_vout = irq_info;
-					irq_info_vout.status =
-						I7_INT_VOUT5_BUF_DONE;
-					armcb_v4l2_config_queue_event(
-						pvdev, &irq_info_vout);
-
-					irq_info.status &=
-						~I7_INT_VOUT5_BUF_DONE;
-				}
-				if (irq_info.status & I7_INT_VOUT7_BUF_DONE) {
-					outport = (1 << ISP_OUTPUT_PORT_VOUT7);
-					if (armcb_v4l2_find_ctx_stream_by_outport(
-						    outport, &ctx_id,
-						    &stream_id) < 0) {
-						LOG(LOG_ERR,
-						    "failed to find a valid ctx_id and stream_id for port %d",
-						    outport);
-						goto loop;
-					}
-					armcb_isp_put_frame(
-						ctx_id, stream_id,
-						ISP_OUTPUT_PORT_VOUT7);
-					irq_info_vout = irq_info;
-					irq_info_vout.status =
-						I7_INT_VOUT7_BUF_DONE;
-					armcb_v4l2_config_queue_event(
-						pvdev, &irq_info_vout);
-
-					irq_info.status &=
-						~I7_INT_VOUT7_BUF_DONE;
-				}
-			}
+				armcb_isp_irq_sof_i7(ctx_id,
+						     irq_info.frm_cnt_sof);
 
-			/*5. post irq event to userspace */
-			if (irq_info.status & I7_IRQ_EVENT_POST_MASK)
-				armcb_v4l2_config_queue_event(pvdev, &irq_info);
+			/* same path as the threaded irq: push, then drain */
+			if (irq_info.status & I7_IRQ_EVENT_POST_MASK &&
+			    armcb_irq_ring_push(p_config_dev, &irq_info))
+				armcb_irq_ring_drain(p_config_dev);
 		}
-loop:
 		msleep(33);
 	}
 
@@ -1847,156 +1741,207 @@ static const struct v4l2_ioctl_ops armcb_v4l2_config_ioctl_ops = {
 	.vidioc_unsubscribe_event = armcb_v4l2_config_unsubscribe_event,
 };
 
-static void armcb_irq_msg_fh_init(struct armcb_irq_msg_fh *fh)
-{
-	int idx = 0;
-
-	fh->elems = 32;
-	fh->first = 0;
-	fh->in_use = 0;
-	spin_lock_init(&fh->fh_lock);
-	INIT_LIST_HEAD(&fh->avaliable);
-	for (; idx < fh->elems; idx++)
-		INIT_LIST_HEAD(&fh->ev_array[idx].fh_node);
-}
+/* buffer done status bit to the output port it completes */
+static const struct {
+	u32 mask;
+	isp_output_port_t port;
+} armcb_i7_buf_done_map[] = {
+	{ I7_INT_VOUT0_BUF_DONE, ISP_OUTPUT_PORT_VOUT0 },
+	{ I7_INT_VOUT1_BUF_DONE, ISP_OUTPUT_PORT_VOUT1 },
+	{ I7_INT_VOUT3_BUF_DONE, ISP_OUTPUT_PORT_VOUT3 },
+	{ I7_INT_VOUT5_BUF_DONE, ISP_OUTPUT_PORT_VOUT5 },
+	{ I7_INT_VOUT7_BUF_DONE, ISP_OUTPUT_PORT_VOUT7 },
+	{ I7_INT_VIN_CHNL_L_BUF_DONE, ISP_OUTPUT_PORT_VIN },
+	{ I7_INT_VIN_CHNL_M_BUF_DONE, ISP_OUTPUT_PORT_VIN },
+	{ I7_INT_VIN_CHNL_S_BUF_DONE, ISP_OUTPUT_PORT_VIN },
+	{ I7_INT_VIN_CHNL_VS_BUF_DONE, ISP_OUTPUT_PORT_VIN },
+};
 
+/**
+ * @description: complete the buffers of one interrupt and post one event
+ *               carrying the whole status word and frame counters
+ * @param {struct isp_irq_info} *info: interrupt information
+ * @return {*}
+ */
 static void buffer_done_i7_handle(struct isp_irq_info *info)
 {
 	struct video_device *pvdev = &p_v4l_config_dev->vid_cap_dev;
-	uint32_t ctx_id = ((info->id & 0x3) << 2) | ((info->id >> 2) & 03);
+	uint32_t ctx_id = armcb_irq_info_ctx(info);
 	armcb_v4l2_dev_t *pdev = NULL;
+	unsigned long hit = 0;
+	int i = 0;
 
-	pdev = armcb_v4l2_core_get_dev(ctx_id);
-	if (pdev && atomic_read(&pdev->opened) == 0)
-		ctx_id = armcb_v4l2_core_find_1st_opened_dev();
-
-	pdev = armcb_v4l2_core_get_dev(ctx_id);
+	pdev = armcb_isp_irq_ctx_dev(&ctx_id);
+	if (!pdev)
+		return;
 
 	if (atomic_read(&pdev->upload_streamoff) == 1) {
 		LOG(LOG_DEBUG, "ctx_id: %d, the stream is off\n", ctx_id);
 		return;
 	}
 #ifdef ENABLE_RUNTIME_UPDATE_STATS_ADDR
-	if (info->status & I7_INT_3A_INT_MASK) {
-		uint32_t outport = 0;
+	/* a stats ring owns the 3a port, it was completed in the isr */
+	if (info->status & I7_INT_3A_INT_MASK &&
+	    !armcb_isp_stats_ring_active(ctx_id)) {
 		uint32_t stream_id = 0;
 
-		outport = (1 << ISP_OUTPUT_PORT_3A);
-		if (!armcb_v4l2_find_stream_by_outport_ctx(outport, ctx_id,
-							   &stream_id)) {
+		if (!armcb_v4l2_find_stream_by_outport_ctx(
+			    1 << ISP_OUTPUT_PORT_3A, ctx_id, &stream_id)) {
 			armcb_isp_put_frame(ctx_id, stream_id,
 					    ISP_OUTPUT_PORT_3A);
 		}
-
-		armcb_v4l2_config_queue_event_with_status(pvdev, info,
-							  I7_INT_3A_INT_MASK);
-
-		info->status &= ~I7_INT_3A_INT_MASK;
 	}
 #endif
 
-	if (info->status & I7_INT_VOUTX_INT_MASK) {
-		if (info->status & I7_INT_VOUT0_BUF_DONE) {
-			armcb_isp_put_frame(ctx_id, -1, ISP_OUTPUT_PORT_VOUT0);
-			armcb_v4l2_config_queue_event_with_status(
-				pvdev, info, I7_INT_VOUT0_BUF_DONE);
+	for (i = 0; i < ARRAY_SIZE(armcb_i7_buf_done_map); i++) {
+		if (info->status & armcb_i7_buf_done_map[i].mask)
+			__set_bit(i, &hit);
+	}
 
-			info->status &= ~I7_INT_VOUT0_BUF_DONE;
-		}
-		if (info->status & I7_INT_VOUT1_BUF_DONE) {
-			armcb_isp_put_frame(ctx_id, -1, ISP_OUTPUT_PORT_VOUT1);
-			armcb_v4l2_config_queue_event_with_status(
-				pvdev, info, I7_INT_VOUT1_BUF_DONE);
+	for_each_set_bit(i, &hit, ARRAY_SIZE(armcb_i7_buf_done_map))
+		armcb_isp_put_frame(ctx_id, -1, armcb_i7_buf_done_map[i].port);
 
-			info->status &= ~I7_INT_VOUT1_BUF_DONE;
-		}
-		if (info->status & I7_INT_VOUT3_BUF_DONE) {
-			armcb_isp_put_frame(ctx_id, -1, ISP_OUTPUT_PORT_VOUT3);
-			armcb_v4l2_config_queue_event_with_status(
-				pvdev, info, I7_INT_VOUT3_BUF_DONE);
+	if (info->status & I7_IRQ_EVENT_POST_MASK) {
+		armcb_v4l2_config_queue_event(pvdev, info);
+		p_v4l_config_dev->irq_ev_posted++;
+	}
+	p_v4l_config_dev->irq_ev_done_bits += hweight_long(hit);
+	p_v4l_config_dev->irq_ev_frames++;
+}
 
-			info->status &= ~I7_INT_VOUT3_BUF_DONE;
-		}
-		if (info->status & I7_INT_VOUT5_BUF_DONE) {
-			armcb_isp_put_frame(ctx_id, -1, ISP_OUTPUT_PORT_VOUT5);
-			armcb_v4l2_config_queue_event_with_status(
-				pvdev, info, I7_INT_VOUT5_BUF_DONE);
+static void armcb_irq_lat_record(armcb_v4l2_config_dev_t *dev,
+				 struct armcb_irq_ring *ring,
+				 const struct armcb_irq_event *ev)
+{
+	u64 now = ktime_get_ns();
+	u64 delta = now - ev->ts_ns;
+	u64 us = div_u64(delta, NSEC_PER_USEC);
+	int bucket = us ? fls64(us) : 0;
+
+	if (bucket >= ARMCB_IRQ_LAT_BUCKETS)
+		bucket = ARMCB_IRQ_LAT_BUCKETS - 1;
+	dev->irq_lat_hist[bucket]++;
+	if (delta > dev->irq_lat_max_ns)
+		dev->irq_lat_max_ns = delta;
+
+	if (!(ev->info.status &
+	      (I7_INT_VOUTX_INT_MASK | I7_INT_VIN_EXPX_INT_MASK)))
+		return;
 
-			info->status &= ~I7_INT_VOUT5_BUF_DONE;
-		}
-		if (info->status & I7_INT_VOUT7_BUF_DONE) {
-			armcb_isp_put_frame(ctx_id, -1, ISP_OUTPUT_PORT_VOUT7);
-			armcb_v4l2_config_queue_event_with_status(
-				pvdev, info, I7_INT_VOUT7_BUF_DONE);
+	/* per ctx frame rate, 1/8 weighted moving average of the interval */
+	ring->frames++;
+	ring->lat_sum_ns += delta;
+	if (ring->last_frame_ns) {
+		u64 interval = now - ring->last_frame_ns;
 
-			info->status &= ~I7_INT_VOUT7_BUF_DONE;
-		}
+		ring->interval_ns = ring->interval_ns ?
+			(ring->interval_ns * 7 + interval) >> 3 : interval;
 	}
+	ring->last_frame_ns = now;
+}
 
-	if (info->status & I7_INT_VIN_EXPX_INT_MASK) {
-		if (info->status & I7_INT_VIN_CHNL_L_BUF_DONE) { //Channel Long
-			armcb_isp_put_frame(ctx_id, -1, ISP_OUTPUT_PORT_VIN);
-			armcb_v4l2_config_queue_event_with_status(
-				pvdev, info, I7_INT_VIN_CHNL_L_BUF_DONE);
-
-			info->status &= ~I7_INT_VIN_CHNL_L_BUF_DONE;
-		}
-		if (info->status &
-		    I7_INT_VIN_CHNL_M_BUF_DONE) { //Channel Middle
-			armcb_isp_put_frame(ctx_id, -1, ISP_OUTPUT_PORT_VIN);
-			armcb_v4l2_config_queue_event_with_status(
-				pvdev, info, I7_INT_VIN_CHNL_M_BUF_DONE);
-
-			info->status &= ~I7_INT_VIN_CHNL_M_BUF_DONE;
+/**
+ * @description: drain every ctx ring and complete the buffers
+ * @param {armcb_v4l2_config_dev_t} *dev: config device
+ * @return {*}
+ */
+static void armcb_irq_ring_drain(armcb_v4l2_config_dev_t *dev)
+{
+	struct armcb_irq_ring *ring = NULL;
+	struct armcb_irq_event *ev = NULL;
+	int ctx_id = 0;
+
+	for (ctx_id = 0; ctx_id < ARMCB_MAX_DEVS; ctx_id++) {
+		ring = &dev->irq_ring[ctx_id];
+		while ((ev = armcb_irq_ring_peek(ring))) {
+			/* enqueue the buffer to done queue*/
+			buffer_done_i7_handle(&ev->info);
+			armcb_irq_lat_record(dev, ring, ev);
+			armcb_irq_ring_pop(ring);
 		}
-		if (info->status & I7_INT_VIN_CHNL_S_BUF_DONE) { //Channel Short
-			armcb_isp_put_frame(ctx_id, -1, ISP_OUTPUT_PORT_VIN);
-			armcb_v4l2_config_queue_event_with_status(
-				pvdev, info, I7_INT_VIN_CHNL_S_BUF_DONE);
+	}
+}
 
-			info->status &= ~I7_INT_VIN_CHNL_S_BUF_DONE;
-		}
-		if (info->status &
-		    I7_INT_VIN_CHNL_VS_BUF_DONE) { //Channel v short
-			armcb_isp_put_frame(ctx_id, -1, ISP_OUTPUT_PORT_VIN);
-			armcb_v4l2_config_queue_event_with_status(
-				pvdev, info, I7_INT_VIN_CHNL_VS_BUF_DONE);
+/**
+ * @description: wait for the frame interrupt handlers running elsewhere;
+ *               a stream unpublished from the outport map and pstreams
+ *               before the call is no longer referenced after it
+ * @return {*}
+ */
+void armcb_isp_irq_sync(void)
+{
+#ifdef ARMCB_ISP_SW_MODEL
+	armcb_isp_sw_model_sync();
+#else
+	if (p_v4l_config_dev && p_v4l_config_dev->irq > 0)
+		synchronize_irq(p_v4l_config_dev->irq);
+#endif
+}
 
-			info->status &= ~I7_INT_VIN_CHNL_VS_BUF_DONE;
-		}
-	}
+/*
+ * irq threads run SCHED_FIFO, so buffer done is completed here without
+ * another hop through a tasklet or a kthread.
+ */
+static irqreturn_t armcb_I7_isp_thread(s32 irq, void *pdev)
+{
+	armcb_irq_ring_drain((armcb_v4l2_config_dev_t *)pdev);
 
-	if (info->status & I7_IRQ_EVENT_POST_MASK)
-		armcb_v4l2_config_queue_event(pvdev, info);
+	return IRQ_HANDLED;
 }
 
-static void buffer_done_handler(unsigned long data)
+static int armcb_irq_events_show(struct seq_file *s, void *unused)
 {
-	struct armcb_irq_msg_fh *fh = &p_v4l_config_dev->isr_fh;
-	struct isp_irq_info *info = NULL;
-	struct armcb_irq_event *ev = NULL;
-	struct armcb_irq_event *ev_next = NULL;
-	unsigned long flags;
-	(void)data;
+	armcb_v4l2_config_dev_t *dev = p_v4l_config_dev;
+	struct armcb_irq_ring *ring = NULL;
+	int i = 0;
 
-	spin_lock_irqsave(&fh->fh_lock, flags);
-	list_for_each_entry_safe(ev, ev_next, &fh->avaliable, fh_node) {
-		info = &ev->info;
+	if (!dev)
+		return 0;
+
+	seq_printf(s, "%-4s %12s %12s %8s %12s %6s %12s\n", "ctx", "pushed",
+		   "dropped", "pending", "frames", "fps", "avg_lat_us");
+	for (i = 0; i < ARMCB_MAX_DEVS; i++) {
+		ring = &dev->irq_ring[i];
+		if (!ring->pushed && !ring->dropped)
+			continue;
+		seq_printf(s, "%-4d %12llu %12llu %8u %12llu %6llu %12llu\n", i,
+			   ring->pushed, ring->dropped,
+			   READ_ONCE(ring->head) - READ_ONCE(ring->tail),
+			   ring->frames,
+			   ring->interval_ns ?
+				   div64_u64(NSEC_PER_SEC, ring->interval_ns) : 0,
+			   ring->frames ?
+				   div64_u64(ring->lat_sum_ns,
+					     ring->frames * NSEC_PER_USEC) : 0);
+	}
 
-		/* enqueue the buffer to done queue*/
-		buffer_done_i7_handle(info);
+	seq_printf(s, "\nframes %llu, buffer done %llu, events %llu\n",
+		   dev->irq_ev_frames, dev->irq_ev_done_bits,
+		   dev->irq_ev_posted);
 
-		list_del(&ev->fh_node);
-		fh->in_use--;
-		fh->first = irqev_pos(fh, 1);
+	seq_printf(s, "\nirq to buffer done latency, max %llu ns\n",
+		   dev->irq_lat_max_ns);
+	for (i = 0; i < ARMCB_IRQ_LAT_BUCKETS; i++) {
+		if (!dev->irq_lat_hist[i])
+			continue;
+		if (i == ARMCB_IRQ_LAT_BUCKETS - 1)
+			seq_printf(s, "  >= %6lu us: %llu\n", 1UL << (i - 1),
+				   dev->irq_lat_hist[i]);
+		else
+			seq_printf(s, "  <  %6lu us: %llu\n", 1UL << i,
+				   dev->irq_lat_hist[i]);
 	}
-	spin_unlock_irqrestore(&fh->fh_lock, flags);
+
+	return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(armcb_irq_events);
 
 static int armcb_v4l2_config_probe(struct platform_device *pdev)
 {
 	int ret = 0;
+#ifndef ARMCB_ISP_SW_MODEL
 	int isp_irqno = 0;
+#endif
 	struct armcb_isp_info *hw_info = NULL;
 	struct video_device *vfd = NULL;
 #ifdef QEMU_ON_VEXPRESS
@@ -2081,6 +2026,10 @@ static int armcb_v4l2_config_probe(struct platform_device *pdev)
 		LOG(LOG_INFO, "hw_info isp_type=%d", hw_info->type);
 	}
 
+	/* the register shadow only knows the i7 map */
+	if (hw_info->type == ISP_TYPE_I7)
+		armcb_isp_shadow_enable_i7();
+
 #ifdef QEMU_ON_VEXPRESS
 	interrupt_task = kthread_run(armcb_isp_interrupt_task,
 				     (void *)p_v4l_config_dev,
@@ -2090,6 +2039,19 @@ static int armcb_v4l2_config_probe(struct platform_device *pdev)
 		ret = -ENXIO;
 		goto unreg_dev;
 	}
+#elif defined(ARMCB_ISP_SW_MODEL)
+	/* the model only speaks the I7 interrupt layout */
+	if (hw_info->type != ISP_TYPE_I7) {
+		ret = -ENODEV;
+		LOG(LOG_ERR, "software isp model needs an I7 config node");
+		goto unreg_dev;
+	}
+	ret = armcb_isp_sw_model_start(hw_info->isp_isr, hw_info->isp_thread,
+				       (void *)p_v4l_config_dev);
+	if (ret != 0) {
+		LOG(LOG_ERR, "failed to start software isp model ret(%d)", ret);
+		goto unreg_dev;
+	}
 #else
 	isp_irqno = platform_get_irq(pdev, 0);
 
@@ -2101,21 +2063,25 @@ static int armcb_v4l2_config_probe(struct platform_device *pdev)
 	}
 
 #ifdef CONFIG_ARENA_FPGA_PLATFORM
-	ret = devm_request_irq(&pdev->dev, isp_irqno, hw_info->isp_isr,
-			       IRQF_SHARED, pdev->name,
-			       (void *)p_v4l_config_dev);
+	ret = devm_request_threaded_irq(&pdev->dev, isp_irqno,
+					hw_info->isp_isr, hw_info->isp_thread,
+					IRQF_SHARED, pdev->name,
+					(void *)p_v4l_config_dev);
 #else
-	ret = devm_request_irq(&pdev->dev, isp_irqno, hw_info->isp_isr,
-			       IRQF_ONESHOT | IRQF_SHARED, pdev->name,
-			       (void *)p_v4l_config_dev);
+	ret = devm_request_threaded_irq(&pdev->dev, isp_irqno,
+					hw_info->isp_isr, hw_info->isp_thread,
+					IRQF_ONESHOT | IRQF_SHARED, pdev->name,
+					(void *)p_v4l_config_dev);
 #endif
 	if (ret != 0) {
 		ret = -ENXIO;
 		LOG(LOG_ERR, "devm_request_irq failed ret(%d)", ret);
 		goto unreg_dev;
 	}
+	p_v4l_config_dev->irq = isp_irqno;
 #endif
 
+#ifndef ARMCB_ISP_SW_MODEL
 	/*register i7 error isr*/
 	if (hw_info->type == ISP_TYPE_I7) {
 		isp_irqno = platform_get_irq(pdev, 1);
@@ -2137,10 +2103,17 @@ static int armcb_v4l2_config_probe(struct platform_device *pdev)
 			goto unreg_dev;
 		}
 	}
+#endif
 
-	armcb_irq_msg_fh_init(&p_v4l_config_dev->isr_fh);
-	tasklet_init(&p_v4l_config_dev->buffer_done_task, buffer_done_handler,
-		     0UL);
+	ret = armcb_isp_stats_init();
+	if (ret)
+		goto unreg_dev;
+
+	if (!g_irq_debugfs_init) {
+		debugfs_create_file("irq_events", 0444, system_debugfs_root(),
+				    NULL, &armcb_irq_events_fops);
+		g_irq_debugfs_init = true;
+	}
 
 #ifndef CONFIG_PLAT_BBOX
 	init_completion(&g_rdr_dump_comp);
@@ -2164,8 +2137,12 @@ static int armcb_v4l2_config_probe(struct platform_device *pdev)
 
 #ifndef CONFIG_PLAT_BBOX
 err_rproc_add:
+	armcb_isp_stats_exit();
 #endif
 unreg_dev:
+#ifdef ARMCB_ISP_SW_MODEL
+	armcb_isp_sw_model_stop();
+#endif
 	video_unregister_device(&p_v4l_config_dev->vid_cap_dev);
 	v4l2_device_put(&p_v4l_config_dev->v4l2_dev);
 exit_ret:
@@ -2177,6 +2154,11 @@ static int armcb_v4l2_config_remove(struct platform_device *pdev)
 {
 	int ret = 0;
 
+#ifdef ARMCB_ISP_SW_MODEL
+	armcb_isp_sw_model_stop();
+#endif
+	armcb_isp_stats_exit();
+
 #ifndef CONFIG_PLAT_BBOX
 	cix_isp_rproc_rdr_unregister_core();
 	cix_isp_rproc_rdr_unregister_exception();
@@ -2265,3 +2247,7 @@ void armcb_v4l2_cfg_driver_destroy(void)
 	}
 }
 #endif
+
+#ifdef ARMCB_ISP_KUNIT_TEST
+#include "armcb_v4l2_config_test.c"
+#endif
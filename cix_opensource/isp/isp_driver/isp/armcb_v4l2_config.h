@@ -16,21 +16,35 @@
 #define __ARMCB_V4L2_CONFIG_H__
 
 #include "armcb_isp_driver.h"
+#include "armcb_v4l2_core.h"
 #include <linux/interrupt.h>
 #include <media/v4l2-device.h>
 
+#define ARMCB_IRQ_RING_SIZE (32)
+#define ARMCB_IRQ_LAT_BUCKETS (16)
+
 struct armcb_irq_event {
 	struct isp_irq_info info;
-	struct list_head fh_node;
+	u64 ts_ns;
 };
 
-struct armcb_irq_msg_fh {
-	struct armcb_irq_event ev_array[32];
-	int in_use;
-	int first;
-	int elems;
-	spinlock_t fh_lock;
-	struct list_head avaliable;
+/*
+ * Single producer (hard irq handler) / single consumer (irq thread) ring,
+ * one per ctx. head is only written by the producer and tail only by the
+ * consumer, so no lock is needed. A full ring drops the new event and
+ * counts it instead of overwriting an event the consumer may be reading.
+ */
+struct armcb_irq_ring {
+	struct armcb_irq_event ev[ARMCB_IRQ_RING_SIZE];
+	unsigned int head;
+	unsigned int tail;
+	u64 pushed;
+	u64 dropped;
+	/* consumer side, frames with buffer done bits */
+	u64 frames;
+	u64 lat_sum_ns;
+	u64 last_frame_ns;
+	u64 interval_ns;
 };
 
 typedef struct armcb_v4l2_config_dev {
@@ -64,18 +78,19 @@ typedef struct armcb_v4l2_config_dev {
 	struct media_entity_enum crashed;
 	struct media_device media_dev;
 
-	/* buffer_done_work */
-	struct tasklet_struct buffer_done_task;
-	struct armcb_irq_msg_fh isr_fh;
+	/* buffer done events, filled by the isr and drained by the irq thread */
+	struct armcb_irq_ring irq_ring[ARMCB_MAX_DEVS];
+	/* irq to buffer done latency, log2 buckets in us */
+	u64 irq_lat_hist[ARMCB_IRQ_LAT_BUCKETS];
+	u64 irq_lat_max_ns;
+	/* one event is posted per interrupt however many ports are done */
+	u64 irq_ev_frames;
+	u64 irq_ev_done_bits;
+	u64 irq_ev_posted;
+	/* frame interrupt line, 0 when frames come from the software model */
+	int irq;
 } armcb_v4l2_config_dev_t;
 
-static inline unsigned int irqev_pos(const struct armcb_irq_msg_fh *fh,
-				 unsigned int idx)
-{
-	idx += fh->first;
-	return idx >= fh->elems ? idx - fh->elems : idx;
-}
-
 int armcb_v4l2_config_update_stream_vin_addr(armcb_v4l2_stream_t *pstream);
 int armcb_v4l2_config_update_stream_hw_addr(armcb_v4l2_stream_t *pstream);
 int armcb_init_output_addr_by_i7(uint32_t *p_vout_reg1,
@@ -83,6 +98,7 @@ int armcb_init_output_addr_by_i7(uint32_t *p_vout_reg1,
 void armcb_i7_disable_int(void);
 void armcb_i7_disable_vin(void);
 int destroy_buf_queue(struct vb2_queue *q, enum vb2_buffer_state state);
+void armcb_isp_irq_sync(void);
 
 #ifdef ARMCB_CAM_KO
 void *armcb_get_v4l2_cfg_driver_instance(void);
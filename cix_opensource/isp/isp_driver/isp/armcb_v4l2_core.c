@@ -17,8 +17,10 @@
 #include "armcb_camera_io_drv.h"
 #include "armcb_isp.h"
 #include "armcb_isp_driver.h"
+#include "armcb_isp_stats.h"
 #include "armcb_platform.h"
 #include "armcb_register.h"
+#include "armcb_sensor_queue.h"
 #include "armcb_v4l2_config.h"
 #include "armcb_v4l2_stream.h"
 #include "armcb_v4l_sd.h"
@@ -28,6 +30,7 @@
 #include "linux/types.h"
 #include "media/media-device.h"
 #include "media/media-entity.h"
+#include "system_debugfs.h"
 #include "system_dma.h"
 #include "system_logger.h"
 #include <linux/errno.h>
@@ -38,6 +41,7 @@
 #include <linux/mutex.h>
 #include <linux/platform_device.h>
 #include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/v4l2-dv-timings.h>
 #include <linux/videodev2.h>
@@ -58,7 +62,6 @@
 #endif
 
 #define ARMCB_MODULE_NAME "armcb_isp_v4l2"
-#define MAX_PLANES_NUM 2
 #define READY_TIME 3500
 
 extern int armcb_multi_cam;
@@ -68,10 +71,8 @@ dma_addr_t discard_buf_addr_dma;
 dma_addr_t discard_dma_handle;
 
 static armcb_v4l2_dev_t *g_isp_v4l2_devs[ARMCB_MAX_DEVS] = { 0 };
-static uint32_t outport_array[ARMCB_MAX_DEVS][V4L2_STREAM_TYPE_MAX];
 static int g_adev_idx;
-armcb_v4l2_stream_t
-	*g_outport_map[ARMCB_MAX_DEVS][ISP_OUTPUT_PORT_MAX] = { 0 };
+static bool g_debugfs_init;
 
 
 static const int vout_idx[5] = {
@@ -168,26 +169,44 @@ int armcb_v4l2_find_stream(armcb_v4l2_stream_t **ppstream, uint32_t ctx_id,
 	return 0;
 }
 
+/* dev->outport_lock must be held */
+static int armcb_v4l2_dev_find_outport(armcb_v4l2_dev_t *dev, uint32_t outport)
+{
+	int stream_id = 0;
+
+	for (stream_id = 0; stream_id < V4L2_STREAM_TYPE_MAX; stream_id++) {
+		if (outport & dev->outport_bits[stream_id])
+			return stream_id;
+	}
+
+	return -1;
+}
+
 int armcb_v4l2_find_ctx_stream_by_outport(uint32_t outport, uint32_t *p_ctx_id,
 					  uint32_t *p_stream_id)
 {
+	armcb_v4l2_dev_t *dev = NULL;
+	unsigned long flags;
 	uint32_t ctx_id = 0;
-	uint32_t stream_id = 0;
+	int stream_id = -1;
 
-	if (outport < 0 || p_ctx_id == NULL || p_stream_id == NULL) {
+	if (p_ctx_id == NULL || p_stream_id == NULL) {
 		LOG(LOG_ERR, "invalid parameter");
 		return -EINVAL;
 	}
 
 	for (ctx_id = 0; ctx_id < ARMCB_MAX_DEVS; ctx_id++) {
-		for (stream_id = 0; stream_id < V4L2_STREAM_TYPE_MAX;
-			 stream_id++) {
-			if (outport & outport_array[ctx_id][stream_id])
-				goto exit;
-		}
+		dev = g_isp_v4l2_devs[ctx_id];
+		if (!dev)
+			continue;
+		spin_lock_irqsave(&dev->outport_lock, flags);
+		stream_id = armcb_v4l2_dev_find_outport(dev, outport);
+		spin_unlock_irqrestore(&dev->outport_lock, flags);
+		if (stream_id >= 0)
+			break;
 	}
 
-	if (ctx_id == ARMCB_MAX_DEVS) {
+	if (stream_id < 0) {
 		*p_ctx_id = -1;
 		*p_stream_id = -1;
 		LOG(LOG_ERR,
@@ -196,7 +215,6 @@ int armcb_v4l2_find_ctx_stream_by_outport(uint32_t outport, uint32_t *p_ctx_id,
 		return -EINVAL;
 	}
 
-exit:
 	*p_ctx_id = ctx_id;
 	*p_stream_id = stream_id;
 
@@ -208,19 +226,23 @@ exit:
 int armcb_v4l2_find_stream_by_outport_ctx(uint32_t outport, uint32_t ctx_id,
 					  uint32_t *p_stream_id)
 {
-	uint32_t stream_id = 0;
+	armcb_v4l2_dev_t *dev = NULL;
+	unsigned long flags;
+	int stream_id = -1;
 
-	if (outport < 0 || ctx_id < 0 || p_stream_id == NULL) {
+	if (ctx_id >= ARMCB_MAX_DEVS || p_stream_id == NULL) {
 		LOG(LOG_ERR, "invalid parameter");
 		return -EINVAL;
 	}
 
-	for (stream_id = 0; stream_id < V4L2_STREAM_TYPE_MAX; stream_id++) {
-		if (outport & outport_array[ctx_id][stream_id])
-			goto exit;
+	dev = g_isp_v4l2_devs[ctx_id];
+	if (dev) {
+		spin_lock_irqsave(&dev->outport_lock, flags);
+		stream_id = armcb_v4l2_dev_find_outport(dev, outport);
+		spin_unlock_irqrestore(&dev->outport_lock, flags);
 	}
 
-	if (stream_id == V4L2_STREAM_TYPE_MAX) {
+	if (stream_id < 0) {
 		*p_stream_id = -1;
 		LOG(LOG_DEBUG,
 			"failed to find a valid stream_id for outport:%d and ctx_id:%d",
@@ -228,7 +250,6 @@ int armcb_v4l2_find_stream_by_outport_ctx(uint32_t outport, uint32_t ctx_id,
 		return -EINVAL;
 	}
 
-exit:
 	*p_stream_id = stream_id;
 
 	LOG(LOG_DEBUG, "success find stream_id:%d for outport:%d and ctx_id:%d",
@@ -236,40 +257,186 @@ exit:
 	return 0;
 }
 
+/*
+ * Called from the irq path. The stream stays valid until the handler
+ * returns: armcb_v4l2_stream_deinit() waits for it in armcb_isp_irq_sync()
+ * after the stream was removed from the map.
+ */
+armcb_v4l2_stream_t *armcb_v4l2_outport_stream(uint32_t ctx_id,
+					       isp_output_port_t port)
+{
+	armcb_v4l2_stream_t *pstream = NULL;
+	armcb_v4l2_dev_t *dev = NULL;
+	unsigned long flags;
+
+	if (ctx_id >= ARMCB_MAX_DEVS || port >= ISP_OUTPUT_PORT_MAX)
+		return NULL;
+
+	dev = g_isp_v4l2_devs[ctx_id];
+	if (!dev)
+		return NULL;
+
+	spin_lock_irqsave(&dev->outport_lock, flags);
+	pstream = dev->outport_map[port];
+	spin_unlock_irqrestore(&dev->outport_lock, flags);
+
+	return pstream;
+}
+
+static void armcb_v4l2_set_outport(armcb_v4l2_dev_t *dev, int outport_idx,
+				   armcb_v4l2_stream_t *pstream)
+{
+	unsigned long flags;
+
+	if (outport_idx < 0 || outport_idx >= ISP_OUTPUT_PORT_MAX)
+		return;
+
+	spin_lock_irqsave(&dev->outport_lock, flags);
+	dev->outport_map[outport_idx] = pstream;
+	spin_unlock_irqrestore(&dev->outport_lock, flags);
+}
+
+static void armcb_release_output_port(armcb_v4l2_dev_t *dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->outport_lock, flags);
+	memset(dev->outport_map, 0, sizeof(dev->outport_map));
+	spin_unlock_irqrestore(&dev->outport_lock, flags);
+
+	LOG(LOG_INFO, "#### Armcb release ctx %d port resource !!!", dev->ctx_id);
+}
+
+void armcb_v4l2_release_all_output_ports(void)
+{
+	int i = 0;
+
+	for (i = 0; i < ARMCB_MAX_DEVS; i++) {
+		if (g_isp_v4l2_devs[i])
+			armcb_release_output_port(g_isp_v4l2_devs[i]);
+	}
+}
+
 extern struct device *mem_dev;
-void armcb_isp_invalid_cache (struct vb2_buffer *vb,
-					armcb_v4l2_buffer_t *pbuf)
+
+/* Ports listed here hand their frames to consumers that never read them
+ * from the CPU (encoder, display, NPU), so their buffers skip the cache
+ * invalidation on buffer done.
+ */
+static uint no_cpu_sync_ports;
+module_param(no_cpu_sync_ports, uint, 0644);
+MODULE_PARM_DESC(no_cpu_sync_ports,
+		 "Bitmask of (1 << isp_output_port_t) skipping CPU cache invalidation");
+
+struct armcb_isp_sync_stats {
+	u64 frames;
+	u64 skipped;
+	u64 last_bytes;
+	u64 total_bytes;
+};
+
+static struct armcb_isp_sync_stats
+	g_sync_stats[ARMCB_MAX_DEVS][ISP_OUTPUT_PORT_MAX];
+
+static void armcb_isp_invalid_cache(armcb_v4l2_buffer_t *pbuf,
+				    uint32_t ctx_id, isp_output_port_t port)
 {
-	struct sg_table sgt0;
-	struct sg_table sgt1;
-	struct device *dev = mem_dev;
+	struct armcb_isp_sync_stats *stats = NULL;
+	unsigned int i = 0;
 
-	void* dma_vaddr_0;
-	void* dma_vaddr_1;
-	dma_addr_t dma_addr_0;
-	dma_addr_t dma_addr_1;
+	if (!mem_dev || ctx_id >= ARMCB_MAX_DEVS || port >= ISP_OUTPUT_PORT_MAX)
+		return;
 
-	if((!dev) || (pbuf->vvb.vb2_buf.num_planes > MAX_PLANES_NUM))
+	stats = &g_sync_stats[ctx_id][port];
+	if (no_cpu_sync_ports & (1 << port)) {
+		stats->skipped++;
 		return;
+	}
 
-	dma_vaddr_0 = vb2_plane_vaddr(&pbuf->vvb.vb2_buf, 0);
-	dma_addr_0 = vb2_dma_contig_plane_dma_addr(vb, 0);
+	/* the sg_tables only cover the bytes written by the ISP */
+	for (i = 0; i < pbuf->sgt_num; i++)
+		dma_sync_sgtable_for_cpu(mem_dev, &pbuf->sgt[i], DMA_FROM_DEVICE);
 
-	dma_get_sgtable_attrs(dev, &sgt0, dma_vaddr_0, dma_addr_0,
-			vb->planes[0].length, 0);
+	stats->frames++;
+	stats->last_bytes = pbuf->sync_bytes;
+	stats->total_bytes += pbuf->sync_bytes;
+}
 
-	dma_sync_sgtable_for_cpu(dev, &sgt0, DMA_FROM_DEVICE);
+static int armcb_isp_sync_stats_show(struct seq_file *s, void *unused)
+{
+	struct armcb_isp_sync_stats *stats = NULL;
+	int ctx_id = 0;
+	int port = 0;
 
-	if (pbuf->vvb.vb2_buf.num_planes > 1) {
-		dma_vaddr_1 = vb2_plane_vaddr(&pbuf->vvb.vb2_buf, 1);
-		dma_addr_1 = vb2_dma_contig_plane_dma_addr(vb, 1);
+	seq_printf(s, "%-4s %-6s %12s %12s %12s %16s\n", "ctx", "port",
+		   "frames", "skipped", "last_bytes", "total_bytes");
+	for (ctx_id = 0; ctx_id < ARMCB_MAX_DEVS; ctx_id++) {
+		for (port = 0; port < ISP_OUTPUT_PORT_MAX; port++) {
+			stats = &g_sync_stats[ctx_id][port];
+			if (!stats->frames && !stats->skipped)
+				continue;
+			seq_printf(s, "%-4d %-6s %12llu %12llu %12llu %16llu\n",
+				   ctx_id, g_IspPortToken[port], stats->frames,
+				   stats->skipped, stats->last_bytes,
+				   stats->total_bytes);
+		}
+	}
+	seq_printf(s, "sg_tables: %d\n", armcb_vb2_sgt_live());
 
-		dma_get_sgtable_attrs(dev, &sgt1, dma_vaddr_1, dma_addr_1,
-				vb->planes[1].length, 0);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(armcb_isp_sync_stats);
 
-		dma_sync_sgtable_for_cpu(dev, &sgt1, DMA_FROM_DEVICE);
+struct armcb_isp_port_stats {
+	u64 underrun; /// sol found no queued buffer, hw sent to scratch
+	u64 dropped; /// buffer done with no busy buffer to complete
+};
+
+static struct armcb_isp_port_stats
+	g_port_stats[ARMCB_MAX_DEVS][ISP_OUTPUT_PORT_MAX];
+
+static struct armcb_isp_port_stats *
+armcb_isp_port_stats_get(armcb_v4l2_stream_t *pstream)
+{
+	int port = armcb_outport_bits_to_idx(pstream->outport);
+
+	if (pstream->ctx_id >= ARMCB_MAX_DEVS || port < 0 ||
+	    port >= ISP_OUTPUT_PORT_MAX)
+		return NULL;
+
+	return &g_port_stats[pstream->ctx_id][port];
+}
+
+void armcb_isp_count_underrun(armcb_v4l2_stream_t *pstream)
+{
+	struct armcb_isp_port_stats *stats = armcb_isp_port_stats_get(pstream);
+
+	if (stats)
+		stats->underrun++;
+}
+
+static int armcb_isp_port_stats_show(struct seq_file *s, void *unused)
+{
+	struct armcb_isp_port_stats *stats = NULL;
+	int ctx_id = 0;
+	int port = 0;
+
+	seq_printf(s, "%-4s %-6s %12s %12s\n", "ctx", "port", "underrun",
+		   "dropped");
+	for (ctx_id = 0; ctx_id < ARMCB_MAX_DEVS; ctx_id++) {
+		for (port = 0; port < ISP_OUTPUT_PORT_MAX; port++) {
+			stats = &g_port_stats[ctx_id][port];
+			if (!stats->underrun && !stats->dropped)
+				continue;
+			seq_printf(s, "%-4d %-6s %12llu %12llu\n", ctx_id,
+				   g_IspPortToken[port], stats->underrun,
+				   stats->dropped);
+		}
 	}
+
+	return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(armcb_isp_port_stats);
 
 void armcb_isp_put_frame(uint32_t ctx_id, int stream_id, isp_output_port_t port)
 {
@@ -279,14 +446,13 @@ void armcb_isp_put_frame(uint32_t ctx_id, int stream_id, isp_output_port_t port)
 	armcb_v4l2_buffer_t *pbuf = NULL;
 	struct vb2_buffer *vb = NULL;
 	armcb_v4l2_dev_t *dev = NULL;
-
-	static armcb_v4l2_buffer_t *splastbuf;
+	struct armcb_isp_port_stats *stats = NULL;
 	armcb_v4l2_buffer_t *plastbuf = NULL;
 
 	dev = armcb_v4l2_core_get_dev(ctx_id);
 
 	if (stream_id < 0 && port < ISP_OUTPUT_PORT_MAX) {
-		pstream = g_outport_map[ctx_id][port];
+		pstream = armcb_v4l2_outport_stream(ctx_id, port);
 	} else {
 		/* find stream pointer */
 		rc = armcb_v4l2_find_stream(&pstream, ctx_id, stream_id);
@@ -298,6 +464,13 @@ void armcb_isp_put_frame(uint32_t ctx_id, int stream_id, isp_output_port_t port)
 		}
 	}
 
+	/* check if stream is on */
+	if (!pstream || !pstream->stream_started) {
+		LOG(LOG_DEBUG, "[Stream#%d] is not started yet on ctx %d",
+			stream_id, ctx_id);
+		return;
+	}
+
 	LOG(LOG_DEBUG,
 		"ctx_id:%d Stream#%d fmt(%d*%d %d %d) outport(%d %s) streamType(%d) "
 		"reserved_buf_addr(0x%x)",
@@ -307,13 +480,6 @@ void armcb_isp_put_frame(uint32_t ctx_id, int stream_id, isp_output_port_t port)
 		pstream->cur_v4l2_fmt.type, pstream->outport, g_IspPortToken[port],
 		pstream->stream_type, pstream->reserved_buf_addr);
 
-	/* check if stream is on */
-	if (!pstream || !pstream->stream_started) {
-		LOG(LOG_DEBUG, "[Stream#%d] is not started yet on ctx %d",
-			stream_id, ctx_id);
-		return;
-	}
-
 	LOG(LOG_DEBUG, "ctx_id:%d [Stream#%d] %p", ctx_id, pstream->stream_id,
 		pstream);
 
@@ -326,7 +492,7 @@ void armcb_isp_put_frame(uint32_t ctx_id, int stream_id, isp_output_port_t port)
 	/* try to get an active buffer from vb2 queue  */
 	if (!list_empty(&pstream->stream_buffer_list_busy)) {
 		if (!list_is_singular(&pstream->stream_buffer_list_busy) ||
-			(plastbuf == splastbuf)) {
+			(plastbuf == pstream->last_busy)) {
 			pbuf = list_entry(pstream->stream_buffer_list_busy.next,
 					  armcb_v4l2_buffer_t, list);
 			if(pbuf)
@@ -335,14 +501,17 @@ void armcb_isp_put_frame(uint32_t ctx_id, int stream_id, isp_output_port_t port)
 	}
 
 	if (!pbuf) {
-		/// @TODO: need to use reserved buffer to hw output.
+		/* the frame went to the stream scratch buffer */
 		LOG(LOG_DEBUG, "[Stream#%d] type: %d no buffers, use reserved buffer",
 			pstream->stream_id, V4L2_STREAM_TYPE_VIDEO);
+		stats = armcb_isp_port_stats_get(pstream);
+		if (stats)
+			stats->dropped++;
 		goto spin_unlock;
 	}
 
-	splastbuf = list_last_entry(&(pstream->stream_buffer_list_busy),
-					armcb_v4l2_buffer_t, list);
+	pstream->last_busy = list_last_entry(&(pstream->stream_buffer_list_busy),
+					     armcb_v4l2_buffer_t, list);
 
 	spin_unlock_irqrestore(&pstream->slock, flags);
 
@@ -367,9 +536,9 @@ void armcb_isp_put_frame(uint32_t ctx_id, int stream_id, isp_output_port_t port)
 
 	/* Invalid cache before CPU read buffer to avoid the cache
 	 * line issue */
-	armcb_isp_invalid_cache(vb, pbuf);
+	armcb_isp_invalid_cache(pbuf, ctx_id, port);
 	vb->timestamp = ktime_get_ns();
-	vb2_buffer_done(vb, VB2_BUF_STATE_DONE);
+	armcb_vb2_buffer_done(pbuf, VB2_BUF_STATE_DONE);
 
 	LOG(LOG_DEBUG, "%s put frame success ctx_id:%d stream_id:%d",
                g_IspPortToken[port], ctx_id, stream_id);
@@ -444,20 +613,6 @@ int armcb_disable_irq(void)
 	return ret;
 }
 
-static int armcb_release_output_port(void)
-{
-    int rc = 0, i = 0, j = 0;
-
-    for(i = 0; i < ARMCB_MAX_DEVS; i++  )
-    {
-        for(j = 0; j < ISP_OUTPUT_PORT_MAX; j++)
-            g_outport_map[i][j] = NULL;
-    }
-
-    LOG(LOG_INFO, "#### Armcb release all port resource !!!");
-    return rc;
-}
-
 // Get current application PID
 
 static int find_user_process_by_name(const char *name)
@@ -555,12 +710,11 @@ static int armcb_v4l2_fop_release(struct file *file)
 		/* deinit stream */
 		if (pstream) {
 			outport_idx = armcb_outport_bits_to_idx(pstream->outport);
-			if (outport_idx >= 0 && outport_idx < ISP_OUTPUT_PORT_MAX)
-				g_outport_map[sp->ctx_id][outport_idx] = NULL;
+			armcb_v4l2_set_outport(dev, outport_idx, NULL);
 			if (pstream->stream_type < V4L2_STREAM_TYPE_MAX)
 				dev->stream_id_index[pstream->stream_type] = -1;
+			WRITE_ONCE(dev->pstreams[sp->stream_id], NULL);
 			armcb_v4l2_stream_deinit(pstream, dev);
-			dev->pstreams[sp->stream_id] = NULL;
 		}
 
 		msleep(READY_TIME);
@@ -570,7 +724,7 @@ static int armcb_v4l2_fop_release(struct file *file)
 	}
 
 	/* When the stream is stream off and the buffer is released, it should
-	 * set the g_outport_map to 0 to avoid the next loop outport is busy
+	 * clear the outport map to avoid the next loop outport is busy
 	 */
 	/* case3. The stream is streamoff, and need to close the fd, clear
 	 * the outport port, clear the atomic flags to avoid the outport busy.
@@ -596,7 +750,7 @@ static int armcb_v4l2_fop_release(struct file *file)
 	return rc;
 
 deinit:
-	armcb_release_output_port();
+	armcb_release_output_port(dev);
 	atomic_set(&dev->stream_on_cnt, STREAM_DEFAULT);
 	atomic_set(&dev->port_idx_release, OUTPORT_IDX_DEFAULT);
 
@@ -792,6 +946,10 @@ static int armcb_v4l2_streamon(struct file *file, void *priv,
 	}
 #endif
 
+	/* a failure leaves the stream on the shared discard buffer */
+	if (pstream)
+		armcb_v4l2_alloc_stream_scratch(pstream);
+
 	rc = armcb_v4l2_stream_on(pstream);
 	if (rc != 0) {
 		LOG(LOG_ERR, "fail to isp_stream_on. (stream_id = %d, rc=%d)",
@@ -873,12 +1031,11 @@ static int armcb_isp_vb2_streamoff(struct file *file)
 			/* deinit stream */
 			if (pstream) {
 				outport_idx = armcb_outport_bits_to_idx(pstream->outport);
-				if (outport_idx >= 0 && outport_idx < ISP_OUTPUT_PORT_MAX)
-					g_outport_map[dev->ctx_id][outport_idx] = NULL;
+				armcb_v4l2_set_outport(dev, outport_idx, NULL);
 				if (pstream->stream_type < V4L2_STREAM_TYPE_MAX)
 					dev->stream_id_index[pstream->stream_type] = -1;
+				WRITE_ONCE(dev->pstreams[loop], NULL);
 				armcb_v4l2_stream_deinit(pstream, dev);
-				dev->pstreams[loop] = NULL;
 				dev->is_streaming = 0;
 			}
 		}
@@ -922,6 +1079,7 @@ int armcb_v4l2_s_fmt_vid_cap_mplane(struct file *file, void *priv,
 	struct vb2_queue *q = &sp->vb2_q;
 
 	int outport_idx = -1;
+	unsigned long flags;
 	int i;
 	int rc = 0;
 	struct v4l2_event ev;
@@ -979,7 +1137,9 @@ int armcb_v4l2_s_fmt_vid_cap_mplane(struct file *file, void *priv,
 	atomic_set(&dev->port_idx_release, OUTPORT_IDX_IS_FREE);
 	/* update stream pointer index */
 	dev->stream_id_index[pstream->stream_type] = pstream->stream_id;
-	outport_array[sp->ctx_id][sp->stream_id] = pstream->outport;
+	spin_lock_irqsave(&dev->outport_lock, flags);
+	dev->outport_bits[sp->stream_id] = pstream->outport;
+	spin_unlock_irqrestore(&dev->outport_lock, flags);
 	outport_idx = armcb_outport_bits_to_idx(pstream->outport);
 	if (outport_idx < 0 || outport_idx >= ISP_OUTPUT_PORT_MAX) {
 		rc = -EINVAL;
@@ -989,7 +1149,7 @@ int armcb_v4l2_s_fmt_vid_cap_mplane(struct file *file, void *priv,
 		return rc;
 	}
 
-	if (g_outport_map[sp->ctx_id][outport_idx]) {
+	if (armcb_v4l2_outport_stream(dev->ctx_id, outport_idx)) {
 		rc = -EINVAL;
 		LOG(LOG_ERR, "busy outport idx:%d, bits:%#x\n", outport_idx,
 			pstream->outport);
@@ -997,7 +1157,7 @@ int armcb_v4l2_s_fmt_vid_cap_mplane(struct file *file, void *priv,
 		return rc;
 	}
 
-	g_outport_map[sp->ctx_id][outport_idx] = pstream;
+	armcb_v4l2_set_outport(dev, outport_idx, pstream);
 	memset(&ev, 0, sizeof(struct v4l2_event));
 	ev.id = ISP_DAEMON_EVENT_SET_IMG_SIZE;
 	ev.type = V4L2_EVENT_CTRL;
@@ -1047,7 +1207,6 @@ int armcb_v4l2_reqbufs(struct file *file, void *priv,
 	return rc;
 }
 
-/*
 static int armcb_v4l2_expbuf(struct file *file, void *priv,
 				 struct v4l2_exportbuffer *p)
 {
@@ -1057,13 +1216,12 @@ static int armcb_v4l2_expbuf(struct file *file, void *priv,
 	if (armcb_v4l2_is_q_busy(&sp->vb2_q, file))
 		return -EBUSY;
 
-	rc = vb2_expbuf(&sp->vb2_q, p);
+	rc = armcb_vb2_expbuf(&sp->vb2_q, p);
 	LOG(LOG_DEBUG, "expbuf sid:%d type:%d index:%d plane:%d rc: %d",
 		sp->stream_id, p->type, p->index, p->plane, rc);
 
 	return rc;
 }
-*/
 
 static int armcb_v4l2_querybuf(struct file *file, void *priv,
 				   struct v4l2_buffer *p)
@@ -1230,6 +1388,57 @@ int armcb_v4l2_release_discard_buffer(u32 reserved_size, struct device *dev)
 	return ret;
 }
 
+/* Per stream (so per ctx and port) scratch buffer the hardware is pointed
+ * at when userspace has no buffer queued, allocated here in process context
+ * so the sol interrupt never has to.
+ */
+int armcb_v4l2_alloc_stream_scratch(armcb_v4l2_stream_t *pstream)
+{
+	struct v4l2_pix_format_mplane *pix = &pstream->cur_v4l2_fmt.fmt.pix_mp;
+	dma_addr_t dma_handle = 0;
+	size_t size = 0;
+	int i = 0;
+
+	if (!mem_dev)
+		return -ENODEV;
+
+	for (i = 0; i < pix->num_planes && i < VIDEO_MAX_PLANES; i++)
+		size += pix->plane_fmt[i].sizeimage;
+	size = PAGE_ALIGN(size);
+	if (!size)
+		return -EINVAL;
+
+	if (pstream->scratch_vaddr && pstream->scratch_size == size)
+		return 0;
+
+	armcb_v4l2_release_stream_scratch(pstream);
+
+	pstream->scratch_vaddr = dma_alloc_coherent(mem_dev, size, &dma_handle,
+						    GFP_KERNEL);
+	if (!pstream->scratch_vaddr) {
+		LOG(LOG_WARN, "[Stream#%d] no scratch buffer, size %zu",
+		    pstream->stream_id, size);
+		return -ENOMEM;
+	}
+
+	pstream->scratch_size = size;
+	pstream->reserved_buf_addr_dma = dma_handle;
+
+	return 0;
+}
+
+void armcb_v4l2_release_stream_scratch(armcb_v4l2_stream_t *pstream)
+{
+	if (!pstream->scratch_vaddr)
+		return;
+
+	dma_free_coherent(mem_dev, pstream->scratch_size,
+			  pstream->scratch_vaddr, pstream->reserved_buf_addr_dma);
+	pstream->scratch_vaddr = NULL;
+	pstream->scratch_size = 0;
+	pstream->reserved_buf_addr_dma = 0;
+}
+
 int armcb_v4l2_config_init_update_stream_hw_addr(armcb_v4l2_dev_t *dev)
 {
 	u32 vout_reg1 = 0;
@@ -1286,9 +1495,13 @@ static int armcb_v4l2_s_ctrl(struct file *file, void *fh,
 				LOG(LOG_INFO, "devname:%s, ISP_DAEMON_SET_STREAM_OFF\n", dev_name(&vdev->dev));
 				/*disbale the stream operate ram,if not smmu error maybe occur */
 				armcb_disable_irq();
+				/* no sof to wait for anymore */
+				armcb_sensor_queue_stop(dev->ctx_id);
 				rc = armcb_isp_hw_apply_list(CMD_TYPE_STREAMOFF);
 				if (rc < 0)
 					LOG(LOG_ERR, "armcb_isp_hw_apply_list failed ret(%d)", rc);
+				/* the 3a port is idle, a closed stats ring can go */
+				armcb_isp_stats_ring_stop(dev->ctx_id);
 				rc = armcb_isp_hw_apply_list(CMD_TYPE_POWERDOWN);
 				if (rc < 0)
 					LOG(LOG_ERR, "armcb_isp_hw_apply_list failed ret(%d)", rc);
@@ -1302,6 +1515,37 @@ static int armcb_v4l2_s_ctrl(struct file *file, void *fh,
 	return rc;
 }
 
+static int armcb_v4l2_g_ctrl(struct file *file, void *fh,
+			     struct v4l2_control *ctrl)
+{
+	armcb_v4l2_dev_t *dev = video_drvdata(file);
+	struct armcb_isp_v4l2_fh *sp = fh_to_private(fh);
+	armcb_v4l2_stream_t *pstream = NULL;
+	struct armcb_isp_port_stats *stats = NULL;
+
+	if (sp->stream_id >= V4L2_STREAM_TYPE_MAX)
+		return -EINVAL;
+
+	pstream = dev->pstreams[sp->stream_id];
+	if (pstream)
+		stats = armcb_isp_port_stats_get(pstream);
+	if (!stats)
+		return -ENODEV;
+
+	switch (ctrl->id) {
+	case ISP_DAEMON_GET_PORT_UNDERRUN:
+		ctrl->value = (s32)min_t(u64, stats->underrun, S32_MAX);
+		break;
+	case ISP_DAEMON_GET_PORT_DROPPED:
+		ctrl->value = (s32)min_t(u64, stats->dropped, S32_MAX);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static int
 armcb_v4l2_core_subscribe_event(struct v4l2_fh *fh,
 				  const struct v4l2_event_subscription *sub)
@@ -1414,7 +1658,7 @@ static const struct v4l2_ioctl_ops armcb_ioctl_ops = {
 
 	.vidioc_prepare_buf = vb2_ioctl_prepare_buf,
 	.vidioc_create_bufs = vb2_ioctl_create_bufs,
-	.vidioc_expbuf = NULL,
+	.vidioc_expbuf = armcb_v4l2_expbuf,
 
 	.vidioc_enum_fmt_vid_cap = armcb_v4l2_enum_fmt_vid_cap,
 	.vidioc_enum_framesizes = armcb_v4l2_enum_framesizes,
@@ -1433,6 +1677,7 @@ static const struct v4l2_ioctl_ops armcb_ioctl_ops = {
 
 	//sync
 	.vidioc_s_ctrl = armcb_v4l2_s_ctrl,
+	.vidioc_g_ctrl = armcb_v4l2_g_ctrl,
 };
 
 /*-----------------------------------------------------------------
@@ -1529,6 +1774,7 @@ armcb_v4l2_create_instance(struct platform_device *pdev, int ctx_id,
 				V4L2_CAP_READWRITE;
 	/* initialize locks */
 	spin_lock_init(&dev->slock);
+	spin_lock_init(&dev->outport_lock);
 	spin_lock_init(&dev->v4l2_event_slock);
 
 	dev->ddr_lp_mode = 1;
@@ -1624,6 +1870,16 @@ armcb_v4l2_dev_t *armcb_register_instance(struct platform_device *pdev,
 
 	LOG(LOG_INFO, "register v4l2 video instance %d %p", cam_id, adev);
 	g_isp_v4l2_devs[cam_id] = adev;
+
+	if (!g_debugfs_init) {
+		debugfs_create_file("cache_invalidate", 0444,
+				    system_debugfs_root(), NULL,
+				    &armcb_isp_sync_stats_fops);
+		debugfs_create_file("port_underrun", 0444,
+				    system_debugfs_root(), NULL,
+				    &armcb_isp_port_stats_fops);
+		g_debugfs_init = true;
+	}
 	return adev;
 }
 
@@ -1647,3 +1903,7 @@ void armcb_cam_instance_destroy(void)
 	}
 	g_adev_idx = 0;
 }
+
+#ifdef ARMCB_ISP_KUNIT_TEST
+#include "armcb_v4l2_core_test.c"
+#endif
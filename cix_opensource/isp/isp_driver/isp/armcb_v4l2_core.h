@@ -93,6 +93,13 @@ typedef struct armcb_v4l2_dev {
 	dma_addr_t discard_buf_addr_dma;
 	bool multi_cam;
 	int buf_type;
+
+	/* outport routing of this ctx, set at s_fmt and read from the irq
+	 * path, so concurrent cameras never contend on a shared table.
+	 */
+	spinlock_t outport_lock;
+	armcb_v4l2_stream_t *outport_map[ISP_OUTPUT_PORT_MAX];
+	u32 outport_bits[V4L2_STREAM_TYPE_MAX];
 } armcb_v4l2_dev_t;
 
 struct armcb_v4l_dev_info {
@@ -150,6 +157,9 @@ enum stream_status{
 #define ISP_DAEMON_SET_STREAM_ON 0xA001
 #define ISP_DAEMON_SET_MULTI_CAM 0xA002
 #define ISP_DAEMON_SET_STREAM_OFF 0xA003
+/* VIDIOC_G_CTRL, counters of the port bound to the fh stream */
+#define ISP_DAEMON_GET_PORT_UNDERRUN 0xA004
+#define ISP_DAEMON_GET_PORT_DROPPED 0xA005
 
 #define fh_to_private(__fh) container_of(__fh, struct armcb_isp_v4l2_fh, fh)
 
@@ -173,6 +183,9 @@ int armcb_v4l2_find_ctx_stream_by_outport(uint32_t outport, uint32_t *p_ctx_id,
 					  uint32_t *p_stream_id);
 int armcb_v4l2_find_stream_by_outport_ctx(uint32_t outport, uint32_t ctx_id,
 					  uint32_t *p_stream_id);
+armcb_v4l2_stream_t *armcb_v4l2_outport_stream(uint32_t ctx_id,
+					       isp_output_port_t port);
+void armcb_v4l2_release_all_output_ports(void);
 void armcb_cam_instance_destroy(void);
 
 int armcb_v4l2_reqbufs(struct file *file, void *priv,
@@ -180,6 +193,9 @@ int armcb_v4l2_reqbufs(struct file *file, void *priv,
 
 int armcb_v4l2_alloc_discard_buffer(u32 reserved_size, struct device *dev);
 int armcb_v4l2_release_discard_buffer(u32 reserved_size, struct device *dev);
+int armcb_v4l2_alloc_stream_scratch(armcb_v4l2_stream_t *pstream);
+void armcb_v4l2_release_stream_scratch(armcb_v4l2_stream_t *pstream);
+void armcb_isp_count_underrun(armcb_v4l2_stream_t *pstream);
 
 void armcb_v4l2_stream_off(armcb_v4l2_stream_t *pstream, armcb_v4l2_dev_t *dev);
 void armcb_v4l2_stream_deinit(armcb_v4l2_stream_t *pstream,
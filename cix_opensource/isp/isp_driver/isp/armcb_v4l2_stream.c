@@ -19,6 +19,7 @@
 #include "armcb_v4l2_stream.h"
 #include "armcb_v4l2_core.h"
 #include "armcb_v4l2_config.h"
+#include "armcb_vb2.h"
 #include "isp_hw_ops.h"
 
 #ifdef LOG_MODULE
@@ -180,6 +181,8 @@ int armcb_v4l2_stream_init(armcb_v4l2_stream_t **ppstream, int stream_id,
 
 	/* init locks */
 	spin_lock_init(&new_stream->slock);
+	spin_lock_init(&new_stream->fence_lock);
+	new_stream->fence_ctx = dma_fence_context_alloc(1);
 
 	/* return stream private ptr to caller */
 	*ppstream = new_stream;
@@ -205,7 +208,7 @@ armcb_v4l2_stream_buffer_list_release(armcb_v4l2_stream_t *pstream,
 		vb = &vvb->vb2_buf;
 		buf_index = vb->index;
 
-		vb2_buffer_done(vb, VB2_BUF_STATE_ERROR);
+		armcb_vb2_buffer_done(buf, VB2_BUF_STATE_ERROR);
 
 		LOG(LOG_INFO, "[Stream#%d] vid_cap buffer %d done",
 		    pstream->stream_id, buf_index);
@@ -226,6 +229,10 @@ void armcb_v4l2_stream_deinit(armcb_v4l2_stream_t *pstream,
 	/* stop hardware do stream-off first if it's on */
 	armcb_v4l2_stream_off(pstream, dev);
 
+	/* callers unpublished it, let the irq path still holding it finish */
+	armcb_isp_irq_sync();
+	armcb_v4l2_release_stream_scratch(pstream);
+
 	/* release fw_info */
 	kfree(pstream);
 	pstream = NULL;
@@ -17,6 +17,9 @@
 
 //#include <linux/videodev2.h>
 #include <armcb_isp.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-fence.h>
+#include <linux/scatterlist.h>
 #include <media/videobuf2-v4l2.h>
 
 /* Sensor data types */
@@ -40,10 +43,25 @@ typedef struct _armcb_v4l2_sensor_info {
 	uint8_t preset_cur;
 } armcb_v4l2_sensor_info;
 
+#define ARMCB_VB2_MAX_PLANES 2
+
 /* buffer for one video frame */
 typedef struct _armcb_v4l2_buffer {
 	struct vb2_v4l2_buffer vvb;
 	struct list_head list;
+
+	/* Per plane sg_table built at buf_init, covers only the bytes the
+	 * ISP writes for the negotiated format, used for cache maintenance.
+	 */
+	struct sg_table sgt[ARMCB_VB2_MAX_PLANES];
+	unsigned int sgt_num;
+	size_t sync_bytes;
+
+	/* Last dma-buf exported for each plane, its reservation object gets
+	 * the fence of every frame written while the buffer is queued.
+	 */
+	struct dma_buf *dbuf[ARMCB_VB2_MAX_PLANES];
+	struct dma_fence *fence;
 } armcb_v4l2_buffer_t;
 
 /**
@@ -94,6 +112,18 @@ typedef struct _armcb_v4l2_stream_t {
 	u32 reserved_buf_addr;
 	u32 reserved_buf_size;
 	dma_addr_t reserved_buf_addr_dma;
+	/* Scratch buffer the port writes to when no vb2 buffer is queued,
+	 * sized from the format at stream on, dma address above.
+	 */
+	void *scratch_vaddr;
+	size_t scratch_size;
+	/* last busy buffer seen by armcb_isp_put_frame */
+	armcb_v4l2_buffer_t *last_busy;
+
+	/* write fences of the exported buffers, signalled on buffer done */
+	spinlock_t fence_lock;
+	u64 fence_ctx;
+	u64 fence_seqno;
 
 	struct video_device *video_dev;
 } armcb_v4l2_stream_t;
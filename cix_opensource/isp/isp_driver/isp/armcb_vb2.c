@@ -13,6 +13,10 @@
  *
  */
 #include <linux/errno.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-fence.h>
+#include <linux/dma-mapping.h>
+#include <linux/dma-resv.h>
 #include <linux/kernel.h>
 #include <linux/sched.h>
 #include <linux/v4l2-dv-timings.h>
@@ -35,6 +39,16 @@
 #define LOG_MODULE LOG_MODULE_ISP
 #endif
 
+extern struct device *mem_dev;
+
+/* sg_tables held by buffers of every queue, back to 0 once all are freed */
+static atomic_t g_vb2_sgt_live = ATOMIC_INIT(0);
+
+int armcb_vb2_sgt_live(void)
+{
+	return atomic_read(&g_vb2_sgt_live);
+}
+
 static int armcb_vb2_queue_setup(struct vb2_queue *vq, unsigned int *nbuffers,
 				 unsigned int *nplanes, unsigned int sizes[],
 				 struct device *alloc_devs[])
@@ -71,6 +85,236 @@ done:
 	return 0;
 }
 
+#ifdef V4L2_OPT
+/* Bytes the ISP writes into one plane: stride x height of the negotiated
+ * format, bounded by the plane size.
+ */
+static size_t armcb_vb2_plane_sync_len(armcb_v4l2_stream_t *pstream,
+				       struct vb2_buffer *vb, unsigned int plane)
+{
+	size_t plane_size = vb2_plane_size(vb, plane);
+	size_t len = pstream->cur_v4l2_fmt.fmt.pix_mp.plane_fmt[plane].sizeimage;
+
+	if (!len || len > plane_size)
+		len = plane_size;
+
+	return len;
+}
+
+static const char *armcb_vb2_fence_driver_name(struct dma_fence *fence)
+{
+	return "armcb-isp";
+}
+
+static const char *armcb_vb2_fence_timeline_name(struct dma_fence *fence)
+{
+	return "armcb-isp-out";
+}
+
+static const struct dma_fence_ops armcb_vb2_fence_ops = {
+	.get_driver_name = armcb_vb2_fence_driver_name,
+	.get_timeline_name = armcb_vb2_fence_timeline_name,
+};
+
+static void armcb_vb2_signal_fence(armcb_v4l2_buffer_t *buf, int error)
+{
+	struct dma_fence *fence = xchg(&buf->fence, NULL);
+
+	if (!fence)
+		return;
+
+	if (error)
+		dma_fence_set_error(fence, error);
+	dma_fence_signal(fence);
+	dma_fence_put(fence);
+}
+
+static void armcb_vb2_add_fence(struct dma_buf *dbuf, struct dma_fence *fence)
+{
+	struct dma_resv *resv = dbuf->resv;
+
+	dma_resv_lock(resv, NULL);
+#if (KERNEL_VERSION(5, 19, 0) <= LINUX_VERSION_CODE)
+	if (!dma_resv_reserve_fences(resv, 1))
+		dma_resv_add_fence(resv, fence, DMA_RESV_USAGE_WRITE);
+#else
+	dma_resv_add_excl_fence(resv, fence);
+#endif
+	dma_resv_unlock(resv);
+}
+
+/*
+ * Publish a write fence for the frame about to land in @buf on every
+ * exported dma-buf of it, importers that honour implicit sync wait on it
+ * and DMA_BUF_IOCTL_EXPORT_SYNC_FILE turns it into an explicit fence.
+ */
+static void armcb_vb2_attach_fence(armcb_v4l2_stream_t *pstream,
+				   armcb_v4l2_buffer_t *buf)
+{
+	struct dma_fence *fence = NULL;
+	unsigned int i = 0;
+
+	/* vb2 returned the buffer on its own, e.g. on a cancelled queue */
+	armcb_vb2_signal_fence(buf, -ECANCELED);
+
+	for (i = 0; i < ARMCB_VB2_MAX_PLANES; i++) {
+		if (buf->dbuf[i])
+			break;
+	}
+	if (i == ARMCB_VB2_MAX_PLANES)
+		return;
+
+	fence = kzalloc(sizeof(*fence), GFP_KERNEL);
+	if (!fence)
+		return;
+
+	dma_fence_init(fence, &armcb_vb2_fence_ops, &pstream->fence_lock,
+		       pstream->fence_ctx, ++pstream->fence_seqno);
+
+	for (i = 0; i < ARMCB_VB2_MAX_PLANES; i++) {
+		if (buf->dbuf[i])
+			armcb_vb2_add_fence(buf->dbuf[i], fence);
+	}
+
+	buf->fence = fence;
+}
+
+static void armcb_vb2_buf_cleanup(struct vb2_buffer *vb)
+{
+	struct vb2_v4l2_buffer *vvb = to_vb2_v4l2_buffer(vb);
+	armcb_v4l2_buffer_t *buf = container_of(vvb, armcb_v4l2_buffer_t, vvb);
+	unsigned int i = 0;
+
+	armcb_vb2_signal_fence(buf, -ECANCELED);
+	for (i = 0; i < ARMCB_VB2_MAX_PLANES; i++) {
+		if (buf->dbuf[i])
+			dma_buf_put(buf->dbuf[i]);
+		buf->dbuf[i] = NULL;
+	}
+
+	while (buf->sgt_num > 0) {
+		sg_free_table(&buf->sgt[--buf->sgt_num]);
+		atomic_dec(&g_vb2_sgt_live);
+	}
+	buf->sync_bytes = 0;
+}
+
+/**
+ * @description: VIDIOC_EXPBUF, export a plane through the dma-contig
+ *               exporter and keep a reference to hang fences on; the fd
+ *               is only installed once the dma-buf carries the fence of a
+ *               frame already in flight
+ * @param {struct vb2_queue} *q: stream queue
+ * @param {struct v4l2_exportbuffer} *p: export request, fd on return
+ * @return {int} 0 on success, negative errno otherwise
+ */
+int armcb_vb2_expbuf(struct vb2_queue *q, struct v4l2_exportbuffer *p)
+{
+	armcb_v4l2_buffer_t *buf = NULL;
+	struct dma_fence *fence = NULL;
+	struct vb2_buffer *vb = NULL;
+	struct dma_buf *dbuf = NULL;
+	int fd = 0;
+
+	/* the checks of vb2_core_expbuf() */
+	if (q->memory != VB2_MEMORY_MMAP || p->type != q->type ||
+	    (p->flags & ~(O_CLOEXEC | O_ACCMODE)) || !q->mem_ops->get_dmabuf)
+		return -EINVAL;
+	if (vb2_fileio_is_active(q))
+		return -EBUSY;
+
+	vb = vb2_get_buffer(q, p->index);
+	if (!vb || p->plane >= vb->num_planes)
+		return -EINVAL;
+
+#if (KERNEL_VERSION(5, 16, 0) <= LINUX_VERSION_CODE)
+	dbuf = q->mem_ops->get_dmabuf(vb, vb->planes[p->plane].mem_priv,
+				      p->flags & O_ACCMODE);
+#else
+	dbuf = q->mem_ops->get_dmabuf(vb->planes[p->plane].mem_priv,
+				      p->flags & O_ACCMODE);
+#endif
+	if (IS_ERR_OR_NULL(dbuf))
+		return -EINVAL;
+
+	if (p->plane < ARMCB_VB2_MAX_PLANES) {
+		buf = container_of(to_vb2_v4l2_buffer(vb), armcb_v4l2_buffer_t,
+				   vvb);
+
+		/* queued buffer: the importer must wait for its frame too */
+		rcu_read_lock();
+		fence = READ_ONCE(buf->fence);
+		if (fence)
+			fence = dma_fence_get_rcu(fence);
+		rcu_read_unlock();
+		if (fence) {
+			armcb_vb2_add_fence(dbuf, fence);
+			dma_fence_put(fence);
+		}
+
+		get_dma_buf(dbuf);
+	}
+
+	fd = dma_buf_fd(dbuf, p->flags & ~O_ACCMODE);
+	if (fd < 0) {
+		if (buf)
+			dma_buf_put(dbuf);
+		dma_buf_put(dbuf);
+		return fd;
+	}
+	p->fd = fd;
+
+	if (buf) {
+		dbuf = xchg(&buf->dbuf[p->plane], dbuf);
+		if (dbuf)
+			dma_buf_put(dbuf);
+	}
+
+	return 0;
+}
+
+static int armcb_vb2_buf_init(struct vb2_buffer *vb)
+{
+	armcb_v4l2_stream_t *pstream = vb2_get_drv_priv(vb->vb2_queue);
+	struct vb2_v4l2_buffer *vvb = to_vb2_v4l2_buffer(vb);
+	armcb_v4l2_buffer_t *buf = container_of(vvb, armcb_v4l2_buffer_t, vvb);
+	unsigned int i = 0;
+	size_t len = 0;
+	int rc = 0;
+
+	buf->sgt_num = 0;
+	buf->sync_bytes = 0;
+	buf->fence = NULL;
+	memset(buf->dbuf, 0, sizeof(buf->dbuf));
+
+	if (!mem_dev || vb->memory != VB2_MEMORY_MMAP ||
+	    vb->num_planes > ARMCB_VB2_MAX_PLANES)
+		return 0;
+
+	/* The format can't change while buffers are allocated, so the
+	 * written range is fixed for the lifetime of the buffer.
+	 */
+	for (i = 0; i < vb->num_planes; i++) {
+		len = armcb_vb2_plane_sync_len(pstream, vb, i);
+		rc = dma_get_sgtable_attrs(mem_dev, &buf->sgt[i],
+					   vb2_plane_vaddr(vb, i),
+					   vb2_dma_contig_plane_dma_addr(vb, i),
+					   len, 0);
+		if (rc) {
+			LOG(LOG_ERR, "[Stream#%d] buf %u plane %u sgtable failed (rc=%d)",
+			    pstream->stream_id, vb->index, i, rc);
+			armcb_vb2_buf_cleanup(vb);
+			return rc;
+		}
+		atomic_inc(&g_vb2_sgt_live);
+		buf->sgt_num++;
+		buf->sync_bytes += len;
+	}
+
+	return 0;
+}
+#endif
+
 static void armcb_vb2_buf_finish(struct vb2_buffer *vb)
 {
 	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
@@ -86,6 +330,9 @@ static void armcb_vb2_buf_queue(struct vb2_buffer *vb)
 	unsigned long flags;
 
 	if(pstream) {
+#ifdef V4L2_OPT
+		armcb_vb2_attach_fence(pstream, buf);
+#endif
 		spin_lock_irqsave(&pstream->slock, flags);
 		list_add_tail(&buf->list, &pstream->stream_buffer_list);
 		spin_unlock_irqrestore(&pstream->slock, flags);
@@ -93,6 +340,16 @@ static void armcb_vb2_buf_queue(struct vb2_buffer *vb)
 
 	return;
 }
+void armcb_vb2_buffer_done(armcb_v4l2_buffer_t *buf,
+			   enum vb2_buffer_state state)
+{
+#ifdef V4L2_OPT
+	/* wake importers first, vb2 may hand the buffer out right away */
+	armcb_vb2_signal_fence(buf, state == VB2_BUF_STATE_DONE ? 0 : -EIO);
+#endif
+	vb2_buffer_done(&buf->vvb.vb2_buf, state);
+}
+
 #ifndef V4L2_OPT
 static void *armcb_vb2_cma_get_userptr(struct vb2_buffer *vb,
 					   struct device *alloc_ctx,
@@ -164,6 +421,10 @@ static void cap_vb2_stop_streaming(struct vb2_queue *q)
 
 static struct vb2_ops armcb_vid_cap_qops = {
 	.queue_setup = armcb_vb2_queue_setup,
+#ifdef V4L2_OPT
+	.buf_init = armcb_vb2_buf_init,
+	.buf_cleanup = armcb_vb2_buf_cleanup,
+#endif
 	.buf_queue = armcb_vb2_buf_queue,
 	.buf_finish = armcb_vb2_buf_finish,
 	.wait_prepare = vb2_ops_wait_prepare,
@@ -178,7 +439,6 @@ struct vb2_ops *armcb_vb2_get_q_ops(void)
 	return &armcb_vid_cap_qops;
 }
 
-extern struct device *mem_dev;
 int isp_vb2_queue_init(struct vb2_queue *q, struct mutex *mlock,
 			   armcb_v4l2_stream_t *pstream, struct device *dev)
 {
@@ -215,20 +475,18 @@ int isp_vb2_queue_init(struct vb2_queue *q, struct mutex *mlock,
 	return ret;
 }
 
-extern armcb_v4l2_stream_t *g_outport_map[ARMCB_MAX_DEVS][ISP_OUTPUT_PORT_MAX];
-
 int isp_vb2_queue_release(struct vb2_queue *q, struct file *file)
 {
-	int ret = 0, i = 0, j = 0;
+	int ret = 0;
 
-	/* Set the g_outport_map to 0 to avoid the next loop outport is busy*/
-	for(i = 0; i < ARMCB_MAX_DEVS; i++  )
-	{
-		for(j = 0; j < ISP_OUTPUT_PORT_MAX; j++)
-			g_outport_map[i][j] = NULL;
-	}
+	/* Clear the outport maps to avoid the next loop outport is busy*/
+	armcb_v4l2_release_all_output_ports();
 
 	LOG(LOG_INFO, "#### Armcb isp release all resource and exit !!!");
 
 	return ret;
 }
+
+#ifdef ARMCB_ISP_KUNIT_TEST
+#include "armcb_vb2_test.c"
+#endif
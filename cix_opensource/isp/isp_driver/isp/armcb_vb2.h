@@ -34,4 +34,24 @@ int armcb_s_fmt_vid_cap(struct file *file, void *priv, struct v4l2_format *f);
 int isp_vb2_queue_init(struct vb2_queue *q, struct mutex *mlock,
 		       armcb_v4l2_stream_t *pstream, struct device *dev);
 int isp_vb2_queue_release(struct vb2_queue *q, struct file *file);
+
+/**
+ * @description: hand a buffer back to vb2 and signal the write fence of its
+ *               exported dma-bufs, with an error unless @state is DONE
+ * @param {armcb_v4l2_buffer_t} *buf: buffer owned by the driver
+ * @param {enum vb2_buffer_state} state: vb2 state to complete with
+ * @return {*}
+ */
+void armcb_vb2_buffer_done(armcb_v4l2_buffer_t *buf,
+			   enum vb2_buffer_state state);
+/**
+ * @description: number of per plane sg_tables currently built by buf_init
+ *               and not yet freed by buf_cleanup
+ * @return {int}
+ */
+int armcb_vb2_sgt_live(void);
+
+#ifdef V4L2_OPT
+int armcb_vb2_expbuf(struct vb2_queue *q, struct v4l2_exportbuffer *p);
+#endif
 #endif
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#include "system_debugfs.h"
+#include <linux/err.h>
+#include <linux/mutex.h>
+
+#define SYSTEM_DEBUGFS_NAME "armcb_isp"
+
+static struct dentry *g_debugfs_root;
+static DEFINE_MUTEX(g_debugfs_lock);
+
+struct dentry *system_debugfs_root(void)
+{
+	struct dentry *root;
+
+	mutex_lock(&g_debugfs_lock);
+	if (!g_debugfs_root) {
+		root = debugfs_create_dir(SYSTEM_DEBUGFS_NAME, NULL);
+		if (!IS_ERR_OR_NULL(root))
+			g_debugfs_root = root;
+	}
+	root = g_debugfs_root;
+	mutex_unlock(&g_debugfs_lock);
+
+	return root;
+}
+
+void system_debugfs_destroy(void)
+{
+	mutex_lock(&g_debugfs_lock);
+	debugfs_remove_recursive(g_debugfs_root);
+	g_debugfs_root = NULL;
+	mutex_unlock(&g_debugfs_lock);
+}
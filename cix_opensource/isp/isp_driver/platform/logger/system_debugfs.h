@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef __SYSTEM_DEBUGFS_H__
+#define __SYSTEM_DEBUGFS_H__
+
+#include <linux/debugfs.h>
+
+/**
+ * system_debugfs_root() - get the "armcb_isp" debugfs directory
+ *
+ * The directory is created on first use and shared by every sub-driver of
+ * the module. Returns NULL when debugfs is not available, debugfs helpers
+ * accept a NULL parent so callers don't need to check it.
+ */
+struct dentry *system_debugfs_root(void);
+
+/**
+ * system_debugfs_destroy() - remove the debugfs directory and all its files
+ */
+void system_debugfs_destroy(void);
+
+#endif
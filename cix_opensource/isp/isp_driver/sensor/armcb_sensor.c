@@ -21,6 +21,7 @@
 #include <linux/v4l2-controls.h>
 #include <media/media-device.h>
 #include <media/v4l2-async.h>
+#include <media/v4l2-event.h>
 
 #include <linux/gpio/consumer.h>
 #include <linux/pinctrl/consumer.h>
@@ -259,12 +260,22 @@ static long armcb_imgsens_subdev_ioctl(struct v4l2_subdev *sd, unsigned int cmd,
 	case ARMCB_VIDIOC_APPLY_CMD: {
 		struct cmd_buf *pcmd_buf = (struct cmd_buf *)arg;
 
+		/* updates still waiting for a frame won't get one */
+		if (pcmd_buf->cmd_type == CMD_TYPE_STREAMOFF &&
+		    pimgsens_sd->apply_queue)
+			armcb_sensor_queue_flush(pimgsens_sd->apply_queue);
+
 		switch (pcmd_buf->static_info.bus) {
 		case HW_BUS_AHB_POWER:
 			res |= armcb_imgsens_hw_apply(pcmd_buf, pimgsens_sd);
 			break;
 		default:
-			res |= armcb_isp_hw_apply(pcmd_buf, client);
+			if (pimgsens_sd->apply_queue &&
+			    armcb_sensor_queue_wants(pcmd_buf))
+				res |= armcb_sensor_queue_add(
+					pimgsens_sd->apply_queue, pcmd_buf);
+			else
+				res |= armcb_isp_hw_apply(pcmd_buf, client);
 			break;
 		}
 		break;
@@ -275,8 +286,27 @@ static long armcb_imgsens_subdev_ioctl(struct v4l2_subdev *sd, unsigned int cmd,
 	return res;
 }
 
+static int armcb_imgsens_subscribe_event(struct v4l2_subdev *sd,
+					 struct v4l2_fh *fh,
+					 struct v4l2_event_subscription *sub)
+{
+	if (sub->type != ARMCB_EVENT_SENSOR_APPLIED)
+		return -EINVAL;
+
+	return v4l2_event_subscribe(fh, sub, ARMCB_IMGSENS_NEVENTS, NULL);
+}
+
+static int armcb_imgsens_unsubscribe_event(struct v4l2_subdev *sd,
+					   struct v4l2_fh *fh,
+					   struct v4l2_event_subscription *sub)
+{
+	return v4l2_event_unsubscribe(fh, sub);
+}
+
 static const struct v4l2_subdev_core_ops armcb_imgsens_subdev_core_ops = {
 	.ioctl = &armcb_imgsens_subdev_ioctl,
+	.subscribe_event = &armcb_imgsens_subscribe_event,
+	.unsubscribe_event = &armcb_imgsens_unsubscribe_event,
 };
 
 static struct v4l2_subdev_ops armcb_imgsens_subdev_ops = {
@@ -286,17 +316,27 @@ static struct v4l2_subdev_ops armcb_imgsens_subdev_ops = {
 static int armcb_imgsens_subdev_open(struct v4l2_subdev *sd,
 					 struct v4l2_subdev_fh *fh)
 {
-	int ret = 0;
-	/* empty function */
-	return ret;
+	struct armcb_imgsens_subdev *pimgsens_sd = v4l2_get_subdevdata(sd);
+
+	atomic_inc(&pimgsens_sd->users);
+
+	return 0;
 }
 
 static int armcb_imgsens_subdev_close(struct v4l2_subdev *sd,
 					  struct v4l2_subdev_fh *fh)
 {
-	int ret = 0;
-	/* empty function */
-	return ret;
+	struct armcb_imgsens_subdev *pimgsens_sd = v4l2_get_subdevdata(sd);
+
+	/*
+	 * updates of a closed session must not hit the next one, but a tool
+	 * closing its own fd does not end the session of the daemon
+	 */
+	if (atomic_dec_and_test(&pimgsens_sd->users) &&
+	    pimgsens_sd->apply_queue)
+		armcb_sensor_queue_flush(pimgsens_sd->apply_queue);
+
+	return 0;
 }
 
 static const struct v4l2_subdev_internal_ops armcb_imgsens_sd_internal_ops = {
@@ -317,7 +357,7 @@ armcb_imgsens_configure_subdevs(struct armcb_imgsens_subdev *pimgsens_sd)
 	snprintf(sd->name, sizeof(sd->name), "sensor0");
 
 	sd->internal_ops = &armcb_imgsens_sd_internal_ops;
-	sd->flags |= V4L2_SUBDEV_FL_HAS_DEVNODE;
+	sd->flags |= V4L2_SUBDEV_FL_HAS_EVENTS | V4L2_SUBDEV_FL_HAS_DEVNODE;
 	sd->entity.function = MEDIA_ENT_F_V4L2_SUBDEV_UNKNOWN;
 	sd->entity.function = ARMCB_CAMERA_SUBDEV_IMGSENS;
 	sd->entity.name = sd->name;
@@ -482,6 +522,12 @@ static int imgsens_probe(struct i2c_client *client)
 	pimgsens_sd->armcb_v4l2_dev = adev;
 	i2c_set_clientdata(client, (void *)pimgsens_sd);
 
+	/* without the queue SOF triggered updates are written immediately */
+	pimgsens_sd->apply_queue = armcb_sensor_queue_create(
+		cam_id, &client->dev, &pimgsens_sd->imgsens_sd.sd, client);
+	if (!pimgsens_sd->apply_queue)
+		LOG(LOG_WARN, "cam %u has no apply queue", cam_id);
+
 	pimgsens_sd->imgs_inst.pinctrl = devm_pinctrl_get(&client->dev);
 	if (IS_ERR(pimgsens_sd->imgs_inst.pinctrl))
 		LOG(LOG_ERR, "can't get pinctrl, bus recovery not supported\n");
@@ -560,6 +606,7 @@ void imgsens_remove(struct i2c_client *client)
 			pimgsens_sd->power_on = FALSE;
 		}
 
+		armcb_sensor_queue_destroy(pimgsens_sd->apply_queue);
 		list_del_init(&pimgsens_sd->imgsens_sd.sd.async_list);
 #if (KERNEL_VERSION(4, 17, 0) > LINUX_VERSION_CODE)
 		v4l2_device_unregister_subdev(&pimgsens_sd->imgsens_sd.sd);
@@ -26,6 +26,7 @@
 #include <linux/types.h>
 #include <media/videobuf2-v4l2.h>
 
+#include "armcb_sensor_queue.h"
 #include "armcb_v4l2_core.h"
 #include "armcb_v4l_sd.h"
 
@@ -64,6 +65,7 @@ enum armcb_imgsens_scene_mode {
 
 #define ARMCB_IMGSENS_NUM_MAX (1)
 #define IMGSENS_I2C_DRVNAME "imgsensor0"
+#define ARMCB_IMGSENS_NEVENTS (32)
 
 struct armcb_imgsen_info {
 	u8 uchl;
@@ -116,6 +118,8 @@ struct armcb_imgsens_subdev {
 	struct regulator *vsupply_0;
 	struct regulator *vsupply_1;
 	BOOL power_on;
+	struct armcb_sensor_queue *apply_queue; /// frame synchronized updates
+	atomic_t users; /// open subdev fds
 };
 
 struct armcb_i2c_camsensor {
@@ -0,0 +1,419 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#include "armcb_sensor_queue.h"
+#include "armcb_isp.h"
+#include "armcb_v4l2_core.h"
+#include "isp_hw_ops.h"
+#include "isp_hw_trace.h"
+#include "system_logger.h"
+#include <linux/kthread.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/property.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <media/v4l2-event.h>
+#include <media/v4l2-subdev.h>
+
+#ifdef LOG_MODULE
+#undef LOG_MODULE
+#define LOG_MODULE LOG_MODULE_SENSOR
+#endif
+
+#define ARMCB_SENSOR_QUEUE_DEPTH (16)
+#define ARMCB_SENSOR_QUEUE_MAX_REGS (256)
+
+/* "cix,group-hold" = <reg on off>, wraps every queued update */
+struct armcb_sensor_hold {
+	bool valid;
+	u32 reg;
+	u32 on;
+	u32 off;
+};
+
+struct armcb_sensor_update {
+	struct list_head node;
+	u32 target;
+	u32 order;
+	struct cmd_buf cmd; /// followed by the rest of the settings
+};
+
+struct armcb_sensor_queue {
+	u32 cam_id;
+	void *client;
+	struct v4l2_subdev *sd;
+	struct armcb_sensor_hold hold;
+
+	spinlock_t lock;
+	struct list_head pending; /// sorted by target frame
+	u32 depth;
+	u32 sof; /// last sof frame count
+	bool sof_valid;
+
+	struct kthread_worker *worker;
+	struct kthread_work work;
+
+	/* worker only */
+	u64 applied;
+	u64 late;
+};
+
+/* protects g_sensor_queues against the sof irq */
+static DEFINE_SPINLOCK(g_sensor_queue_lock);
+static struct armcb_sensor_queue *g_sensor_queues[ARMCB_MAX_DEVS];
+/* keeps a queue alive while a stream off flushes it, held by its writers */
+static DEFINE_MUTEX(g_sensor_queue_mutex);
+
+#ifdef ARMCB_ISP_KUNIT_TEST
+/// stands in for the sensor bus when set, see armcb_sensor_queue_test.c
+static int (*armcb_sensor_queue_kunit_apply)(struct cmd_buf *cmd,
+					     void *client);
+#endif
+
+static int armcb_sensor_queue_apply(struct armcb_sensor_queue *queue,
+				    struct cmd_buf *cmd)
+{
+#ifdef ARMCB_ISP_KUNIT_TEST
+	if (armcb_sensor_queue_kunit_apply)
+		return armcb_sensor_queue_kunit_apply(cmd, queue->client);
+#endif
+	return armcb_isp_hw_apply(cmd, queue->client);
+}
+
+/* frame counters wrap, compare them as a distance */
+static inline bool armcb_frame_due(u32 target, u32 frame)
+{
+	return (s32)(target - frame) <= 0;
+}
+
+static bool armcb_sensor_queue_due_locked(struct armcb_sensor_queue *queue)
+{
+	struct armcb_sensor_update *upd = NULL;
+
+	if (!queue->sof_valid)
+		return false;
+
+	upd = list_first_entry_or_null(&queue->pending,
+				       struct armcb_sensor_update, node);
+
+	return upd && armcb_frame_due(upd->target, queue->sof);
+}
+
+static void armcb_sensor_queue_report(struct armcb_sensor_queue *queue,
+				      struct armcb_sensor_update *upd,
+				      u32 landed, int result)
+{
+	struct v4l2_event ev = {
+		.type = ARMCB_EVENT_SENSOR_APPLIED,
+	};
+	struct armcb_sensor_applied *applied =
+		(struct armcb_sensor_applied *)ev.u.data;
+
+	applied->order = upd->order;
+	applied->target = upd->target;
+	applied->landed = landed;
+	applied->result = result;
+
+	if (queue->sd && queue->sd->devnode)
+		v4l2_event_queue(queue->sd->devnode, &ev);
+}
+
+static void armcb_sensor_queue_work(struct kthread_work *work)
+{
+	struct armcb_sensor_queue *queue =
+		container_of(work, struct armcb_sensor_queue, work);
+	struct armcb_sensor_update *upd = NULL;
+	struct armcb_sensor_update *tmp = NULL;
+	unsigned long flags = 0;
+	ktime_t start;
+	u32 landed = 0;
+	int ret = 0;
+	LIST_HEAD(due);
+
+	spin_lock_irqsave(&queue->lock, flags);
+	list_for_each_entry_safe(upd, tmp, &queue->pending, node) {
+		if (!armcb_frame_due(upd->target, queue->sof))
+			break;
+		list_move_tail(&upd->node, &due);
+		queue->depth--;
+	}
+	spin_unlock_irqrestore(&queue->lock, flags);
+
+	list_for_each_entry_safe(upd, tmp, &due, node) {
+		start = ktime_get();
+		ret = armcb_sensor_queue_apply(queue, &upd->cmd);
+		landed = READ_ONCE(queue->sof);
+
+		queue->applied++;
+		if (landed != upd->target) {
+			queue->late++;
+			LOG_RATELIMITED(LOG_WARN,
+					"cam %u update %u for frame %u landed on %u",
+					queue->cam_id, upd->order, upd->target,
+					landed);
+		}
+		trace_armcb_sensor_apply(queue->cam_id, upd->order, upd->target,
+					 landed,
+					 ktime_to_ns(ktime_sub(ktime_get(), start)));
+		armcb_sensor_queue_report(queue, upd, landed, ret);
+
+		list_del(&upd->node);
+		kfree(upd);
+	}
+}
+
+static void armcb_sensor_hold_fill(struct cmd_i2c_setting *setting,
+				   const struct cmd_i2c_setting *tmpl, u32 reg,
+				   u32 val)
+{
+	*setting = *tmpl;
+	setting->direct = DRV_DIRECTION_WRITE;
+	setting->reg_data_type = DRV_DATA_TYPE_BYTE;
+	setting->reg_addr = reg;
+	setting->ptr_user = NULL;
+	setting->val = val;
+	setting->delay_us = 0;
+}
+
+bool armcb_sensor_queue_wants(const struct cmd_buf *cmd)
+{
+	return cmd->static_info.bus == HW_BUS_I2C &&
+	       cmd->static_info.trigger_cond == CMD_COND_SOF &&
+	       cmd->cmd_type == CMD_TYPE_UPDATE;
+}
+
+int armcb_sensor_queue_add(struct armcb_sensor_queue *queue,
+			   struct cmd_buf *cmd)
+{
+	struct armcb_sensor_update *upd = NULL;
+	struct armcb_sensor_update *pos = NULL;
+	struct cmd_i2c_setting *settings = NULL;
+	unsigned int cnt = cmd->cmd_cnt;
+	unsigned int extra = queue->hold.valid ? 2 : 0;
+	unsigned long flags = 0;
+	size_t size = 0;
+	bool kick = false;
+	int ret = 0;
+	int i = 0;
+
+	if (!cnt || cnt > ARMCB_SENSOR_QUEUE_MAX_REGS ||
+	    cmd->static_info.buf_size < offsetof(struct cmd_buf, settings) +
+						cnt * sizeof(*settings)) {
+		LOG(LOG_ERR, "invalid queued cmd, cnt %u size %u", cnt,
+		    cmd->static_info.buf_size);
+		return -EINVAL;
+	}
+
+	/* nobody is waiting on the ioctl to read a value back later */
+	for (i = 0; i < cnt; i++) {
+		if (cmd->settings.i2c[i].direct != DRV_DIRECTION_WRITE) {
+			LOG(LOG_ERR, "queued cmd %u has a read at %d",
+			    cmd->order, i);
+			return -EINVAL;
+		}
+	}
+
+	size = offsetof(struct cmd_buf, settings) +
+	       (cnt + extra) * sizeof(*settings);
+	upd = kzalloc(offsetof(struct armcb_sensor_update, cmd) + size,
+		      GFP_KERNEL);
+	if (!upd)
+		return -ENOMEM;
+
+	upd->target = cmd->apply_frame_id;
+	upd->order = cmd->order;
+	memcpy(&upd->cmd, cmd, offsetof(struct cmd_buf, settings));
+	upd->cmd.static_info.buf_size = size;
+	upd->cmd.cmd_cnt = cnt + extra;
+
+	settings = upd->cmd.settings.i2c;
+	if (extra) {
+		armcb_sensor_hold_fill(&settings[0], &cmd->settings.i2c[0],
+				       queue->hold.reg, queue->hold.on);
+		armcb_sensor_hold_fill(&settings[cnt + 1], &cmd->settings.i2c[0],
+				       queue->hold.reg, queue->hold.off);
+		settings++;
+	}
+	memcpy(settings, cmd->settings.i2c, cnt * sizeof(*settings));
+
+	spin_lock_irqsave(&queue->lock, flags);
+	if (queue->depth >= ARMCB_SENSOR_QUEUE_DEPTH) {
+		ret = -EBUSY;
+	} else {
+		/* same target keeps submission order */
+		list_for_each_entry(pos, &queue->pending, node) {
+			if ((s32)(upd->target - pos->target) < 0)
+				break;
+		}
+		list_add_tail(&upd->node, &pos->node);
+		queue->depth++;
+		kick = armcb_sensor_queue_due_locked(queue);
+	}
+	spin_unlock_irqrestore(&queue->lock, flags);
+
+	if (ret) {
+		LOG_RATELIMITED(LOG_WARN, "cam %u apply queue full",
+				queue->cam_id);
+		kfree(upd);
+		return ret;
+	}
+
+	/* the target frame already started, don't wait for the next sof */
+	if (kick)
+		kthread_queue_work(queue->worker, &queue->work);
+
+	return 0;
+}
+
+void armcb_sensor_queue_flush(struct armcb_sensor_queue *queue)
+{
+	struct armcb_sensor_update *upd = NULL;
+	struct armcb_sensor_update *tmp = NULL;
+	unsigned long flags = 0;
+	LIST_HEAD(drop);
+
+	spin_lock_irqsave(&queue->lock, flags);
+	list_splice_init(&queue->pending, &drop);
+	queue->depth = 0;
+	queue->sof_valid = false;
+	spin_unlock_irqrestore(&queue->lock, flags);
+
+	kthread_flush_work(&queue->work);
+
+	list_for_each_entry_safe(upd, tmp, &drop, node) {
+		list_del(&upd->node);
+		kfree(upd);
+	}
+
+	LOG(LOG_INFO, "cam %u apply queue flushed, applied %llu late %llu",
+	    queue->cam_id, queue->applied, queue->late);
+}
+
+void armcb_sensor_queue_stop(u32 ctx_id)
+{
+	if (ctx_id >= ARMCB_MAX_DEVS)
+		return;
+
+	mutex_lock(&g_sensor_queue_mutex);
+	if (g_sensor_queues[ctx_id])
+		armcb_sensor_queue_flush(g_sensor_queues[ctx_id]);
+	mutex_unlock(&g_sensor_queue_mutex);
+}
+
+void armcb_sensor_queue_sof(u32 ctx_id, u32 frame)
+{
+	struct armcb_sensor_queue *queue = NULL;
+	unsigned long flags = 0;
+	bool kick = false;
+
+	if (ctx_id >= ARMCB_MAX_DEVS)
+		return;
+
+	spin_lock_irqsave(&g_sensor_queue_lock, flags);
+	queue = g_sensor_queues[ctx_id];
+	if (queue) {
+		spin_lock(&queue->lock);
+		queue->sof = frame;
+		queue->sof_valid = true;
+		kick = armcb_sensor_queue_due_locked(queue);
+		spin_unlock(&queue->lock);
+		if (kick)
+			kthread_queue_work(queue->worker, &queue->work);
+	}
+	spin_unlock_irqrestore(&g_sensor_queue_lock, flags);
+}
+
+struct armcb_sensor_queue *armcb_sensor_queue_create(u32 cam_id,
+						     struct device *dev,
+						     struct v4l2_subdev *sd,
+						     void *client)
+{
+	struct armcb_sensor_queue *queue = NULL;
+	unsigned long flags = 0;
+	u32 hold[3] = { 0 };
+
+	if (cam_id >= ARMCB_MAX_DEVS)
+		return NULL;
+
+	queue = kzalloc(sizeof(*queue), GFP_KERNEL);
+	if (!queue)
+		return NULL;
+
+	queue->cam_id = cam_id;
+	queue->client = client;
+	queue->sd = sd;
+	spin_lock_init(&queue->lock);
+	INIT_LIST_HEAD(&queue->pending);
+	kthread_init_work(&queue->work, armcb_sensor_queue_work);
+
+	if (!device_property_read_u32_array(dev, "cix,group-hold", hold,
+					    ARRAY_SIZE(hold))) {
+		queue->hold.valid = true;
+		queue->hold.reg = hold[0];
+		queue->hold.on = hold[1];
+		queue->hold.off = hold[2];
+	}
+
+	queue->worker = kthread_create_worker(0, "armcb-sensor%u", cam_id);
+	if (IS_ERR(queue->worker)) {
+		LOG(LOG_ERR, "failed to create sensor worker %ld",
+		    PTR_ERR(queue->worker));
+		kfree(queue);
+		return NULL;
+	}
+	/* the writes have to fit in the vertical blanking */
+	sched_set_fifo(queue->worker->task);
+
+	mutex_lock(&g_sensor_queue_mutex);
+	spin_lock_irqsave(&g_sensor_queue_lock, flags);
+	if (g_sensor_queues[cam_id]) {
+		spin_unlock_irqrestore(&g_sensor_queue_lock, flags);
+		mutex_unlock(&g_sensor_queue_mutex);
+		LOG(LOG_ERR, "cam %u already has an apply queue", cam_id);
+		kthread_destroy_worker(queue->worker);
+		kfree(queue);
+		return NULL;
+	}
+	g_sensor_queues[cam_id] = queue;
+	spin_unlock_irqrestore(&g_sensor_queue_lock, flags);
+	mutex_unlock(&g_sensor_queue_mutex);
+
+	LOG(LOG_INFO, "cam %u apply queue, group hold %s", cam_id,
+	    queue->hold.valid ? "on" : "off");
+
+	return queue;
+}
+
+void armcb_sensor_queue_destroy(struct armcb_sensor_queue *queue)
+{
+	unsigned long flags = 0;
+
+	if (!queue)
+		return;
+
+	mutex_lock(&g_sensor_queue_mutex);
+	spin_lock_irqsave(&g_sensor_queue_lock, flags);
+	g_sensor_queues[queue->cam_id] = NULL;
+	spin_unlock_irqrestore(&g_sensor_queue_lock, flags);
+	mutex_unlock(&g_sensor_queue_mutex);
+
+	armcb_sensor_queue_flush(queue);
+	kthread_destroy_worker(queue->worker);
+	kfree(queue);
+}
+
+#ifdef ARMCB_ISP_KUNIT_TEST
+#include "armcb_sensor_queue_test.c"
+#endif
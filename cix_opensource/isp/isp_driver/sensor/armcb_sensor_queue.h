@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#ifndef __ARMCB_SENSOR_QUEUE_H__
+#define __ARMCB_SENSOR_QUEUE_H__
+
+#include <linux/types.h>
+#include <linux/videodev2.h>
+
+/*
+ * Frame synchronized sensor updates
+ *
+ * An I2C cmd of type CMD_TYPE_UPDATE with trigger_cond CMD_COND_SOF is not
+ * written from the ioctl, it is queued until the SOF of frame
+ * apply_frame_id and then written by the sensor worker. Every queued cmd
+ * posts one ARMCB_EVENT_SENSOR_APPLIED event on the sensor subdev with the
+ * SOF frame count at the end of the transfer, landed == target when the
+ * update made it in the frame it was meant for.
+ */
+#define ARMCB_EVENT_SENSOR_APPLIED (V4L2_EVENT_PRIVATE_START + 0x100)
+
+struct armcb_sensor_applied {
+	__u32 order; /// order of the cmd buf
+	__u32 target; /// apply_frame_id of the cmd buf
+	__u32 landed; /// sof frame count once the registers were written
+	__s32 result; /// 0 or negative errno of the transfer
+};
+
+#ifdef __KERNEL__
+struct armcb_sensor_queue;
+struct cmd_buf;
+struct device;
+struct v4l2_subdev;
+
+/**
+ * @description: create the apply queue of a sensor and its worker
+ * @param {u32} cam_id: ctx the sensor feeds
+ * @param {struct device} *dev: sensor device, for the group hold property
+ * @param {struct v4l2_subdev} *sd: subdev the applied events go to
+ * @param {void} *client: bus client handed to armcb_isp_hw_apply
+ * @return {struct armcb_sensor_queue} NULL on failure
+ */
+struct armcb_sensor_queue *armcb_sensor_queue_create(u32 cam_id,
+						     struct device *dev,
+						     struct v4l2_subdev *sd,
+						     void *client);
+void armcb_sensor_queue_destroy(struct armcb_sensor_queue *queue);
+
+/**
+ * @description: whether @cmd is applied at a frame rather than immediately
+ * @param {struct cmd_buf} *cmd: cmd from ARMCB_VIDIOC_APPLY_CMD
+ * @return {bool}
+ */
+bool armcb_sensor_queue_wants(const struct cmd_buf *cmd);
+
+/**
+ * @description: copy @cmd into the queue of its target frame
+ * @param {struct armcb_sensor_queue} *queue: queue of the sensor
+ * @param {struct cmd_buf} *cmd: write only I2C cmd
+ * @return {int} 0 on success, -EBUSY when the queue is full
+ */
+int armcb_sensor_queue_add(struct armcb_sensor_queue *queue,
+			   struct cmd_buf *cmd);
+
+/**
+ * @description: drop the pending updates and wait for the one in flight
+ * @param {struct armcb_sensor_queue} *queue: queue of the sensor
+ * @return {*}
+ */
+void armcb_sensor_queue_flush(struct armcb_sensor_queue *queue);
+
+/**
+ * @description: stream off of @ctx_id, flush the queue of its sensor
+ * @param {u32} ctx_id: ctx streamed off
+ * @return {*}
+ */
+void armcb_sensor_queue_stop(u32 ctx_id);
+
+/**
+ * @description: SOF of @ctx_id, kicks the worker when an update is due
+ * @param {u32} ctx_id: ctx of the interrupt
+ * @param {u32} frame: sof frame count
+ * @return {*}
+ */
+void armcb_sensor_queue_sof(u32 ctx_id, u32 frame);
+#endif
+
+#endif
@@ -0,0 +1,497 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * KUnit tests of the ispmem device, included at the end of
+ * armcb_camera_io_drv.c. The mapping cache is fed by a udmabuf style
+ * exporter: a dma-buf over kernel pages, counting how often the cache
+ * really attaches to it.
+ *
+ * The cma block suite drives the vm_operations directly: a KUnit thread
+ * has no mm to vm_mmap() into, so fork and mremap are stood in for by
+ * ispmem_vm_open() on a copied vma.
+ */
+
+#include "armcb_isp_kunit.h"
+
+#define CAM_MEM_TEST_PAGES 16
+#define CAM_MEM_TEST_LOOPS 10000
+
+struct cam_mem_test_buf {
+	struct page *pages[CAM_MEM_TEST_PAGES];
+	unsigned int npages;
+	struct page *block;
+	unsigned int order;
+	atomic_t attaches;
+};
+
+struct cam_mem_test_ctx {
+	struct armcb_kunit_dev kdev;
+	struct armcb_ispmem_info info;
+	struct armcb_ispmem_info *saved_info;
+	uint saved_cache_max;
+};
+
+static int cam_mem_test_attach(struct dma_buf *dmabuf,
+			       struct dma_buf_attachment *attach)
+{
+	struct cam_mem_test_buf *tbuf = dmabuf->priv;
+
+	atomic_inc(&tbuf->attaches);
+	return 0;
+}
+
+static struct sg_table *cam_mem_test_map(struct dma_buf_attachment *attach,
+					 enum dma_data_direction dir)
+{
+	struct cam_mem_test_buf *tbuf = attach->dmabuf->priv;
+	struct sg_table *sgt = NULL;
+	int ret = 0;
+
+	sgt = kzalloc(sizeof(*sgt), GFP_KERNEL);
+	if (!sgt)
+		return ERR_PTR(-ENOMEM);
+
+	ret = sg_alloc_table_from_pages(sgt, tbuf->pages, tbuf->npages, 0,
+					tbuf->npages << PAGE_SHIFT, GFP_KERNEL);
+	if (!ret)
+		ret = dma_map_sgtable(attach->dev, sgt, dir, 0);
+	if (ret) {
+		sg_free_table(sgt);
+		kfree(sgt);
+		return ERR_PTR(ret);
+	}
+
+	return sgt;
+}
+
+static void cam_mem_test_unmap(struct dma_buf_attachment *attach,
+			       struct sg_table *sgt,
+			       enum dma_data_direction dir)
+{
+	dma_unmap_sgtable(attach->dev, sgt, dir, 0);
+	sg_free_table(sgt);
+	kfree(sgt);
+}
+
+static int cam_mem_test_vmap(struct dma_buf *dmabuf, struct iosys_map *map)
+{
+	struct cam_mem_test_buf *tbuf = dmabuf->priv;
+	void *vaddr = NULL;
+
+	vaddr = vmap(tbuf->pages, tbuf->npages, VM_MAP, PAGE_KERNEL);
+	if (!vaddr)
+		return -ENOMEM;
+
+	iosys_map_set_vaddr(map, vaddr);
+	return 0;
+}
+
+static void cam_mem_test_vunmap(struct dma_buf *dmabuf, struct iosys_map *map)
+{
+	vunmap(map->vaddr);
+}
+
+static void cam_mem_test_release(struct dma_buf *dmabuf)
+{
+	struct cam_mem_test_buf *tbuf = dmabuf->priv;
+
+	__free_pages(tbuf->block, tbuf->order);
+	kfree(tbuf);
+}
+
+static const struct dma_buf_ops cam_mem_test_ops = {
+	.attach = cam_mem_test_attach,
+	.map_dma_buf = cam_mem_test_map,
+	.unmap_dma_buf = cam_mem_test_unmap,
+	.vmap = cam_mem_test_vmap,
+	.vunmap = cam_mem_test_vunmap,
+	.release = cam_mem_test_release,
+};
+
+/*
+ * Export @npages contiguous pages. @scattered swaps the first two pages in
+ * the page list, so the buffer can't be mapped as one range.
+ */
+static struct dma_buf *cam_mem_test_export(struct kunit *test,
+					   unsigned int npages, bool scattered,
+					   struct cam_mem_test_buf **out)
+{
+	DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
+	struct cam_mem_test_buf *tbuf = NULL;
+	struct dma_buf *dmabuf = NULL;
+	struct page *block = NULL;
+	unsigned int order = get_order(npages << PAGE_SHIFT);
+	unsigned int i = 0;
+
+	/* below 4G so the test device maps it without bouncing */
+	block = alloc_pages(GFP_KERNEL | GFP_DMA32 | __GFP_ZERO, order);
+	KUNIT_ASSERT_NOT_NULL(test, block);
+
+	/* owned by the dma-buf from here, freed by its release */
+	tbuf = kzalloc(sizeof(*tbuf), GFP_KERNEL);
+	if (!tbuf)
+		__free_pages(block, order);
+	KUNIT_ASSERT_NOT_NULL(test, tbuf);
+
+	tbuf->block = block;
+	tbuf->order = order;
+	tbuf->npages = npages;
+	for (i = 0; i < npages; i++)
+		tbuf->pages[i] = tbuf->block + i;
+	if (scattered)
+		swap(tbuf->pages[0], tbuf->pages[1]);
+
+	exp_info.ops = &cam_mem_test_ops;
+	exp_info.size = npages << PAGE_SHIFT;
+	exp_info.flags = O_RDWR;
+	exp_info.priv = tbuf;
+
+	dmabuf = dma_buf_export(&exp_info);
+	if (IS_ERR(dmabuf)) {
+		kfree(tbuf);
+		__free_pages(block, order);
+	}
+	KUNIT_ASSERT_FALSE(test, IS_ERR(dmabuf));
+
+	if (out)
+		*out = tbuf;
+	return dmabuf;
+}
+
+/// map @dmabuf like CAM_HW_BUFFER_MAP, taking a reference of its own
+static int cam_mem_test_map_buf(struct dma_buf *dmabuf,
+				struct hw_mem_map_cmd *cmd)
+{
+	bool is_new = false;
+
+	get_dma_buf(dmabuf);
+	return cam_mem_buf_map_dmabuf(dmabuf, cmd, &is_new);
+}
+
+static int cam_mem_test_init(struct kunit *test)
+{
+	struct cam_mem_test_ctx *ctx = NULL;
+
+	if (cam_mem_info) {
+		mutex_lock(&buf_tbl.m_lock);
+		if (!bitmap_empty(buf_tbl.bitMap, CAM_MEM_BUFQ_MAX)) {
+			mutex_unlock(&buf_tbl.m_lock);
+			kunit_skip(test, "ispmem mappings in use");
+		}
+		mutex_unlock(&buf_tbl.m_lock);
+	}
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx);
+
+	/* map through the probed device, or a stand-in without hardware */
+	ctx->saved_info = cam_mem_info;
+	ctx->saved_cache_max = mem_cache_max;
+	if (!cam_mem_info) {
+		KUNIT_ASSERT_EQ(test, armcb_kunit_mem_dev_get(&ctx->kdev), 0);
+		ctx->info.pddev = &ctx->kdev.pdev->dev;
+		cam_mem_info = &ctx->info;
+		mutex_init(&buf_tbl.m_lock);
+	}
+
+	cam_mem_tbl_init();
+	memset(&buf_tbl.stats, 0, sizeof(buf_tbl.stats));
+	test->priv = ctx;
+
+	return 0;
+}
+
+static void cam_mem_test_exit(struct kunit *test)
+{
+	struct cam_mem_test_ctx *ctx = test->priv;
+
+	if (!ctx)
+		return;
+
+	cam_mem_release_all();
+	mem_cache_max = ctx->saved_cache_max;
+	cam_mem_info = ctx->saved_info;
+	armcb_kunit_mem_dev_put(&ctx->kdev);
+}
+
+/* a released buffer mapped again comes back from the cache */
+static void cam_mem_test_cache_hit(struct kunit *test)
+{
+	struct hw_mem_map_cmd cmd = { .fd = 3 };
+	struct cam_mem_test_buf *tbuf = NULL;
+	struct dma_buf *dmabuf = NULL;
+	unsigned long phy_addr = 0;
+	int idx = 0;
+
+	dmabuf = cam_mem_test_export(test, CAM_MEM_TEST_PAGES, false, &tbuf);
+
+	idx = cam_mem_test_map_buf(dmabuf, &cmd);
+	KUNIT_ASSERT_GE(test, idx, 0);
+	KUNIT_EXPECT_EQ(test, cmd.out.kBufhandle, idx);
+	KUNIT_EXPECT_NE(test, cmd.out.kvAddr, 0UL);
+	phy_addr = cmd.out.phyAddr;
+	KUNIT_EXPECT_EQ(test, cam_mem_buf_unmap_idx(idx), 0);
+	KUNIT_EXPECT_EQ(test, buf_tbl.idle_cnt, 1U);
+
+	/* a recycled fd number maps the same buffer */
+	cmd.fd = 7;
+	KUNIT_EXPECT_EQ(test, cam_mem_test_map_buf(dmabuf, &cmd), idx);
+	KUNIT_EXPECT_EQ(test, cmd.out.phyAddr, phy_addr);
+	KUNIT_EXPECT_EQ(test, buf_tbl.idle_cnt, 0U);
+	KUNIT_EXPECT_EQ(test, buf_tbl.stats.hits, 1ULL);
+	KUNIT_EXPECT_EQ(test, buf_tbl.stats.misses, 1ULL);
+	KUNIT_EXPECT_EQ(test, atomic_read(&tbuf->attaches), 1);
+
+	KUNIT_EXPECT_EQ(test, cam_mem_buf_unmap_idx(idx), 0);
+	KUNIT_EXPECT_EQ(test, cam_mem_buf_unmap_idx(-1), -EINVAL);
+	KUNIT_EXPECT_EQ(test, cam_mem_buf_unmap_idx(CAM_MEM_BUFQ_MAX), -EINVAL);
+	dma_buf_put(dmabuf);
+}
+
+/* idle mappings past mem_cache_max are torn down oldest first */
+static void cam_mem_test_lru_evict(struct kunit *test)
+{
+	struct hw_mem_map_cmd cmd = { 0 };
+	struct dma_buf *dmabuf[3] = { NULL };
+	int idx[3] = { 0 };
+	int i = 0;
+
+	mem_cache_max = 2;
+	for (i = 0; i < 3; i++) {
+		dmabuf[i] = cam_mem_test_export(test, 1, false, NULL);
+		idx[i] = cam_mem_test_map_buf(dmabuf[i], &cmd);
+		KUNIT_ASSERT_GE(test, idx[i], 0);
+	}
+
+	for (i = 0; i < 3; i++)
+		KUNIT_EXPECT_EQ(test, cam_mem_buf_unmap_idx(idx[i]), 0);
+
+	KUNIT_EXPECT_EQ(test, buf_tbl.idle_cnt, 2U);
+	KUNIT_EXPECT_EQ(test, buf_tbl.stats.evictions, 1ULL);
+	KUNIT_EXPECT_FALSE(test, test_bit(idx[0], buf_tbl.bitMap));
+	KUNIT_EXPECT_TRUE(test, test_bit(idx[2], buf_tbl.bitMap));
+
+	for (i = 0; i < 3; i++)
+		dma_buf_put(dmabuf[i]);
+}
+
+/* the ISP takes one base address, a scattered buffer is refused */
+static void cam_mem_test_scattered(struct kunit *test)
+{
+	struct hw_mem_map_cmd cmd = { 0 };
+	struct dma_buf *dmabuf = NULL;
+
+	if (cmamem_dev.has_iommu)
+		kunit_skip(test, "the IOMMU maps any buffer as one range");
+
+	dmabuf = cam_mem_test_export(test, 2, true, NULL);
+	KUNIT_EXPECT_EQ(test, cam_mem_test_map_buf(dmabuf, &cmd), -EINVAL);
+	KUNIT_EXPECT_TRUE(test, bitmap_empty(buf_tbl.bitMap, CAM_MEM_BUFQ_MAX));
+	dma_buf_put(dmabuf);
+}
+
+static s64 cam_mem_test_loop(struct kunit *test, struct dma_buf *dmabuf)
+{
+	struct hw_mem_map_cmd cmd = { 0 };
+	ktime_t start = 0;
+	int idx = 0;
+	int i = 0;
+
+	start = ktime_get();
+	for (i = 0; i < CAM_MEM_TEST_LOOPS; i++) {
+		idx = cam_mem_test_map_buf(dmabuf, &cmd);
+		if (idx < 0 || cam_mem_buf_unmap_idx(idx)) {
+			KUNIT_FAIL(test, "map/unmap %d failed (%d)", i, idx);
+			break;
+		}
+	}
+
+	return ktime_to_ns(ktime_sub(ktime_get(), start)) / CAM_MEM_TEST_LOOPS;
+}
+
+/* map/unmap one buffer 10k times, without and with the cache */
+static void cam_mem_test_bench(struct kunit *test)
+{
+	struct cam_mem_test_buf *tbuf = NULL;
+	struct dma_buf *dmabuf = NULL;
+	s64 cold_ns = 0;
+	s64 cached_ns = 0;
+
+	dmabuf = cam_mem_test_export(test, CAM_MEM_TEST_PAGES, false, &tbuf);
+
+	mem_cache_max = 0;
+	cold_ns = cam_mem_test_loop(test, dmabuf);
+	KUNIT_EXPECT_EQ(test, atomic_read(&tbuf->attaches), CAM_MEM_TEST_LOOPS);
+
+	mem_cache_max = 32;
+	atomic_set(&tbuf->attaches, 0);
+	cached_ns = cam_mem_test_loop(test, dmabuf);
+	KUNIT_EXPECT_EQ(test, atomic_read(&tbuf->attaches), 1);
+
+	kunit_info(test, "%d map/unmap: uncached %lld ns, cached %lld ns\n",
+		   CAM_MEM_TEST_LOOPS, cold_ns, cached_ns);
+	dma_buf_put(dmabuf);
+}
+
+static struct kunit_case cam_mem_map_cases[] = {
+	KUNIT_CASE(cam_mem_test_cache_hit),
+	KUNIT_CASE(cam_mem_test_lru_evict),
+	KUNIT_CASE(cam_mem_test_scattered),
+	KUNIT_CASE(cam_mem_test_bench),
+	{}
+};
+
+static struct kunit_suite cam_mem_map_suite = {
+	.name = "armcb_isp_mem_map_cache",
+	.init = cam_mem_test_init,
+	.exit = cam_mem_test_exit,
+	.test_cases = cam_mem_map_cases,
+};
+
+#define CMA_TEST_SIZE (3 * PAGE_SIZE)
+
+struct cma_test_ctx {
+	struct armcb_kunit_dev kdev;
+	uint saved_pool_max_mb;
+};
+
+static int cma_test_init(struct kunit *test)
+{
+	struct cma_test_ctx *ctx = NULL;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx);
+
+	/* allocate from the probed device, or a stand-in without hardware */
+	if (!cmamem_dev.pddev) {
+		KUNIT_ASSERT_EQ(test, armcb_kunit_mem_dev_get(&ctx->kdev), 0);
+		cmamem_dev.pddev = &ctx->kdev.pdev->dev;
+		mutex_init(&cma_buf_ctl.m_lock);
+		ispmem_cma_mem_init();
+	}
+
+	/* room for the test blocks whatever the pool already holds */
+	ctx->saved_pool_max_mb = ispmem_pool_max_mb;
+	ispmem_pool_max_mb = U16_MAX;
+	test->priv = ctx;
+
+	return 0;
+}
+
+static void cma_test_exit(struct kunit *test)
+{
+	struct cma_test_ctx *ctx = test->priv;
+
+	if (!ctx)
+		return;
+
+	ispmem_pool_max_mb = ctx->saved_pool_max_mb;
+	if (ctx->kdev.pdev) {
+		ispmem_pool_drain();
+		idr_destroy(&cma_buf_ctl.idr);
+		cmamem_dev.pddev = NULL;
+	}
+	armcb_kunit_mem_dev_put(&ctx->kdev);
+}
+
+/* search the pool rather than the block, which may be gone already */
+static bool cma_test_pooled(struct cmamem_block *block)
+{
+	struct cmamem_block *pos = NULL;
+	bool found = false;
+
+	mutex_lock(&cma_buf_ctl.m_lock);
+	list_for_each_entry(pos, &cma_buf_ctl.pool[block->cached],
+			    memqueue_list) {
+		if (pos == block) {
+			found = true;
+			break;
+		}
+	}
+	mutex_unlock(&cma_buf_ctl.m_lock);
+
+	return found;
+}
+
+/* freed while two vmas still map it: recycled on the last close only */
+static void cma_test_free_mapped(struct kunit *test)
+{
+	struct cmamem_block *block = NULL;
+	struct vm_area_struct *vma = NULL;
+
+	vma = kunit_kcalloc(test, 2, sizeof(*vma), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, vma);
+
+	block = ispmem_block_get(CMA_TEST_SIZE, false);
+	KUNIT_ASSERT_NOT_NULL(test, block);
+
+	/* what ispmem_cma_mmap() does, then a fork duplicating the vma */
+	kref_get(&block->ref);
+	vma[0].vm_private_data = block;
+	vma[0].vm_ops = &ispmem_vm_ops;
+	vma[1] = vma[0];
+	vma[1].vm_ops->open(&vma[1]);
+	KUNIT_EXPECT_EQ(test, kref_read(&block->ref), 3U);
+
+	/* CMEM_FREE drops the allocation, the mappings keep the pages */
+	ispmem_block_put(block);
+	KUNIT_EXPECT_EQ(test, kref_read(&block->ref), 2U);
+	KUNIT_EXPECT_FALSE(test, cma_test_pooled(block));
+
+	vma[0].vm_ops->close(&vma[0]);
+	KUNIT_EXPECT_EQ(test, kref_read(&block->ref), 1U);
+	KUNIT_EXPECT_FALSE(test, cma_test_pooled(block));
+
+	vma[1].vm_ops->close(&vma[1]);
+	KUNIT_EXPECT_TRUE(test, cma_test_pooled(block));
+}
+
+/* a block handed out of the pool again carries none of its old contents */
+static void cma_test_reuse_zeroed(struct kunit *test)
+{
+	struct cmamem_block *block = NULL;
+	struct cmamem_block *reused = NULL;
+
+	block = ispmem_block_get(CMA_TEST_SIZE, false);
+	KUNIT_ASSERT_NOT_NULL(test, block);
+	memset(block->kernel_addr, 0xa5, CMA_TEST_SIZE);
+	ispmem_block_put(block);
+	KUNIT_ASSERT_TRUE(test, cma_test_pooled(block));
+
+	/* the pool is LIFO, the same size comes straight back */
+	reused = ispmem_block_get(CMA_TEST_SIZE, false);
+	KUNIT_ASSERT_NOT_NULL(test, reused);
+	KUNIT_EXPECT_PTR_EQ(test, reused, block);
+	KUNIT_EXPECT_EQ(test, kref_read(&reused->ref), 1U);
+	KUNIT_EXPECT_PTR_EQ(test, memchr_inv(reused->kernel_addr, 0,
+					     CMA_TEST_SIZE), NULL);
+	ispmem_block_put(reused);
+}
+
+static struct kunit_case cma_block_cases[] = {
+	KUNIT_CASE(cma_test_free_mapped),
+	KUNIT_CASE(cma_test_reuse_zeroed),
+	{}
+};
+
+static struct kunit_suite cma_block_suite = {
+	.name = "armcb_isp_cma_block",
+	.init = cma_test_init,
+	.exit = cma_test_exit,
+	.test_cases = cma_block_cases,
+};
+
+kunit_test_suites(&cam_mem_map_suite, &cma_block_suite);
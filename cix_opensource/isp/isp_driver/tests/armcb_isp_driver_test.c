@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * KUnit tests of the register shadow, included at the end of
+ * armcb_isp_driver.c. A subdev standing in for the probed one carries the
+ * shadow, the writes are recorded as the batched writes of a command list
+ * record them.
+ */
+
+#include "armcb_isp_kunit.h"
+
+struct armcb_shadow_test {
+	struct armcb_isp_subdev sd;
+	const struct armcb_isp_shadow_range *saved_static;
+	unsigned int saved_nstatic;
+};
+
+static bool armcb_shadow_test_kept(int blk, u32 offset)
+{
+	return test_bit(offset / 4, p_isp_subdev->shadow[blk].set);
+}
+
+static int armcb_shadow_test_init(struct kunit *test)
+{
+	struct armcb_shadow_test *t = NULL;
+	struct armcb_isp_shadow *shadow = NULL;
+	int blk = 0;
+
+	if (p_isp_subdev)
+		kunit_skip(test, "isp subdev probed");
+
+	t = kunit_kzalloc(test, sizeof(*t), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t);
+	for (blk = 0; blk < ARMCB_ISP_SHADOW_BLKS; blk++) {
+		shadow = &t->sd.shadow[blk];
+		shadow->words = ARMCB_ISP_SHADOW_MAX_BYTES / 4;
+		shadow->val = kunit_kcalloc(test, shadow->words, sizeof(u32),
+					    GFP_KERNEL);
+		shadow->set = kunit_kcalloc(test, BITS_TO_LONGS(shadow->words),
+					    sizeof(unsigned long), GFP_KERNEL);
+		KUNIT_ASSERT_NOT_NULL(test, shadow->val);
+		KUNIT_ASSERT_NOT_NULL(test, shadow->set);
+	}
+
+	t->saved_static = g_shadow_static;
+	t->saved_nstatic = g_shadow_nstatic;
+	p_isp_subdev = &t->sd;
+	test->priv = t;
+
+	return 0;
+}
+
+static void armcb_shadow_test_exit(struct kunit *test)
+{
+	struct armcb_shadow_test *t = test->priv;
+
+	if (!t)
+		return;
+
+	p_isp_subdev = NULL;
+	g_shadow_nstatic = t->saved_nstatic;
+	g_shadow_static = t->saved_static;
+}
+
+/* only the static configuration of the i7 is kept */
+static void armcb_shadow_test_allowlist(struct kunit *test)
+{
+	static const u32 dynamic[] = {
+		I7_INT_CLEAR_ADDR, I7_INT_ERR_CLEAR_ADDR,
+		I7_INT_AFBC_CLEAR_ADDR, I7_INT_AFBC_STATUS_ADDR,
+		I7_INT_FRMCNT_SEL_ADDR, I7_INT_SOF_FRMCNT_SEL_ADDR,
+		I5_INT_CLEAR_ADDR, I7_INT_SOF_FRMCNT_ADDR,
+		I7_3A_START_ADDR, I7_VOUT1_START_ADDR,
+		DAW0_IFBC_IDMA_REG_1C, I7_VIN_LONG_START_ADDR_DAR0,
+	};
+	static const u32 kept[] = {
+		I7_INT_MASK_ADDR, I7_INT_ERR_MASK_ADDR,
+		I7_VIN_BASE_ADDR + 0x40, I7_PSC_BASE_ADDR,
+		I7_SCA_BASE_ADDR,
+	};
+	unsigned int i = 0;
+
+	armcb_isp_shadow_enable_i7();
+
+	for (i = 0; i < ARRAY_SIZE(dynamic); i++) {
+		armcb_isp_shadow_reg(dynamic[i], 0xffffffff);
+		KUNIT_EXPECT_FALSE_MSG(test,
+				       armcb_shadow_test_kept(
+					       ARMCB_ISP_SHADOW_ISP, dynamic[i]),
+				       "0x%x replayed on resume", dynamic[i]);
+	}
+	for (i = 0; i < ARRAY_SIZE(kept); i++) {
+		armcb_isp_shadow_reg(kept[i], i + 1);
+		KUNIT_EXPECT_TRUE_MSG(test,
+				      armcb_shadow_test_kept(
+					      ARMCB_ISP_SHADOW_ISP, kept[i]),
+				      "0x%x lost on resume", kept[i]);
+		KUNIT_EXPECT_EQ(test,
+				p_isp_subdev->shadow[ARMCB_ISP_SHADOW_ISP]
+					.val[kept[i] / 4],
+				i + 1);
+	}
+
+	armcb_isp_shadow_reg2(0x10, 1);
+	KUNIT_EXPECT_FALSE(test,
+			   armcb_shadow_test_kept(ARMCB_ISP_SHADOW_GDC, 0x10));
+}
+
+/* an isp type without a known map keeps nothing */
+static void armcb_shadow_test_no_map(struct kunit *test)
+{
+	g_shadow_static = NULL;
+	g_shadow_nstatic = 0;
+
+	armcb_isp_shadow_reg(I7_INT_MASK_ADDR, 1);
+	armcb_isp_shadow_reg(I7_PSC_BASE_ADDR, 1);
+	KUNIT_EXPECT_TRUE(test, bitmap_empty(
+		p_isp_subdev->shadow[ARMCB_ISP_SHADOW_ISP].set,
+		p_isp_subdev->shadow[ARMCB_ISP_SHADOW_ISP].words));
+}
+
+/* a reset asked by the error isr drops what was kept */
+static void armcb_shadow_test_clear(struct kunit *test)
+{
+	struct armcb_isp_shadow *shadow =
+		&p_isp_subdev->shadow[ARMCB_ISP_SHADOW_ISP];
+
+	armcb_isp_shadow_enable_i7();
+	armcb_isp_shadow_reg(I7_INT_MASK_ADDR, 1);
+	armcb_isp_shadow_reg(I7_PSC_BASE_ADDR, 2);
+	KUNIT_ASSERT_FALSE(test, bitmap_empty(shadow->set, shadow->words));
+
+	armcb_isp_shadow_clear();
+	KUNIT_EXPECT_TRUE(test, bitmap_empty(shadow->set, shadow->words));
+}
+
+static struct kunit_case armcb_shadow_test_cases[] = {
+	KUNIT_CASE(armcb_shadow_test_allowlist),
+	KUNIT_CASE(armcb_shadow_test_no_map),
+	KUNIT_CASE(armcb_shadow_test_clear),
+	{}
+};
+
+static struct kunit_suite armcb_shadow_test_suite = {
+	.name = "armcb_isp_shadow",
+	.init = armcb_shadow_test_init,
+	.exit = armcb_shadow_test_exit,
+	.test_cases = armcb_shadow_test_cases,
+};
+
+kunit_test_suites(&armcb_shadow_test_suite);
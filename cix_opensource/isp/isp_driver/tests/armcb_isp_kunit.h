@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#ifndef __ARMCB_ISP_KUNIT_H__
+#define __ARMCB_ISP_KUNIT_H__
+
+/*
+ * Helpers shared by the KUnit suites of the module. Each suite lives in
+ * tests/ and is included at the end of the file it tests, so it reaches the
+ * static functions of that file:
+ *
+ * #ifdef ARMCB_ISP_KUNIT_TEST
+ * #include "armcb_xxx_test.c"
+ * #endif
+ */
+
+#include <kunit/test.h>
+#include <linux/dma-mapping.h>
+#include <linux/platform_device.h>
+
+extern struct device *mem_dev;
+
+/* platform device standing in for the ISP memory device */
+struct armcb_kunit_dev {
+	struct platform_device *pdev;
+	struct device *saved_mem_dev;
+};
+
+/**
+ * @description: register a DMA capable device and make it mem_dev, the
+ *               device the driver allocates and maps its buffers with
+ * @param {struct armcb_kunit_dev} *kdev: filled on success
+ * @return {int} 0 on success, negative errno otherwise
+ */
+static inline int armcb_kunit_mem_dev_get(struct armcb_kunit_dev *kdev)
+{
+	struct platform_device *pdev = NULL;
+	int rc = 0;
+
+	pdev = platform_device_register_simple("armcb-isp-kunit",
+					       PLATFORM_DEVID_AUTO, NULL, 0);
+	if (IS_ERR(pdev))
+		return PTR_ERR(pdev);
+
+	rc = dma_coerce_mask_and_coherent(&pdev->dev, DMA_BIT_MASK(32));
+	if (rc) {
+		platform_device_unregister(pdev);
+		return rc;
+	}
+
+	kdev->pdev = pdev;
+	kdev->saved_mem_dev = mem_dev;
+	mem_dev = &pdev->dev;
+
+	return 0;
+}
+
+/**
+ * @description: give mem_dev back and unregister the test device
+ * @param {struct armcb_kunit_dev} *kdev: from armcb_kunit_mem_dev_get
+ * @return {*}
+ */
+static inline void armcb_kunit_mem_dev_put(struct armcb_kunit_dev *kdev)
+{
+	if (!kdev->pdev)
+		return;
+
+	mem_dev = kdev->saved_mem_dev;
+	platform_device_unregister(kdev->pdev);
+	kdev->pdev = NULL;
+}
+
+#endif
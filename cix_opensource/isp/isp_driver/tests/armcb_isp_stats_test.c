@@ -0,0 +1,378 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * KUnit tests of the 3a statistics ring, included at the end of
+ * armcb_isp_stats.c. The interrupts are simulated: on a sol the "hardware"
+ * latches the 3a address for the frame starting and the driver programs
+ * the one of the next frame, at the end of the frame the hardware writes
+ * the frame count at the start of the latched slot and raises 3a done.
+ * The fake register backend stands in for I7_3A_START_ADDR.
+ */
+
+#include "armcb_isp_kunit.h"
+
+#define ARMCB_STATS_TEST_CTX 0
+#define ARMCB_STATS_TEST_SLOTS ARMCB_STATS_MIN_SLOTS
+#define ARMCB_STATS_TEST_FRAMES 512
+#define ARMCB_STATS_TEST_DISCARD 0x1000
+
+struct armcb_stats_test {
+	struct armcb_kunit_dev kdev;
+	u32 *regs;
+	struct file *file;
+	struct armcb_stats_ring *ring;
+	dma_addr_t saved_discard;
+
+	/* addresses latched by the hardware, oldest first */
+	u32 latched[ARMCB_STATS_INFLIGHT];
+	u32 nlatched;
+	u32 frame;
+};
+
+static u32 armcb_stats_test_reg(struct armcb_stats_test *t)
+{
+	return t->regs[I7_3A_START_ADDR / sizeof(u32)];
+}
+
+/* slot the hardware writes for @addr, -1 when not in the ring */
+static int armcb_stats_test_slot(struct armcb_stats_test *t, u32 addr)
+{
+	struct armcb_stats_ring *ring = t->ring;
+	u32 base = 0;
+
+	if (!ring)
+		return -1;
+
+	base = (u32)armcb_stats_slot_dma(ring, 0);
+	if (addr < base || (addr - base) % ring->slot_stride ||
+	    (addr - base) / ring->slot_stride >= ring->slots)
+		return -1;
+
+	return (addr - base) / ring->slot_stride;
+}
+
+static u32 *armcb_stats_test_data(struct armcb_stats_test *t, u32 slot)
+{
+	return t->ring->vaddr + PAGE_SIZE + slot * t->ring->slot_stride;
+}
+
+/* sol: the frame starting latches the port, the next one is programmed */
+static void armcb_stats_test_sol(struct armcb_stats_test *t)
+{
+	t->latched[t->nlatched++] = armcb_stats_test_reg(t);
+	armcb_isp_stats_ring_program(ARMCB_STATS_TEST_CTX);
+}
+
+/*
+ * end of frame: the oldest latched address gets the statistics, the 3a
+ * done interrupt only reaches the driver when !@lost
+ */
+static int armcb_stats_test_done(struct armcb_stats_test *t, bool lost)
+{
+	u32 addr = t->latched[0];
+	int slot = 0;
+
+	t->nlatched--;
+	memmove(&t->latched[0], &t->latched[1],
+		t->nlatched * sizeof(t->latched[0]));
+
+	slot = armcb_stats_test_slot(t, addr);
+	if (slot >= 0)
+		*armcb_stats_test_data(t, slot) = t->frame;
+	if (!lost)
+		armcb_isp_stats_ring_done(ARMCB_STATS_TEST_CTX, t->frame);
+	t->frame++;
+
+	return slot;
+}
+
+static int armcb_stats_test_setup(struct armcb_stats_test *t)
+{
+	struct armcb_stats_setup setup = {
+		.ctx_id = ARMCB_STATS_TEST_CTX,
+		.slots = ARMCB_STATS_TEST_SLOTS,
+		.slot_size = SZ_4K,
+	};
+	int rc = armcb_stats_setup(t->file, &setup);
+
+	t->ring = t->file->private_data;
+
+	return rc;
+}
+
+static int armcb_stats_test_init(struct kunit *test)
+{
+	struct armcb_stats_test *t = NULL;
+
+	if (g_stats_rings[ARMCB_STATS_TEST_CTX])
+		kunit_skip(test, "stats ring in use");
+
+	t = kunit_kzalloc(test, sizeof(*t), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t);
+	t->regs = kunit_kzalloc(test, ARMCB_ISP_KUNIT_REG_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t->regs);
+	t->file = kunit_kzalloc(test, sizeof(*t->file), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t->file);
+	KUNIT_ASSERT_EQ(test, armcb_kunit_mem_dev_get(&t->kdev), 0);
+
+	t->saved_discard = discard_buf_addr_dma;
+	discard_buf_addr_dma = ARMCB_STATS_TEST_DISCARD;
+	armcb_isp_kunit_regs = t->regs;
+	test->priv = t;
+
+	KUNIT_ASSERT_EQ(test, armcb_stats_test_setup(t), 0);
+
+	return 0;
+}
+
+static void armcb_stats_test_exit(struct kunit *test)
+{
+	struct armcb_stats_test *t = test->priv;
+
+	if (!t)
+		return;
+
+	if (t->file->private_data)
+		armcb_stats_release(NULL, t->file);
+	/* the fake register goes away, nothing points into a ring anymore */
+	spin_lock_irq(&g_stats_lock);
+	g_stats_reg_ring = NULL;
+	spin_unlock_irq(&g_stats_lock);
+	armcb_isp_stats_ring_stop(ARMCB_STATS_TEST_CTX);
+	flush_work(&g_stats_free_work);
+
+	armcb_isp_kunit_regs = NULL;
+	discard_buf_addr_dma = t->saved_discard;
+	armcb_kunit_mem_dev_put(&t->kdev);
+}
+
+/*
+ * Userspace holds between none and all of the published slots while the
+ * ISP runs and some 3a done interrupts go missing: the hardware never
+ * writes a held slot and every published slot has its own frame.
+ */
+static void armcb_stats_test_held(struct kunit *test)
+{
+	struct armcb_stats_test *t = test->priv;
+	struct armcb_stats_ring_hdr *hdr = t->ring->hdr;
+	struct armcb_stats_slot_info *info = NULL;
+	unsigned long held = 0;
+	u32 hold = 0;
+	u32 tail = 0;
+	u32 i = 0;
+	int slot = 0;
+
+	/* the frame in flight at the first sol was set up before the ring */
+	armcb_stats_test_sol(t);
+	KUNIT_EXPECT_LT(test, armcb_stats_test_done(t, false), 0);
+
+	for (i = 0; i < ARMCB_STATS_TEST_FRAMES; i++) {
+		armcb_stats_test_sol(t);
+		slot = armcb_stats_test_done(t, i % 7 == 3);
+		KUNIT_ASSERT_GE(test, slot, 0);
+		KUNIT_EXPECT_FALSE_MSG(test, test_bit(slot, &held),
+				       "frame %u overwrote held slot %d",
+				       t->frame - 1, slot);
+
+		/* take what was published, then give back down to @hold */
+		for (; tail != smp_load_acquire(&hdr->head); tail++) {
+			info = &hdr->info[tail % hdr->slots];
+			KUNIT_ASSERT_LT(test, info->slot, hdr->slots);
+			KUNIT_EXPECT_EQ(test,
+					*armcb_stats_test_data(t, info->slot),
+					info->frame);
+			__set_bit(info->slot, &held);
+		}
+		hold = (i / 16) % hdr->slots;
+		while (tail - READ_ONCE(hdr->tail) > hold) {
+			info = &hdr->info[hdr->tail % hdr->slots];
+			/* still the frame published, nothing wrote it since */
+			KUNIT_EXPECT_EQ(test,
+					*armcb_stats_test_data(t, info->slot),
+					info->frame);
+			__clear_bit(info->slot, &held);
+			WRITE_ONCE(hdr->tail, hdr->tail + 1);
+		}
+	}
+
+	KUNIT_EXPECT_GT(test, hdr->head, (u32)ARMCB_STATS_TEST_FRAMES / 4);
+	KUNIT_EXPECT_GT(test, hdr->dropped, 0U);
+}
+
+/* closed while streaming: the slots outlive the fd until their 3a done */
+static void armcb_stats_test_release_inflight(struct kunit *test)
+{
+	struct armcb_stats_test *t = test->priv;
+	struct armcb_stats_ring *ring = t->ring;
+	struct file *file = NULL;
+	u32 i = 0;
+
+	/* frame 1 in flight, the slot of frame 2 already programmed */
+	armcb_stats_test_sol(t);
+	armcb_stats_test_done(t, false);
+	armcb_stats_test_sol(t);
+
+	/* the address may be latched by another ctx, the close leaves it */
+	KUNIT_ASSERT_EQ(test, armcb_stats_release(NULL, t->file), 0);
+	KUNIT_EXPECT_GE(test, armcb_stats_test_slot(t, armcb_stats_test_reg(t)),
+			0);
+	KUNIT_EXPECT_PTR_EQ(test, g_stats_rings[ARMCB_STATS_TEST_CTX], ring);
+
+	/* the ctx is not free for a new ring before its slots are */
+	file = kunit_kzalloc(test, sizeof(*file), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, file);
+	swap(t->file, file);
+	KUNIT_EXPECT_EQ(test, armcb_stats_test_setup(t), -EBUSY);
+	swap(t->file, file);
+	t->ring = ring;
+
+	/* frame 1 and frame 2 still land in the ring, its sol moves the port */
+	KUNIT_EXPECT_GE(test, armcb_stats_test_done(t, false), 0);
+	KUNIT_EXPECT_PTR_EQ(test, g_stats_rings[ARMCB_STATS_TEST_CTX], ring);
+	armcb_stats_test_sol(t);
+	KUNIT_EXPECT_EQ(test, armcb_stats_test_reg(t),
+			(u32)ARMCB_STATS_TEST_DISCARD);
+	KUNIT_EXPECT_GE(test, armcb_stats_test_done(t, false), 0);
+	KUNIT_EXPECT_NULL(test, g_stats_rings[ARMCB_STATS_TEST_CTX]);
+	t->ring = NULL;
+
+	/* frame 3 writes the discard buffer, the ring goes after frame 4 */
+	for (i = 0; i < ARMCB_STATS_INFLIGHT; i++) {
+		KUNIT_EXPECT_FALSE(test, list_empty(&g_stats_parked));
+		armcb_stats_test_sol(t);
+		KUNIT_EXPECT_EQ(test, t->latched[0],
+				(u32)ARMCB_STATS_TEST_DISCARD);
+		KUNIT_EXPECT_LT(test, armcb_stats_test_done(t, false), 0);
+	}
+	flush_work(&g_stats_free_work);
+	KUNIT_EXPECT_TRUE(test, list_empty(&g_stats_parked));
+}
+
+/*
+ * closed after a sol, then stream off retires the slots, but the 3a
+ * address still points into the ring until the next stream on moves it
+ */
+static void armcb_stats_test_release_streamoff(struct kunit *test)
+{
+	struct armcb_stats_test *t = test->priv;
+	struct armcb_stats_ring *ring = t->ring;
+	u32 i = 0;
+
+	armcb_stats_test_sol(t);
+	KUNIT_ASSERT_EQ(test, armcb_stats_release(NULL, t->file), 0);
+	KUNIT_EXPECT_NOT_NULL(test, g_stats_rings[ARMCB_STATS_TEST_CTX]);
+
+	armcb_isp_stats_ring_stop(ARMCB_STATS_TEST_CTX);
+	t->nlatched = 0;
+	KUNIT_EXPECT_NULL(test, g_stats_rings[ARMCB_STATS_TEST_CTX]);
+	KUNIT_EXPECT_PTR_EQ(test, g_stats_reg_ring, ring);
+	flush_work(&g_stats_free_work);
+	KUNIT_EXPECT_FALSE(test, list_empty(&g_stats_parked));
+	t->ring = NULL;
+
+	/* the first frame still writes the ring, the ones after it discard */
+	for (i = 0; i <= ARMCB_STATS_INFLIGHT; i++) {
+		armcb_stats_test_sol(t);
+		armcb_stats_test_done(t, false);
+	}
+	KUNIT_EXPECT_EQ(test, armcb_stats_test_reg(t),
+			(u32)ARMCB_STATS_TEST_DISCARD);
+	flush_work(&g_stats_free_work);
+	KUNIT_EXPECT_TRUE(test, list_empty(&g_stats_parked));
+}
+
+/* no discard buffer: a closed ring stays until another address replaces it */
+static void armcb_stats_test_release_no_discard(struct kunit *test)
+{
+	struct armcb_stats_test *t = test->priv;
+	struct armcb_stats_ring *ring = t->ring;
+	u32 i = 0;
+
+	discard_buf_addr_dma = 0;
+	armcb_stats_test_sol(t);
+	armcb_stats_test_done(t, false);
+	armcb_stats_test_sol(t);
+	KUNIT_ASSERT_EQ(test, armcb_stats_release(NULL, t->file), 0);
+
+	/* the frames keep writing the last slot, it is still allocated */
+	for (i = 0; i < 4; i++) {
+		KUNIT_EXPECT_GE(test, armcb_stats_test_done(t, false), 0);
+		armcb_stats_test_sol(t);
+	}
+	KUNIT_EXPECT_NULL(test, g_stats_rings[ARMCB_STATS_TEST_CTX]);
+	KUNIT_EXPECT_PTR_EQ(test, g_stats_reg_ring, ring);
+
+	/* stream off doesn't free it either, the address still points there */
+	armcb_isp_stats_ring_stop(ARMCB_STATS_TEST_CTX);
+	t->nlatched = 0;
+	flush_work(&g_stats_free_work);
+	KUNIT_EXPECT_FALSE(test, list_empty(&g_stats_parked));
+
+	/* a new ring on the ctx takes the address over */
+	KUNIT_ASSERT_EQ(test, armcb_stats_test_setup(t), 0);
+	for (i = 0; i <= ARMCB_STATS_INFLIGHT; i++) {
+		armcb_stats_test_sol(t);
+		armcb_stats_test_done(t, false);
+	}
+	KUNIT_EXPECT_PTR_EQ(test, g_stats_reg_ring, t->ring);
+	flush_work(&g_stats_free_work);
+	KUNIT_EXPECT_TRUE(test, list_empty(&g_stats_parked));
+}
+
+/* no sol latched a slot yet: the ring is freed by the close itself */
+static void armcb_stats_test_release_idle(struct kunit *test)
+{
+	struct armcb_stats_test *t = test->priv;
+
+	KUNIT_ASSERT_EQ(test, armcb_stats_release(NULL, t->file), 0);
+	KUNIT_EXPECT_NULL(test, g_stats_rings[ARMCB_STATS_TEST_CTX]);
+	t->ring = NULL;
+}
+
+/* a second setup on the same fd is refused, not leaked */
+static void armcb_stats_test_setup_twice(struct kunit *test)
+{
+	struct armcb_stats_test *t = test->priv;
+	struct armcb_stats_ring *ring = t->ring;
+	struct armcb_stats_setup setup = {
+		.ctx_id = ARMCB_STATS_TEST_CTX + 1,
+		.slots = ARMCB_STATS_TEST_SLOTS,
+		.slot_size = SZ_4K,
+	};
+
+	KUNIT_EXPECT_EQ(test, armcb_stats_setup(t->file, &setup), -EBUSY);
+	KUNIT_EXPECT_PTR_EQ(test, t->file->private_data, (void *)ring);
+	KUNIT_EXPECT_NULL(test, g_stats_rings[ARMCB_STATS_TEST_CTX + 1]);
+}
+
+static struct kunit_case armcb_stats_test_cases[] = {
+	KUNIT_CASE(armcb_stats_test_held),
+	KUNIT_CASE(armcb_stats_test_release_inflight),
+	KUNIT_CASE(armcb_stats_test_release_streamoff),
+	KUNIT_CASE(armcb_stats_test_release_no_discard),
+	KUNIT_CASE(armcb_stats_test_release_idle),
+	KUNIT_CASE(armcb_stats_test_setup_twice),
+	{}
+};
+
+static struct kunit_suite armcb_stats_test_suite = {
+	.name = "armcb_isp_stats_ring",
+	.init = armcb_stats_test_init,
+	.exit = armcb_stats_test_exit,
+	.test_cases = armcb_stats_test_cases,
+};
+
+kunit_test_suites(&armcb_stats_test_suite);
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * KUnit tests of the sensor apply queue, included at the end of
+ * armcb_sensor_queue.c.
+ *
+ * A 1 kHz hard irq hrtimer stands in for the sof interrupt and a fake bus
+ * for the sensor. A SCHED_FIFO producer queues updates a few frames ahead
+ * while every cpu runs a busy kthread, and each update has to be written
+ * during its target frame, not before and not after.
+ */
+
+#include "armcb_isp_kunit.h"
+#include <linux/delay.h>
+#include <linux/hrtimer.h>
+
+#define ARMCB_SQ_TEST_CAM 0
+#define ARMCB_SQ_TEST_UPDATES 2000
+#define ARMCB_SQ_TEST_PER_FRAME 2
+#define ARMCB_SQ_TEST_AHEAD 3
+#define ARMCB_SQ_TEST_REGS 4
+#define ARMCB_SQ_TEST_XFER_US 100 /// 4 writes at 400 kHz
+#define ARMCB_SQ_TEST_PERIOD_NS (NSEC_PER_SEC / 1000)
+
+struct armcb_sq_test {
+	struct armcb_kunit_dev kdev;
+	struct armcb_sensor_queue *queue;
+	struct cmd_buf *cmd;
+	struct hrtimer timer;
+	struct completion done;
+	u32 frame; /// last sof raised by the timer
+	u32 applied;
+	u32 next_order;
+	u32 early;
+	u32 misordered;
+};
+
+static enum hrtimer_restart armcb_sq_test_tick(struct hrtimer *timer)
+{
+	struct armcb_sq_test *t =
+		container_of(timer, struct armcb_sq_test, timer);
+	u32 frame = t->frame + 1;
+
+	WRITE_ONCE(t->frame, frame);
+	armcb_sensor_queue_sof(ARMCB_SQ_TEST_CAM, frame);
+
+	hrtimer_forward_now(timer, ns_to_ktime(ARMCB_SQ_TEST_PERIOD_NS));
+	return HRTIMER_RESTART;
+}
+
+/* the sensor bus: the writes start in the current frame and take a while */
+static int armcb_sq_test_apply(struct cmd_buf *cmd, void *client)
+{
+	struct armcb_sq_test *t = client;
+
+	if ((s32)(READ_ONCE(t->queue->sof) - cmd->apply_frame_id) < 0)
+		t->early++;
+	if (cmd->order != t->next_order)
+		t->misordered++;
+	t->next_order = cmd->order + 1;
+
+	udelay(ARMCB_SQ_TEST_XFER_US);
+
+	if (++t->applied == ARMCB_SQ_TEST_UPDATES)
+		complete(&t->done);
+
+	return 0;
+}
+
+static int armcb_sq_test_hog(void *data)
+{
+	while (!kthread_should_stop()) {
+		cpu_relax();
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static int armcb_sq_test_init(struct kunit *test)
+{
+	struct armcb_sq_test *t = NULL;
+	size_t size = offsetof(struct cmd_buf, settings) +
+		      ARMCB_SQ_TEST_REGS * sizeof(struct cmd_i2c_setting);
+	int i = 0;
+
+	/* a bound sensor owns the queue of its cam */
+	if (READ_ONCE(g_sensor_queues[ARMCB_SQ_TEST_CAM]))
+		kunit_skip(test, "cam %d has a sensor", ARMCB_SQ_TEST_CAM);
+
+	t = kunit_kzalloc(test, sizeof(*t), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t);
+	t->cmd = kunit_kzalloc(test, size, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t->cmd);
+	init_completion(&t->done);
+
+	t->cmd->static_info.bus = HW_BUS_I2C;
+	t->cmd->static_info.trigger_cond = CMD_COND_SOF;
+	t->cmd->static_info.buf_size = size;
+	t->cmd->cmd_type = CMD_TYPE_UPDATE;
+	t->cmd->cmd_cnt = ARMCB_SQ_TEST_REGS;
+	for (i = 0; i < ARMCB_SQ_TEST_REGS; i++) {
+		t->cmd->settings.i2c[i].direct = DRV_DIRECTION_WRITE;
+		t->cmd->settings.i2c[i].reg_data_type = DRV_DATA_TYPE_BYTE;
+		t->cmd->settings.i2c[i].reg_addr = 0x3500 + i;
+	}
+
+	KUNIT_ASSERT_EQ(test, armcb_kunit_mem_dev_get(&t->kdev), 0);
+	t->queue = armcb_sensor_queue_create(ARMCB_SQ_TEST_CAM,
+					     &t->kdev.pdev->dev, NULL, t);
+	if (!t->queue) {
+		armcb_kunit_mem_dev_put(&t->kdev);
+		KUNIT_FAIL(test, "no apply queue");
+		return -ENOMEM;
+	}
+	armcb_sensor_queue_kunit_apply = armcb_sq_test_apply;
+	test->priv = t;
+
+	return 0;
+}
+
+static void armcb_sq_test_exit(struct kunit *test)
+{
+	struct armcb_sq_test *t = test->priv;
+
+	if (!t)
+		return;
+
+	armcb_sensor_queue_destroy(t->queue);
+	armcb_sensor_queue_kunit_apply = NULL;
+	armcb_kunit_mem_dev_put(&t->kdev);
+}
+
+/* 1000 frames with every cpu busy: each update lands on its target frame */
+static void armcb_sq_test_landing(struct kunit *test)
+{
+	struct armcb_sq_test *t = test->priv;
+	struct task_struct **hogs = NULL;
+	unsigned int nhogs = num_online_cpus();
+	unsigned int busy = 0;
+	u32 added = 0;
+	u32 seen = 0;
+	u32 frame = 0;
+	int ret = 0;
+	int i = 0;
+
+	hogs = kunit_kcalloc(test, nhogs, sizeof(*hogs), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, hogs);
+	for (busy = 0; busy < nhogs; busy++) {
+		hogs[busy] = kthread_run(armcb_sq_test_hog, NULL,
+					 "armcb-sq-hog%u", busy);
+		if (IS_ERR(hogs[busy]))
+			break;
+	}
+
+	/* the daemon queues its updates from a realtime thread */
+	sched_set_fifo(current);
+
+	hrtimer_init(&t->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_HARD);
+	t->timer.function = armcb_sq_test_tick;
+	hrtimer_start(&t->timer, ns_to_ktime(ARMCB_SQ_TEST_PERIOD_NS),
+		      HRTIMER_MODE_REL_HARD);
+
+	while (added < ARMCB_SQ_TEST_UPDATES && !ret) {
+		frame = READ_ONCE(t->frame);
+		if (frame == seen) {
+			usleep_range(100, 200);
+			continue;
+		}
+		seen = frame;
+
+		for (i = 0; i < ARMCB_SQ_TEST_PER_FRAME &&
+			    added < ARMCB_SQ_TEST_UPDATES; i++) {
+			t->cmd->order = added;
+			t->cmd->apply_frame_id = frame + ARMCB_SQ_TEST_AHEAD;
+			ret = armcb_sensor_queue_add(t->queue, t->cmd);
+			if (ret)
+				break;
+			added++;
+		}
+	}
+
+	KUNIT_EXPECT_EQ(test, ret, 0);
+	if (!ret)
+		KUNIT_EXPECT_NE(test,
+				wait_for_completion_timeout(&t->done, 10 * HZ),
+				0UL);
+	hrtimer_cancel(&t->timer);
+	sched_set_normal(current, 0);
+	for (i = 0; i < busy; i++)
+		kthread_stop(hogs[i]);
+
+	armcb_sensor_queue_flush(t->queue);
+	KUNIT_EXPECT_EQ(test, t->applied, (u32)ARMCB_SQ_TEST_UPDATES);
+	KUNIT_EXPECT_EQ(test, t->queue->applied, (u64)ARMCB_SQ_TEST_UPDATES);
+	KUNIT_EXPECT_EQ(test, t->queue->late, 0ULL);
+	KUNIT_EXPECT_EQ(test, t->early, 0U);
+	KUNIT_EXPECT_EQ(test, t->misordered, 0U);
+
+	kunit_info(test, "%u updates over %u frames, %u busy cpus\n", added,
+		   t->frame, busy);
+}
+
+/* stream off drops what still waits for a frame, the sofs after it find none */
+static void armcb_sq_test_stop(struct kunit *test)
+{
+	struct armcb_sq_test *t = test->priv;
+	u32 frame = 0;
+
+	for (frame = 10; frame < 14; frame++) {
+		t->cmd->order = frame;
+		t->cmd->apply_frame_id = frame;
+		KUNIT_ASSERT_EQ(test, armcb_sensor_queue_add(t->queue, t->cmd),
+				0);
+	}
+	KUNIT_EXPECT_EQ(test, t->queue->depth, 4U);
+
+	armcb_sensor_queue_stop(ARMCB_SQ_TEST_CAM);
+	KUNIT_EXPECT_EQ(test, t->queue->depth, 0U);
+
+	for (frame = 10; frame < 14; frame++)
+		armcb_sensor_queue_sof(ARMCB_SQ_TEST_CAM, frame);
+	kthread_flush_worker(t->queue->worker);
+
+	KUNIT_EXPECT_EQ(test, t->applied, 0U);
+	KUNIT_EXPECT_EQ(test, t->queue->applied, 0ULL);
+
+	/* out of range ctx ids are ignored */
+	armcb_sensor_queue_stop(ARMCB_MAX_DEVS);
+}
+
+static struct kunit_case armcb_sq_test_cases[] = {
+	KUNIT_CASE(armcb_sq_test_landing),
+	KUNIT_CASE(armcb_sq_test_stop),
+	{}
+};
+
+static struct kunit_suite armcb_sq_test_suite = {
+	.name = "armcb_isp_sensor_queue",
+	.init = armcb_sq_test_init,
+	.exit = armcb_sq_test_exit,
+	.test_cases = armcb_sq_test_cases,
+};
+
+kunit_test_suites(&armcb_sq_test_suite);
@@ -0,0 +1,425 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * KUnit tests of the config device, included at the end of
+ * armcb_v4l2_config.c.
+ *
+ * The irq ring suite runs the producer from a 1 kHz hard irq hrtimer and
+ * the consumer from a SCHED_FIFO kthread standing in for the irq thread,
+ * four ctxs interleaved, and checks every event arrives once and in order.
+ *
+ * The stream address suite points armcb_isp_write_reg() at a fake register
+ * file and checks which vout start addresses a stream programs for queued
+ * buffers, on underrun and for a port without address registers.
+ */
+
+#include "armcb_isp_kunit.h"
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+
+#define ARMCB_CONFIG_TEST_CTXS 4
+#define ARMCB_CONFIG_TEST_EVENTS 2000
+#define ARMCB_CONFIG_TEST_PERIOD_NS (NSEC_PER_SEC / 1000)
+#define ARMCB_CONFIG_TEST_WIDTH 320
+#define ARMCB_CONFIG_TEST_HEIGHT 240
+#define ARMCB_CONFIG_TEST_BUFS 2
+#define ARMCB_CONFIG_TEST_SCRATCH 0x40000000
+
+struct armcb_config_test_irq {
+	armcb_v4l2_config_dev_t *dev;
+	struct hrtimer timer;
+	struct task_struct *thread;
+	struct completion done;
+	unsigned int produced;
+	unsigned int received;
+	unsigned int next_seq[ARMCB_CONFIG_TEST_CTXS];
+	unsigned int misordered;
+};
+
+/* synthetic buffer done of @ctx_id, the frame counter carries @seq */
+static void armcb_config_test_event(struct isp_irq_info *info, u32 ctx_id,
+				    u32 seq)
+{
+	memset(info, 0, sizeof(*info));
+	info->int_type = ISP_NORMAL_INT;
+	info->status = I7_INT_VOUT1_BUF_DONE;
+	info->id = ctx_id << 2;
+	info->frm_cnt_sof = seq;
+}
+
+static enum hrtimer_restart armcb_config_test_tick(struct hrtimer *timer)
+{
+	struct armcb_config_test_irq *irq =
+		container_of(timer, struct armcb_config_test_irq, timer);
+	struct isp_irq_info info;
+	u32 seq = irq->produced;
+
+	armcb_config_test_event(&info, seq % ARMCB_CONFIG_TEST_CTXS, seq);
+	armcb_irq_ring_push(irq->dev, &info);
+	irq->produced++;
+	wake_up_process(irq->thread);
+
+	if (irq->produced == ARMCB_CONFIG_TEST_EVENTS)
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, ns_to_ktime(ARMCB_CONFIG_TEST_PERIOD_NS));
+	return HRTIMER_RESTART;
+}
+
+/* armcb_irq_ring_drain() minus the buffer done, which needs streams */
+static bool armcb_config_test_drain(struct armcb_config_test_irq *irq)
+{
+	struct armcb_irq_ring *ring = NULL;
+	struct armcb_irq_event *ev = NULL;
+	bool any = false;
+	u32 ctx_id = 0;
+
+	for (ctx_id = 0; ctx_id < ARMCB_CONFIG_TEST_CTXS; ctx_id++) {
+		ring = &irq->dev->irq_ring[ctx_id];
+		while ((ev = armcb_irq_ring_peek(ring))) {
+			if (armcb_irq_info_ctx(&ev->info) != ctx_id ||
+			    ev->info.frm_cnt_sof != irq->next_seq[ctx_id])
+				irq->misordered++;
+			irq->next_seq[ctx_id] =
+				ev->info.frm_cnt_sof + ARMCB_CONFIG_TEST_CTXS;
+			armcb_irq_lat_record(irq->dev, ring, ev);
+			armcb_irq_ring_pop(ring);
+			irq->received++;
+			any = true;
+		}
+	}
+
+	return any;
+}
+
+static int armcb_config_test_thread(void *data)
+{
+	struct armcb_config_test_irq *irq = data;
+
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!armcb_config_test_drain(irq))
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		if (irq->received == ARMCB_CONFIG_TEST_EVENTS)
+			complete(&irq->done);
+	}
+
+	return 0;
+}
+
+static int armcb_config_test_init(struct kunit *test)
+{
+	armcb_v4l2_config_dev_t *dev = NULL;
+
+	dev = kunit_kzalloc(test, sizeof(*dev), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, dev);
+	test->priv = dev;
+
+	return 0;
+}
+
+/* 2 s of 1 kHz interrupts over 4 ctxs: nothing lost, nothing reordered */
+static void armcb_config_test_irq_1khz(struct kunit *test)
+{
+	struct armcb_config_test_irq *irq = NULL;
+	u64 frames = 0;
+	u64 lat = 0;
+	int i = 0;
+
+	irq = kunit_kzalloc(test, sizeof(*irq), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, irq);
+	irq->dev = test->priv;
+	for (i = 0; i < ARMCB_CONFIG_TEST_CTXS; i++)
+		irq->next_seq[i] = i;
+	init_completion(&irq->done);
+
+	irq->thread = kthread_run(armcb_config_test_thread, irq,
+				  "armcb-irq-kunit");
+	KUNIT_ASSERT_FALSE(test, IS_ERR(irq->thread));
+	sched_set_fifo(irq->thread);
+
+	hrtimer_init(&irq->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_HARD);
+	irq->timer.function = armcb_config_test_tick;
+	hrtimer_start(&irq->timer, ns_to_ktime(ARMCB_CONFIG_TEST_PERIOD_NS),
+		      HRTIMER_MODE_REL_HARD);
+
+	KUNIT_EXPECT_NE(test,
+			wait_for_completion_timeout(&irq->done, 5 * HZ), 0UL);
+	hrtimer_cancel(&irq->timer);
+	kthread_stop(irq->thread);
+
+	KUNIT_EXPECT_EQ(test, irq->produced, ARMCB_CONFIG_TEST_EVENTS);
+	KUNIT_EXPECT_EQ(test, irq->received, ARMCB_CONFIG_TEST_EVENTS);
+	KUNIT_EXPECT_EQ(test, irq->misordered, 0U);
+	for (i = 0; i < ARMCB_CONFIG_TEST_CTXS; i++) {
+		KUNIT_EXPECT_EQ(test, irq->dev->irq_ring[i].dropped, 0ULL);
+		KUNIT_EXPECT_EQ(test, irq->dev->irq_ring[i].pushed,
+				(u64)ARMCB_CONFIG_TEST_EVENTS /
+					ARMCB_CONFIG_TEST_CTXS);
+		frames += irq->dev->irq_ring[i].frames;
+	}
+	for (i = 0; i < ARMCB_IRQ_LAT_BUCKETS; i++)
+		lat += irq->dev->irq_lat_hist[i];
+	KUNIT_EXPECT_EQ(test, frames, (u64)ARMCB_CONFIG_TEST_EVENTS);
+	KUNIT_EXPECT_EQ(test, lat, (u64)ARMCB_CONFIG_TEST_EVENTS);
+
+	kunit_info(test, "max irq to consumer latency %llu us\n",
+		   div_u64(irq->dev->irq_lat_max_ns, NSEC_PER_USEC));
+}
+
+/* a full ring refuses the newest event, the queued ones stay intact */
+static void armcb_config_test_irq_full(struct kunit *test)
+{
+	armcb_v4l2_config_dev_t *dev = test->priv;
+	struct armcb_irq_ring *ring = &dev->irq_ring[1];
+	struct armcb_irq_event *ev = NULL;
+	struct isp_irq_info info;
+	u32 seq = 0;
+
+	for (seq = 0; seq < ARMCB_IRQ_RING_SIZE; seq++) {
+		armcb_config_test_event(&info, 1, seq);
+		KUNIT_EXPECT_TRUE(test, armcb_irq_ring_push(dev, &info));
+	}
+
+	armcb_config_test_event(&info, 1, seq);
+	KUNIT_EXPECT_FALSE(test, armcb_irq_ring_push(dev, &info));
+	KUNIT_EXPECT_EQ(test, ring->dropped, 1ULL);
+	KUNIT_EXPECT_EQ(test, ring->pushed, (u64)ARMCB_IRQ_RING_SIZE);
+
+	for (seq = 0; (ev = armcb_irq_ring_peek(ring)); seq++) {
+		KUNIT_EXPECT_EQ(test, ev->info.frm_cnt_sof, seq);
+		armcb_irq_ring_pop(ring);
+	}
+	KUNIT_EXPECT_EQ(test, seq, (u32)ARMCB_IRQ_RING_SIZE);
+
+	/* room again once the consumer caught up */
+	KUNIT_EXPECT_TRUE(test, armcb_irq_ring_push(dev, &info));
+}
+
+static struct kunit_case armcb_config_irq_cases[] = {
+	KUNIT_CASE(armcb_config_test_irq_1khz),
+	KUNIT_CASE(armcb_config_test_irq_full),
+	{}
+};
+
+static struct kunit_suite armcb_config_irq_suite = {
+	.name = "armcb_isp_irq_ring",
+	.init = armcb_config_test_init,
+	.test_cases = armcb_config_irq_cases,
+};
+
+struct armcb_config_test_hw {
+	struct armcb_kunit_dev kdev;
+	armcb_v4l2_stream_t stream;
+	struct vb2_queue q;
+	struct mutex lock;
+	u32 *regs;
+	dma_addr_t saved_discard;
+};
+
+static u32 armcb_config_test_reg(struct armcb_config_test_hw *hw, u32 offset)
+{
+	return hw->regs[offset / 4];
+}
+
+/* dma address of @plane of buffer @index, what the port must be given */
+static u32 armcb_config_test_plane(struct armcb_config_test_hw *hw,
+				   unsigned int index, unsigned int plane)
+{
+	return (u32)vb2_dma_contig_plane_dma_addr(vb2_get_buffer(&hw->q, index),
+						  plane);
+}
+
+static int armcb_config_test_hw_init(struct kunit *test)
+{
+	struct armcb_config_test_hw *hw = NULL;
+	struct v4l2_pix_format_mplane *pix = NULL;
+	armcb_v4l2_stream_t *pstream = NULL;
+
+	hw = kunit_kzalloc(test, sizeof(*hw), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, hw);
+	hw->regs = kunit_kzalloc(test, ARMCB_ISP_KUNIT_REG_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, hw->regs);
+	KUNIT_ASSERT_EQ(test, armcb_kunit_mem_dev_get(&hw->kdev), 0);
+
+	/* ctx 0 on vout1, NV12 with the chroma in the second plane */
+	pstream = &hw->stream;
+	pstream->outport = 1 << ISP_OUTPUT_PORT_VOUT1;
+	pstream->reserved_buf_addr_dma = ARMCB_CONFIG_TEST_SCRATCH;
+	INIT_LIST_HEAD(&pstream->stream_buffer_list);
+	INIT_LIST_HEAD(&pstream->stream_buffer_list_busy);
+	spin_lock_init(&pstream->slock);
+	spin_lock_init(&pstream->fence_lock);
+	pstream->fence_ctx = dma_fence_context_alloc(1);
+
+	pstream->cur_v4l2_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	pix = &pstream->cur_v4l2_fmt.fmt.pix_mp;
+	pix->width = ARMCB_CONFIG_TEST_WIDTH;
+	pix->height = ARMCB_CONFIG_TEST_HEIGHT;
+	pix->pixelformat = V4L2_PIX_FMT_NV12M;
+	pix->num_planes = 2;
+	pix->plane_fmt[0].bytesperline = ARMCB_CONFIG_TEST_WIDTH;
+	pix->plane_fmt[0].sizeimage =
+		ARMCB_CONFIG_TEST_WIDTH * ARMCB_CONFIG_TEST_HEIGHT;
+	pix->plane_fmt[1].bytesperline = ARMCB_CONFIG_TEST_WIDTH;
+	pix->plane_fmt[1].sizeimage =
+		ARMCB_CONFIG_TEST_WIDTH * ARMCB_CONFIG_TEST_HEIGHT / 2;
+
+	mutex_init(&hw->lock);
+	hw->saved_discard = discard_buf_addr_dma;
+	armcb_isp_kunit_regs = hw->regs;
+	test->priv = hw;
+	KUNIT_ASSERT_EQ(test,
+			isp_vb2_queue_init(&hw->q, &hw->lock, pstream, NULL),
+			0);
+
+	return 0;
+}
+
+static void armcb_config_test_hw_exit(struct kunit *test)
+{
+	struct armcb_config_test_hw *hw = test->priv;
+
+	if (!hw)
+		return;
+
+	armcb_isp_kunit_regs = NULL;
+	discard_buf_addr_dma = hw->saved_discard;
+	if (hw->q.ops) {
+		mutex_lock(&hw->lock);
+		/* buffers the "hardware" still holds go back before streamoff */
+		destroy_buf_queue(&hw->q, VB2_BUF_STATE_ERROR);
+		vb2_queue_release(&hw->q);
+		mutex_unlock(&hw->lock);
+	}
+	armcb_kunit_mem_dev_put(&hw->kdev);
+}
+
+/* queue @count mmap buffers and stream on, they land on the pending list */
+static void armcb_config_test_hw_queue(struct kunit *test,
+				       struct armcb_config_test_hw *hw,
+				       unsigned int count)
+{
+	struct v4l2_requestbuffers req = {
+		.count = count,
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.memory = V4L2_MEMORY_MMAP,
+	};
+	struct v4l2_plane planes[ARMCB_VB2_MAX_PLANES] = {};
+	struct v4l2_buffer b = {
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.memory = V4L2_MEMORY_MMAP,
+		.length = ARMCB_VB2_MAX_PLANES,
+		.m.planes = planes,
+	};
+
+	mutex_lock(&hw->lock);
+	KUNIT_ASSERT_EQ(test, vb2_reqbufs(&hw->q, &req), 0);
+	KUNIT_ASSERT_EQ(test, req.count, count);
+	for (b.index = 0; b.index < count; b.index++)
+		KUNIT_ASSERT_EQ(test, vb2_qbuf(&hw->q, NULL, &b), 0);
+	KUNIT_ASSERT_EQ(test, vb2_streamon(&hw->q, hw->q.type), 0);
+	mutex_unlock(&hw->lock);
+}
+
+/* each sol hands the next queued buffer to the port, one per plane */
+static void armcb_config_test_hw_queued(struct kunit *test)
+{
+	struct armcb_config_test_hw *hw = test->priv;
+	armcb_v4l2_stream_t *pstream = &hw->stream;
+	unsigned int i = 0;
+
+	armcb_config_test_hw_queue(test, hw, ARMCB_CONFIG_TEST_BUFS);
+
+	for (i = 0; i < ARMCB_CONFIG_TEST_BUFS; i++) {
+		KUNIT_EXPECT_EQ(test,
+				armcb_v4l2_config_update_stream_hw_addr(pstream),
+				0);
+		KUNIT_EXPECT_EQ(test,
+				armcb_config_test_reg(hw, I7_VOUT1_START_ADDR),
+				armcb_config_test_plane(hw, i, 0));
+		KUNIT_EXPECT_EQ(test,
+				armcb_config_test_reg(hw, I7_VOUT2_START_ADDR),
+				armcb_config_test_plane(hw, i, 1));
+	}
+
+	KUNIT_EXPECT_TRUE(test, list_empty(&pstream->stream_buffer_list));
+	KUNIT_EXPECT_EQ(test, list_count_nodes(&pstream->stream_buffer_list_busy),
+			(size_t)ARMCB_CONFIG_TEST_BUFS);
+}
+
+/* nothing queued: the stream scratch buffer, chroma after the luma */
+static void armcb_config_test_hw_underrun(struct kunit *test)
+{
+	struct armcb_config_test_hw *hw = test->priv;
+	armcb_v4l2_stream_t *pstream = &hw->stream;
+	u32 luma = pstream->cur_v4l2_fmt.fmt.pix_mp.plane_fmt[0].sizeimage;
+
+	armcb_config_test_hw_queue(test, hw, 1);
+	KUNIT_EXPECT_EQ(test, armcb_v4l2_config_update_stream_hw_addr(pstream),
+			0);
+	KUNIT_EXPECT_EQ(test, armcb_config_test_reg(hw, I7_VOUT1_START_ADDR),
+			armcb_config_test_plane(hw, 0, 0));
+
+	KUNIT_EXPECT_EQ(test, armcb_v4l2_config_update_stream_hw_addr(pstream),
+			0);
+	KUNIT_EXPECT_EQ(test, armcb_config_test_reg(hw, I7_VOUT1_START_ADDR),
+			(u32)ARMCB_CONFIG_TEST_SCRATCH);
+	KUNIT_EXPECT_EQ(test, armcb_config_test_reg(hw, I7_VOUT2_START_ADDR),
+			(u32)ARMCB_CONFIG_TEST_SCRATCH + luma);
+
+	/* no scratch buffer: the shared discard buffer instead */
+	pstream->reserved_buf_addr_dma = 0;
+	discard_buf_addr_dma = ARMCB_CONFIG_TEST_SCRATCH * 2;
+	KUNIT_EXPECT_EQ(test, armcb_v4l2_config_update_stream_hw_addr(pstream),
+			0);
+	KUNIT_EXPECT_EQ(test, armcb_config_test_reg(hw, I7_VOUT1_START_ADDR),
+			(u32)ARMCB_CONFIG_TEST_SCRATCH * 2);
+	KUNIT_EXPECT_EQ(test, armcb_config_test_reg(hw, I7_VOUT2_START_ADDR),
+			(u32)ARMCB_CONFIG_TEST_SCRATCH * 2 + luma);
+}
+
+/* a port without start address registers touches no register at all */
+static void armcb_config_test_hw_no_port(struct kunit *test)
+{
+	struct armcb_config_test_hw *hw = test->priv;
+
+	hw->stream.outport = 0;
+	KUNIT_EXPECT_EQ(test,
+			armcb_v4l2_config_update_stream_hw_addr(&hw->stream),
+			-EINVAL);
+	KUNIT_EXPECT_PTR_EQ(test,
+			    memchr_inv(hw->regs, 0, ARMCB_ISP_KUNIT_REG_SIZE),
+			    NULL);
+}
+
+static struct kunit_case armcb_config_hw_addr_cases[] = {
+	KUNIT_CASE(armcb_config_test_hw_queued),
+	KUNIT_CASE(armcb_config_test_hw_underrun),
+	KUNIT_CASE(armcb_config_test_hw_no_port),
+	{}
+};
+
+static struct kunit_suite armcb_config_hw_addr_suite = {
+	.name = "armcb_isp_stream_hw_addr",
+	.init = armcb_config_test_hw_init,
+	.exit = armcb_config_test_hw_exit,
+	.test_cases = armcb_config_hw_addr_cases,
+};
+
+kunit_test_suites(&armcb_config_irq_suite, &armcb_config_hw_addr_suite);
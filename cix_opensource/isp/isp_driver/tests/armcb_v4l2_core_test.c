@@ -0,0 +1,346 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * KUnit tests of the v4l2 devices, included at the end of armcb_v4l2_core.c.
+ *
+ * The ctx isolation suite registers four virtual ctxs sharing vout1 and
+ * plays the interrupt path against them the way the irq thread does: the
+ * sol programs the next buffer of a ctx, the buffer done completes it.
+ * Every frame has to land on the queue of its own ctx, in order, also
+ * after another ctx tore its stream down in the middle.
+ */
+
+#include "armcb_isp_kunit.h"
+
+#define ARMCB_CORE_TEST_CTXS 4
+#define ARMCB_CORE_TEST_BUFS 4
+#define ARMCB_CORE_TEST_FRAMES 32
+#define ARMCB_CORE_TEST_WIDTH 320
+#define ARMCB_CORE_TEST_HEIGHT 240
+
+struct armcb_core_test_ctx {
+	armcb_v4l2_dev_t *dev;
+	armcb_v4l2_stream_t *stream;
+	struct vb2_queue q;
+	struct mutex lock;
+	unsigned int programmed;
+	unsigned int done;
+};
+
+struct armcb_core_test {
+	struct armcb_kunit_dev kdev;
+	u32 *regs;
+	struct armcb_core_test_ctx ctx[ARMCB_CORE_TEST_CTXS];
+};
+
+static armcb_v4l2_stream_t *armcb_core_test_stream(uint32_t ctx_id)
+{
+	struct v4l2_pix_format_mplane *pix = NULL;
+	armcb_v4l2_stream_t *pstream = NULL;
+
+	/* kfree()d by armcb_v4l2_stream_deinit() */
+	pstream = kzalloc(sizeof(*pstream), GFP_KERNEL);
+	if (!pstream)
+		return NULL;
+
+	pstream->ctx_id = ctx_id;
+	pstream->stream_type = V4L2_STREAM_TYPE_VIDEO;
+	pstream->outport = 1 << ISP_OUTPUT_PORT_VOUT1;
+	INIT_LIST_HEAD(&pstream->stream_buffer_list);
+	INIT_LIST_HEAD(&pstream->stream_buffer_list_busy);
+	spin_lock_init(&pstream->slock);
+	spin_lock_init(&pstream->fence_lock);
+	pstream->fence_ctx = dma_fence_context_alloc(1);
+
+	pstream->cur_v4l2_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	pix = &pstream->cur_v4l2_fmt.fmt.pix_mp;
+	pix->width = ARMCB_CORE_TEST_WIDTH;
+	pix->height = ARMCB_CORE_TEST_HEIGHT;
+	pix->pixelformat = V4L2_PIX_FMT_NV12M;
+	pix->num_planes = 2;
+	pix->plane_fmt[0].bytesperline = ARMCB_CORE_TEST_WIDTH;
+	pix->plane_fmt[0].sizeimage =
+		ARMCB_CORE_TEST_WIDTH * ARMCB_CORE_TEST_HEIGHT;
+	pix->plane_fmt[1].bytesperline = ARMCB_CORE_TEST_WIDTH;
+	pix->plane_fmt[1].sizeimage =
+		ARMCB_CORE_TEST_WIDTH * ARMCB_CORE_TEST_HEIGHT / 2;
+
+	return pstream;
+}
+
+/* a dequeued buffer index, or a negative errno when none is done */
+static int armcb_core_test_dqbuf(struct armcb_core_test_ctx *cx)
+{
+	struct v4l2_plane planes[ARMCB_VB2_MAX_PLANES] = {};
+	struct v4l2_buffer b = {
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.memory = V4L2_MEMORY_MMAP,
+		.length = ARMCB_VB2_MAX_PLANES,
+		.m.planes = planes,
+	};
+	int rc = 0;
+
+	mutex_lock(&cx->lock);
+	rc = vb2_dqbuf(&cx->q, &b, true);
+	mutex_unlock(&cx->lock);
+
+	return rc ? rc : b.index;
+}
+
+static int armcb_core_test_qbuf(struct armcb_core_test_ctx *cx,
+				unsigned int index)
+{
+	struct v4l2_plane planes[ARMCB_VB2_MAX_PLANES] = {};
+	struct v4l2_buffer b = {
+		.index = index,
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.memory = V4L2_MEMORY_MMAP,
+		.length = ARMCB_VB2_MAX_PLANES,
+		.m.planes = planes,
+	};
+	int rc = 0;
+
+	mutex_lock(&cx->lock);
+	rc = vb2_qbuf(&cx->q, NULL, &b);
+	mutex_unlock(&cx->lock);
+
+	return rc;
+}
+
+/* the order of armcb_v4l2_fop_release(): unpublish, release, deinit */
+static void armcb_core_test_teardown(struct armcb_core_test_ctx *cx)
+{
+	armcb_v4l2_stream_t *pstream = cx->stream;
+
+	if (!pstream)
+		return;
+
+	armcb_v4l2_set_outport(cx->dev, ISP_OUTPUT_PORT_VOUT1, NULL);
+	WRITE_ONCE(cx->dev->pstreams[0], NULL);
+
+	mutex_lock(&cx->lock);
+	destroy_buf_queue(&cx->q, VB2_BUF_STATE_ERROR);
+	vb2_queue_release(&cx->q);
+	mutex_unlock(&cx->lock);
+
+	armcb_v4l2_stream_deinit(pstream, cx->dev);
+	cx->stream = NULL;
+}
+
+static int armcb_core_test_ctx_init(struct kunit *test,
+				    struct armcb_core_test_ctx *cx,
+				    uint32_t ctx_id)
+{
+	struct v4l2_requestbuffers req = {
+		.count = ARMCB_CORE_TEST_BUFS,
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.memory = V4L2_MEMORY_MMAP,
+	};
+	unsigned int i = 0;
+
+	cx->dev = kzalloc(sizeof(*cx->dev), GFP_KERNEL);
+	if (!cx->dev)
+		return -ENOMEM;
+	cx->dev->ctx_id = ctx_id;
+	spin_lock_init(&cx->dev->outport_lock);
+	atomic_set(&cx->dev->opened, 1);
+	g_isp_v4l2_devs[ctx_id] = cx->dev;
+
+	cx->stream = armcb_core_test_stream(ctx_id);
+	if (!cx->stream)
+		return -ENOMEM;
+
+	mutex_init(&cx->lock);
+	KUNIT_ASSERT_EQ(test,
+			isp_vb2_queue_init(&cx->q, &cx->lock, cx->stream, NULL),
+			0);
+
+	mutex_lock(&cx->lock);
+	KUNIT_ASSERT_EQ(test, vb2_reqbufs(&cx->q, &req), 0);
+	mutex_unlock(&cx->lock);
+	KUNIT_ASSERT_EQ(test, req.count, ARMCB_CORE_TEST_BUFS);
+	for (i = 0; i < ARMCB_CORE_TEST_BUFS; i++)
+		KUNIT_ASSERT_EQ(test, armcb_core_test_qbuf(cx, i), 0);
+
+	mutex_lock(&cx->lock);
+	KUNIT_ASSERT_EQ(test, vb2_streamon(&cx->q, cx->q.type), 0);
+	mutex_unlock(&cx->lock);
+	armcb_v4l2_stream_on(cx->stream);
+
+	cx->dev->outport_bits[0] = cx->stream->outport;
+	cx->dev->pstreams[0] = cx->stream;
+	armcb_v4l2_set_outport(cx->dev, ISP_OUTPUT_PORT_VOUT1, cx->stream);
+
+	return 0;
+}
+
+static int armcb_core_test_init(struct kunit *test)
+{
+	struct armcb_core_test *t = NULL;
+	uint32_t ctx_id = 0;
+
+	for (ctx_id = 0; ctx_id < ARMCB_CORE_TEST_CTXS; ctx_id++) {
+		if (g_isp_v4l2_devs[ctx_id])
+			kunit_skip(test, "isp v4l2 devices registered");
+	}
+
+	t = kunit_kzalloc(test, sizeof(*t), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t);
+	t->regs = kunit_kzalloc(test, ARMCB_ISP_KUNIT_REG_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, t->regs);
+	KUNIT_ASSERT_EQ(test, armcb_kunit_mem_dev_get(&t->kdev), 0);
+	armcb_isp_kunit_regs = t->regs;
+	test->priv = t;
+
+	for (ctx_id = 0; ctx_id < ARMCB_CORE_TEST_CTXS; ctx_id++)
+		KUNIT_ASSERT_EQ(test,
+				armcb_core_test_ctx_init(test, &t->ctx[ctx_id],
+							 ctx_id),
+				0);
+
+	return 0;
+}
+
+static void armcb_core_test_exit(struct kunit *test)
+{
+	struct armcb_core_test *t = test->priv;
+	struct armcb_core_test_ctx *cx = NULL;
+	uint32_t ctx_id = 0;
+
+	if (!t)
+		return;
+
+	for (ctx_id = 0; ctx_id < ARMCB_CORE_TEST_CTXS; ctx_id++) {
+		cx = &t->ctx[ctx_id];
+		if (!cx->dev)
+			continue;
+		if (cx->q.ops)
+			armcb_core_test_teardown(cx);
+		else
+			kfree(cx->stream);
+		g_isp_v4l2_devs[ctx_id] = NULL;
+		kfree(cx->dev);
+	}
+
+	armcb_isp_kunit_regs = NULL;
+	armcb_kunit_mem_dev_put(&t->kdev);
+}
+
+/*
+ * One frame of every ctx, interleaved in a different order each time. A
+ * frame is done one sol after it was programmed, so ctx frame n completes
+ * the buffer of frame n - 1 and nothing on any other ctx.
+ */
+static void armcb_core_test_frame(struct kunit *test,
+				  struct armcb_core_test *t, unsigned int frame)
+{
+	struct armcb_core_test_ctx *cx = NULL;
+	struct vb2_buffer *vb = NULL;
+	uint32_t ctx_id = 0;
+	uint32_t other = 0;
+	unsigned int i = 0;
+	int index = 0;
+
+	for (i = 0; i < ARMCB_CORE_TEST_CTXS; i++) {
+		ctx_id = (frame + i) % ARMCB_CORE_TEST_CTXS;
+		cx = &t->ctx[ctx_id];
+
+		if (cx->stream) {
+			KUNIT_EXPECT_EQ(test,
+					armcb_v4l2_config_update_stream_hw_addr(
+						cx->stream),
+					0);
+			vb = vb2_get_buffer(&cx->q,
+					    cx->programmed % ARMCB_CORE_TEST_BUFS);
+			KUNIT_EXPECT_EQ(test,
+					armcb_isp_read_reg(I7_VOUT1_START_ADDR),
+					(u32)vb2_dma_contig_plane_dma_addr(vb, 0));
+			cx->programmed++;
+		}
+
+		/* a torn down ctx still gets its interrupts */
+		armcb_isp_put_frame(ctx_id, -1, ISP_OUTPUT_PORT_VOUT1);
+
+		for (other = 0; other < ARMCB_CORE_TEST_CTXS; other++) {
+			if (!t->ctx[other].stream)
+				continue;
+			index = armcb_core_test_dqbuf(&t->ctx[other]);
+			if (other != ctx_id || cx->programmed < 2) {
+				KUNIT_EXPECT_EQ(test, index, -EAGAIN);
+				continue;
+			}
+			KUNIT_EXPECT_EQ(test, index,
+					(int)(cx->done % ARMCB_CORE_TEST_BUFS));
+			if (index < 0)
+				continue;
+			cx->done++;
+			KUNIT_EXPECT_EQ(test, armcb_core_test_qbuf(cx, index), 0);
+		}
+	}
+}
+
+static void armcb_core_test_isolation(struct kunit *test)
+{
+	struct armcb_core_test *t = test->priv;
+	unsigned int frame = 0;
+	uint32_t ctx_id = 0;
+
+	for (frame = 0; frame < ARMCB_CORE_TEST_FRAMES; frame++)
+		armcb_core_test_frame(test, t, frame);
+
+	for (ctx_id = 0; ctx_id < ARMCB_CORE_TEST_CTXS; ctx_id++)
+		KUNIT_EXPECT_EQ(test, t->ctx[ctx_id].done,
+				ARMCB_CORE_TEST_FRAMES - 1U);
+}
+
+/* ctx 2 closes mid stream, its late interrupts find no stream to touch */
+static void armcb_core_test_teardown_midstream(struct kunit *test)
+{
+	struct armcb_core_test *t = test->priv;
+	unsigned int frame = 0;
+	uint32_t ctx_id = 0;
+
+	for (frame = 0; frame < ARMCB_CORE_TEST_FRAMES / 2; frame++)
+		armcb_core_test_frame(test, t, frame);
+
+	armcb_core_test_teardown(&t->ctx[2]);
+	KUNIT_EXPECT_NULL(test,
+			  armcb_v4l2_outport_stream(2, ISP_OUTPUT_PORT_VOUT1));
+
+	for (; frame < ARMCB_CORE_TEST_FRAMES; frame++)
+		armcb_core_test_frame(test, t, frame);
+
+	for (ctx_id = 0; ctx_id < ARMCB_CORE_TEST_CTXS; ctx_id++) {
+		KUNIT_EXPECT_EQ(test, t->ctx[ctx_id].done,
+				ctx_id == 2 ? ARMCB_CORE_TEST_FRAMES / 2 - 1U :
+					      ARMCB_CORE_TEST_FRAMES - 1U);
+	}
+}
+
+static struct kunit_case armcb_core_ctx_cases[] = {
+	KUNIT_CASE(armcb_core_test_isolation),
+	KUNIT_CASE(armcb_core_test_teardown_midstream),
+	{}
+};
+
+static struct kunit_suite armcb_core_ctx_suite = {
+	.name = "armcb_isp_ctx_isolation",
+	.init = armcb_core_test_init,
+	.exit = armcb_core_test_exit,
+	.test_cases = armcb_core_ctx_cases,
+};
+
+kunit_test_suites(&armcb_core_ctx_suite);
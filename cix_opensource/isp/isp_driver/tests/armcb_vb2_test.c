@@ -0,0 +1,439 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * KUnit tests of the vb2 queue ops, included at the end of armcb_vb2.c.
+ * The queue is the one the driver sets up for a stream, its buffers are
+ * allocated by vb2-dma-contig on a test device standing in for mem_dev.
+ *
+ * The expbuf suite plays a dummy importer: it takes the exported fd,
+ * attaches to the dma-buf and checks through its reservation object that
+ * the frame fence is pending while the buffer is queued and signalled by
+ * the buffer done of the simulated interrupt.
+ */
+
+#include <linux/fdtable.h>
+#include "armcb_isp_kunit.h"
+
+#define ARMCB_VB2_TEST_WIDTH 640
+#define ARMCB_VB2_TEST_HEIGHT 480
+#define ARMCB_VB2_TEST_BUFS 3
+#define ARMCB_VB2_TEST_LOOPS 16
+
+struct armcb_vb2_test_ctx {
+	struct armcb_kunit_dev kdev;
+	armcb_v4l2_stream_t stream;
+	struct vb2_queue q;
+	struct mutex lock;
+};
+
+static armcb_v4l2_buffer_t *armcb_vb2_test_buf(struct armcb_vb2_test_ctx *ctx,
+					       unsigned int index)
+{
+	struct vb2_buffer *vb = vb2_get_buffer(&ctx->q, index);
+
+	return container_of(to_vb2_v4l2_buffer(vb), armcb_v4l2_buffer_t, vvb);
+}
+
+static int armcb_vb2_test_reqbufs(struct armcb_vb2_test_ctx *ctx,
+				  unsigned int count)
+{
+	struct v4l2_requestbuffers req = {
+		.count = count,
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.memory = V4L2_MEMORY_MMAP,
+	};
+	int rc = 0;
+
+	mutex_lock(&ctx->lock);
+	rc = vb2_reqbufs(&ctx->q, &req);
+	mutex_unlock(&ctx->lock);
+
+	return rc ? rc : req.count;
+}
+
+static int armcb_vb2_test_qbuf(struct armcb_vb2_test_ctx *ctx,
+			       unsigned int index)
+{
+	struct v4l2_plane planes[ARMCB_VB2_MAX_PLANES] = {};
+	struct v4l2_buffer b = {
+		.index = index,
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.memory = V4L2_MEMORY_MMAP,
+		.length = ARMCB_VB2_MAX_PLANES,
+		.m.planes = planes,
+	};
+	int rc = 0;
+
+	mutex_lock(&ctx->lock);
+	rc = vb2_qbuf(&ctx->q, NULL, &b);
+	mutex_unlock(&ctx->lock);
+
+	return rc;
+}
+
+static int armcb_vb2_test_dqbuf(struct armcb_vb2_test_ctx *ctx)
+{
+	struct v4l2_plane planes[ARMCB_VB2_MAX_PLANES] = {};
+	struct v4l2_buffer b = {
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.memory = V4L2_MEMORY_MMAP,
+		.length = ARMCB_VB2_MAX_PLANES,
+		.m.planes = planes,
+	};
+	int rc = 0;
+
+	mutex_lock(&ctx->lock);
+	rc = vb2_dqbuf(&ctx->q, &b, true);
+	mutex_unlock(&ctx->lock);
+
+	return rc ? rc : b.index;
+}
+
+static int armcb_vb2_test_stream(struct armcb_vb2_test_ctx *ctx, bool on)
+{
+	int rc = 0;
+
+	mutex_lock(&ctx->lock);
+	if (on)
+		rc = vb2_streamon(&ctx->q, ctx->q.type);
+	else
+		rc = vb2_streamoff(&ctx->q, ctx->q.type);
+	mutex_unlock(&ctx->lock);
+
+	return rc;
+}
+
+/* what the ISP does with a queued buffer: take it and hand it back done */
+static armcb_v4l2_buffer_t *armcb_vb2_test_take(armcb_v4l2_stream_t *pstream)
+{
+	armcb_v4l2_buffer_t *buf = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pstream->slock, flags);
+	buf = list_first_entry_or_null(&pstream->stream_buffer_list,
+				       armcb_v4l2_buffer_t, list);
+	if (buf)
+		list_del(&buf->list);
+	spin_unlock_irqrestore(&pstream->slock, flags);
+
+	return buf;
+}
+
+static int armcb_vb2_test_init(struct kunit *test)
+{
+	struct armcb_vb2_test_ctx *ctx = NULL;
+	armcb_v4l2_stream_t *pstream = NULL;
+	struct v4l2_pix_format_mplane *pix = NULL;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx);
+	KUNIT_ASSERT_EQ(test, armcb_kunit_mem_dev_get(&ctx->kdev), 0);
+
+	pstream = &ctx->stream;
+	INIT_LIST_HEAD(&pstream->stream_buffer_list);
+	INIT_LIST_HEAD(&pstream->stream_buffer_list_busy);
+	spin_lock_init(&pstream->slock);
+	spin_lock_init(&pstream->fence_lock);
+	pstream->fence_ctx = dma_fence_context_alloc(1);
+
+	/* NV12, the luma plane then half as many chroma bytes */
+	pstream->cur_v4l2_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	pix = &pstream->cur_v4l2_fmt.fmt.pix_mp;
+	pix->width = ARMCB_VB2_TEST_WIDTH;
+	pix->height = ARMCB_VB2_TEST_HEIGHT;
+	pix->pixelformat = V4L2_PIX_FMT_NV12;
+	pix->num_planes = 2;
+	pix->plane_fmt[0].bytesperline = ARMCB_VB2_TEST_WIDTH;
+	pix->plane_fmt[0].sizeimage = ARMCB_VB2_TEST_WIDTH * ARMCB_VB2_TEST_HEIGHT;
+	pix->plane_fmt[1].bytesperline = ARMCB_VB2_TEST_WIDTH;
+	pix->plane_fmt[1].sizeimage =
+		ARMCB_VB2_TEST_WIDTH * ARMCB_VB2_TEST_HEIGHT / 2;
+
+	mutex_init(&ctx->lock);
+	test->priv = ctx;
+	KUNIT_ASSERT_EQ(test,
+			isp_vb2_queue_init(&ctx->q, &ctx->lock, pstream, NULL),
+			0);
+
+	return 0;
+}
+
+static void armcb_vb2_test_exit(struct kunit *test)
+{
+	struct armcb_vb2_test_ctx *ctx = test->priv;
+
+	if (!ctx)
+		return;
+
+	if (ctx->q.ops) {
+		mutex_lock(&ctx->lock);
+		vb2_queue_release(&ctx->q);
+		mutex_unlock(&ctx->lock);
+	}
+	armcb_kunit_mem_dev_put(&ctx->kdev);
+}
+
+/* buf_init builds the tables once, buffer done cycles reuse them */
+static void armcb_vb2_test_sgt_built_once(struct kunit *test)
+{
+	struct armcb_vb2_test_ctx *ctx = test->priv;
+	struct v4l2_pix_format_mplane *pix = &ctx->stream.cur_v4l2_fmt.fmt.pix_mp;
+	struct scatterlist *sgl[ARMCB_VB2_TEST_BUFS][ARMCB_VB2_MAX_PLANES];
+	armcb_v4l2_buffer_t *buf = NULL;
+	int live = armcb_vb2_sgt_live();
+	unsigned int i = 0;
+	unsigned int p = 0;
+	int loop = 0;
+
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_reqbufs(ctx, ARMCB_VB2_TEST_BUFS),
+			ARMCB_VB2_TEST_BUFS);
+	KUNIT_EXPECT_EQ(test, armcb_vb2_sgt_live(),
+			live + ARMCB_VB2_TEST_BUFS * 2);
+
+	for (i = 0; i < ARMCB_VB2_TEST_BUFS; i++) {
+		buf = armcb_vb2_test_buf(ctx, i);
+		KUNIT_ASSERT_EQ(test, buf->sgt_num, 2U);
+		KUNIT_EXPECT_EQ(test, buf->sync_bytes,
+				(size_t)pix->plane_fmt[0].sizeimage +
+					pix->plane_fmt[1].sizeimage);
+		for (p = 0; p < 2; p++) {
+			KUNIT_EXPECT_GT(test, buf->sgt[p].orig_nents, 0U);
+			sgl[i][p] = buf->sgt[p].sgl;
+		}
+	}
+
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_stream(ctx, true), 0);
+	for (loop = 0; loop < ARMCB_VB2_TEST_LOOPS; loop++) {
+		for (i = 0; i < ARMCB_VB2_TEST_BUFS; i++)
+			KUNIT_ASSERT_EQ(test, armcb_vb2_test_qbuf(ctx, i), 0);
+		while ((buf = armcb_vb2_test_take(&ctx->stream)))
+			armcb_vb2_buffer_done(buf, VB2_BUF_STATE_DONE);
+		for (i = 0; i < ARMCB_VB2_TEST_BUFS; i++)
+			KUNIT_ASSERT_GE(test, armcb_vb2_test_dqbuf(ctx), 0);
+	}
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_stream(ctx, false), 0);
+
+	for (i = 0; i < ARMCB_VB2_TEST_BUFS; i++) {
+		buf = armcb_vb2_test_buf(ctx, i);
+		KUNIT_EXPECT_EQ(test, buf->sgt_num, 2U);
+		for (p = 0; p < 2; p++)
+			KUNIT_EXPECT_PTR_EQ(test, buf->sgt[p].sgl, sgl[i][p]);
+	}
+	KUNIT_EXPECT_EQ(test, armcb_vb2_sgt_live(),
+			live + ARMCB_VB2_TEST_BUFS * 2);
+}
+
+/* every table built by buf_init is freed by buf_cleanup */
+static void armcb_vb2_test_sgt_no_leak(struct kunit *test)
+{
+	struct armcb_vb2_test_ctx *ctx = test->priv;
+	int live = armcb_vb2_sgt_live();
+	int loop = 0;
+
+	for (loop = 0; loop < ARMCB_VB2_TEST_LOOPS; loop++) {
+		KUNIT_ASSERT_EQ(test,
+				armcb_vb2_test_reqbufs(ctx, ARMCB_VB2_TEST_BUFS),
+				ARMCB_VB2_TEST_BUFS);
+		KUNIT_ASSERT_EQ(test, armcb_vb2_test_reqbufs(ctx, 0), 0);
+		KUNIT_ASSERT_EQ(test, armcb_vb2_sgt_live(), live);
+	}
+}
+
+/* a cleanup on its own, e.g. on a failed buf_init, leaves nothing behind */
+static void armcb_vb2_test_sgt_cleanup_twice(struct kunit *test)
+{
+	struct armcb_vb2_test_ctx *ctx = test->priv;
+	armcb_v4l2_buffer_t *buf = NULL;
+	int live = armcb_vb2_sgt_live();
+
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_reqbufs(ctx, 1), 1);
+	buf = armcb_vb2_test_buf(ctx, 0);
+
+	armcb_vb2_buf_cleanup(&buf->vvb.vb2_buf);
+	KUNIT_EXPECT_EQ(test, buf->sgt_num, 0U);
+	KUNIT_EXPECT_EQ(test, buf->sync_bytes, (size_t)0);
+	KUNIT_EXPECT_EQ(test, armcb_vb2_sgt_live(), live);
+
+	/* vb2 calls it again when the buffer is freed */
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_reqbufs(ctx, 0), 0);
+	KUNIT_EXPECT_EQ(test, armcb_vb2_sgt_live(), live);
+}
+
+static struct kunit_case armcb_vb2_sgt_cases[] = {
+	KUNIT_CASE(armcb_vb2_test_sgt_built_once),
+	KUNIT_CASE(armcb_vb2_test_sgt_no_leak),
+	KUNIT_CASE(armcb_vb2_test_sgt_cleanup_twice),
+	{}
+};
+
+static struct kunit_suite armcb_vb2_sgt_suite = {
+	.name = "armcb_isp_vb2_sgt",
+	.init = armcb_vb2_test_init,
+	.exit = armcb_vb2_test_exit,
+	.test_cases = armcb_vb2_sgt_cases,
+};
+
+static int armcb_vb2_test_export(struct armcb_vb2_test_ctx *ctx,
+				 unsigned int index, unsigned int plane)
+{
+	struct v4l2_exportbuffer p = {
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.index = index,
+		.plane = plane,
+		.flags = O_CLOEXEC | O_RDWR,
+	};
+	int rc = 0;
+
+	mutex_lock(&ctx->lock);
+	rc = armcb_vb2_expbuf(&ctx->q, &p);
+	mutex_unlock(&ctx->lock);
+
+	return rc ? rc : p.fd;
+}
+
+/* what an importer honouring implicit sync looks at before reading */
+static bool armcb_vb2_test_signaled(struct dma_buf *dbuf)
+{
+#if (KERNEL_VERSION(5, 19, 0) <= LINUX_VERSION_CODE)
+	return dma_resv_test_signaled(dbuf->resv, DMA_RESV_USAGE_WRITE);
+#elif (KERNEL_VERSION(5, 14, 0) <= LINUX_VERSION_CODE)
+	return dma_resv_test_signaled(dbuf->resv, false);
+#else
+	return dma_resv_test_signaled_rcu(dbuf->resv, false);
+#endif
+}
+
+struct armcb_vb2_test_importer {
+	int fd;
+	struct dma_buf *dbuf;
+	struct dma_buf_attachment *attach;
+};
+
+static void armcb_vb2_test_import(struct kunit *test,
+				  struct armcb_vb2_test_ctx *ctx,
+				  struct armcb_vb2_test_importer *imp,
+				  unsigned int index, unsigned int plane)
+{
+	imp->fd = armcb_vb2_test_export(ctx, index, plane);
+	KUNIT_ASSERT_GE(test, imp->fd, 0);
+
+	imp->dbuf = dma_buf_get(imp->fd);
+	KUNIT_ASSERT_FALSE(test, IS_ERR(imp->dbuf));
+	imp->attach = dma_buf_attach(imp->dbuf, &ctx->kdev.pdev->dev);
+	KUNIT_ASSERT_FALSE(test, IS_ERR(imp->attach));
+
+	/* the buffer keeps the same dma-buf to fence later frames on */
+	KUNIT_EXPECT_PTR_EQ(test, armcb_vb2_test_buf(ctx, index)->dbuf[plane],
+			    imp->dbuf);
+}
+
+static void armcb_vb2_test_unimport(struct armcb_vb2_test_importer *imp)
+{
+	dma_buf_detach(imp->dbuf, imp->attach);
+	dma_buf_put(imp->dbuf);
+	close_fd(imp->fd);
+}
+
+/* the buffer done of the isp wakes the importer of a queued buffer */
+static void armcb_vb2_test_expbuf_fence(struct kunit *test)
+{
+	struct armcb_vb2_test_ctx *ctx = test->priv;
+	struct armcb_vb2_test_importer imp = {};
+	armcb_v4l2_buffer_t *buf = NULL;
+
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_reqbufs(ctx, 1), 1);
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_stream(ctx, true), 0);
+	armcb_vb2_test_import(test, ctx, &imp, 0, 0);
+	KUNIT_EXPECT_TRUE(test, armcb_vb2_test_signaled(imp.dbuf));
+
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_qbuf(ctx, 0), 0);
+	KUNIT_EXPECT_FALSE(test, armcb_vb2_test_signaled(imp.dbuf));
+
+	buf = armcb_vb2_test_take(&ctx->stream);
+	KUNIT_ASSERT_NOT_NULL(test, buf);
+	armcb_vb2_buffer_done(buf, VB2_BUF_STATE_DONE);
+	KUNIT_EXPECT_TRUE(test, armcb_vb2_test_signaled(imp.dbuf));
+	KUNIT_EXPECT_EQ(test, armcb_vb2_test_dqbuf(ctx), 0);
+
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_stream(ctx, false), 0);
+	armcb_vb2_test_unimport(&imp);
+}
+
+/* exported while its frame is in flight: the new dma-buf gets the fence */
+static void armcb_vb2_test_expbuf_inflight(struct kunit *test)
+{
+	struct armcb_vb2_test_ctx *ctx = test->priv;
+	struct armcb_vb2_test_importer luma = {};
+	struct armcb_vb2_test_importer chroma = {};
+	armcb_v4l2_buffer_t *buf = NULL;
+
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_reqbufs(ctx, 1), 1);
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_stream(ctx, true), 0);
+	armcb_vb2_test_import(test, ctx, &luma, 0, 0);
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_qbuf(ctx, 0), 0);
+
+	armcb_vb2_test_import(test, ctx, &chroma, 0, 1);
+	KUNIT_EXPECT_FALSE(test, armcb_vb2_test_signaled(chroma.dbuf));
+
+	buf = armcb_vb2_test_take(&ctx->stream);
+	KUNIT_ASSERT_NOT_NULL(test, buf);
+	armcb_vb2_buffer_done(buf, VB2_BUF_STATE_DONE);
+	KUNIT_EXPECT_TRUE(test, armcb_vb2_test_signaled(luma.dbuf));
+	KUNIT_EXPECT_TRUE(test, armcb_vb2_test_signaled(chroma.dbuf));
+	KUNIT_EXPECT_EQ(test, armcb_vb2_test_dqbuf(ctx), 0);
+
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_stream(ctx, false), 0);
+	armcb_vb2_test_unimport(&chroma);
+	armcb_vb2_test_unimport(&luma);
+}
+
+/* requests vb2_expbuf() refuses are refused before an fd exists */
+static void armcb_vb2_test_expbuf_invalid(struct kunit *test)
+{
+	struct armcb_vb2_test_ctx *ctx = test->priv;
+	struct v4l2_exportbuffer p = {
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.flags = O_RDWR,
+	};
+
+	KUNIT_ASSERT_EQ(test, armcb_vb2_test_reqbufs(ctx, 1), 1);
+
+	p.plane = 2;
+	KUNIT_EXPECT_EQ(test, armcb_vb2_expbuf(&ctx->q, &p), -EINVAL);
+	p.plane = 0;
+	p.index = 1;
+	KUNIT_EXPECT_EQ(test, armcb_vb2_expbuf(&ctx->q, &p), -EINVAL);
+	p.index = 0;
+	p.flags = O_RDWR | O_NONBLOCK;
+	KUNIT_EXPECT_EQ(test, armcb_vb2_expbuf(&ctx->q, &p), -EINVAL);
+	KUNIT_EXPECT_NULL(test, armcb_vb2_test_buf(ctx, 0)->dbuf[0]);
+}
+
+static struct kunit_case armcb_vb2_expbuf_cases[] = {
+	KUNIT_CASE(armcb_vb2_test_expbuf_fence),
+	KUNIT_CASE(armcb_vb2_test_expbuf_inflight),
+	KUNIT_CASE(armcb_vb2_test_expbuf_invalid),
+	{}
+};
+
+static struct kunit_suite armcb_vb2_expbuf_suite = {
+	.name = "armcb_isp_vb2_expbuf",
+	.init = armcb_vb2_test_init,
+	.exit = armcb_vb2_test_exit,
+	.test_cases = armcb_vb2_expbuf_cases,
+};
+
+kunit_test_suites(&armcb_vb2_sgt_suite, &armcb_vb2_expbuf_suite);
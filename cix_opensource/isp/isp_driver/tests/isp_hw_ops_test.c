@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * KUnit tests and benchmark of the AHB dispatch table, included at the end
+ * of isp_hw_ops.c. The benchmark replays a 5k entry write list and reports
+ * ns per register for the lookup, the batched apply and the one register
+ * at a time accessor it replaced.
+ */
+
+#include "armcb_isp_kunit.h"
+
+#define ISP_HW_OPS_TEST_BENCH_REGS 5000
+#define ISP_HW_OPS_TEST_BENCH_REG (ISP_REG_BASE + I7_INT_MASK_ADDR)
+
+/* every entry is found by its own bounds, the rest goes to the isp block */
+static void isp_hw_ops_test_lookup(struct kunit *test)
+{
+	const struct armcb_ahb_range *range = NULL;
+	unsigned int i = 0;
+
+	for (i = 0; i < ARRAY_SIZE(armcb_ahb_ranges); i++) {
+		range = &armcb_ahb_ranges[i];
+		if (i)
+			KUNIT_EXPECT_GT(test, range->base, range[-1].end);
+		KUNIT_EXPECT_PTR_EQ(test, armcb_ahb_lookup(range->base), range);
+		KUNIT_EXPECT_PTR_EQ(test, armcb_ahb_lookup(range->end), range);
+	}
+
+	if (armcb_ahb_ranges[0].base) {
+		KUNIT_EXPECT_PTR_EQ(test,
+				    armcb_ahb_lookup(armcb_ahb_ranges[0].base - 1),
+				    &armcb_ahb_isp_range);
+	}
+}
+
+static bool isp_hw_ops_test_bus_ready(void)
+{
+#ifdef ARMCB_ISP_SW_MODEL
+	return true;
+#else
+	return armcb_isp_get_reg_base() != NULL;
+#endif
+}
+
+static s64 isp_hw_ops_test_ns_per_reg(ktime_t start)
+{
+	return ktime_to_ns(ktime_sub(ktime_get(), start)) /
+	       ISP_HW_OPS_TEST_BENCH_REGS;
+}
+
+/* each entry writes back the current value of the interrupt mask */
+static void isp_hw_ops_test_bench(struct kunit *test)
+{
+	const struct armcb_ahb_range *range = NULL;
+	struct cmd_ahb_setting *settings = NULL;
+	unsigned long hits = 0;
+	ktime_t ktime = 0;
+	unsigned int i = 0;
+	u32 addr = 0;
+	u32 val = 0;
+
+	settings = kunit_kcalloc(test, ISP_HW_OPS_TEST_BENCH_REGS,
+				 sizeof(*settings), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, settings);
+
+	/// lookup, spread over every range of the table
+	ktime = ktime_get();
+	for (i = 0; i < ISP_HW_OPS_TEST_BENCH_REGS; i++) {
+		addr = armcb_ahb_ranges[i % ARRAY_SIZE(armcb_ahb_ranges)].base;
+		range = armcb_ahb_lookup(addr + ((i & 0xff) << 2));
+		hits += range->iomem != NULL;
+	}
+	kunit_info(test, "lookup %lld ns/register (%lu mapped)\n",
+		   isp_hw_ops_test_ns_per_reg(ktime), hits);
+
+	if (!isp_hw_ops_test_bus_ready())
+		kunit_skip(test, "isp block not mapped");
+
+	range = armcb_ahb_lookup(ISP_HW_OPS_TEST_BENCH_REG);
+	settings[0].reg_addr = ISP_HW_OPS_TEST_BENCH_REG;
+	KUNIT_ASSERT_TRUE(test, armcb_ahb_read(&settings[0], &val));
+
+	for (i = 0; i < ISP_HW_OPS_TEST_BENCH_REGS; i++) {
+		settings[i].direct = DRV_DIRECTION_WRITE;
+		settings[i].reg_addr = ISP_HW_OPS_TEST_BENCH_REG;
+		settings[i].val = val;
+	}
+
+	ktime = ktime_get();
+	KUNIT_EXPECT_EQ(test,
+			armcb_ahb_apply_settings(settings,
+						 ISP_HW_OPS_TEST_BENCH_REGS),
+			0);
+	kunit_info(test, "apply %lld ns/register\n",
+		   isp_hw_ops_test_ns_per_reg(ktime));
+
+	ktime = ktime_get();
+	for (i = 0; i < ISP_HW_OPS_TEST_BENCH_REGS; i++)
+		range->write(settings[i].reg_addr - range->sub, settings[i].val);
+	kunit_info(test, "single write %lld ns/register\n",
+		   isp_hw_ops_test_ns_per_reg(ktime));
+
+	KUNIT_EXPECT_EQ(test, range->read(ISP_HW_OPS_TEST_BENCH_REG - range->sub),
+			val);
+}
+
+static struct kunit_case isp_hw_ops_ahb_cases[] = {
+	KUNIT_CASE(isp_hw_ops_test_lookup),
+	KUNIT_CASE(isp_hw_ops_test_bench),
+	{}
+};
+
+static struct kunit_suite isp_hw_ops_ahb_suite = {
+	.name = "armcb_isp_ahb_dispatch",
+	.test_cases = isp_hw_ops_ahb_cases,
+};
+
+kunit_test_suites(&isp_hw_ops_ahb_suite);
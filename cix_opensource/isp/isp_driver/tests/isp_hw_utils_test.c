@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * KUnit tests of the I2C burst writer, included at the end of
+ * isp_hw_utils.c. The sensor sits on a fake adapter that records every
+ * message of every i2c_transfer() instead of driving a bus.
+ */
+
+#include "armcb_isp_kunit.h"
+
+#define ISP_HW_UTILS_TEST_SLAVE 0x1a
+#define ISP_HW_UTILS_TEST_MSGS_MAX 128
+#define ISP_HW_UTILS_TEST_REGS 64
+
+struct isp_hw_utils_test_msg {
+	u16 addr;
+	u16 len;
+	unsigned int xfer; /// index of the i2c_transfer() carrying it
+	u8 buf[ARMCN_I2CSEND_BUFLENS_MAX];
+};
+
+struct isp_hw_utils_test_ctx {
+	struct i2c_adapter adap;
+	struct i2c_adapter_quirks quirks;
+	struct i2c_client client;
+	struct cmd_i2c_setting regs[ISP_HW_UTILS_TEST_REGS];
+
+	struct isp_hw_utils_test_msg msgs[ISP_HW_UTILS_TEST_MSGS_MAX];
+	unsigned int nmsgs;
+	unsigned int nxfers;
+	int fail_xfer; /// transfer failing with -EIO, -1 for none
+};
+
+static int isp_hw_utils_test_xfer(struct i2c_adapter *adap,
+				  struct i2c_msg *msgs, int num)
+{
+	struct isp_hw_utils_test_ctx *ctx = i2c_get_adapdata(adap);
+	struct isp_hw_utils_test_msg *rec = NULL;
+	int i = 0;
+
+	if (ctx->nxfers == ctx->fail_xfer)
+		return -EIO;
+
+	for (i = 0; i < num; i++) {
+		if (ctx->nmsgs == ISP_HW_UTILS_TEST_MSGS_MAX)
+			return -ENOSPC;
+
+		rec = &ctx->msgs[ctx->nmsgs++];
+		rec->addr = msgs[i].addr;
+		rec->len = msgs[i].len;
+		rec->xfer = ctx->nxfers;
+		memcpy(rec->buf, msgs[i].buf,
+		       min_t(u16, msgs[i].len, sizeof(rec->buf)));
+	}
+	ctx->nxfers++;
+
+	return num;
+}
+
+static u32 isp_hw_utils_test_func(struct i2c_adapter *adap)
+{
+	return I2C_FUNC_I2C;
+}
+
+static const struct i2c_algorithm isp_hw_utils_test_algo = {
+	.master_xfer = isp_hw_utils_test_xfer,
+	.functionality = isp_hw_utils_test_func,
+};
+
+/* @count byte registers with 16 bit addresses from @reg, data = index */
+static void isp_hw_utils_test_fill(struct isp_hw_utils_test_ctx *ctx,
+				   unsigned int first, unsigned int count,
+				   unsigned int reg)
+{
+	struct cmd_i2c_setting *s = NULL;
+	unsigned int i = 0;
+
+	for (i = first; i < first + count; i++) {
+		s = &ctx->regs[i];
+		s->slave_addr = ISP_HW_UTILS_TEST_SLAVE;
+		s->direct = DRV_DIRECTION_WRITE;
+		s->reg_addr_type = DRV_ADDR_TYPE_WORD;
+		s->reg_data_type = DRV_DATA_TYPE_BYTE;
+		s->reg_addr = reg + i - first;
+		s->val = i & 0xff;
+	}
+}
+
+static int isp_hw_utils_test_init(struct kunit *test)
+{
+	struct isp_hw_utils_test_ctx *ctx = NULL;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx);
+
+	ctx->fail_xfer = -1;
+	ctx->adap.owner = THIS_MODULE;
+	ctx->adap.algo = &isp_hw_utils_test_algo;
+	ctx->adap.quirks = &ctx->quirks;
+	strscpy(ctx->adap.name, "armcb-isp-kunit", sizeof(ctx->adap.name));
+	i2c_set_adapdata(&ctx->adap, ctx);
+	KUNIT_ASSERT_EQ(test, i2c_add_adapter(&ctx->adap), 0);
+
+	ctx->client.adapter = &ctx->adap;
+	test->priv = ctx;
+
+	return 0;
+}
+
+static void isp_hw_utils_test_exit(struct kunit *test)
+{
+	struct isp_hw_utils_test_ctx *ctx = test->priv;
+
+	if (ctx)
+		i2c_del_adapter(&ctx->adap);
+}
+
+/* a run is split every max_burst data bytes, all in one transfer */
+static void isp_hw_utils_test_burst_boundaries(struct kunit *test)
+{
+	struct isp_hw_utils_test_ctx *ctx = test->priv;
+	struct armcb_i2c_burst_stats stats = { 0 };
+	static const u8 first[] = { 0x30, 0x00, 0x00, 0x01, 0x02, 0x03 };
+	static const u8 last[] = { 0x30, 0x08, 0x08, 0x09 };
+
+	isp_hw_utils_test_fill(ctx, 0, 10, 0x3000);
+	KUNIT_ASSERT_EQ(test,
+			armcb_i2c_burst_write(&ctx->client, ctx->regs, 10, 4,
+					      &stats),
+			0);
+
+	KUNIT_ASSERT_EQ(test, ctx->nmsgs, 3U);
+	KUNIT_EXPECT_EQ(test, ctx->nxfers, 1U);
+	KUNIT_EXPECT_EQ(test, stats.msgs, 3U);
+	KUNIT_EXPECT_EQ(test, stats.xfers, 1U);
+
+	KUNIT_EXPECT_EQ(test, ctx->msgs[0].addr, ISP_HW_UTILS_TEST_SLAVE);
+	KUNIT_EXPECT_EQ(test, ctx->msgs[0].len, (u16)sizeof(first));
+	KUNIT_EXPECT_EQ(test, memcmp(ctx->msgs[0].buf, first, sizeof(first)), 0);
+	KUNIT_EXPECT_EQ(test, ctx->msgs[1].len, (u16)6);
+	KUNIT_EXPECT_EQ(test, ctx->msgs[1].buf[1], (u8)0x04);
+	KUNIT_EXPECT_EQ(test, ctx->msgs[2].len, (u16)sizeof(last));
+	KUNIT_EXPECT_EQ(test, memcmp(ctx->msgs[2].buf, last, sizeof(last)), 0);
+	KUNIT_EXPECT_EQ(test, ctx->client.addr, ISP_HW_UTILS_TEST_SLAVE);
+}
+
+/* gaps, other slaves and other widths start a new message */
+static void isp_hw_utils_test_burst_breaks(struct kunit *test)
+{
+	struct isp_hw_utils_test_ctx *ctx = test->priv;
+
+	isp_hw_utils_test_fill(ctx, 0, 3, 0x3000);
+	isp_hw_utils_test_fill(ctx, 3, 2, 0x3010);
+	isp_hw_utils_test_fill(ctx, 5, 2, 0x3012);
+	ctx->regs[5].slave_addr = ISP_HW_UTILS_TEST_SLAVE + 1;
+	ctx->regs[6].slave_addr = ISP_HW_UTILS_TEST_SLAVE + 1;
+	isp_hw_utils_test_fill(ctx, 7, 1, 0x3014);
+	ctx->regs[7].reg_data_type = DRV_DATA_TYPE_WORD;
+	ctx->regs[7].val = 0xbeef;
+
+	KUNIT_ASSERT_EQ(test,
+			armcb_i2c_burst_write(&ctx->client, ctx->regs, 8, 64,
+					      NULL),
+			0);
+
+	KUNIT_ASSERT_EQ(test, ctx->nmsgs, 4U);
+	KUNIT_EXPECT_EQ(test, ctx->nxfers, 1U);
+	KUNIT_EXPECT_EQ(test, ctx->msgs[0].len, (u16)(2 + 3));
+	KUNIT_EXPECT_EQ(test, ctx->msgs[1].len, (u16)(2 + 2));
+	KUNIT_EXPECT_EQ(test, ctx->msgs[1].buf[1], (u8)0x10);
+	KUNIT_EXPECT_EQ(test, ctx->msgs[2].addr, ISP_HW_UTILS_TEST_SLAVE + 1);
+	KUNIT_EXPECT_EQ(test, ctx->msgs[2].len, (u16)(2 + 2));
+	KUNIT_EXPECT_EQ(test, ctx->msgs[3].len, (u16)(2 + 2));
+	KUNIT_EXPECT_EQ(test, ctx->msgs[3].buf[2], (u8)0xbe);
+	KUNIT_EXPECT_EQ(test, ctx->msgs[3].buf[3], (u8)0xef);
+}
+
+/* max_burst 0 keeps one register per message, still packed in transfers */
+static void isp_hw_utils_test_no_burst(struct kunit *test)
+{
+	struct isp_hw_utils_test_ctx *ctx = test->priv;
+	struct armcb_i2c_burst_stats stats = { 0 };
+	unsigned int count = ARMCB_I2C_XFER_MSGS_MAX + 1;
+	unsigned int i = 0;
+
+	isp_hw_utils_test_fill(ctx, 0, count, 0x0100);
+	KUNIT_ASSERT_EQ(test,
+			armcb_i2c_burst_write(&ctx->client, ctx->regs, count, 0,
+					      &stats),
+			0);
+
+	KUNIT_ASSERT_EQ(test, ctx->nmsgs, count);
+	KUNIT_EXPECT_EQ(test, stats.xfers, 2U);
+	for (i = 0; i < count; i++) {
+		KUNIT_EXPECT_EQ(test, ctx->msgs[i].len, (u16)3);
+		KUNIT_EXPECT_EQ(test, ctx->msgs[i].xfer,
+				i < ARMCB_I2C_XFER_MSGS_MAX ? 0U : 1U);
+	}
+}
+
+/* adapter quirks bound the message length and the messages per transfer */
+static void isp_hw_utils_test_quirks(struct kunit *test)
+{
+	struct isp_hw_utils_test_ctx *ctx = test->priv;
+	unsigned int i = 0;
+
+	ctx->quirks.max_write_len = 2 + 3;
+	ctx->quirks.flags = I2C_AQ_NO_REP_START;
+
+	isp_hw_utils_test_fill(ctx, 0, 8, 0x2000);
+	KUNIT_ASSERT_EQ(test,
+			armcb_i2c_burst_write(&ctx->client, ctx->regs, 8, 64,
+					      NULL),
+			0);
+
+	KUNIT_ASSERT_EQ(test, ctx->nmsgs, 3U);
+	KUNIT_EXPECT_EQ(test, ctx->nxfers, 3U);
+	for (i = 0; i < ctx->nmsgs; i++) {
+		KUNIT_EXPECT_LE(test, ctx->msgs[i].len, (u16)5);
+		KUNIT_EXPECT_EQ(test, ctx->msgs[i].xfer, i);
+	}
+	KUNIT_EXPECT_EQ(test, ctx->msgs[2].len, (u16)(2 + 2));
+}
+
+/* a failed transfer stops the writer and is reported */
+static void isp_hw_utils_test_xfer_error(struct kunit *test)
+{
+	struct isp_hw_utils_test_ctx *ctx = test->priv;
+	struct armcb_i2c_burst_stats stats = { 0 };
+
+	ctx->quirks.max_num_msgs = 1;
+	ctx->fail_xfer = 1;
+
+	isp_hw_utils_test_fill(ctx, 0, 4, 0x0000);
+	KUNIT_EXPECT_EQ(test,
+			armcb_i2c_burst_write(&ctx->client, ctx->regs, 4, 0,
+					      &stats),
+			-EIO);
+	KUNIT_EXPECT_EQ(test, ctx->nmsgs, 1U);
+	KUNIT_EXPECT_EQ(test, stats.xfers, 1U);
+}
+
+static struct kunit_case isp_hw_utils_burst_cases[] = {
+	KUNIT_CASE(isp_hw_utils_test_burst_boundaries),
+	KUNIT_CASE(isp_hw_utils_test_burst_breaks),
+	KUNIT_CASE(isp_hw_utils_test_no_burst),
+	KUNIT_CASE(isp_hw_utils_test_quirks),
+	KUNIT_CASE(isp_hw_utils_test_xfer_error),
+	{}
+};
+
+static struct kunit_suite isp_hw_utils_burst_suite = {
+	.name = "armcb_isp_i2c_burst",
+	.init = isp_hw_utils_test_init,
+	.exit = isp_hw_utils_test_exit,
+	.test_cases = isp_hw_utils_burst_cases,
+};
+
+kunit_test_suites(&isp_hw_utils_burst_suite);
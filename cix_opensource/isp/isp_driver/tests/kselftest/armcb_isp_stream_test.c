@@ -0,0 +1,428 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * Stream a capture node at 30, 60 and 120 fps and report, per rate, the
+ * frames lost between two dequeues and the latency from the buffer done
+ * interrupt to the dequeue. The driver stamps a buffer with the monotonic
+ * clock in its irq thread, so the latency is the dequeue time minus the
+ * buffer timestamp. A lost frame shows up as a timestamp gap of more than
+ * one frame period.
+ *
+ * The rate is set through sw_model_fps, so the test needs a module built
+ * with CONFIG_ARMCB_ISP_SW_MODEL=y; on a sensor the rates are skipped.
+ * Output is TAP, as for the kernel selftests.
+ *
+ * usage: armcb_isp_stream_test [-d /dev/videoN] [-s seconds] [-m max drop %]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+#define STREAM_TEST_FPS_PARAM \
+	"/sys/module/armcb_isp_v4l2/parameters/sw_model_fps"
+#define STREAM_TEST_BUFS 4
+#define STREAM_TEST_WIDTH 1280
+#define STREAM_TEST_HEIGHT 720
+#define STREAM_TEST_LAT_BUCKETS 64
+
+static const unsigned int stream_test_rates[] = { 30, 60, 120 };
+
+struct stream_test_buf {
+	void *addr[VIDEO_MAX_PLANES];
+	size_t len[VIDEO_MAX_PLANES];
+};
+
+struct stream_test_result {
+	unsigned int frames;
+	unsigned int dropped;
+	uint64_t lat_sum_us;
+	uint64_t lat_max_us;
+	/* log2 buckets in us, for the 99th percentile */
+	unsigned int lat_hist[STREAM_TEST_LAT_BUCKETS];
+};
+
+struct stream_test {
+	const char *node;
+	int fd;
+	unsigned int seconds;
+	unsigned int max_drop_pct;
+	unsigned int num_planes;
+	struct stream_test_buf bufs[STREAM_TEST_BUFS];
+	unsigned int nbufs;
+};
+
+static int stream_test_ioctl(int fd, unsigned long req, void *arg)
+{
+	int ret = 0;
+
+	do {
+		ret = ioctl(fd, req, arg);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret;
+}
+
+static uint64_t stream_test_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int stream_test_set_fps(unsigned int fps)
+{
+	FILE *f = fopen(STREAM_TEST_FPS_PARAM, "w");
+	int ret = 0;
+
+	if (!f)
+		return -errno;
+
+	if (fprintf(f, "%u\n", fps) < 0)
+		ret = -EIO;
+	if (fclose(f))
+		ret = -errno;
+
+	return ret;
+}
+
+static int stream_test_get_fps(unsigned int *fps)
+{
+	FILE *f = fopen(STREAM_TEST_FPS_PARAM, "r");
+	int ret = 0;
+
+	if (!f)
+		return -errno;
+
+	if (fscanf(f, "%u", fps) != 1)
+		ret = -EIO;
+	fclose(f);
+
+	return ret;
+}
+
+/* keep the format userspace negotiated, or fall back to 720p NV12 */
+static int stream_test_format(struct stream_test *t)
+{
+	struct v4l2_format fmt = {
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+	};
+
+	if (stream_test_ioctl(t->fd, VIDIOC_G_FMT, &fmt) < 0)
+		return -errno;
+
+	if (!fmt.fmt.pix_mp.width || !fmt.fmt.pix_mp.height ||
+	    !fmt.fmt.pix_mp.pixelformat) {
+		memset(&fmt.fmt.pix_mp, 0, sizeof(fmt.fmt.pix_mp));
+		fmt.fmt.pix_mp.width = STREAM_TEST_WIDTH;
+		fmt.fmt.pix_mp.height = STREAM_TEST_HEIGHT;
+		fmt.fmt.pix_mp.pixelformat = V4L2_PIX_FMT_NV12;
+		fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+		if (stream_test_ioctl(t->fd, VIDIOC_S_FMT, &fmt) < 0)
+			return -errno;
+	}
+
+	t->num_planes = fmt.fmt.pix_mp.num_planes;
+	if (!t->num_planes || t->num_planes > VIDEO_MAX_PLANES)
+		return -EINVAL;
+
+	return 0;
+}
+
+static void stream_test_unmap(struct stream_test *t)
+{
+	struct v4l2_requestbuffers req = {
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.memory = V4L2_MEMORY_MMAP,
+	};
+	unsigned int i = 0;
+	unsigned int p = 0;
+
+	for (i = 0; i < t->nbufs; i++) {
+		for (p = 0; p < t->num_planes; p++) {
+			if (t->bufs[i].addr[p])
+				munmap(t->bufs[i].addr[p], t->bufs[i].len[p]);
+		}
+	}
+	memset(t->bufs, 0, sizeof(t->bufs));
+	t->nbufs = 0;
+
+	stream_test_ioctl(t->fd, VIDIOC_REQBUFS, &req);
+}
+
+static int stream_test_queue(struct stream_test *t, unsigned int index)
+{
+	struct v4l2_plane planes[VIDEO_MAX_PLANES] = {};
+	struct v4l2_buffer buf = {
+		.index = index,
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.memory = V4L2_MEMORY_MMAP,
+		.length = t->num_planes,
+		.m.planes = planes,
+	};
+
+	return stream_test_ioctl(t->fd, VIDIOC_QBUF, &buf) < 0 ? -errno : 0;
+}
+
+static int stream_test_map(struct stream_test *t)
+{
+	struct v4l2_requestbuffers req = {
+		.count = STREAM_TEST_BUFS,
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.memory = V4L2_MEMORY_MMAP,
+	};
+	struct v4l2_plane planes[VIDEO_MAX_PLANES] = {};
+	struct v4l2_buffer buf = {
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.memory = V4L2_MEMORY_MMAP,
+		.m.planes = planes,
+	};
+	unsigned int i = 0;
+	unsigned int p = 0;
+	void *addr = NULL;
+
+	if (stream_test_ioctl(t->fd, VIDIOC_REQBUFS, &req) < 0)
+		return -errno;
+	if (!req.count)
+		return -ENOMEM;
+
+	for (i = 0; i < req.count && i < STREAM_TEST_BUFS; i++) {
+		buf.index = i;
+		buf.length = t->num_planes;
+		if (stream_test_ioctl(t->fd, VIDIOC_QUERYBUF, &buf) < 0)
+			return -errno;
+
+		t->nbufs++;
+		for (p = 0; p < t->num_planes; p++) {
+			addr = mmap(NULL, planes[p].length,
+				    PROT_READ | PROT_WRITE, MAP_SHARED, t->fd,
+				    planes[p].m.mem_offset);
+			if (addr == MAP_FAILED)
+				return -errno;
+			t->bufs[i].addr[p] = addr;
+			t->bufs[i].len[p] = planes[p].length;
+		}
+
+		if (stream_test_queue(t, i))
+			return -errno;
+	}
+
+	return 0;
+}
+
+static unsigned int stream_test_p99_us(const struct stream_test_result *r)
+{
+	unsigned int want = r->frames - r->frames / 100;
+	unsigned int seen = 0;
+	int i = 0;
+
+	for (i = 0; i < STREAM_TEST_LAT_BUCKETS; i++) {
+		seen += r->lat_hist[i];
+		if (seen >= want)
+			return i ? 1U << i : 1;
+	}
+
+	return 0;
+}
+
+static void stream_test_account(struct stream_test_result *r,
+				uint64_t *last_ts_us, uint64_t ts_us,
+				uint64_t now_us, uint64_t period_us)
+{
+	uint64_t lat_us = now_us > ts_us ? now_us - ts_us : 0;
+	int bucket = lat_us ? 64 - __builtin_clzll(lat_us) : 0;
+
+	if (bucket >= STREAM_TEST_LAT_BUCKETS)
+		bucket = STREAM_TEST_LAT_BUCKETS - 1;
+	r->lat_hist[bucket]++;
+	r->lat_sum_us += lat_us;
+	if (lat_us > r->lat_max_us)
+		r->lat_max_us = lat_us;
+
+	/* frames the queue ran dry for land in the scratch buffer */
+	if (*last_ts_us && ts_us > *last_ts_us)
+		r->dropped += (ts_us - *last_ts_us + period_us / 2) /
+				      period_us -
+			      1;
+	*last_ts_us = ts_us;
+	r->frames++;
+}
+
+static int stream_test_run(struct stream_test *t, unsigned int fps,
+			   struct stream_test_result *r)
+{
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES] = {};
+	struct v4l2_buffer buf = {
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		.memory = V4L2_MEMORY_MMAP,
+		.m.planes = planes,
+	};
+	struct pollfd pfd = { .fd = t->fd, .events = POLLIN };
+	uint64_t period_us = 1000000 / fps;
+	uint64_t end_us = 0;
+	uint64_t last_ts_us = 0;
+	uint64_t ts_us = 0;
+	int ret = 0;
+
+	memset(r, 0, sizeof(*r));
+
+	ret = stream_test_map(t);
+	if (ret)
+		goto unmap;
+
+	if (stream_test_ioctl(t->fd, VIDIOC_STREAMON, &type) < 0) {
+		ret = -errno;
+		goto unmap;
+	}
+
+	end_us = stream_test_now_us() + (uint64_t)t->seconds * 1000000;
+	while (stream_test_now_us() < end_us) {
+		ret = poll(&pfd, 1, 1000);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			ret = ret ? -errno : -ETIMEDOUT;
+			break;
+		}
+
+		buf.length = t->num_planes;
+		if (stream_test_ioctl(t->fd, VIDIOC_DQBUF, &buf) < 0) {
+			ret = -errno;
+			break;
+		}
+
+		ts_us = (uint64_t)buf.timestamp.tv_sec * 1000000 +
+			buf.timestamp.tv_usec;
+		stream_test_account(r, &last_ts_us, ts_us, stream_test_now_us(),
+				    period_us);
+
+		ret = stream_test_queue(t, buf.index);
+		if (ret)
+			break;
+	}
+
+	stream_test_ioctl(t->fd, VIDIOC_STREAMOFF, &type);
+unmap:
+	stream_test_unmap(t);
+
+	return ret;
+}
+
+static void stream_test_usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-d /dev/videoN] [-s seconds] [-m max drop %%]\n",
+		prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct stream_test t = {
+		.node = "/dev/video9",
+		.seconds = 5,
+		.max_drop_pct = 1,
+	};
+	struct stream_test_result r;
+	unsigned int saved_fps = 0;
+	unsigned int fps = 0;
+	unsigned int i = 0;
+	int failed = 0;
+	int opt = 0;
+	int ret = 0;
+
+	while ((opt = getopt(argc, argv, "d:s:m:h")) != -1) {
+		switch (opt) {
+		case 'd':
+			t.node = optarg;
+			break;
+		case 's':
+			t.seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			t.max_drop_pct = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			stream_test_usage(argv[0]);
+			return opt == 'h' ? 0 : 2;
+		}
+	}
+
+	printf("TAP version 13\n");
+	printf("1..%zu\n", sizeof(stream_test_rates) / sizeof(stream_test_rates[0]));
+
+	t.fd = open(t.node, O_RDWR | O_NONBLOCK);
+	if (t.fd < 0) {
+		printf("# %s: %s\n", t.node, strerror(errno));
+		for (i = 0; i < sizeof(stream_test_rates) / sizeof(stream_test_rates[0]); i++)
+			printf("ok %u # SKIP %u fps, no capture node\n", i + 1,
+			       stream_test_rates[i]);
+		return 4;
+	}
+
+	ret = stream_test_format(&t);
+	if (ret) {
+		printf("Bail out! format: %s\n", strerror(-ret));
+		close(t.fd);
+		return 1;
+	}
+
+	ret = stream_test_get_fps(&saved_fps);
+	for (i = 0; i < sizeof(stream_test_rates) / sizeof(stream_test_rates[0]); i++) {
+		fps = stream_test_rates[i];
+		if (ret || stream_test_set_fps(fps)) {
+			printf("ok %u # SKIP %u fps, rate set by the sensor\n",
+			       i + 1, fps);
+			continue;
+		}
+
+		if (stream_test_run(&t, fps, &r) || !r.frames) {
+			printf("not ok %u %u fps: %u frames\n", i + 1, fps,
+			       r.frames);
+			failed++;
+			continue;
+		}
+
+		printf("# %u fps: %u frames, %u dropped, irq to dqbuf avg %llu us p99 < %u us max %llu us\n",
+		       fps, r.frames, r.dropped,
+		       (unsigned long long)(r.lat_sum_us / r.frames),
+		       stream_test_p99_us(&r),
+		       (unsigned long long)r.lat_max_us);
+
+		if (r.dropped * 100 > (r.frames + r.dropped) * t.max_drop_pct) {
+			printf("not ok %u %u fps\n", i + 1, fps);
+			failed++;
+		} else {
+			printf("ok %u %u fps\n", i + 1, fps);
+		}
+	}
+
+	if (!ret)
+		stream_test_set_fps(saved_fps);
+	close(t.fd);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,324 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2021-2021, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * Loopback KUnit tests of the CDMA transfer queue, included at the end of
+ * system_dma.c. The engine runs on a stand-in register file whose BTT
+ * write memcpy()s inside a test buffer, the bus address being the offset
+ * in it. Interrupt mode is driven by calling the ISR from the test.
+ */
+
+#include "armcb_isp_kunit.h"
+
+#define SYSTEM_DMA_TEST_MEM SZ_256K
+#define SYSTEM_DMA_TEST_CHUNK SZ_4K
+#define SYSTEM_DMA_TEST_XFERS 4
+
+struct system_dma_test_hw {
+	u8 *mem;
+	u32 regs[CDMA_REG_BTT / 4 + 1];
+	u32 sr;
+	bool irq;
+	bool hang; /// started chunks never go idle
+	int fail_chunk; /// chunk index ending with a slave error, -1 for none
+	unsigned int chunks;
+	unsigned int resets;
+};
+
+static struct system_dma_test_hw g_dma_test_hw;
+
+static u32 system_dma_test_read(u32 offset)
+{
+	if (offset == CDMA_REG_SR)
+		return g_dma_test_hw.sr;
+
+	return g_dma_test_hw.regs[offset / 4];
+}
+
+static void system_dma_test_write(u32 offset, u32 value)
+{
+	struct system_dma_test_hw *hw = &g_dma_test_hw;
+	u32 src = hw->regs[CDMA_REG_SA / 4];
+	u32 dst = hw->regs[CDMA_REG_DA / 4];
+
+	switch (offset) {
+	case CDMA_REG_CR:
+		if (value & CDMA_CR_RESET) {
+			hw->resets++;
+			hw->sr = CDMA_SR_IDLE;
+			value &= ~CDMA_CR_RESET;
+		}
+		hw->regs[offset / 4] = value;
+		break;
+	case CDMA_REG_SR:
+		hw->sr &= ~(value & (CDMA_SR_IOC_IRQ | CDMA_SR_ERR_IRQ));
+		break;
+	case CDMA_REG_BTT:
+		hw->sr &= ~CDMA_SR_IDLE;
+		if (hw->hang)
+			break;
+
+		if (hw->chunks++ == hw->fail_chunk) {
+			hw->sr |= CDMA_SR_IDLE | BIT(5);
+			hw->sr |= hw->irq ? CDMA_SR_ERR_IRQ : 0;
+			break;
+		}
+
+		if (src + value <= SYSTEM_DMA_TEST_MEM &&
+		    dst + value <= SYSTEM_DMA_TEST_MEM)
+			memcpy(hw->mem + dst, hw->mem + src, value);
+		hw->sr |= CDMA_SR_IDLE;
+		hw->sr |= hw->irq ? CDMA_SR_IOC_IRQ : 0;
+		break;
+	default:
+		hw->regs[offset / 4] = value;
+		break;
+	}
+}
+
+static const struct system_dma_hw_ops system_dma_test_ops = {
+	.read = system_dma_test_read,
+	.write = system_dma_test_write,
+};
+
+struct system_dma_test_ctx {
+	struct system_dma_engine saved;
+	struct system_dma_xfer xfer[SYSTEM_DMA_TEST_XFERS];
+	struct system_dma_xfer *done[SYSTEM_DMA_TEST_XFERS];
+	unsigned int ndone;
+};
+
+static void system_dma_test_cb(struct system_dma_xfer *xfer, void *priv)
+{
+	struct system_dma_test_ctx *ctx = priv;
+
+	if (ctx->ndone < SYSTEM_DMA_TEST_XFERS)
+		ctx->done[ctx->ndone] = xfer;
+	ctx->ndone++;
+}
+
+/* what the hardware would do on its interrupt line */
+static void system_dma_test_fire(struct system_dma_engine *eng)
+{
+	local_irq_disable();
+	system_dma_isr(0, eng);
+	local_irq_enable();
+}
+
+/* @n transfers of @bytes from the bottom half of the buffer to the top */
+static void system_dma_test_queue(struct kunit *test, unsigned int n,
+				  u32 bytes)
+{
+	struct system_dma_test_ctx *ctx = test->priv;
+	u32 src = 0;
+	unsigned int i = 0;
+
+	for (i = 0; i < n; i++) {
+		src = i * bytes;
+		memset(g_dma_test_hw.mem + src, 0x10 + i, bytes);
+		system_dma_xfer_init(&ctx->xfer[i], src,
+				     SYSTEM_DMA_TEST_MEM / 2 + src, bytes,
+				     system_dma_test_cb, ctx);
+		KUNIT_ASSERT_EQ(test, cdma_submit(&ctx->xfer[i]), 0);
+	}
+}
+
+static void system_dma_test_check(struct kunit *test, unsigned int i,
+				  u32 bytes)
+{
+	u8 *dst = g_dma_test_hw.mem + SYSTEM_DMA_TEST_MEM / 2 + i * bytes;
+
+	KUNIT_EXPECT_EQ(test, dst[0], (u8)(0x10 + i));
+	KUNIT_EXPECT_EQ(test, dst[bytes - 1], (u8)(0x10 + i));
+}
+
+static int system_dma_test_init(struct kunit *test)
+{
+	struct system_dma_engine *eng = &g_dma_engine;
+	struct system_dma_test_ctx *ctx = NULL;
+	unsigned long flags = 0;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ctx);
+
+	memset(&g_dma_test_hw, 0, sizeof(g_dma_test_hw));
+	g_dma_test_hw.mem = kunit_kzalloc(test, SYSTEM_DMA_TEST_MEM,
+					  GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, g_dma_test_hw.mem);
+	g_dma_test_hw.sr = CDMA_SR_IDLE;
+	g_dma_test_hw.fail_chunk = -1;
+
+	spin_lock_irqsave(&eng->lock, flags);
+	if (eng->active || eng->polling) {
+		spin_unlock_irqrestore(&eng->lock, flags);
+		kunit_skip(test, "cdma busy");
+	}
+	ctx->saved.ops = eng->ops;
+	ctx->saved.irq = eng->irq;
+	ctx->saved.max_bytes = eng->max_bytes;
+	ctx->saved.poll_timeout_us = eng->poll_timeout_us;
+	eng->ops = &system_dma_test_ops;
+	eng->irq = -1;
+	eng->max_bytes = SYSTEM_DMA_TEST_CHUNK;
+	spin_unlock_irqrestore(&eng->lock, flags);
+
+	test->priv = ctx;
+
+	return 0;
+}
+
+static void system_dma_test_exit(struct kunit *test)
+{
+	struct system_dma_engine *eng = &g_dma_engine;
+	struct system_dma_test_ctx *ctx = test->priv;
+	unsigned long flags = 0;
+	unsigned int i = 0;
+
+	if (!ctx)
+		return;
+
+	/* a failed case may leave transfers behind, flush them */
+	g_dma_test_hw.hang = false;
+	for (i = 0; i < 64 && eng->irq >= 0 && READ_ONCE(eng->active); i++)
+		system_dma_test_fire(eng);
+
+	spin_lock_irqsave(&eng->lock, flags);
+	eng->ops = ctx->saved.ops;
+	eng->irq = ctx->saved.irq;
+	eng->max_bytes = ctx->saved.max_bytes;
+	eng->poll_timeout_us = ctx->saved.poll_timeout_us;
+	spin_unlock_irqrestore(&eng->lock, flags);
+}
+
+/* polling: each submit returns with its copy done, chunks chained */
+static void system_dma_test_poll_chain(struct kunit *test)
+{
+	struct system_dma_test_ctx *ctx = test->priv;
+	u32 bytes = 2 * SYSTEM_DMA_TEST_CHUNK + 100;
+	unsigned int i = 0;
+
+	system_dma_test_queue(test, 2, bytes);
+
+	KUNIT_ASSERT_EQ(test, ctx->ndone, 2U);
+	KUNIT_EXPECT_EQ(test, g_dma_test_hw.chunks, 6U);
+	for (i = 0; i < 2; i++) {
+		KUNIT_EXPECT_PTR_EQ(test, ctx->done[i], &ctx->xfer[i]);
+		KUNIT_EXPECT_EQ(test, ctx->xfer[i].status, (s32)bytes);
+		system_dma_test_check(test, i, bytes);
+	}
+	KUNIT_EXPECT_EQ(test, cdma_en(0, SYSTEM_DMA_TEST_MEM / 2, 64), 64);
+	KUNIT_EXPECT_NULL(test, g_dma_engine.active);
+}
+
+/* interrupt: transfers queue up and complete in order from the ISR */
+static void system_dma_test_irq_queue(struct kunit *test)
+{
+	struct system_dma_test_ctx *ctx = test->priv;
+	struct system_dma_engine *eng = &g_dma_engine;
+	u32 bytes = SYSTEM_DMA_TEST_CHUNK + 8;
+	unsigned int fired = 0;
+	unsigned int i = 0;
+
+	eng->irq = 0;
+	g_dma_test_hw.irq = true;
+	system_dma_test_queue(test, SYSTEM_DMA_TEST_XFERS, bytes);
+
+	/* only the first chunk is on the engine, nothing completed yet */
+	KUNIT_EXPECT_EQ(test, ctx->ndone, 0U);
+	KUNIT_EXPECT_EQ(test, g_dma_test_hw.chunks, 1U);
+	KUNIT_EXPECT_PTR_EQ(test, eng->active, &ctx->xfer[0]);
+
+	while (eng->active && fired++ < 4 * SYSTEM_DMA_TEST_XFERS)
+		system_dma_test_fire(eng);
+
+	KUNIT_EXPECT_EQ(test, fired, 2U * SYSTEM_DMA_TEST_XFERS);
+	KUNIT_ASSERT_EQ(test, ctx->ndone, SYSTEM_DMA_TEST_XFERS);
+	for (i = 0; i < SYSTEM_DMA_TEST_XFERS; i++) {
+		KUNIT_EXPECT_PTR_EQ(test, ctx->done[i], &ctx->xfer[i]);
+		KUNIT_EXPECT_EQ(test, ctx->xfer[i].status, (s32)bytes);
+		system_dma_test_check(test, i, bytes);
+	}
+
+	/* a spurious interrupt is not ours */
+	local_irq_disable();
+	KUNIT_EXPECT_EQ(test, system_dma_isr(0, eng), IRQ_NONE);
+	local_irq_enable();
+}
+
+/* a chunk error fails its transfer, resets the engine, the queue goes on */
+static void system_dma_test_irq_error(struct kunit *test)
+{
+	struct system_dma_test_ctx *ctx = test->priv;
+	struct system_dma_engine *eng = &g_dma_engine;
+	u32 bytes = SYSTEM_DMA_TEST_CHUNK + 8;
+	unsigned int fired = 0;
+
+	eng->irq = 0;
+	g_dma_test_hw.irq = true;
+	g_dma_test_hw.fail_chunk = 1;
+	system_dma_test_queue(test, 2, bytes);
+
+	while (eng->active && fired++ < 8)
+		system_dma_test_fire(eng);
+
+	KUNIT_ASSERT_EQ(test, ctx->ndone, 2U);
+	KUNIT_EXPECT_EQ(test, ctx->xfer[0].status, -EIO);
+	KUNIT_EXPECT_EQ(test, g_dma_test_hw.resets, 1U);
+	KUNIT_EXPECT_PTR_EQ(test, ctx->done[1], &ctx->xfer[1]);
+	KUNIT_EXPECT_EQ(test, ctx->xfer[1].status, (s32)bytes);
+	system_dma_test_check(test, 1, bytes);
+}
+
+/* a chunk that never goes idle fails with -ETIMEDOUT instead of spinning */
+static void system_dma_test_poll_timeout(struct kunit *test)
+{
+	g_dma_engine.poll_timeout_us = 1000;
+	g_dma_test_hw.hang = true;
+
+	KUNIT_EXPECT_EQ(test, cdma_en(0, SYSTEM_DMA_TEST_MEM / 2, 64),
+			-ETIMEDOUT);
+	KUNIT_EXPECT_EQ(test, g_dma_test_hw.resets, 1U);
+	KUNIT_EXPECT_NULL(test, g_dma_engine.active);
+	KUNIT_EXPECT_FALSE(test, g_dma_engine.polling);
+
+	g_dma_test_hw.hang = false;
+	KUNIT_EXPECT_EQ(test, cdma_en(0, SYSTEM_DMA_TEST_MEM / 2, 64), 64);
+}
+
+/* the address window is checked at submit time */
+static void system_dma_test_bad_addr(struct kunit *test)
+{
+	KUNIT_EXPECT_EQ(test, cdma_en(0, 0, 0), -EINVAL);
+	KUNIT_EXPECT_EQ(test, cdma_en(MEM_END_7020 - 16, 0, 64), -EINVAL);
+	KUNIT_EXPECT_EQ(test, g_dma_test_hw.chunks, 0U);
+}
+
+static struct kunit_case system_dma_cases[] = {
+	KUNIT_CASE(system_dma_test_poll_chain),
+	KUNIT_CASE(system_dma_test_irq_queue),
+	KUNIT_CASE(system_dma_test_irq_error),
+	KUNIT_CASE(system_dma_test_poll_timeout),
+	KUNIT_CASE(system_dma_test_bad_addr),
+	{}
+};
+
+static struct kunit_suite system_dma_suite = {
+	.name = "armcb_isp_system_dma",
+	.init = system_dma_test_init,
+	.exit = system_dma_test_exit,
+	.test_cases = system_dma_cases,
+};
+
+kunit_test_suites(&system_dma_suite);
@@ -39,6 +39,7 @@
 #include <linux/device.h>
 #include <linux/err.h>
 #include <linux/interrupt.h>
+#include <linux/pm_qos.h>
 #include <linux/pm_runtime.h>
 #include <linux/pm_domain.h>
 #include <linux/of_address.h>
@@ -64,6 +65,7 @@
 #include "mvx_session.h"
 #include "mvx_log_group.h"
 #include "mvx_pm_runtime.h"
+#include "mvx_sim.h"
 
 /****************************************************************************
  * Defines
@@ -96,6 +98,25 @@ module_param(busctrl_split, uint, 0660);
 static bool disable_dfs = 0;
 module_param(disable_dfs, bool, 0660);
 
+/*
+ * DVFS mode.
+ * 0: Frequency is looked up from the estimated load in sky1_mvx_freq_table.
+ * 1: Closed loop. The cycles per macroblock of each codec are measured at
+ *    runtime, the lowest OPP meeting all sessions' deadlines is requested as
+ *    minimum frequency and devfreq is fed the measured busy time.
+ */
+static uint dvfs_mode = 0;
+module_param(dvfs_mode, uint, 0440);
+MODULE_PARM_DESC(dvfs_mode, "0=load table, 1=closed loop.");
+
+static uint dvfs_headroom = 20;
+module_param(dvfs_headroom, uint, 0660);
+MODULE_PARM_DESC(dvfs_headroom, "Closed loop DVFS headroom in percent.");
+
+static uint dvfs_latency_ms = 200;
+module_param(dvfs_latency_ms, uint, 0660);
+MODULE_PARM_DESC(dvfs_latency_ms, "Time in which frames queued to firmware must complete.");
+
 /****************************************************************************
  * Types
  ****************************************************************************/
@@ -130,6 +151,8 @@ struct mvx_dev_ctx {
     struct devfreq_dev_profile devfreq_profile;
     struct devfreq *devfreq;
     unsigned long target_freq;
+    struct dev_pm_qos_request min_freq_req;
+    struct work_struct dvfs_work;
 };
 
 /**
@@ -216,6 +239,11 @@ static unsigned int get_core_mask(struct mvx_client_ops *client)
     return mvx_hwreg_get_core_mask(&ctx->hwreg);
 }
 
+/* The simulator has no perf domain to scale. */
+static bool dfs_disabled(struct mvx_dev_ctx *ctx)
+{
+    return disable_dfs || ctx->hwreg.sim != NULL;
+}
 
 static int update_freq(struct mvx_dev_ctx *ctx)
 {
@@ -259,13 +287,74 @@ static int update_freq(struct mvx_dev_ctx *ctx)
     return ret;
 }
 
+/**
+ * predict_freq() - Lowest OPP that meets the deadlines of all sessions.
+ * @ctx:    Pointer to context.
+ *
+ * Return: 0 on success, else error code.
+ */
+static int predict_freq(struct mvx_dev_ctx *ctx)
+{
+    const struct mvx_freq_table *base = &sky1_mvx_freq_table[0];
+    struct devfreq_dev_profile *profile = &ctx->devfreq_profile;
+    unsigned int ncores = max_t(unsigned int, mvx_hwreg_get_ncores(&ctx->hwreg), 1);
+    uint64_t core_cycles;
+    uint64_t session_cycles;
+    uint64_t required;
+    unsigned long default_cpm;
+    int ret;
+    int i;
+
+    if (profile->max_state == 0)
+        return -EINVAL;
+
+    /* Cycles per macroblock implied by the first entry of the load table. */
+    default_cpm = base->freq / base->load * base->cores;
+
+    ret = mvx_sched_calculate_cycles(&ctx->scheduler, default_cpm,
+                     dvfs_latency_ms, &core_cycles,
+                     &session_cycles);
+    if (ret != 0)
+        return ret;
+
+    required = max(div_u64(core_cycles, ncores), session_cycles);
+    required = div_u64(required * (100 + dvfs_headroom), 100);
+
+    for (i = 0; i < profile->max_state - 1; i++)
+        if (profile->freq_table[i] >= required)
+            break;
+
+    ctx->target_freq = profile->freq_table[i];
+
+    return 0;
+}
+
+static void dvfs_work(struct work_struct *work)
+{
+    struct mvx_dev_ctx *ctx = container_of(work, struct mvx_dev_ctx, dvfs_work);
+    int ret;
+
+    ret = predict_freq(ctx);
+    if (ret != 0)
+        return;
+
+    if (dev_pm_qos_request_active(&ctx->min_freq_req))
+        dev_pm_qos_update_request(&ctx->min_freq_req,
+                      DIV_ROUND_UP(ctx->target_freq, 1000));
+}
+
 static int update_load(struct mvx_client_session *csession)
 {
     struct mvx_dev_ctx *ctx = csession->ctx;
     int ret;
 
-    if (disable_dfs)
+    if (dfs_disabled(ctx))
+        return 0;
+
+    if (dvfs_mode == 1) {
+        queue_work(system_wq, &ctx->dvfs_work);
         return 0;
+    }
 
     ret = update_freq(ctx);
     if (ret != 0)
@@ -485,6 +574,7 @@ static int mvx_devfreq_target(struct device *dev, unsigned long *freq, u32 flags
     pre_freq = scmi_device_get_freq(ctx->opp_pmdomain);
     ret = scmi_device_set_freq(ctx->opp_pmdomain, *freq);
     atomic_set(&mvx_log_perf.freq, *freq);
+    mvx_sched_set_freq(&ctx->scheduler, *freq);
 
     MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_DEBUG, "%s() target=%ld, previous=%ld, current=%ld.",
                     __func__, target_freq, pre_freq, *freq);
@@ -507,8 +597,16 @@ static int mvx_devfreq_get_dev_status(struct device *dev,
 {
     struct mvx_dev_ctx *ctx = dev_get_drvdata(dev);
 
-    update_freq(ctx);
     stat->current_frequency = scmi_device_get_freq(ctx->opp_pmdomain);
+
+    if (dvfs_mode == 1) {
+        mvx_sched_get_busy(&ctx->scheduler, &stat->busy_time,
+                   &stat->total_time);
+        queue_work(system_wq, &ctx->dvfs_work);
+        return 0;
+    }
+
+    update_freq(ctx);
     stat->busy_time = ctx->target_freq;
     stat->total_time = stat->current_frequency;
 
@@ -527,12 +625,12 @@ static int mvx_devfreq_init(struct mvx_dev_ctx *ctx)
 
     MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_INFO, "%s()", __func__);
 
-    if (disable_dfs)
-        return 0;
-
     if (!ctx)
         return -EINVAL;
 
+    if (dfs_disabled(ctx))
+        return 0;
+
     ondemand_data = devm_kzalloc(ctx->dev, sizeof(*ondemand_data), GFP_KERNEL);
     if (!ondemand_data)
         return -ENOMEM;
@@ -596,8 +694,14 @@ static int mvx_devfreq_init(struct mvx_dev_ctx *ctx)
     profile->target = mvx_devfreq_target;
     profile->get_dev_status = mvx_devfreq_get_dev_status;
     profile->get_cur_freq = mvx_devfreq_get_cur_freq;
-    ondemand_data->downdifferential = 1;
-    ondemand_data->upthreshold = 100;
+    if (dvfs_mode == 1) {
+        /* Busy time is measured, use utilization thresholds. */
+        ondemand_data->downdifferential = 5;
+        ondemand_data->upthreshold = 90;
+    } else {
+        ondemand_data->downdifferential = 1;
+        ondemand_data->upthreshold = 100;
+    }
     ctx->devfreq = devm_devfreq_add_device(ctx->dev, profile, DEVFREQ_GOV_SIMPLE_ONDEMAND, ondemand_data);
     if (IS_ERR(ctx->devfreq)) {
         MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_ERROR, "Failed to add devfreq device");
@@ -611,8 +715,20 @@ static int mvx_devfreq_init(struct mvx_dev_ctx *ctx)
         goto remove_device;
     }
 
-    return ret;
+    INIT_WORK(&ctx->dvfs_work, dvfs_work);
+    if (dvfs_mode == 1) {
+        ret = dev_pm_qos_add_request(ctx->dev, &ctx->min_freq_req,
+                         DEV_PM_QOS_MIN_FREQUENCY, 0);
+        if (ret < 0) {
+            MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_ERROR, "Failed to add min frequency request");
+            goto unregister_notifier;
+        }
+    }
+
+    return 0;
 
+unregister_notifier:
+    devm_devfreq_unregister_opp_notifier(ctx->dev, ctx->devfreq);
 remove_device:
     devm_devfreq_remove_device(ctx->dev, ctx->devfreq);
     ctx->devfreq = NULL;
@@ -636,7 +752,7 @@ static int mvx_devfreq_remove(struct mvx_dev_ctx *ctx)
 {
     MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_INFO, "%s()", __func__);
 
-    if (disable_dfs)
+    if (dfs_disabled(ctx))
         return 0;
 
     if (ctx->devfreq) {
@@ -644,6 +760,9 @@ static int mvx_devfreq_remove(struct mvx_dev_ctx *ctx)
         devm_kfree(ctx->dev, ctx->devfreq->data);
         devm_devfreq_remove_device(ctx->dev, ctx->devfreq);
         ctx->devfreq = NULL;
+        cancel_work_sync(&ctx->dvfs_work);
+        if (dev_pm_qos_request_active(&ctx->min_freq_req))
+            dev_pm_qos_remove_request(&ctx->min_freq_req);
     }
     if (ctx->devfreq_profile.max_state > 0) {
         dev_pm_opp_remove_table(ctx->dev);
@@ -742,13 +861,17 @@ static int mvx_dev_probe(struct device *dev,
     if (ret != 0)
         goto destruct_dentry;
 
+    /* The simulator has neither clock nor reset. */
     ctx->clk = devm_clk_get_optional(dev, MVE_CLK_NAME);
-    if (IS_ERR_OR_NULL(ctx->clk)) {
+    if (IS_ERR(ctx->clk) || (ctx->clk == NULL && ctx->hwreg.sim == NULL)) {
         MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_ERROR, "Failed to get clock.");
         ret = -EFAULT;
         goto destruct_hwreg;
     }
-    ctx->rstc = devm_reset_control_get(dev, MVE_RST_NAME);
+    if (ctx->hwreg.sim != NULL)
+        ctx->rstc = NULL;
+    else
+        ctx->rstc = devm_reset_control_get(dev, MVE_RST_NAME);
     if (IS_ERR(ctx->rstc)) {
         MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_ERROR, "Failed to get reset_control, %s.",
                         MVE_RST_NAME);
@@ -768,7 +891,11 @@ static int mvx_dev_probe(struct device *dev,
     }
     disable_irq(ctx->irq);
 
-    if (has_acpi_companion(dev)) {
+    if (ctx->hwreg.sim != NULL) {
+        /* Simulated power domain, runtime PM of the parent device. */
+        ctx->pmdomains[0] = dev->parent;
+        ctx->pmdomains_cnt = 1;
+    } else if (has_acpi_companion(dev)) {
 #ifdef	CONFIG_ACPI
         ctx->pmdomains[0] = dev;
         i = 1;
@@ -945,11 +1072,13 @@ static int mvx_pdev_probe(struct platform_device *pdev)
     int irq = 0;
 
     MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_INFO, "probe");
-    rcsu_res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
-    res = platform_get_resource(pdev, IORESOURCE_MEM, 1);
-    if (IS_ERR_OR_NULL(rcsu_res) || IS_ERR_OR_NULL(res)) {
-        MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_ERROR, "Failed to get address of resource.");
-        return -ENXIO;
+    if (mvx_sim_get(&pdev->dev) == NULL) {
+        rcsu_res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+        res = platform_get_resource(pdev, IORESOURCE_MEM, 1);
+        if (IS_ERR_OR_NULL(rcsu_res) || IS_ERR_OR_NULL(res)) {
+            MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_ERROR, "Failed to get address of resource.");
+            return -ENXIO;
+        }
     }
     irq = platform_get_irq(pdev, 0);
     if (irq < 0) {
@@ -1265,8 +1394,17 @@ int mvx_dev_init(void)
 
     /* LCOV_EXCL_STOP */
 
+    ret = mvx_sim_init();
+    if (ret != 0) {
+        pr_err("mvx_dev: Failed to register simulated device.\n");
+        goto unregister_pci_driver;
+    }
+
     return 0;
 
+unregister_pci_driver:
+    pci_unregister_driver(&mvx_pci_driver);
+
 unregister_driver:
     platform_driver_unregister(&mvx_dev_driver); /* LCOV_EXCL_LINE */
 
@@ -1275,6 +1413,7 @@ unregister_driver:
 
 void mvx_dev_exit(void)
 {
+    mvx_sim_exit();
     pci_unregister_driver(&mvx_pci_driver); /* LCOV_EXCL_LINE */
     platform_driver_unregister(&mvx_dev_driver);
 }
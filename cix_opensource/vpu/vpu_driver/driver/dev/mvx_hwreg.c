@@ -43,6 +43,7 @@
 #include "mvx_hwreg_v61.h"
 #include "mvx_hwreg_v52_v76.h"
 #include "mvx_pm_runtime.h"
+#include "mvx_sim.h"
 
 static uint hw_ncores = MVX_NUMBER_OF_CORES;
 module_param(hw_ncores, uint, 0660);
@@ -161,7 +162,7 @@ static int mvx_hwreg_hw_ver_construct(struct mvx_hwreg *hwreg)
 {
     uint32_t value;
 
-    value = readl(hwreg->registers);
+    value = mvx_hwreg_read(hwreg, MVX_HWREG_HARDWARE_ID);
 
     switch (value >> 16) {
     case 0x5650:
@@ -419,6 +420,11 @@ int mvx_hwreg_construct(struct mvx_hwreg *hwreg,
 
     hwreg->dev = dev;
 
+    /* A simulated device has no register regions to map. */
+    hwreg->sim = mvx_sim_get(dev);
+    if (hwreg->sim != NULL)
+        goto setup;
+
     hwreg->rcsu_res = request_mem_region(rcsu_res->start, resource_size(rcsu_res), name);
     if (hwreg->rcsu_res == NULL) {
         MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_ERROR,
@@ -454,6 +460,7 @@ int mvx_hwreg_construct(struct mvx_hwreg *hwreg,
         goto release_mem;
     }
 
+setup:
     for (lsid = 0; lsid < MVX_LSID_MAX; ++lsid) {
         hwreg->lsid_hwreg[lsid].hwreg = hwreg;
         hwreg->lsid_hwreg[lsid].lsid = lsid;
@@ -470,6 +477,9 @@ int mvx_hwreg_construct(struct mvx_hwreg *hwreg,
     return 0;
 
 unmap_io:
+    if (hwreg->sim != NULL)
+        return ret;
+
     iounmap(hwreg->registers);
 release_mem:
     release_mem_region(res->start, resource_size(res));
@@ -483,6 +493,9 @@ release_rcsu_mem:
 
 void mvx_hwreg_destruct(struct mvx_hwreg *hwreg)
 {
+    if (hwreg->sim != NULL)
+        return;
+
     iounmap(hwreg->rcsu_registers);
     release_mem_region(hwreg->rcsu_res->start, resource_size(hwreg->rcsu_res));
     iounmap(hwreg->registers);
@@ -494,6 +507,9 @@ uint32_t mvx_hwreg_read(struct mvx_hwreg *hwreg,
 {
     unsigned int offset = get_offset(what);
 
+    if (hwreg->sim != NULL)
+        return mvx_sim_read(hwreg->sim, what);
+
     return readl(hwreg->registers + offset);
 }
 
@@ -503,6 +519,11 @@ void mvx_hwreg_write(struct mvx_hwreg *hwreg,
 {
     unsigned int offset = get_offset(what);
 
+    if (hwreg->sim != NULL) {
+        mvx_sim_write(hwreg->sim, what, value);
+        return;
+    }
+
     writel(value, hwreg->registers + offset);
 }
 
@@ -512,6 +533,9 @@ uint32_t mvx_hwreg_read_lsid(struct mvx_hwreg *hwreg,
 {
     unsigned int offset = get_lsid_offset(lsid, what);
 
+    if (hwreg->sim != NULL)
+        return mvx_sim_read_lsid(hwreg->sim, lsid, what);
+
     return readl(hwreg->registers + offset);
 }
 
@@ -522,6 +546,11 @@ void mvx_hwreg_write_lsid(struct mvx_hwreg *hwreg,
 {
     unsigned int offset = get_lsid_offset(lsid, what);
 
+    if (hwreg->sim != NULL) {
+        mvx_sim_write_lsid(hwreg->sim, lsid, what, value);
+        return;
+    }
+
     writel(value, hwreg->registers + offset);
 }
 
@@ -530,6 +559,9 @@ uint32_t mvx_hwreg_read_rcsu(struct mvx_hwreg *hwreg,
 {
     unsigned int offset = get_rcsu_offset(what);
 
+    if (hwreg->sim != NULL)
+        return mvx_sim_read_rcsu(hwreg->sim, what);
+
     return readl(hwreg->rcsu_registers + offset);
 }
 
@@ -539,6 +571,11 @@ void mvx_hwreg_write_rcsu(struct mvx_hwreg *hwreg,
 {
     unsigned int offset = get_rcsu_offset(what);
 
+    if (hwreg->sim != NULL) {
+        mvx_sim_write_rcsu(hwreg->sim, what, value);
+        return;
+    }
+
     writel(value, hwreg->rcsu_registers + offset);
 }
 
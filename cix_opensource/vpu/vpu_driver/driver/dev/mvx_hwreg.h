@@ -200,6 +200,7 @@ enum mvx_busctrl_split_type {
 };
 
 struct mvx_hwreg;
+struct mvx_sim;
 
 /**
  * struct mvx_lsid_hwreg - Helper struct used for debugfs reading of lsid
@@ -215,6 +216,7 @@ struct mvx_lsid_hwreg {
  */
 struct mvx_hwreg {
     struct device *dev;
+    struct mvx_sim *sim;
     struct resource *rcsu_res;
     void *rcsu_registers;
     struct resource *res;
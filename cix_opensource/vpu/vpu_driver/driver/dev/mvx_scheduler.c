@@ -36,8 +36,10 @@
 #include <linux/errno.h>
 #include <linux/debugfs.h>
 #include <linux/device.h>
+#include <linux/math64.h>
 #include <linux/workqueue.h>
 #include <linux/module.h>
+#include <linux/mvx-v4l2-controls.h>
 #include "mvx_if.h"
 #include "mvx_hwreg.h"
 #include "mvx_mmu.h"
@@ -54,6 +56,36 @@
 static int wait_scheduler_timeout = 1000;
 module_param(wait_scheduler_timeout, int, 0660);
 
+static uint sched_policy = MVX_SCHED_POLICY_FAIR;
+module_param(sched_policy, uint, 0660);
+MODULE_PARM_DESC(sched_policy, "LSID scheduling policy. 0=priority, 1=weighted fair, 2=earliest deadline.");
+
+/*
+ * Macroblocks a session may process per switch in when several sessions
+ * share the hardware. Small streams get several frames per job, which
+ * amortizes the cost of switch in, switch out and MMU flush.
+ */
+static uint job_quantum_mbs = 4 * 8160;
+module_param(job_quantum_mbs, uint, 0660);
+MODULE_PARM_DESC(job_quantum_mbs, "Target macroblocks per switch in.");
+
+/* Quantum used when a real-time session (priority high or above) exists. */
+static uint job_rt_quantum_mbs = 8160;
+module_param(job_rt_quantum_mbs, uint, 0660);
+MODULE_PARM_DESC(job_rt_quantum_mbs, "Target macroblocks per switch in with real-time sessions.");
+
+static uint max_job_frames = 8;
+module_param(max_job_frames, uint, 0660);
+MODULE_PARM_DESC(max_job_frames, "Maximum frames per job. 1 disables job batching.");
+
+/* A job may not span more than this much of the stream's own frame time. */
+static uint job_latency_ms = 100;
+module_param(job_latency_ms, uint, 0660);
+MODULE_PARM_DESC(job_latency_ms, "Maximum stream time covered by one job.");
+
+/* Fixed point scale of the virtual time increments. */
+#define MVX_SCHED_VTIME_SHIFT 16
+
 /****************************************************************************
  * Static functions
  ****************************************************************************/
@@ -69,19 +101,393 @@ static struct mvx_lsid *find_free_lsid(struct mvx_sched *sched)
     return NULL;
 }
 
+static enum mvx_sched_policy get_sched_policy(void)
+{
+    return sched_policy < MVX_SCHED_POLICY_MAX ?
+           sched_policy : MVX_SCHED_POLICY_PRIORITY;
+}
+
+/**
+ * sched_key() - Sort key of a session for the active scheduling policy.
+ *
+ * Sessions with a lower key are mapped to a LSID first and evicted last.
+ */
+static uint64_t sched_key(struct mvx_sched_session *session)
+{
+    if (get_sched_policy() == MVX_SCHED_POLICY_DEADLINE)
+        return ktime_to_ns(session->deadline);
+
+    return session->vtime;
+}
+
 static struct mvx_lsid *find_idle_lsid(struct mvx_sched *sched)
 {
+    struct mvx_lsid *victim = NULL;
     unsigned int i;
 
     for (i = 0; i < sched->nlsid; i++) {
+        struct mvx_lsid *lsid = &sched->lsid[i];
         bool idle;
 
-        idle = mvx_lsid_idle(&sched->lsid[i]);
-        if (idle != false)
-            return &sched->lsid[i];
+        idle = mvx_lsid_idle(lsid);
+        if (idle == false)
+            continue;
+
+        if (get_sched_policy() == MVX_SCHED_POLICY_PRIORITY ||
+            lsid->session == NULL)
+            return lsid;
+
+        /*
+         * Prefer to evict a session that is not waiting to run, and
+         * among those the one that has received most service.
+         */
+        if (victim == NULL ||
+            (victim->session->in_pending && !lsid->session->in_pending) ||
+            (victim->session->in_pending == lsid->session->in_pending &&
+             sched_key(lsid->session) > sched_key(victim->session)))
+            victim = lsid;
     }
 
-    return NULL;
+    return victim;
+}
+
+/**
+ * session_cost_mbs() - Decode equivalent macroblocks per second.
+ * @session:    Pointer to session.
+ * @fps:    Frame rate the session is running at.
+ *
+ * Return: Macroblocks per second, normalized to the cost of decoding.
+ */
+static unsigned long session_cost_mbs(struct mvx_session *session, uint32_t fps)
+{
+    struct mvx_session_port *port_in = &session->port[MVX_DIR_INPUT];
+    struct mvx_session_port *port_out = &session->port[MVX_DIR_OUTPUT];
+    unsigned long mbs;
+
+    mbs = (ALIGN(session->orig_width, 16) / 16) * (ALIGN(session->orig_height, 16) / 16);
+
+    // The performance of encode is half that of decode, we use decode as the benchmark.
+    if (session->is_encoder) {
+        fps *= 2;
+        if (port_out->format == MVX_FORMAT_VP8)
+            fps = fps * 4 / 3; // VP8 encode is 1.33x slower
+    } else {
+        if (MVX_IS_LEGACY_FORMAT(port_in->format))
+            fps = fps * 8 / 3; // Legacy formats are 2.67x slower
+    }
+
+    return mbs * fps;
+}
+
+static uint32_t session_target_fps(struct mvx_session *session)
+{
+    if (session->fps_d == 0)
+        return 0;
+
+    return session->fps_n / session->fps_d;
+}
+
+/* Virtual time of a session, including the run it has not been charged for. */
+static uint64_t session_vtime_now(struct mvx_sched_session *session, ktime_t now)
+{
+    uint64_t run;
+
+    if (session->dispatched_at == 0 || ktime_after(now, session->dispatched_at) == false)
+        return session->vtime;
+
+    run = ktime_to_ns(ktime_sub(now, session->dispatched_at));
+
+    return session->vtime + div64_u64(run << MVX_SCHED_VTIME_SHIFT,
+                      max(session->weight, 1UL));
+}
+
+/**
+ * update_vclock() - Advance the system virtual time.
+ * @sched:    Pointer to scheduler object.
+ * @self:    Session being queued, not counted.
+ * @now:    Current time.
+ *
+ * The system virtual time follows the least served of the sessions that are
+ * waiting or running, so a session that wakes up competes with the backlogged
+ * ones instead of queuing behind all of them. It never goes back.
+ */
+static void update_vclock(struct mvx_sched *sched,
+              struct mvx_sched_session *self,
+              ktime_t now)
+{
+    struct mvx_sched_session *tmp;
+    uint64_t vmin = U64_MAX;
+    unsigned int i;
+
+    list_for_each_entry(tmp, &sched->pending, pending) {
+        if (tmp != self)
+            vmin = min(vmin, tmp->vtime);
+    }
+
+    for (i = 0; i < sched->nlsid; i++) {
+        tmp = sched->lsid[i].session;
+        if (tmp != NULL && tmp != self && tmp->dispatched_at != 0)
+            vmin = min(vmin, session_vtime_now(tmp, now));
+    }
+
+    if (vmin != U64_MAX && vmin > sched->vclock)
+        sched->vclock = vmin;
+}
+
+/**
+ * update_session_key() - Refresh weight, virtual time and deadline.
+ *
+ * Called when a session is added to the pending list. The weight is the
+ * same load estimate that is used for DVFS, but is computed without
+ * touching the DVFS sampling window.
+ */
+static void update_session_key(struct mvx_sched *sched,
+                   struct mvx_sched_session *session)
+{
+    struct mvx_session *s = mvx_if_session_to_session(session->isession);
+    uint32_t fps = max(s->last_fps, session_target_fps(s));
+    ktime_t now = ktime_get();
+
+    session->weight = max(session_cost_mbs(s, max_t(uint32_t, fps, 1)), 1UL);
+    session->queued_at = now;
+
+    /* Do not let a session that has been idle build up credit. */
+    update_vclock(sched, session, now);
+    if (session->vtime < sched->vclock)
+        session->vtime = sched->vclock;
+
+    session->deadline = ktime_add_ns(now,
+            div_u64(NSEC_PER_SEC, max_t(uint32_t, fps, 1)));
+}
+
+static void update_session_realtime(struct mvx_sched *sched,
+                    struct mvx_sched_session *session,
+                    bool realtime)
+{
+    if (session->realtime == realtime)
+        return;
+
+    session->realtime = realtime;
+    if (realtime)
+        sched->rt_session_count++;
+    else
+        sched->rt_session_count--;
+}
+
+/**
+ * session_job_frames() - Number of frames per firmware job.
+ *
+ * A single session runs until idle. Otherwise the session gets as many
+ * frames as fit in the macroblock quantum, limited by max_job_frames and by
+ * the number of frames the stream produces in job_latency_ms.
+ *
+ * Return: Frames per job, 0 for unlimited.
+ */
+static uint32_t session_job_frames(struct mvx_sched *sched,
+                   struct mvx_sched_session *session)
+{
+    struct mvx_session *s = mvx_if_session_to_session(session->isession);
+    uint32_t fps = max_t(uint32_t, session_target_fps(s), 1);
+    unsigned long mbs = session_cost_mbs(s, 1);
+    unsigned long quantum;
+    uint32_t frames;
+
+    if (sched->session_count <= 1)
+        return 0;
+
+    if (max_job_frames <= 1 || mbs == 0)
+        return 1;
+
+    quantum = sched->rt_session_count > 0 ?
+          job_rt_quantum_mbs : job_quantum_mbs;
+    frames = clamp_t(unsigned long, quantum / mbs, 1, max_job_frames);
+    frames = min(frames, max_t(uint32_t, fps * job_latency_ms / MSEC_PER_SEC, 1));
+
+    return frames;
+}
+
+static void update_job_frames(struct mvx_sched *sched,
+                  struct mvx_sched_session *session)
+{
+    struct mvx_session *s = mvx_if_session_to_session(session->isession);
+    uint32_t job_frames;
+
+    if (s->job_frames_set)
+        return;
+
+    job_frames = session_job_frames(sched, session);
+
+    /* Session was running until idle, force it to give up the LSID. */
+    if (s->job_frames == 0 && job_frames != 0)
+        s->pending_switch_out = true;
+
+    s->job_frames = job_frames;
+}
+
+static unsigned long session_frame_mbs(struct mvx_session *session)
+{
+    return (ALIGN(session->orig_width, 16) / 16) *
+           (ALIGN(session->orig_height, 16) / 16);
+}
+
+static struct mvx_sched_cost *session_cost(struct mvx_sched *sched,
+                       struct mvx_session *session)
+{
+    enum mvx_direction dir = session->is_encoder ?
+                 MVX_DIR_OUTPUT : MVX_DIR_INPUT;
+    enum mvx_format codec = session->port[dir].format;
+    unsigned long mbs = session_frame_mbs(session);
+    unsigned int res;
+
+    if (mvx_is_bitstream(codec) == false)
+        return NULL;
+
+    if (mbs <= 3600)
+        res = 0;
+    else if (mbs <= 8160)
+        res = 1;
+    else
+        res = 2;
+
+    return &sched->cost[codec - MVX_FORMAT_BITSTREAM_FIRST]
+               [session->is_encoder][res];
+}
+
+static bool session_running(struct mvx_sched_session *session)
+{
+    struct mvx_session *s = mvx_if_session_to_session(session->isession);
+
+    return session->dispatched_at != 0 &&
+           ktime_after(s->fw_switched_in_at, session->dispatched_at);
+}
+
+/**
+ * learn_cost() - Update learned codec cost from measured busy time.
+ * @sched:    Pointer to scheduler object.
+ * @session:    Pointer to session.
+ * @now:    End of the measured interval.
+ * @partial:    The session is still running. Busy time is kept for the
+ *              next sample if no frame has completed yet.
+ */
+static void learn_cost(struct mvx_sched *sched,
+               struct mvx_sched_session *session,
+               ktime_t now,
+               bool partial)
+{
+    struct mvx_session *s = mvx_if_session_to_session(session->isession);
+    struct mvx_sched_cost *cost = session_cost(sched, s);
+    unsigned long freq = READ_ONCE(sched->freq);
+    unsigned long mbs = session_frame_mbs(s);
+    uint64_t frames = s->hw_frames - session->learn_frames;
+    ktime_t start;
+    uint64_t cycles;
+    unsigned long cpm;
+
+    if (session_running(session) == false)
+        return;
+
+    start = ktime_after(s->fw_switched_in_at, session->learn_from) ?
+        s->fw_switched_in_at : session->learn_from;
+    if (ktime_after(now, start) == false)
+        return;
+
+    if (frames == 0 && partial)
+        return;
+
+    session->learn_from = now;
+    session->learn_frames = s->hw_frames;
+
+    if (cost == NULL || freq == 0 || mbs == 0 || frames == 0)
+        return;
+
+    cycles = div_u64(ktime_to_ns(ktime_sub(now, start)), NSEC_PER_USEC) *
+         (freq / 1000) / 1000;
+    cycles *= max_t(unsigned int, s->isession.ncores, 1);
+    cpm = div64_u64(cycles, frames * mbs);
+
+    if (cost->samples == 0)
+        cost->cpm = cpm;
+    else
+        cost->cpm = (cost->cpm * 7 + cpm) / 8;
+    cost->samples++;
+}
+
+/**
+ * account_busy() - Add busy interval to the current sampling window.
+ *
+ * Intervals are added in order of their end time. Overlap with the already
+ * accounted part of the window is skipped.
+ */
+static void account_busy(struct mvx_sched *sched,
+             ktime_t start,
+             ktime_t end)
+{
+    if (ktime_before(start, sched->sample_at))
+        start = sched->sample_at;
+
+    if (ktime_before(start, sched->busy_until))
+        start = sched->busy_until;
+
+    if (ktime_after(end, start) == false)
+        return;
+
+    sched->busy_ns += ktime_to_ns(ktime_sub(end, start));
+    sched->busy_until = end;
+}
+
+static void account_dispatch(struct mvx_sched *sched,
+                 struct mvx_sched_session *session)
+{
+    ktime_t now = ktime_get();
+    uint64_t wait = 0;
+
+    if (session->queued_at != 0)
+        wait = ktime_to_ns(ktime_sub(now, session->queued_at));
+
+    session->wait_ns += wait;
+    session->max_wait_ns = max(session->max_wait_ns, wait);
+    session->switch_in_count++;
+    session->queued_at = 0;
+    session->dispatched_at = now;
+    session->learn_from = now;
+    session->learn_frames =
+        mvx_if_session_to_session(session->isession)->hw_frames;
+}
+
+static void account_switch_out(struct mvx_sched *sched,
+                   struct mvx_sched_session *session)
+{
+    struct mvx_session *s = mvx_if_session_to_session(session->isession);
+    ktime_t now = ktime_get();
+    uint64_t run;
+
+    session->switch_out_count++;
+
+    if (session->dispatched_at == 0)
+        return;
+
+    if (ktime_after(s->fw_switched_in_at, session->dispatched_at)) {
+        session->switch_in_ns += ktime_to_ns(
+            ktime_sub(s->fw_switched_in_at, session->dispatched_at));
+        session->switch_in_samples++;
+    }
+
+    if (ktime_after(s->fw_switch_out_at, session->dispatched_at)) {
+        session->switch_out_ns += ktime_to_ns(
+            ktime_sub(now, s->fw_switch_out_at));
+        session->switch_out_samples++;
+    }
+
+    if (session_running(session)) {
+        account_busy(sched, s->fw_switched_in_at, now);
+        learn_cost(sched, session, now, false);
+    }
+
+    run = ktime_to_ns(ktime_sub(now, session->dispatched_at));
+    session->dispatched_at = 0;
+    session->run_ns += run;
+    session->vtime += div64_u64(run << MVX_SCHED_VTIME_SHIFT,
+                    max(session->weight, 1UL));
 }
 
 static int map_session(struct mvx_sched *sched,
@@ -102,6 +508,7 @@ static int map_session(struct mvx_sched *sched,
         return ret;
 
     session->lsid = lsid;
+    session->lsid_map_count++;
     lsid->session = session;
 
     return 0;
@@ -218,6 +625,7 @@ static uint32_t sort_jobs(uint32_t jobqueue,
 /**
  * pending list is only updated when sched is locked.
  * a session can only be added once
+ * pending list is ordered by priority, then by sched_key
  *
  * notify_list = []
  * lock_sched
@@ -229,7 +637,7 @@ static uint32_t sort_jobs(uint32_t jobqueue,
  *
  *      l = free_lsid
  *      if l is Nul:
- *              l = idle_lsid
+ *              l = idle_lsid with highest sched_key
  *              if l is Nul:
  *                      break
  *      if is_mapped(l):
@@ -291,6 +699,7 @@ static void sched_task(struct work_struct *ws)
                 continue;
             }
 
+            account_dispatch(sched, pending);
             pending->in_pending = false;
             list_del(&pending->pending);
             continue;
@@ -380,6 +789,7 @@ static void sched_task(struct work_struct *ws)
             continue;
         }
 
+        account_dispatch(sched, pending);
         pending->in_pending = false;
         list_del(&pending->pending);
     }
@@ -419,6 +829,35 @@ static void sched_session_print(struct seq_file *s,
     mvx_seq_printf(s, "Dev session", ind, "%px\n", session);
     mvx_seq_printf(s, "MVX session", ind, "%px\n",
                mvx_if_session_to_session(session->isession));
+    mvx_seq_printf(s, "Priority", ind, "%u\n", session->priority);
+    mvx_seq_printf(s, "Weight (mbs)", ind, "%lu\n", session->weight);
+    mvx_seq_printf(s, "Virtual time", ind, "%llu\n", session->vtime);
+    mvx_seq_printf(s, "Switch in", ind, "%u\n", session->switch_in_count);
+    mvx_seq_printf(s, "Switch out", ind, "%u\n", session->switch_out_count);
+    mvx_seq_printf(s, "LSID map", ind, "%u\n", session->lsid_map_count);
+    mvx_seq_printf(s, "Wait total (us)", ind, "%llu\n",
+               div_u64(session->wait_ns, NSEC_PER_USEC));
+    mvx_seq_printf(s, "Wait avg (us)", ind, "%llu\n",
+               session->switch_in_count == 0 ? 0 :
+               div64_u64(session->wait_ns,
+                     (uint64_t)session->switch_in_count * NSEC_PER_USEC));
+    mvx_seq_printf(s, "Wait max (us)", ind, "%llu\n",
+               div_u64(session->max_wait_ns, NSEC_PER_USEC));
+    mvx_seq_printf(s, "Run total (us)", ind, "%llu\n",
+               div_u64(session->run_ns, NSEC_PER_USEC));
+    mvx_seq_printf(s, "Job frames", ind, "%u\n",
+               mvx_if_session_to_session(session->isession)->job_frames);
+    mvx_seq_printf(s, "Switch in avg (us)", ind, "%llu\n",
+               session->switch_in_samples == 0 ? 0 :
+               div64_u64(session->switch_in_ns,
+                     (uint64_t)session->switch_in_samples * NSEC_PER_USEC));
+    mvx_seq_printf(s, "Switch out avg (us)", ind, "%llu\n",
+               session->switch_out_samples == 0 ? 0 :
+               div64_u64(session->switch_out_ns,
+                     (uint64_t)session->switch_out_samples * NSEC_PER_USEC));
+    mvx_seq_printf(s, "MMU flush", ind, "%u\n", session->mmu_flush_count);
+    mvx_seq_printf(s, "MMU flush total (us)", ind, "%llu\n",
+               div_u64(session->mmu_flush_ns, NSEC_PER_USEC));
 
     lsid = session->lsid;
     if (lsid == NULL)
@@ -445,12 +884,22 @@ static int sched_show(struct seq_file *s,
     if (ret < 0)
         return 0;
 
+    ret = mutex_lock_interruptible(&sched->sessions_mutex);
+    if (ret != 0) {
+        mvx_pm_runtime_put_sync(hwreg->dev);
+        return ret;
+    }
+
     ret = mutex_lock_interruptible(&sched->mutex);
     if (ret != 0) {
+        mutex_unlock(&sched->sessions_mutex);
         mvx_pm_runtime_put_sync(hwreg->dev);
         return ret;
     }
 
+    mvx_seq_printf(s, "Policy", 0, "%u\n", get_sched_policy());
+    mvx_seq_printf(s, "Sessions", 0, "%u\n", sched->session_count);
+    mvx_seq_printf(s, "Virtual clock", 0, "%llu\n", sched->vclock);
     mvx_seq_printf(s, "Core LSID", 0, "%08x\n",
                mvx_hwreg_read(hwreg, MVX_HWREG_CORELSID));
     mvx_seq_printf(s, "Job queue", 0, "%08x\n",
@@ -474,7 +923,42 @@ static int sched_show(struct seq_file *s,
         sched_session_print(s, session, hwreg, 2);
     }
 
+    seq_puts(s, "unscheduled:\n");
+    i = 0;
+    list_for_each_entry(session, &sched->sessions, session) {
+        char tmp[10];
+
+        if (session->lsid != NULL || session->in_pending)
+            continue;
+
+        scnprintf(tmp, sizeof(tmp), "%d", i++);
+        mvx_seq_printf(s, tmp, 1, "\n");
+        sched_session_print(s, session, hwreg, 2);
+    }
+
+    seq_puts(s, "cost:\n");
+    for (i = 0; i <= MVX_FORMAT_BITSTREAM_LAST - MVX_FORMAT_BITSTREAM_FIRST; i++) {
+        int dir, res;
+
+        for (dir = 0; dir < 2; dir++) {
+            for (res = 0; res < MVX_SCHED_COST_RES_BUCKETS; res++) {
+                struct mvx_sched_cost *cost = &sched->cost[i][dir][res];
+                char tmp[32];
+
+                if (cost->samples == 0)
+                    continue;
+
+                scnprintf(tmp, sizeof(tmp), "%d %s res%d",
+                      MVX_FORMAT_BITSTREAM_FIRST + i,
+                      dir ? "enc" : "dec", res);
+                mvx_seq_printf(s, tmp, 1, "cpm=%lu, samples=%u\n",
+                           cost->cpm, cost->samples);
+            }
+        }
+    }
+
     mutex_unlock(&sched->mutex);
+    mutex_unlock(&sched->sessions_mutex);
     mvx_pm_runtime_put_sync(hwreg->dev);
 
     return 0;
@@ -523,6 +1007,8 @@ int mvx_sched_construct(struct mvx_sched *sched,
     sched->hwreg = hwreg;
     sched->if_ops = if_ops;
     sched->state = MVX_SCHED_STATE_IDLE;
+    sched->sample_at = ktime_get();
+    sched->busy_until = sched->sample_at;
     init_completion(&sched->cmp);
     mutex_init(&sched->mutex);
     INIT_LIST_HEAD(&sched->pending);
@@ -580,6 +1066,23 @@ int mvx_sched_session_construct(struct mvx_sched_session *session,
     INIT_LIST_HEAD(&session->notify);
     session->lsid = NULL;
     session->in_pending = false;
+    session->weight = 1;
+    session->vtime = 0;
+    session->deadline = 0;
+    session->queued_at = 0;
+    session->dispatched_at = 0;
+    session->wait_ns = 0;
+    session->max_wait_ns = 0;
+    session->run_ns = 0;
+    session->switch_in_count = 0;
+    session->switch_out_count = 0;
+    session->lsid_map_count = 0;
+    session->switch_in_ns = 0;
+    session->switch_out_ns = 0;
+    session->switch_in_samples = 0;
+    session->switch_out_samples = 0;
+    session->mmu_flush_ns = 0;
+    session->mmu_flush_count = 0;
 
     memset(&session->pcb, 0, sizeof(session->pcb));
 
@@ -617,6 +1120,33 @@ void mvx_sched_list_insert_by_priority(struct mvx_sched *sched,
     list_add(&session->pending, &sched->pending);
 }
 
+/**
+ * mvx_sched_list_insert_by_key() - Insert session in pending list.
+ *
+ * Same as mvx_sched_list_insert_by_priority(), but sessions with equal
+ * priority are ordered by sched_key() instead of arrival order.
+ */
+static void mvx_sched_list_insert_by_key(struct mvx_sched *sched,
+                struct mvx_sched_session *session)
+{
+    struct mvx_sched_session *tmp;
+
+    list_for_each_entry_reverse(tmp, &sched->pending, pending) {
+        if (session->priority > tmp->priority_pending ||
+            (session->priority == tmp->priority_pending &&
+             sched_key(session) >= sched_key(tmp))) {
+            list_add(&session->pending, &tmp->pending);
+            return;
+        } else if (session->priority < tmp->priority_pending &&
+                   tmp->priority_pending > 1 && session->priority > 0) {
+            /* Only age sessions overtaken by a higher priority class */
+            tmp->priority_pending--;
+        }
+    }
+
+    list_add(&session->pending, &sched->pending);
+}
+
 int mvx_sched_switch_in(struct mvx_sched *sched,
             struct mvx_sched_session *session)
 {
@@ -640,7 +1170,14 @@ int mvx_sched_switch_in(struct mvx_sched *sched,
 
     session->in_pending = true;
     session->priority_pending = session->priority;
-    mvx_sched_list_insert_by_priority(sched, session);
+    update_session_realtime(sched, session,
+                session->priority <= V4L2_SESSION_PRIORITY_HIGH);
+    update_session_key(sched, session);
+    update_job_frames(sched, session);
+    if (get_sched_policy() == MVX_SCHED_POLICY_PRIORITY)
+        mvx_sched_list_insert_by_priority(sched, session);
+    else
+        mvx_sched_list_insert_by_key(sched, session);
     queue_work(sched->sched_queue, &sched->sched_task);
 
 unlock_mutex:
@@ -661,6 +1198,8 @@ int mvx_sched_switch_out_rsp(struct mvx_sched *sched,
         return ret;
     }
 
+    account_switch_out(sched, session);
+
     for (i = 0; i < sched->nlsid; i++)
         all_lsid_idle &= mvx_lsid_idle(&sched->lsid[i]);
 
@@ -736,8 +1275,13 @@ int mvx_sched_flush_mmu(struct mvx_sched *sched,
 {
     mutex_lock(&sched->mutex);
 
-    if (session->lsid != NULL)
+    if (session->lsid != NULL) {
+        ktime_t start = ktime_get();
+
         mvx_lsid_flush_mmu(session->lsid);
+        session->mmu_flush_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+        session->mmu_flush_count++;
+    }
 
     mutex_unlock(&sched->mutex);
 
@@ -880,6 +1424,8 @@ void mvx_sched_terminate(struct mvx_sched *sched,
 
     mutex_lock(&sched->mutex);
 
+    update_session_realtime(sched, session, false);
+
     if (session->lsid != NULL) {
         mvx_lsid_jobqueue_remove(session->lsid);
         mvx_lsid_terminate(session->lsid);
@@ -996,7 +1542,6 @@ int mvx_sched_resume(struct mvx_sched *sched)
 
 static unsigned long calculate_session_load(struct mvx_session *session)
 {
-    unsigned long mbs;
     struct mvx_session_port *port_in = &session->port[MVX_DIR_INPUT];
     struct mvx_session_port *port_out = &session->port[MVX_DIR_OUTPUT];
     uint32_t fps;
@@ -1008,8 +1553,6 @@ static unsigned long calculate_session_load(struct mvx_session *session)
     if (session->fw_state == MVX_FW_STATE_STOPPED)
         return 0;
 
-    mbs = (ALIGN(session->orig_width, 16) / 16) * (ALIGN(session->orig_height, 16) / 16);
-
     ktime_get_real_ts64(&now);
     delta = timespec64_sub(now, session->last_timespec);
 
@@ -1032,17 +1575,7 @@ static unsigned long calculate_session_load(struct mvx_session *session)
         fps = max(session->last_fps, session->fps_n / session->fps_d);
     }
 
-    // The performance of encode is half that of decode, we use decode as the benchmark.
-    if (session->is_encoder) {
-        fps *= 2;
-        if (port_out->format == MVX_FORMAT_VP8)
-            fps = fps * 4 / 3; // VP8 encode is 1.33x slower
-    } else {
-        if (MVX_IS_LEGACY_FORMAT(port_in->format))
-            fps = fps * 8 / 3; // Legacy formats are 2.67x slower
-    }
-
-    return mbs * fps;
+    return session_cost_mbs(session, fps);
 }
 
 int mvx_sched_calculate_load(struct mvx_sched *sched, unsigned long *mbs_per_sec)
@@ -1067,18 +1600,119 @@ int mvx_sched_calculate_load(struct mvx_sched *sched, unsigned long *mbs_per_sec
     return 0;
 }
 
-static void update_session_job_frames(struct mvx_sched *sched, uint32_t job_frames)
+int mvx_sched_calculate_cycles(struct mvx_sched *sched,
+                   unsigned long default_cpm,
+                   unsigned int latency_ms,
+                   uint64_t *core_cycles,
+                   uint64_t *session_cycles)
+{
+    struct mvx_sched_session *session;
+    ktime_t now = ktime_get();
+    int ret;
+
+    ret = mutex_lock_interruptible(&sched->sessions_mutex);
+    if (ret != 0)
+        return ret;
+
+    ret = mutex_lock_interruptible(&sched->mutex);
+    if (ret != 0) {
+        mutex_unlock(&sched->sessions_mutex);
+        return ret;
+    }
+
+    *core_cycles = 0;
+    *session_cycles = 0;
+
+    list_for_each_entry(session, &sched->sessions, session) {
+        struct mvx_session *s = mvx_if_session_to_session(session->isession);
+        struct mvx_sched_cost *cost;
+        uint32_t rate;
+        uint64_t cycles;
+
+        if (s->fw_state == MVX_FW_STATE_STOPPED)
+            continue;
+
+        learn_cost(sched, session, now, true);
+
+        /*
+         * Frames must be processed at the fps target, at the measured
+         * input rate, and frames queued to firmware must complete within
+         * the latency target.
+         */
+        rate = max(session_target_fps(s), s->last_fps);
+        if (latency_ms > 0)
+            rate = max_t(uint32_t, rate,
+                     s->port[MVX_DIR_INPUT].buffer_count *
+                     MSEC_PER_SEC / latency_ms);
+
+        cost = session_cost(sched, s);
+        if (cost != NULL && cost->samples > 0)
+            cycles = (uint64_t)cost->cpm * session_frame_mbs(s) * rate;
+        else
+            cycles = (uint64_t)default_cpm * session_cost_mbs(s, rate);
+
+        *core_cycles += cycles;
+        *session_cycles = max(*session_cycles,
+                      div_u64(cycles, max_t(unsigned int,
+                                s->isession.ncores, 1)));
+    }
+
+    mutex_unlock(&sched->mutex);
+    mutex_unlock(&sched->sessions_mutex);
+
+    return 0;
+}
+
+void mvx_sched_get_busy(struct mvx_sched *sched,
+            unsigned long *busy_ns,
+            unsigned long *total_ns)
+{
+    ktime_t now = ktime_get();
+    ktime_t running_from = 0;
+    unsigned int i;
+
+    mutex_lock(&sched->mutex);
+
+    /* Sessions still running are busy from their switch in until now. */
+    for (i = 0; i < sched->nlsid; i++) {
+        struct mvx_sched_session *session = sched->lsid[i].session;
+        struct mvx_session *s;
+
+        if (session == NULL || session_running(session) == false)
+            continue;
+
+        s = mvx_if_session_to_session(session->isession);
+        if (running_from == 0 ||
+            ktime_before(s->fw_switched_in_at, running_from))
+            running_from = s->fw_switched_in_at;
+    }
+
+    if (running_from != 0)
+        account_busy(sched, running_from, now);
+
+    *total_ns = ktime_to_ns(ktime_sub(now, sched->sample_at));
+    *busy_ns = min_t(uint64_t, sched->busy_ns, *total_ns);
+
+    sched->busy_ns = 0;
+    sched->sample_at = now;
+    sched->busy_until = now;
+
+    mutex_unlock(&sched->mutex);
+}
+
+void mvx_sched_set_freq(struct mvx_sched *sched, unsigned long freq)
+{
+    WRITE_ONCE(sched->freq, freq);
+}
+
+static void update_session_job_frames(struct mvx_sched *sched)
 {
     struct mvx_sched_session *session;
     struct mvx_sched_session *tmp;
 
     list_for_each_entry_safe(session, tmp, &sched->sessions, session) {
-        if (session && session->isession) {
-            struct mvx_session * s = mvx_if_session_to_session(session->isession);
-            if (s->job_frames == 0 && job_frames == 1)
-                s->pending_switch_out = true;
-            s->job_frames = job_frames;
-        }
+        if (session && session->isession)
+            update_job_frames(sched, session);
     }
 }
 
@@ -1094,10 +1728,8 @@ int mvx_sched_add_session(struct mvx_sched *sched, struct list_head *session)
 
     list_add_tail(session, &sched->sessions);
     sched->session_count++;
-    if (sched->session_count <= 2 ) {
-        uint32_t job_frames = sched->session_count == 1 ? 0 : 1;
-        update_session_job_frames(sched, job_frames);
-    }
+    if (sched->session_count <= 2)
+        update_session_job_frames(sched);
 
     mutex_unlock(&sched->sessions_mutex);
 
@@ -1112,7 +1744,7 @@ int mvx_sched_remove_session(struct mvx_sched *sched, struct list_head *session)
         list_del(session);
         sched->session_count--;
         if (sched->session_count == 1)
-            update_session_job_frames(sched, 0);
+            update_session_job_frames(sched);
     }
 
     mutex_unlock(&sched->sessions_mutex);
@@ -37,8 +37,10 @@
  ****************************************************************************/
 
 #include <linux/kref.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/mutex.h>
+#include "mvx_if.h"
 #include "mvx_lsid.h"
 
 /****************************************************************************
@@ -54,6 +56,36 @@ enum mvx_sched_state {
     MVX_SCHED_STATE_SUSPEND
 };
 
+/**
+ * enum mvx_sched_policy - Order in which pending sessions are mapped to LSIDs.
+ * @MVX_SCHED_POLICY_PRIORITY:    Session priority, then arrival order.
+ * @MVX_SCHED_POLICY_FAIR:    Weighted fair queuing. Sessions are weighted by
+ *                              their macroblock throughput and the session
+ *                              with the least weighted service runs first.
+ * @MVX_SCHED_POLICY_DEADLINE:    Earliest deadline first. The deadline of a
+ *                              session is its switch in request time plus
+ *                              one frame period of its fps target.
+ */
+enum mvx_sched_policy {
+    MVX_SCHED_POLICY_PRIORITY,
+    MVX_SCHED_POLICY_FAIR,
+    MVX_SCHED_POLICY_DEADLINE,
+    MVX_SCHED_POLICY_MAX
+};
+
+/* Resolution buckets of the learned codec cost, split at 720p and 1080p. */
+#define MVX_SCHED_COST_RES_BUCKETS 3
+
+/**
+ * struct mvx_sched_cost - Learned hardware cost of a codec.
+ * @cpm:    Core cycles per macroblock, exponential moving average.
+ * @samples:    Number of samples.
+ */
+struct mvx_sched_cost {
+    unsigned long cpm;
+    unsigned int samples;
+};
+
 /**
  * struct mvx_sched - Scheduler class.
  * @dev:    Pointer to device.
@@ -63,6 +95,16 @@ enum mvx_sched_state {
  * @pending:    List if sessions pending scheduling.
  * @nlsid:    Number of LSID.
  * @lsid:    Array of LSID instances.
+ * @vclock:    System virtual time, the lowest virtual time of the waiting and
+ *              running sessions. Used as starting point for sessions that
+ *              have been idle.
+ * @rt_session_count:    Number of real-time sessions, used to cap the job
+ *              frames of all sessions.
+ * @freq:    Current core clock frequency in Hz, 0 if unknown.
+ * @cost:    Learned cost per bitstream format, direction and resolution.
+ * @sample_at:    Start of the current busy time sampling window.
+ * @busy_until:    End of the busy time accounted in the current window.
+ * @busy_ns:    Busy time of completed jobs in the current window.
  */
 struct mvx_sched {
     struct device *dev;
@@ -79,6 +121,15 @@ struct mvx_sched {
     enum mvx_sched_state state;
     struct completion cmp;
     unsigned int session_count;
+    uint64_t vclock;
+    unsigned int rt_session_count;
+    unsigned long freq;
+    struct mvx_sched_cost cost[MVX_FORMAT_BITSTREAM_LAST -
+                   MVX_FORMAT_BITSTREAM_FIRST + 1][2]
+                  [MVX_SCHED_COST_RES_BUCKETS];
+    ktime_t sample_at;
+    ktime_t busy_until;
+    uint64_t busy_ns;
 };
 
 /**
@@ -87,6 +138,26 @@ struct mvx_sched {
  * @head:    List head used to insert session into scheduler pending list.
  * @lsid:    Pointer to LSID the session is mapped to.
  * @pcb:    LSID pcb.
+ * @realtime:    Session has high or preemption priority.
+ * @weight:    Macroblocks per second the session needs to meet its fps target.
+ * @vtime:    Hardware time received, scaled by the inverse of @weight.
+ * @deadline:    Time by which the session should be running.
+ * @queued_at:    Time the session was added to the pending list.
+ * @dispatched_at:    Time the session was added to the job queue.
+ * @wait_ns:    Accumulated time spent in the pending list.
+ * @max_wait_ns:    Longest time spent in the pending list.
+ * @run_ns:    Accumulated time between dispatch and switch out.
+ * @switch_in_count:    Number of times the session was added to job queue.
+ * @switch_out_count:    Number of switch out responses.
+ * @lsid_map_count:    Number of times the session was mapped to a LSID.
+ * @switch_in_ns:    Accumulated time from dispatch to firmware switch in.
+ * @switch_out_ns:    Accumulated time from switch out request to response.
+ * @switch_in_samples:    Number of samples in @switch_in_ns.
+ * @switch_out_samples:    Number of samples in @switch_out_ns.
+ * @mmu_flush_ns:    Accumulated time spent flushing the MMU.
+ * @mmu_flush_count:    Number of MMU flushes.
+ * @learn_from:    Start of busy time not yet used for cost learning.
+ * @learn_frames:    Completed frames when @learn_from was set.
  *
  * This struct is used to keep track of sessions specific information.
  */
@@ -101,6 +172,26 @@ struct mvx_sched_session {
     uint32_t priority;
     uint32_t priority_pending;
     uint32_t priority_in_queue;
+    bool realtime;
+    unsigned long weight;
+    uint64_t vtime;
+    ktime_t deadline;
+    ktime_t queued_at;
+    ktime_t dispatched_at;
+    uint64_t wait_ns;
+    uint64_t max_wait_ns;
+    uint64_t run_ns;
+    unsigned int switch_in_count;
+    unsigned int switch_out_count;
+    unsigned int lsid_map_count;
+    uint64_t switch_in_ns;
+    uint64_t switch_out_ns;
+    unsigned int switch_in_samples;
+    unsigned int switch_out_samples;
+    uint64_t mmu_flush_ns;
+    unsigned int mmu_flush_count;
+    ktime_t learn_from;
+    uint64_t learn_frames;
 };
 
 /****************************************************************************
@@ -255,6 +346,41 @@ int mvx_sched_resume(struct mvx_sched *sched);
  */
 int mvx_sched_calculate_load(struct mvx_sched *sched, unsigned long *mbs_per_sec);
 
+/**
+ * mvx_sched_calculate_cycles() - calculate core cycles needed by all sessions.
+ * @sched:    Pointer to scheduler object.
+ * @default_cpm:    Core cycles per decoded macroblock used for codecs that
+ *                  have not been measured yet.
+ * @latency_ms:    Time in which frames queued to firmware must complete.
+ * @core_cycles:    Core cycles per second summed over all sessions.
+ * @session_cycles:    Highest cycles per second needed on each core used by
+ *                  a single session.
+ *
+ * Return: 0 on success, else error code.
+ */
+int mvx_sched_calculate_cycles(struct mvx_sched *sched,
+                   unsigned long default_cpm,
+                   unsigned int latency_ms,
+                   uint64_t *core_cycles,
+                   uint64_t *session_cycles);
+
+/**
+ * mvx_sched_get_busy() - get hardware busy time since last call.
+ * @sched:    Pointer to scheduler object.
+ * @busy_ns:    Time at least one session was running on the hardware.
+ * @total_ns:    Length of the sampling window.
+ */
+void mvx_sched_get_busy(struct mvx_sched *sched,
+            unsigned long *busy_ns,
+            unsigned long *total_ns);
+
+/**
+ * mvx_sched_set_freq() - set core clock frequency used for cost learning.
+ * @sched:    Pointer to scheduler object.
+ * @freq:    Frequency in Hz.
+ */
+void mvx_sched_set_freq(struct mvx_sched *sched, unsigned long freq);
+
 /**
  * mvx_sched_add_session() - add session to list.
  * @sched:    Pointer to scheduler object.
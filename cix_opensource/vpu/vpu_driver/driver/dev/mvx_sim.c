@@ -0,0 +1,1460 @@
+/*
+ * The confidential and proprietary information contained in this file may
+ * only be used by a person authorised under and to the extent permitted
+ * by a subsisting licensing agreement from Arm Technology (China) Co., Ltd.
+ *
+ *            (C) COPYRIGHT 2021-2021 Arm Technology (China) Co., Ltd.
+ *                ALL RIGHTS RESERVED
+ *
+ * This entire notice must be reproduced on all copies of this file
+ * and copies of this file may only be made by a person if such person is
+ * permitted to do so under the terms of a subsisting license agreement
+ * from Arm Technology (China) Co., Ltd.
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+
+/****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include <linux/device.h>
+#include <linux/dma-mapping.h>
+#include <linux/firmware.h>
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/irq_sim.h>
+#include <linux/irqdomain.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include "fw_v2/mve_protocol_def.h"
+#include "mvx_firmware.h"
+#include "mvx_firmware_cache.h"
+#include "mvx_hwreg.h"
+#include "mvx_log_group.h"
+#include "mvx_mmu.h"
+#include "mvx_sim.h"
+
+/****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+/* Name of the parent device. */
+#define MVX_SIM_NAME            "amvx_sim"
+
+/* Must match the name of the MVx platform driver. */
+#define MVX_SIM_DEV_NAME        "amvx_dev"
+
+/* Physical address of the L1 page table stored in the MMU_CTRL register. */
+#define MVX_SIM_PTE_PA(pte) \
+    ((phys_addr_t)(((pte) >> 2) & ((1 << 28) - 1)) << MVE_PAGE_SHIFT)
+
+/*
+ * Layout of the generated firmware binary. The first BSS page is private per
+ * core, the second is shared between all cores and holds the firmware state
+ * that must survive a switch out.
+ */
+#define MVX_SIM_BSS_ADDR        0x80000
+#define MVX_SIM_STATE_ADDR      (MVE_MEM_REGION_FW_INSTANCE0_ADDR_BEGIN + \
+                     MVX_SIM_BSS_ADDR + MVE_PAGE_SIZE)
+
+#define MVX_SIM_STATE_MAGIC     0x4d565853
+
+/* Number of output buffers requested from the client when decoding. */
+#define MVX_SIM_NUM_BUFFERS     4
+
+/****************************************************************************
+ * Types
+ ****************************************************************************/
+
+/**
+ * struct mvx_sim_state - Firmware state kept in the shared BSS page.
+ * @magic:        MVX_SIM_STATE_MAGIC once the session has booted.
+ * @state:        MVE_STATE_STOPPED or MVE_STATE_RUNNING.
+ * @job_frames:        Frames left of the current job. 0 means infinite.
+ * @eos_pending:    An EOS marker has been consumed from the input queue,
+ *                      but not yet signalled on the output queue.
+ * @seq_sent:        Sequence parameters have been sent.
+ * @wait_flush:        Waiting for the host to flush the output queue.
+ */
+struct mvx_sim_state {
+    uint32_t magic;
+    uint32_t state;
+    uint32_t job_frames;
+    uint32_t eos_pending;
+    uint32_t seq_sent;
+    uint32_t wait_flush;
+};
+
+/**
+ * struct mvx_sim_msg - Message peeked from a host queue.
+ * @code:    Message code.
+ * @size:    Message size in bytes.
+ * @next:    Queue read position following the message.
+ * @data:    Message data.
+ */
+struct mvx_sim_msg {
+    uint16_t code;
+    uint16_t size;
+    unsigned int next;
+    uint32_t data[MVE_COMM_QUEUE_SIZE_IN_WORDS];
+};
+
+/**
+ * struct mvx_sim_queue - Pair of host and firmware communication areas.
+ * @host:    Area written by the host.
+ * @mve:    Area written by the firmware.
+ */
+struct mvx_sim_queue {
+    struct mve_comm_area_host *host;
+    struct mve_comm_area_mve *mve;
+};
+
+struct mvx_sim;
+
+/**
+ * struct mvx_sim_lsid - Simulated firmware instance running on a LSID.
+ * @sim:        Pointer to simulator.
+ * @id:            LSID number.
+ * @running:        LSID has been scheduled on a core. Protected by sim->lock.
+ * @core:        Core the LSID is running on. Protected by sim->lock.
+ * @booted:        Firmware has sent SWITCHED_IN. Protected by sim->lock.
+ * @notify:        A message has been written during this step.
+ * @switch_out:        Firmware shall switch out at the end of this step.
+ * @job_done:        All frames of the current job have been processed.
+ * @idle_since:        Time of the last progress.
+ * @frame_due:        Completion time of the current frame, or 0.
+ * @state:        Copy of the firmware state.
+ * @mmu:        MMU view of the session mapped to the LSID.
+ * @msg:        Message queue.
+ * @buf_in:        Input buffer queue.
+ * @buf_out:        Output buffer queue.
+ * @work:        Work executing a firmware step.
+ * @req:        Scratch for messages.
+ * @in:            Scratch for input buffers.
+ * @out:        Scratch for output buffers.
+ */
+struct mvx_sim_lsid {
+    struct mvx_sim *sim;
+    unsigned int id;
+    bool running;
+    unsigned int core;
+    bool booted;
+    bool notify;
+    bool switch_out;
+    bool job_done;
+    ktime_t idle_since;
+    ktime_t frame_due;
+    struct mvx_sim_state state;
+    struct mvx_mmu mmu;
+    struct mvx_sim_queue msg;
+    struct mvx_sim_queue buf_in;
+    struct mvx_sim_queue buf_out;
+    struct delayed_work work;
+    struct mvx_sim_msg req;
+    struct mvx_sim_msg in;
+    struct mvx_sim_msg out;
+};
+
+/**
+ * struct mvx_sim - Simulated VPU hardware.
+ * @top:    Parent device.
+ * @pdev:    Device bound by the MVx platform driver.
+ * @fwnode:    Firmware node of the IRQ domain.
+ * @domain:    Simulated IRQ domain.
+ * @irq:    Virtual IRQ number.
+ * @ncores:    Number of simulated cores.
+ * @lock:    Protects the registers and the LSID scheduling state.
+ * @mutex:    Serializes firmware steps and LSID termination.
+ * @wq:        Work queue executing firmware steps.
+ * @regs:    Main registers.
+ * @lsid_regs:    LSID registers.
+ * @rcsu_regs:    RCSU registers.
+ * @lsid:    Firmware instances.
+ */
+struct mvx_sim {
+    struct platform_device *top;
+    struct platform_device *pdev;
+    struct fwnode_handle *fwnode;
+    struct irq_domain *domain;
+    unsigned int irq;
+    unsigned int ncores;
+    spinlock_t lock;
+    struct mutex mutex;
+    struct workqueue_struct *wq;
+    uint32_t regs[MVX_HWREG_WHAT_MAX];
+    uint32_t lsid_regs[MVX_LSID_MAX][MVX_HWREG_LSID_MAX];
+    uint32_t rcsu_regs[MVX_RCSU_HWREG_WHAT_MAX];
+    struct mvx_sim_lsid lsid[MVX_LSID_MAX];
+};
+
+/**
+ * struct mvx_sim_fw_request - Pending firmware binary request.
+ * @work:    Work generating the firmware binary.
+ * @dev:    Pointer to device.
+ * @context:    Context passed to callback.
+ * @cont:    Callback.
+ */
+struct mvx_sim_fw_request {
+    struct work_struct work;
+    struct device *dev;
+    void *context;
+    void (*cont)(const struct firmware *fw, void *context);
+};
+
+/****************************************************************************
+ * Static variables and functions
+ ****************************************************************************/
+
+static struct mvx_sim *mvx_sim;
+
+static uint sim_hw_id = 0x56640100;
+module_param(sim_hw_id, uint, 0440);
+MODULE_PARM_DESC(sim_hw_id, "Simulated HARDWARE_ID register.");
+
+static uint sim_ncores = MVX_NUMBER_OF_CORES;
+module_param(sim_ncores, uint, 0440);
+MODULE_PARM_DESC(sim_ncores, "Number of simulated cores.");
+
+static uint sim_protocol_major = 2;
+module_param(sim_protocol_major, uint, 0660);
+MODULE_PARM_DESC(sim_protocol_major, "Host interface major version of the simulated firmware.");
+
+static uint sim_protocol_minor = 5;
+module_param(sim_protocol_minor, uint, 0660);
+MODULE_PARM_DESC(sim_protocol_minor, "Host interface minor version of the simulated firmware.");
+
+static uint sim_frame_us = 2000;
+module_param(sim_frame_us, uint, 0660);
+MODULE_PARM_DESC(sim_frame_us, "Time in microseconds to process one frame.");
+
+static uint sim_idle_ms = 5;
+module_param(sim_idle_ms, uint, 0660);
+MODULE_PARM_DESC(sim_idle_ms, "Time in milliseconds without progress before IDLE is sent.");
+
+static uint sim_width = 1920;
+module_param(sim_width, uint, 0660);
+MODULE_PARM_DESC(sim_width, "Width of decoded frames.");
+
+static uint sim_height = 1080;
+module_param(sim_height, uint, 0660);
+MODULE_PARM_DESC(sim_height, "Height of decoded frames.");
+
+static uint sim_bitstream_bytes = 16384;
+module_param(sim_bitstream_bytes, uint, 0660);
+MODULE_PARM_DESC(sim_bitstream_bytes, "Size of encoded frames.");
+
+/**
+ * read32n() - Read words from a circular queue.
+ */
+static unsigned int read32n(volatile uint32_t *queue,
+                unsigned int pos,
+                uint32_t *data,
+                unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        data[i] = queue[pos];
+        pos = (pos + 1) % MVE_COMM_QUEUE_SIZE_IN_WORDS;
+    }
+
+    return pos;
+}
+
+/**
+ * write32n() - Write words to a circular queue.
+ */
+static unsigned int write32n(volatile uint32_t *queue,
+                 unsigned int pos,
+                 const uint32_t *data,
+                 unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        queue[pos] = data[i];
+        pos = (pos + 1) % MVE_COMM_QUEUE_SIZE_IN_WORDS;
+    }
+
+    return pos;
+}
+
+/**
+ * sim_clean() - Write back memory the host reads after the firmware updated
+ *         it.
+ */
+static void sim_clean(struct mvx_sim_lsid *lsid,
+              void *addr,
+              size_t size)
+{
+    wmb();
+    dma_sync_single_for_device(lsid->mmu.dev, virt_to_phys(addr), size,
+                   DMA_TO_DEVICE);
+}
+
+/**
+ * sim_space() - Number of words that can be written to a firmware queue.
+ *
+ * One word is always left unused to tell a full queue from an empty one.
+ */
+static unsigned int sim_space(struct mvx_sim_queue *queue)
+{
+    unsigned int rpos = queue->host->out_rpos;
+    unsigned int wpos = queue->mve->out_wpos;
+
+    return (rpos + MVE_COMM_QUEUE_SIZE_IN_WORDS - wpos - 1) %
+           MVE_COMM_QUEUE_SIZE_IN_WORDS;
+}
+
+static unsigned int sim_words(uint16_t size)
+{
+    return 1 + DIV_ROUND_UP(size, sizeof(uint32_t));
+}
+
+/**
+ * sim_peek() - Read the next message from a host queue without consuming it.
+ *
+ * Return: true if a message was read, else false.
+ */
+static bool sim_peek(struct mvx_sim_queue *queue,
+             struct mvx_sim_msg *msg)
+{
+    struct mve_msg_header header;
+    unsigned int rpos = queue->mve->in_rpos;
+    unsigned int wpos = queue->host->in_wpos;
+    unsigned int avail;
+    unsigned int words;
+
+    if (rpos == wpos || rpos >= MVE_COMM_QUEUE_SIZE_IN_WORDS ||
+        wpos >= MVE_COMM_QUEUE_SIZE_IN_WORDS)
+        return false;
+
+    /* Read the data only after the write position. */
+    rmb();
+
+    avail = (wpos + MVE_COMM_QUEUE_SIZE_IN_WORDS - rpos) %
+        MVE_COMM_QUEUE_SIZE_IN_WORDS;
+    rpos = read32n(queue->host->in_data, rpos, (uint32_t *)&header, 1);
+
+    words = min_t(unsigned int, sim_words(header.size) - 1, avail - 1);
+    msg->code = header.code;
+    msg->size = min_t(unsigned int, header.size, words * sizeof(uint32_t));
+    msg->next = read32n(queue->host->in_data, rpos, msg->data, words);
+
+    return true;
+}
+
+/**
+ * sim_consume() - Consume a message previously read with sim_peek().
+ */
+static void sim_consume(struct mvx_sim_lsid *lsid,
+            struct mvx_sim_queue *queue,
+            struct mvx_sim_msg *msg)
+{
+    queue->mve->in_rpos = msg->next;
+    sim_clean(lsid, queue->mve, MVE_PAGE_SIZE);
+}
+
+/**
+ * sim_put() - Write a message to a firmware queue.
+ *
+ * Return: 0 on success, else error code.
+ */
+static int sim_put(struct mvx_sim_lsid *lsid,
+           struct mvx_sim_queue *queue,
+           uint16_t code,
+           const void *data,
+           uint16_t size)
+{
+    struct mve_msg_header header = { .code = code, .size = size };
+    unsigned int wpos = queue->mve->out_wpos;
+    const uint8_t *src = data;
+
+    if (sim_space(queue) < sim_words(size))
+        return -ENOSPC;
+
+    wpos = write32n(queue->mve->out_data, wpos, (uint32_t *)&header, 1);
+    while (size > 0) {
+        uint32_t word = 0;
+        uint16_t n = min_t(uint16_t, size, sizeof(word));
+
+        memcpy(&word, src, n);
+        wpos = write32n(queue->mve->out_data, wpos, &word, 1);
+        src += n;
+        size -= n;
+    }
+
+    /* Make the message visible before the write position. */
+    wmb();
+    queue->mve->out_wpos = wpos;
+    sim_clean(lsid, queue->mve, MVE_PAGE_SIZE);
+    lsid->notify = true;
+
+    return 0;
+}
+
+static int sim_reply(struct mvx_sim_lsid *lsid,
+             uint16_t code,
+             const void *data,
+             uint16_t size)
+{
+    return sim_put(lsid, &lsid->msg, code, data, size);
+}
+
+/**
+ * sim_return_buffer() - Return a buffer to the host.
+ * @lsid:    Pointer to LSID.
+ * @output:    true for the output queue, false for the input queue.
+ * @buf:    Buffer previously read with sim_peek().
+ *
+ * The buffer is written to the firmware buffer queue, followed by a response
+ * on the message queue, and is then consumed from the host buffer queue.
+ *
+ * Return: 0 on success, else error code.
+ */
+static int sim_return_buffer(struct mvx_sim_lsid *lsid,
+                 bool output,
+                 struct mvx_sim_msg *buf)
+{
+    struct mvx_sim_queue *queue = output ? &lsid->buf_out : &lsid->buf_in;
+    int ret;
+
+    if (sim_space(&lsid->msg) < sim_words(0))
+        return -ENOSPC;
+
+    ret = sim_put(lsid, queue, buf->code, buf->data, buf->size);
+    if (ret != 0)
+        return ret;
+
+    sim_reply(lsid, output ? MVE_RESPONSE_CODE_OUTPUT :
+          MVE_RESPONSE_CODE_INPUT, NULL, 0);
+    sim_consume(lsid, queue, buf);
+
+    return 0;
+}
+
+static bool sim_is_eos_marker(struct mvx_sim_msg *buf)
+{
+    uint64_t handle;
+
+    if (buf->code != MVE_BUFFER_CODE_FRAME &&
+        buf->code != MVE_BUFFER_CODE_BITSTREAM)
+        return false;
+
+    /* host_handle is the first member of both buffer types. */
+    memcpy(&handle, buf->data, sizeof(handle));
+
+    return handle == MVX_FW_CODE_EOS;
+}
+
+/**
+ * sim_flush() - Return all buffers queued by the host in one direction.
+ *
+ * Return: 0 on success, else error code.
+ */
+static int sim_flush(struct mvx_sim_lsid *lsid,
+             bool output)
+{
+    struct mvx_sim_queue *queue = output ? &lsid->buf_out : &lsid->buf_in;
+    struct mvx_sim_msg *buf = output ? &lsid->out : &lsid->in;
+    int ret;
+
+    while (sim_peek(queue, buf)) {
+        if (buf->code == MVE_BUFFER_CODE_PARAM || sim_is_eos_marker(buf)) {
+            sim_consume(lsid, queue, buf);
+            continue;
+        }
+
+        /* Output buffers are returned without content. */
+        if (output && buf->code == MVE_BUFFER_CODE_FRAME) {
+            struct mve_buffer_frame *f = (void *)buf->data;
+
+            f->frame_flags &= ~(MVE_BUFFER_FRAME_FLAG_TOP_PRESENT |
+                        MVE_BUFFER_FRAME_FLAG_BOT_PRESENT);
+        } else if (output && buf->code == MVE_BUFFER_CODE_BITSTREAM) {
+            struct mve_buffer_bitstream *b = (void *)buf->data;
+
+            b->bitstream_filled_len = 0;
+        }
+
+        ret = sim_return_buffer(lsid, output, buf);
+        if (ret != 0)
+            return ret;
+    }
+
+    if (!output) {
+        lsid->state.eos_pending = 0;
+        lsid->frame_due = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * sim_release() - Stop a LSID and free its core. Called with sim->lock held.
+ */
+static void sim_release(struct mvx_sim *sim,
+            struct mvx_sim_lsid *lsid)
+{
+    uint32_t shift = lsid->core * MVE_CORELSID_LSID_BITS;
+
+    if (!lsid->running)
+        return;
+
+    sim->regs[MVX_HWREG_CORELSID] |= MVX_CORELSID_LSID_MASK << shift;
+    lsid->running = false;
+    lsid->booted = false;
+}
+
+/**
+ * sim_dispatch() - Start jobs from the job queue on free cores. Called with
+ *            sim->lock held.
+ *
+ * Each job runs on a single core. Entries for a LSID that is already running
+ * are dropped.
+ */
+static void sim_dispatch(struct mvx_sim *sim)
+{
+    while (sim->regs[MVX_HWREG_ENABLE] != 0) {
+        uint32_t jobqueue = sim->regs[MVX_HWREG_JOBQUEUE];
+        unsigned int id = (jobqueue >> MVE_JOBQUEUE_LSID_SHIFT) &
+                  MVE_JOBQUEUE_LSID_MASK;
+        struct mvx_sim_lsid *lsid;
+
+        if (id >= MVX_LSID_MAX)
+            break;
+
+        lsid = &sim->lsid[id];
+        if (!lsid->running) {
+            uint32_t corelsid = sim->regs[MVX_HWREG_CORELSID];
+            unsigned int core;
+
+            for (core = 0; core < sim->ncores; core++)
+                if (((corelsid >> (core * MVE_CORELSID_LSID_BITS)) &
+                     MVX_CORELSID_LSID_MASK) == MVX_CORELSID_LSID_MASK)
+                    break;
+
+            if (core >= sim->ncores)
+                break;
+
+            corelsid &= ~(MVX_CORELSID_LSID_MASK <<
+                      (core * MVE_CORELSID_LSID_BITS));
+            corelsid |= id << (core * MVE_CORELSID_LSID_BITS);
+            sim->regs[MVX_HWREG_CORELSID] = corelsid;
+
+            lsid->running = true;
+            lsid->booted = false;
+            lsid->core = core;
+            mod_delayed_work(sim->wq, &lsid->work, 0);
+        }
+
+        sim->regs[MVX_HWREG_JOBQUEUE] =
+            (jobqueue >> MVE_JOBQUEUE_JOB_BITS) |
+            (MVE_JOBQUEUE_JOB_OBSOLETED <<
+             ((MVE_JOBQUEUE_NJOBS - 1) * MVE_JOBQUEUE_JOB_BITS));
+    }
+}
+
+/**
+ * sim_raise_irq() - Raise the VE interrupt for a LSID.
+ */
+static void sim_raise_irq(struct mvx_sim *sim,
+              unsigned int id)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&sim->lock, flags);
+    sim->lsid_regs[id][MVX_HWREG_LIRQVE] = 1;
+    spin_unlock_irqrestore(&sim->lock, flags);
+
+    irq_set_irqchip_state(sim->irq, IRQCHIP_STATE_PENDING, true);
+}
+
+static void *sim_map(struct mvx_sim_lsid *lsid,
+             mvx_mmu_va va)
+{
+    phys_addr_t pa;
+
+    if (mvx_mmu_va_to_pa(&lsid->mmu, va, &pa) != 0)
+        return NULL;
+
+    return phys_to_virt(pa);
+}
+
+/**
+ * sim_fw_boot() - Boot the firmware after the LSID has been scheduled.
+ *
+ * Return: 0 on success, else error code.
+ */
+static int sim_fw_boot(struct mvx_sim_lsid *lsid)
+{
+    struct mvx_sim *sim = lsid->sim;
+    struct mve_response_switched_in switched_in;
+    unsigned long flags;
+    uint32_t mmu_ctrl;
+    int ret;
+
+    spin_lock_irqsave(&sim->lock, flags);
+    mmu_ctrl = sim->lsid_regs[lsid->id][MVX_HWREG_MMU_CTRL];
+    switched_in.core = lsid->core;
+    spin_unlock_irqrestore(&sim->lock, flags);
+
+    lsid->mmu.dev = &sim->pdev->dev;
+    lsid->mmu.page_table = phys_to_virt(MVX_SIM_PTE_PA(mmu_ctrl));
+
+    lsid->msg.host = sim_map(lsid, MVE_COMM_MSG_INQ_ADDR);
+    lsid->msg.mve = sim_map(lsid, MVE_COMM_MSG_OUTQ_ADDR);
+    lsid->buf_in.host = sim_map(lsid, MVE_COMM_BUF_INQ_ADDR);
+    lsid->buf_in.mve = sim_map(lsid, MVE_COMM_BUF_INRQ_ADDR);
+    lsid->buf_out.host = sim_map(lsid, MVE_COMM_BUF_OUTQ_ADDR);
+    lsid->buf_out.mve = sim_map(lsid, MVE_COMM_BUF_OUTRQ_ADDR);
+    if (lsid->msg.host == NULL || lsid->msg.mve == NULL ||
+        lsid->buf_in.host == NULL || lsid->buf_in.mve == NULL ||
+        lsid->buf_out.host == NULL || lsid->buf_out.mve == NULL) {
+        MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_ERROR,
+                  "Simulator failed to map message queues. lsid=%u.",
+                  lsid->id);
+        return -EFAULT;
+    }
+
+    ret = mvx_mmu_read(&lsid->mmu, MVX_SIM_STATE_ADDR, &lsid->state,
+               sizeof(lsid->state));
+    if (ret != 0) {
+        MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_ERROR,
+                  "Simulator failed to read firmware state. lsid=%u.",
+                  lsid->id);
+        return ret;
+    }
+
+    if (lsid->state.magic != MVX_SIM_STATE_MAGIC) {
+        memset(&lsid->state, 0, sizeof(lsid->state));
+        lsid->state.magic = MVX_SIM_STATE_MAGIC;
+        lsid->state.state = MVE_STATE_STOPPED;
+    }
+
+    lsid->switch_out = false;
+    lsid->job_done = false;
+    lsid->idle_since = ktime_get();
+    lsid->frame_due = 0;
+
+    ret = sim_reply(lsid, MVE_RESPONSE_CODE_SWITCHED_IN, &switched_in,
+            sizeof(switched_in));
+    if (ret != 0)
+        return ret;
+
+    spin_lock_irqsave(&sim->lock, flags);
+    lsid->booted = true;
+    spin_unlock_irqrestore(&sim->lock, flags);
+
+    return 0;
+}
+
+/**
+ * sim_fw_switch_out() - Save the firmware state and free the core.
+ *
+ * Return: 0 on success, else error code.
+ */
+static int sim_fw_switch_out(struct mvx_sim_lsid *lsid)
+{
+    struct mvx_sim *sim = lsid->sim;
+    struct mve_response_switched_out switched_out = {
+        .core       = lsid->core,
+        .reason     = 0,
+        .sub_reason = 0
+    };
+    unsigned long flags;
+    int ret;
+
+    ret = mvx_mmu_write(&lsid->mmu, MVX_SIM_STATE_ADDR, &lsid->state,
+                sizeof(lsid->state));
+    if (ret != 0)
+        return ret;
+
+    ret = sim_reply(lsid, MVE_RESPONSE_CODE_SWITCHED_OUT, &switched_out,
+            sizeof(switched_out));
+    if (ret != 0)
+        return ret;
+
+    spin_lock_irqsave(&sim->lock, flags);
+    sim_release(sim, lsid);
+    sim->lsid_regs[lsid->id][MVX_HWREG_LIRQVE] = 1;
+    sim_dispatch(sim);
+    spin_unlock_irqrestore(&sim->lock, flags);
+
+    irq_set_irqchip_state(sim->irq, IRQCHIP_STATE_PENDING, true);
+
+    return 0;
+}
+
+/**
+ * sim_fw_messages() - Handle messages from the host.
+ *
+ * Return: true if any message was handled, else false.
+ */
+static bool sim_fw_messages(struct mvx_sim_lsid *lsid)
+{
+    struct mvx_sim_msg *req = &lsid->req;
+    bool progress = false;
+
+    while (lsid->switch_out == false && sim_peek(&lsid->msg, req)) {
+        int ret = 0;
+
+        switch (req->code) {
+        case MVE_REQUEST_CODE_GO:
+        case MVE_REQUEST_CODE_STOP: {
+            struct mve_response_state_change change = {
+                .new_state = req->code == MVE_REQUEST_CODE_GO ?
+                         MVE_STATE_RUNNING : MVE_STATE_STOPPED
+            };
+
+            ret = sim_reply(lsid, MVE_RESPONSE_CODE_STATE_CHANGE,
+                    &change, sizeof(change));
+            if (ret == 0)
+                lsid->state.state = change.new_state;
+
+            break;
+        }
+        case MVE_REQUEST_CODE_JOB: {
+            struct mve_request_job *job = (void *)req->data;
+
+            lsid->state.job_frames = job->frames;
+            break;
+        }
+        case MVE_REQUEST_CODE_SWITCH:
+            lsid->switch_out = true;
+            break;
+        case MVE_REQUEST_CODE_PING:
+            ret = sim_reply(lsid, MVE_RESPONSE_CODE_PONG, NULL, 0);
+            break;
+        case MVE_REQUEST_CODE_SET_OPTION:
+            ret = sim_reply(lsid, MVE_RESPONSE_CODE_SET_OPTION_CONFIRM,
+                    NULL, 0);
+            break;
+        case MVE_REQUEST_CODE_INPUT_FLUSH:
+            ret = sim_flush(lsid, false);
+            if (ret == 0)
+                ret = sim_reply(lsid, MVE_RESPONSE_CODE_INPUT_FLUSHED,
+                        NULL, 0);
+
+            break;
+        case MVE_REQUEST_CODE_OUTPUT_FLUSH:
+            ret = sim_flush(lsid, true);
+            if (ret == 0)
+                ret = sim_reply(lsid, MVE_RESPONSE_CODE_OUTPUT_FLUSHED,
+                        NULL, 0);
+
+            if (ret == 0)
+                lsid->state.wait_flush = 0;
+
+            break;
+        case MVE_REQUEST_CODE_DUMP:
+            ret = sim_reply(lsid, MVE_RESPONSE_CODE_DUMP, NULL, 0);
+            break;
+        case MVE_REQUEST_CODE_DEBUG:
+            ret = sim_reply(lsid, MVE_RESPONSE_CODE_DEBUG, NULL, 0);
+            break;
+        default:
+            break;
+        }
+
+        /* Retry the message when the host has made room in the queue. */
+        if (ret != 0)
+            break;
+
+        sim_consume(lsid, &lsid->msg, req);
+        progress = true;
+    }
+
+    return progress;
+}
+
+/**
+ * sim_fw_sequence() - Send decoder stream parameters and wait for the host
+ *               to flush the output queue.
+ *
+ * Return: 0 on success, else error code.
+ */
+static int sim_fw_sequence(struct mvx_sim_lsid *lsid)
+{
+    struct mve_response_frame_alloc_parameters alloc = {
+        .planar_alloc_frame_width  = sim_width,
+        .planar_alloc_frame_height = sim_height
+    };
+    struct mve_response_sequence_parameters seq = {
+        .chroma_format      = MVE_CHROMA_FORMAT_420,
+        .bitdepth_luma      = 8,
+        .bitdepth_chroma    = 8,
+        .num_buffers_planar = MVX_SIM_NUM_BUFFERS,
+        .num_buffers_afbc   = MVX_SIM_NUM_BUFFERS
+    };
+
+    if (sim_space(&lsid->msg) < sim_words(sizeof(alloc)) +
+        sim_words(sizeof(seq)))
+        return -ENOSPC;
+
+    sim_reply(lsid, MVE_RESPONSE_CODE_FRAME_ALLOC_PARAM, &alloc,
+          sizeof(alloc));
+    sim_reply(lsid, MVE_RESPONSE_CODE_SEQUENCE_PARAMETERS, &seq,
+          sizeof(seq));
+    lsid->state.seq_sent = 1;
+    lsid->state.wait_flush = 1;
+
+    return 0;
+}
+
+/**
+ * sim_fw_frame() - Process one frame once its processing time has elapsed.
+ * @lsid:    Pointer to LSID.
+ * @delay:    Time left in jiffies if the frame is not completed yet.
+ *
+ * Pixel and bitstream data are not touched, only the buffer descriptors are
+ * updated.
+ *
+ * Return: 0 on success, else error code.
+ */
+static int sim_fw_frame(struct mvx_sim_lsid *lsid,
+            unsigned long *delay)
+{
+    struct mvx_sim_msg *in = &lsid->in;
+    struct mvx_sim_msg *out = &lsid->out;
+    ktime_t now = ktime_get();
+    int ret;
+
+    if (lsid->frame_due == 0)
+        lsid->frame_due = ktime_add_us(now, sim_frame_us);
+
+    if (ktime_before(now, lsid->frame_due)) {
+        *delay = usecs_to_jiffies(ktime_us_delta(lsid->frame_due, now));
+        return -EAGAIN;
+    }
+
+    if (sim_space(&lsid->buf_out) < sim_words(out->size) ||
+        sim_space(&lsid->buf_in) < sim_words(in->size) ||
+        sim_space(&lsid->msg) < 2 * sim_words(0))
+        return -ENOSPC;
+
+    if (in->code == MVE_BUFFER_CODE_BITSTREAM &&
+        out->code == MVE_BUFFER_CODE_FRAME) {
+        struct mve_buffer_bitstream *b = (void *)in->data;
+        struct mve_buffer_frame *f = (void *)out->data;
+
+        f->user_data_tag = b->user_data_tag;
+        f->visible_frame_width = sim_width;
+        f->visible_frame_height = sim_height;
+        f->frame_flags = MVE_BUFFER_FRAME_FLAG_TOP_PRESENT;
+        if (b->bitstream_flags & MVE_BUFFER_BITSTREAM_FLAG_EOS)
+            f->frame_flags |= MVE_BUFFER_FRAME_FLAG_EOS;
+    } else if (in->code == MVE_BUFFER_CODE_FRAME &&
+           out->code == MVE_BUFFER_CODE_BITSTREAM) {
+        struct mve_buffer_frame *f = (void *)in->data;
+        struct mve_buffer_bitstream *b = (void *)out->data;
+
+        b->user_data_tag = f->user_data_tag;
+        b->bitstream_offset = 0;
+        b->bitstream_filled_len = min_t(uint32_t, sim_bitstream_bytes,
+                        b->bitstream_alloc_bytes);
+        b->bitstream_flags = MVE_BUFFER_BITSTREAM_FLAG_ENDOFFRAME;
+        if (f->frame_flags & MVE_BUFFER_FRAME_FLAG_EOS)
+            b->bitstream_flags |= MVE_BUFFER_BITSTREAM_FLAG_EOS;
+    }
+
+    ret = sim_return_buffer(lsid, true, out);
+    if (ret == 0)
+        ret = sim_return_buffer(lsid, false, in);
+
+    lsid->frame_due = 0;
+
+    return ret;
+}
+
+/**
+ * sim_fw_eos() - Return an empty output buffer flagged end of stream.
+ *
+ * Return: 0 on success, else error code.
+ */
+static int sim_fw_eos(struct mvx_sim_lsid *lsid)
+{
+    struct mvx_sim_msg *out = &lsid->out;
+
+    if (out->code == MVE_BUFFER_CODE_FRAME) {
+        struct mve_buffer_frame *f = (void *)out->data;
+
+        f->visible_frame_width = 0;
+        f->visible_frame_height = 0;
+        f->frame_flags = MVE_BUFFER_FRAME_FLAG_EOS;
+    } else if (out->code == MVE_BUFFER_CODE_BITSTREAM) {
+        struct mve_buffer_bitstream *b = (void *)out->data;
+
+        b->bitstream_filled_len = 0;
+        b->bitstream_flags = MVE_BUFFER_BITSTREAM_FLAG_EOS;
+    }
+
+    return sim_return_buffer(lsid, true, out);
+}
+
+/**
+ * sim_fw_buffers() - Process buffers queued by the host.
+ * @lsid:    Pointer to LSID.
+ * @delay:    Time in jiffies until the current frame completes.
+ *
+ * Input and output buffers are left in the host queues until they are
+ * consumed, so that a flush can return them.
+ *
+ * Return: true if any buffer was processed, else false.
+ */
+static bool sim_fw_buffers(struct mvx_sim_lsid *lsid,
+               unsigned long *delay)
+{
+    struct mvx_sim_state *state = &lsid->state;
+    struct mvx_sim_msg *in = &lsid->in;
+    bool progress = false;
+
+    while (state->state == MVE_STATE_RUNNING && state->wait_flush == 0 &&
+           lsid->job_done == false) {
+        bool has_in;
+        bool has_out;
+
+        has_in = sim_peek(&lsid->buf_in, in);
+        if (has_in && in->code == MVE_BUFFER_CODE_PARAM) {
+            sim_consume(lsid, &lsid->buf_in, in);
+            progress = true;
+            continue;
+        }
+
+        if (has_in && in->code == MVE_BUFFER_CODE_GENERAL) {
+            if (sim_return_buffer(lsid, false, in) != 0)
+                break;
+
+            progress = true;
+            continue;
+        }
+
+        if (has_in && sim_is_eos_marker(in)) {
+            sim_consume(lsid, &lsid->buf_in, in);
+            state->eos_pending = 1;
+            progress = true;
+            continue;
+        }
+
+        if (has_in && in->code == MVE_BUFFER_CODE_BITSTREAM) {
+            struct mve_buffer_bitstream *b = (void *)in->data;
+
+            if (state->seq_sent == 0) {
+                if (sim_fw_sequence(lsid) != 0)
+                    break;
+
+                progress = true;
+                continue;
+            }
+
+            /* Empty bitstream buffers do not produce a frame. */
+            if (b->bitstream_filled_len == 0) {
+                if (sim_return_buffer(lsid, false, in) != 0)
+                    break;
+
+                if (b->bitstream_flags & MVE_BUFFER_BITSTREAM_FLAG_EOS)
+                    state->eos_pending = 1;
+
+                progress = true;
+                continue;
+            }
+        }
+
+        has_out = sim_peek(&lsid->buf_out, &lsid->out);
+        if (has_in && has_out) {
+            if (sim_fw_frame(lsid, delay) != 0)
+                break;
+
+            if (state->job_frames > 0 && --state->job_frames == 0)
+                lsid->job_done = true;
+
+            progress = true;
+            continue;
+        }
+
+        if (!has_in && has_out && state->eos_pending != 0) {
+            if (sim_fw_eos(lsid) != 0)
+                break;
+
+            state->eos_pending = 0;
+            progress = true;
+            continue;
+        }
+
+        break;
+    }
+
+    return progress;
+}
+
+/**
+ * sim_fw_work() - Execute one firmware step.
+ */
+static void sim_fw_work(struct work_struct *work)
+{
+    struct mvx_sim_lsid *lsid =
+        container_of(to_delayed_work(work), struct mvx_sim_lsid, work);
+    struct mvx_sim *sim = lsid->sim;
+    unsigned long delay = MAX_JIFFY_OFFSET;
+    unsigned int idle_period = max_t(uint, sim_idle_ms, 1);
+    unsigned long flags;
+    bool running;
+    bool booted;
+    bool progress;
+    ktime_t now;
+    s64 idle_ms;
+
+    mutex_lock(&sim->mutex);
+
+    spin_lock_irqsave(&sim->lock, flags);
+    running = lsid->running;
+    booted = lsid->booted;
+    sim->lsid_regs[lsid->id][MVX_HWREG_IRQHOST] = 0;
+    spin_unlock_irqrestore(&sim->lock, flags);
+
+    if (running == false)
+        goto unlock;
+
+    lsid->notify = false;
+
+    if (booted == false && sim_fw_boot(lsid) != 0) {
+        queue_delayed_work(sim->wq, &lsid->work,
+                   msecs_to_jiffies(idle_period));
+        goto unlock;
+    }
+
+    progress = sim_fw_messages(lsid);
+    if (lsid->switch_out == false)
+        progress |= sim_fw_buffers(lsid, &delay);
+
+    if (lsid->job_done != false) {
+        struct mve_response_job_dequeued dequeued = { .valid_job = 1 };
+
+        if (sim_reply(lsid, MVE_RESPONSE_CODE_JOB_DEQUEUED, &dequeued,
+                  sizeof(dequeued)) == 0) {
+            lsid->job_done = false;
+            lsid->switch_out = true;
+        }
+    }
+
+    if (lsid->switch_out != false && sim_fw_switch_out(lsid) == 0)
+        goto unlock;
+
+    now = ktime_get();
+    if (progress || delay != MAX_JIFFY_OFFSET)
+        lsid->idle_since = now;
+
+    idle_ms = ktime_ms_delta(now, lsid->idle_since);
+    if (idle_ms >= idle_period) {
+        if (sim_reply(lsid, MVE_RESPONSE_CODE_IDLE, NULL, 0) == 0)
+            lsid->idle_since = now;
+
+        idle_ms = 0;
+    }
+
+    if (lsid->notify != false)
+        sim_raise_irq(sim, lsid->id);
+
+    delay = min_t(unsigned long, delay,
+              msecs_to_jiffies(idle_period - idle_ms));
+    queue_delayed_work(sim->wq, &lsid->work, max_t(unsigned long, delay, 1));
+
+unlock:
+    mutex_unlock(&sim->mutex);
+}
+
+/**
+ * sim_terminate() - Stop a LSID immediately.
+ */
+static void sim_terminate(struct mvx_sim *sim,
+              unsigned int id)
+{
+    unsigned long flags;
+
+    /* Wait for a running firmware step to finish. */
+    mutex_lock(&sim->mutex);
+
+    spin_lock_irqsave(&sim->lock, flags);
+    sim_release(sim, &sim->lsid[id]);
+    sim_dispatch(sim);
+    spin_unlock_irqrestore(&sim->lock, flags);
+
+    mutex_unlock(&sim->mutex);
+}
+
+static void sim_fw_request_work(struct work_struct *work)
+{
+    struct mvx_sim_fw_request *req =
+        container_of(work, struct mvx_sim_fw_request, work);
+    struct mvx_fw_header *header;
+    struct firmware *fw;
+
+    fw = kzalloc(sizeof(*fw), GFP_KERNEL);
+    header = vzalloc(MVE_PAGE_SIZE);
+    if (fw == NULL || header == NULL) {
+        kfree(fw);
+        vfree(header);
+        fw = NULL;
+        goto callback;
+    }
+
+    header->protocol_major = sim_protocol_major;
+    header->protocol_minor = sim_protocol_minor;
+    strscpy((char *)header->info_string, "mvx simulator",
+        sizeof(header->info_string));
+    strscpy((char *)header->version_string, "sim",
+        sizeof(header->version_string));
+    header->text_length = MVE_PAGE_SIZE;
+    header->bss_start_address = MVX_SIM_BSS_ADDR;
+    header->bss_bitmap_size = 2;
+    header->bss_bitmap[0] = 0x3;
+    header->master_rw_start_address = MVX_SIM_BSS_ADDR + MVE_PAGE_SIZE;
+    header->master_rw_size = MVE_PAGE_SIZE;
+
+    /* Freed by release_firmware(). */
+    fw->data = (const u8 *)header;
+    fw->size = MVE_PAGE_SIZE;
+
+callback:
+    req->cont(fw, req->context);
+    put_device(req->dev);
+    kfree(req);
+}
+
+/****************************************************************************
+ * Exported functions
+ ****************************************************************************/
+
+int mvx_sim_init(void)
+{
+    struct platform_device_info info = { 0 };
+    struct resource res;
+    struct mvx_sim *sim;
+    unsigned int i;
+    int ret;
+
+    sim = vzalloc(sizeof(*sim));
+    if (sim == NULL)
+        return -ENOMEM;
+
+    spin_lock_init(&sim->lock);
+    mutex_init(&sim->mutex);
+    sim->ncores = clamp_t(uint, sim_ncores, 1, MVX_NUMBER_OF_CORES);
+    sim->regs[MVX_HWREG_JOBQUEUE] = 0x0f0f0f0f;
+    sim->regs[MVX_HWREG_CORELSID] = 0xffffffff;
+
+    for (i = 0; i < MVX_LSID_MAX; i++) {
+        sim->lsid[i].sim = sim;
+        sim->lsid[i].id = i;
+        INIT_DELAYED_WORK(&sim->lsid[i].work, sim_fw_work);
+    }
+
+    sim->wq = alloc_ordered_workqueue(MVX_SIM_NAME, 0);
+    if (sim->wq == NULL) {
+        ret = -ENOMEM;
+        goto free_sim;
+    }
+
+    sim->fwnode = irq_domain_alloc_named_fwnode(MVX_SIM_NAME);
+    if (sim->fwnode == NULL) {
+        ret = -ENOMEM;
+        goto destroy_wq;
+    }
+
+    sim->domain = irq_domain_create_sim(sim->fwnode, 1);
+    if (IS_ERR(sim->domain)) {
+        ret = PTR_ERR(sim->domain);
+        goto free_fwnode;
+    }
+
+    sim->irq = irq_create_mapping(sim->domain, 0);
+    if (sim->irq == 0) {
+        ret = -ENXIO;
+        goto remove_domain;
+    }
+
+    sim->top = platform_device_register_simple(MVX_SIM_NAME,
+                           PLATFORM_DEVID_NONE,
+                           NULL, 0);
+    if (IS_ERR(sim->top)) {
+        ret = PTR_ERR(sim->top);
+        goto dispose_irq;
+    }
+
+    /* Must be set before the device is probed. */
+    mvx_sim = sim;
+
+    memset(&res, 0, sizeof(res));
+    res.start = sim->irq;
+    res.end = sim->irq;
+    res.flags = IORESOURCE_IRQ;
+    info.parent = &sim->top->dev;
+    info.name = MVX_SIM_DEV_NAME;
+    info.id = PLATFORM_DEVID_AUTO;
+    info.res = &res;
+    info.num_res = 1;
+
+    sim->pdev = platform_device_register_full(&info);
+    if (IS_ERR(sim->pdev)) {
+        ret = PTR_ERR(sim->pdev);
+        goto unregister_top;
+    }
+
+    MVX_LOG_PRINT(&mvx_log_dev, MVX_LOG_WARNING,
+              "Simulated VPU registered. id=0x%08x, cores=%u, irq=%u.",
+              sim_hw_id, sim->ncores, sim->irq);
+
+    return 0;
+
+unregister_top:
+    mvx_sim = NULL;
+    platform_device_unregister(sim->top);
+
+dispose_irq:
+    irq_dispose_mapping(sim->irq);
+
+remove_domain:
+    irq_domain_remove_sim(sim->domain);
+
+free_fwnode:
+    irq_domain_free_fwnode(sim->fwnode);
+
+destroy_wq:
+    destroy_workqueue(sim->wq);
+
+free_sim:
+    vfree(sim);
+
+    return ret;
+}
+
+void mvx_sim_exit(void)
+{
+    struct mvx_sim *sim = mvx_sim;
+    unsigned int i;
+
+    if (sim == NULL)
+        return;
+
+    platform_device_unregister(sim->pdev);
+
+    for (i = 0; i < MVX_LSID_MAX; i++)
+        cancel_delayed_work_sync(&sim->lsid[i].work);
+
+    platform_device_unregister(sim->top);
+    mvx_sim = NULL;
+
+    irq_dispose_mapping(sim->irq);
+    irq_domain_remove_sim(sim->domain);
+    irq_domain_free_fwnode(sim->fwnode);
+    destroy_workqueue(sim->wq);
+    vfree(sim);
+}
+
+struct mvx_sim *mvx_sim_get(struct device *dev)
+{
+    if (mvx_sim == NULL || dev == NULL ||
+        dev->parent != &mvx_sim->top->dev)
+        return NULL;
+
+    return mvx_sim;
+}
+
+uint32_t mvx_sim_read(struct mvx_sim *sim,
+              enum mvx_hwreg_what what)
+{
+    unsigned long flags;
+    uint32_t value = 0;
+    unsigned int i;
+
+    if (what >= MVX_HWREG_WHAT_MAX)
+        return 0;
+
+    spin_lock_irqsave(&sim->lock, flags);
+
+    switch (what) {
+    case MVX_HWREG_HARDWARE_ID:
+        value = sim_hw_id;
+        break;
+    case MVX_HWREG_NCORES:
+        value = sim->ncores;
+        break;
+    case MVX_HWREG_NLSID:
+        value = MVX_LSID_MAX;
+        break;
+    case MVX_HWREG_IRQVE:
+        for (i = 0; i < MVX_LSID_MAX; i++)
+            if (sim->lsid_regs[i][MVX_HWREG_LIRQVE] != 0)
+                value |= 1 << i;
+
+        break;
+    default:
+        value = sim->regs[what];
+        break;
+    }
+
+    spin_unlock_irqrestore(&sim->lock, flags);
+
+    return value;
+}
+
+void mvx_sim_write(struct mvx_sim *sim,
+           enum mvx_hwreg_what what,
+           uint32_t value)
+{
+    unsigned long flags;
+
+    if (what >= MVX_HWREG_WHAT_MAX)
+        return;
+
+    spin_lock_irqsave(&sim->lock, flags);
+
+    switch (what) {
+    case MVX_HWREG_HARDWARE_ID:
+    case MVX_HWREG_NCORES:
+    case MVX_HWREG_NLSID:
+    case MVX_HWREG_CORELSID:
+    case MVX_HWREG_IRQVE:
+    case MVX_HWREG_SVNREV:
+    case MVX_HWREG_FUSE:
+        /* Read only. */
+        break;
+    case MVX_HWREG_ENABLE:
+    case MVX_HWREG_JOBQUEUE:
+        sim->regs[what] = value;
+        sim_dispatch(sim);
+        break;
+    default:
+        sim->regs[what] = value;
+        break;
+    }
+
+    spin_unlock_irqrestore(&sim->lock, flags);
+}
+
+uint32_t mvx_sim_read_lsid(struct mvx_sim *sim,
+               unsigned int lsid,
+               enum mvx_hwreg_lsid what)
+{
+    unsigned long flags;
+    uint32_t value;
+
+    if (lsid >= MVX_LSID_MAX || what >= MVX_HWREG_LSID_MAX)
+        return 0;
+
+    spin_lock_irqsave(&sim->lock, flags);
+    value = sim->lsid_regs[lsid][what];
+    spin_unlock_irqrestore(&sim->lock, flags);
+
+    return value;
+}
+
+void mvx_sim_write_lsid(struct mvx_sim *sim,
+            unsigned int lsid,
+            enum mvx_hwreg_lsid what,
+            uint32_t value)
+{
+    unsigned long flags;
+    bool raise = false;
+    bool kick = false;
+
+    if (lsid >= MVX_LSID_MAX || what >= MVX_HWREG_LSID_MAX)
+        return;
+
+    /* Termination completes immediately and TERMINATE always reads 0. */
+    if (what == MVX_HWREG_TERMINATE) {
+        if (value != 0)
+            sim_terminate(sim, lsid);
+
+        return;
+    }
+
+    spin_lock_irqsave(&sim->lock, flags);
+
+    sim->lsid_regs[lsid][what] = value;
+    if (what == MVX_HWREG_LIRQVE && value != 0)
+        raise = true;
+    else if (what == MVX_HWREG_IRQHOST && value != 0)
+        kick = sim->lsid[lsid].running;
+
+    spin_unlock_irqrestore(&sim->lock, flags);
+
+    if (raise)
+        irq_set_irqchip_state(sim->irq, IRQCHIP_STATE_PENDING, true);
+
+    if (kick)
+        mod_delayed_work(sim->wq, &sim->lsid[lsid].work, 0);
+}
+
+uint32_t mvx_sim_read_rcsu(struct mvx_sim *sim,
+               enum mvx_rcsu_hwreg_what what)
+{
+    unsigned long flags;
+    uint32_t value;
+
+    if (what >= MVX_RCSU_HWREG_WHAT_MAX)
+        return 0;
+
+    spin_lock_irqsave(&sim->lock, flags);
+    value = sim->rcsu_regs[what];
+    spin_unlock_irqrestore(&sim->lock, flags);
+
+    return value;
+}
+
+void mvx_sim_write_rcsu(struct mvx_sim *sim,
+            enum mvx_rcsu_hwreg_what what,
+            uint32_t value)
+{
+    unsigned long flags;
+
+    if (what >= MVX_RCSU_HWREG_WHAT_MAX)
+        return;
+
+    spin_lock_irqsave(&sim->lock, flags);
+    sim->rcsu_regs[what] = value;
+    spin_unlock_irqrestore(&sim->lock, flags);
+}
+
+int mvx_sim_request_firmware_nowait(
+    struct device *dev,
+    void *context,
+    void (*cont)(const struct firmware *fw, void *context))
+{
+    struct mvx_sim_fw_request *req;
+
+    req = kzalloc(sizeof(*req), GFP_KERNEL);
+    if (req == NULL)
+        return -ENOMEM;
+
+    INIT_WORK(&req->work, sim_fw_request_work);
+    req->dev = get_device(dev);
+    req->context = context;
+    req->cont = cont;
+    schedule_work(&req->work);
+
+    return 0;
+}
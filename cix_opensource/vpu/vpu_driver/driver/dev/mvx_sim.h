@@ -0,0 +1,223 @@
+/*
+ * The confidential and proprietary information contained in this file may
+ * only be used by a person authorised under and to the extent permitted
+ * by a subsisting licensing agreement from Arm Technology (China) Co., Ltd.
+ *
+ *            (C) COPYRIGHT 2021-2021 Arm Technology (China) Co., Ltd.
+ *                ALL RIGHTS RESERVED
+ *
+ * This entire notice must be reproduced on all copies of this file
+ * and copies of this file may only be made by a person if such person is
+ * permitted to do so under the terms of a subsisting license agreement
+ * from Arm Technology (China) Co., Ltd.
+ *
+ * SPDX-License-Identifier: GPL-2.0-only
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ */
+
+
+#ifndef _MVX_SIM_H_
+#define _MVX_SIM_H_
+
+/****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include <linux/errno.h>
+#include <linux/types.h>
+#include "mvx_hwreg.h"
+
+/****************************************************************************
+ * Types
+ ****************************************************************************/
+
+struct device;
+struct firmware;
+struct mvx_sim;
+
+/****************************************************************************
+ * Exported functions
+ ****************************************************************************/
+
+#ifdef MVX_SIM_ENABLE
+
+/**
+ * mvx_sim_init() - Register the simulated VPU device.
+ *
+ * The simulated device is bound by the regular platform driver, so this
+ * must be called after the driver has been registered.
+ *
+ * Return: 0 on success, else error code.
+ */
+int mvx_sim_init(void);
+
+/**
+ * mvx_sim_exit() - Unregister the simulated VPU device.
+ */
+void mvx_sim_exit(void);
+
+/**
+ * mvx_sim_get() - Get simulator backing a device.
+ * @dev:    Pointer to device.
+ *
+ * Return: Pointer to simulator, or NULL if the device is real hardware.
+ */
+struct mvx_sim *mvx_sim_get(struct device *dev);
+
+/**
+ * mvx_sim_read() - Read simulated hardware register.
+ * @sim:    Pointer to simulator.
+ * @what:    Register to read.
+ *
+ * Return: Register value.
+ */
+uint32_t mvx_sim_read(struct mvx_sim *sim,
+              enum mvx_hwreg_what what);
+
+/**
+ * mvx_sim_write() - Write simulated hardware register.
+ * @sim:    Pointer to simulator.
+ * @what:    Register to write.
+ * @value:    Value to write.
+ */
+void mvx_sim_write(struct mvx_sim *sim,
+           enum mvx_hwreg_what what,
+           uint32_t value);
+
+/**
+ * mvx_sim_read_lsid() - Read simulated LSID register.
+ * @sim:    Pointer to simulator.
+ * @lsid:    LSID register index.
+ * @what:    Register to read.
+ *
+ * Return: Register value.
+ */
+uint32_t mvx_sim_read_lsid(struct mvx_sim *sim,
+               unsigned int lsid,
+               enum mvx_hwreg_lsid what);
+
+/**
+ * mvx_sim_write_lsid() - Write simulated LSID register.
+ * @sim:    Pointer to simulator.
+ * @lsid:    LSID register index.
+ * @what:    Register to write.
+ * @value:    Value to write.
+ *
+ * Writing TERMINATE may sleep.
+ */
+void mvx_sim_write_lsid(struct mvx_sim *sim,
+            unsigned int lsid,
+            enum mvx_hwreg_lsid what,
+            uint32_t value);
+
+/**
+ * mvx_sim_read_rcsu() - Read simulated RCSU register.
+ * @sim:    Pointer to simulator.
+ * @what:    Register to read.
+ *
+ * Return: Register value.
+ */
+uint32_t mvx_sim_read_rcsu(struct mvx_sim *sim,
+               enum mvx_rcsu_hwreg_what what);
+
+/**
+ * mvx_sim_write_rcsu() - Write simulated RCSU register.
+ * @sim:    Pointer to simulator.
+ * @what:    Register to write.
+ * @value:    Value to write.
+ */
+void mvx_sim_write_rcsu(struct mvx_sim *sim,
+            enum mvx_rcsu_hwreg_what what,
+            uint32_t value);
+
+/**
+ * mvx_sim_request_firmware_nowait() - Load simulated firmware binary.
+ * @dev:    Pointer to device.
+ * @context:    Context passed to callback.
+ * @cont:    Callback, called from work queue context.
+ *
+ * Behaves like request_firmware_nowait(), but the returned firmware binary
+ * is generated by the simulator. It must be freed with release_firmware().
+ *
+ * Return: 0 on success, else error code.
+ */
+int mvx_sim_request_firmware_nowait(
+    struct device *dev,
+    void *context,
+    void (*cont)(const struct firmware *fw, void *context));
+
+#else
+
+static inline int mvx_sim_init(void)
+{
+    return 0;
+}
+
+static inline void mvx_sim_exit(void)
+{}
+
+static inline struct mvx_sim *mvx_sim_get(struct device *dev)
+{
+    return NULL;
+}
+
+static inline uint32_t mvx_sim_read(struct mvx_sim *sim,
+                    enum mvx_hwreg_what what)
+{
+    return 0;
+}
+
+static inline void mvx_sim_write(struct mvx_sim *sim,
+                 enum mvx_hwreg_what what,
+                 uint32_t value)
+{}
+
+static inline uint32_t mvx_sim_read_lsid(struct mvx_sim *sim,
+                     unsigned int lsid,
+                     enum mvx_hwreg_lsid what)
+{
+    return 0;
+}
+
+static inline void mvx_sim_write_lsid(struct mvx_sim *sim,
+                      unsigned int lsid,
+                      enum mvx_hwreg_lsid what,
+                      uint32_t value)
+{}
+
+static inline uint32_t mvx_sim_read_rcsu(struct mvx_sim *sim,
+                     enum mvx_rcsu_hwreg_what what)
+{
+    return 0;
+}
+
+static inline void mvx_sim_write_rcsu(struct mvx_sim *sim,
+                      enum mvx_rcsu_hwreg_what what,
+                      uint32_t value)
+{}
+
+static inline int mvx_sim_request_firmware_nowait(
+    struct device *dev,
+    void *context,
+    void (*cont)(const struct firmware *fw, void *context))
+{
+    return -ENODEV;
+}
+
+#endif /* MVX_SIM_ENABLE */
+
+#endif /* _MVX_SIM_H_ */
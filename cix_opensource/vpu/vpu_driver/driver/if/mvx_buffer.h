@@ -36,6 +36,7 @@
  * Includes
  ****************************************************************************/
 
+#include <linux/ktime.h>
 #include <linux/seq_file.h>
 #include <linux/types.h>
 #include "mvx_if.h"
@@ -176,6 +177,8 @@ struct mvx_enc_stats
  * @crop_top:    Top crop in pixels.
  * @nplanes:    Number of planes.
  * @planes:    Array or planes.
+ * @queued_at:    Time the client queued the buffer, 0 once it has been
+ *        handed to the firmware.
  */
 struct mvx_buffer {
     struct device *dev;
@@ -198,6 +201,7 @@ struct mvx_buffer {
     uint8_t src_transform;
     uint16_t bitstream_remaining_kb;
     bool is_contiguous;
+    ktime_t queued_at;
 };
 
 #define MVX_BUFFER_EOS                  0x00000001
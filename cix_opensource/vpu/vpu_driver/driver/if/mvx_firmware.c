@@ -42,10 +42,12 @@
 #include <linux/gfp.h>
 #include <linux/list.h>
 #include <linux/mm.h>
+#include <linux/slab.h>
 #include <linux/firmware.h>
 #include <linux/kobject.h>
 #include <linux/kthread.h>
 #include <linux/timer.h>
+#include <linux/uio.h>
 #include <linux/version.h>
 #include "mvx_if.h"
 #include "mvx_log_group.h"
@@ -240,6 +242,29 @@ static int fw_map(struct mvx_fw *fw)
     } else {
         const struct mvx_fw_bin *fw_bin = fw->fw_bin;
         const struct mvx_fw_header *header = fw_bin->nonsecure.header;
+        struct mvx_fw_image image;
+
+        /*
+         * Use a pre-warmed image if one is available. Its text segment
+         * already holds the firmware binary.
+         */
+        ret = mvx_fw_cache_claim_image(fw_bin->cache, fw_bin, fw->ncores,
+                           &image);
+        if (ret == 0) {
+            fw->text = image.text;
+            fw->bss = image.bss;
+            fw->bss_shared = image.bss_shared;
+
+            for (i = 0; i < fw->ncores; i++) {
+                if (mvx_test_bit(i, &mask)) {
+                    ret = fw_map_core(fw, i);
+                    if (ret != 0)
+                        goto unmap_fw;
+                }
+            }
+
+            goto map_protocol;
+        }
 
         /* Allocate memory for text segment. */
         fw->text = mvx_mmu_alloc_pages(fw->dev, fw_bin->nonsecure.text_cnt, 0,
@@ -283,6 +308,7 @@ static int fw_map(struct mvx_fw *fw)
             goto unmap_fw;
     }
 
+map_protocol:
     /* Map MMU tables for the message queues. */
     ret = fw->ops.map_protocol(fw);
     if (ret != 0)
@@ -581,9 +607,105 @@ int mvx_fw_factory(struct mvx_fw *fw,
     if (IS_ENABLED(CONFIG_DEBUG_FS))
         ret = fw_debugfs_init(fw, parent);
 
+    if (ret == 0)
+        fw_log_init(fw);
+
     return ret;
 }
 
+/* Largest deferred log record, a message header and payload with its log headers. */
+#define MVX_FW_LOG_RECORD_MAX 1024
+#define MVX_FW_LOG_FIFO_SIZE (64 * 1024)
+
+static void fw_log_work(struct work_struct *work)
+{
+    struct mvx_fw *fw = container_of(work, struct mvx_fw, log_work);
+    struct iovec vec;
+    unsigned int dropped;
+    unsigned int len;
+
+    while ((len = kfifo_out(&fw->log_fifo, fw->log_out,
+                MVX_FW_LOG_RECORD_MAX)) > 0) {
+        vec.iov_base = fw->log_out;
+        vec.iov_len = len;
+        MVX_LOG_DATA(&mvx_log_fwif_if, MVX_LOG_INFO, &vec, 1);
+    }
+
+    dropped = atomic_xchg(&fw->log_dropped, 0);
+    if (dropped != 0)
+        MVX_LOG_PRINT(&mvx_log_if, MVX_LOG_WARNING,
+                  "Dropped %u firmware interface log records.",
+                  dropped);
+}
+
+/* Without the fifo every record is logged right away, as before. */
+static void fw_log_init(struct mvx_fw *fw)
+{
+    INIT_WORK(&fw->log_work, fw_log_work);
+    atomic_set(&fw->log_dropped, 0);
+
+    fw->log_buf = kmalloc(MVX_FW_LOG_RECORD_MAX, GFP_KERNEL);
+    fw->log_out = kmalloc(MVX_FW_LOG_RECORD_MAX, GFP_KERNEL);
+    if (fw->log_buf == NULL || fw->log_out == NULL ||
+        kfifo_alloc(&fw->log_fifo, MVX_FW_LOG_FIFO_SIZE, GFP_KERNEL) != 0) {
+        kfree(fw->log_buf);
+        kfree(fw->log_out);
+        fw->log_buf = NULL;
+        fw->log_out = NULL;
+    }
+}
+
+static void fw_log_term(struct mvx_fw *fw)
+{
+    if (fw->log_buf == NULL)
+        return;
+
+    /* Write what the last batch left behind. */
+    flush_work(&fw->log_work);
+    fw_log_work(&fw->log_work);
+
+    kfifo_free(&fw->log_fifo);
+    kfree(fw->log_buf);
+    kfree(fw->log_out);
+    fw->log_buf = NULL;
+    fw->log_out = NULL;
+}
+
+bool mvx_fw_log_defer(struct mvx_fw *fw,
+              struct iovec *vec,
+              unsigned int count)
+{
+    size_t len = 0;
+    unsigned int i;
+
+    lockdep_assert_held(&fw->mutex);
+
+    if (fw->log_buf == NULL)
+        return false;
+
+    for (i = 0; i < count; i++)
+        len += vec[i].iov_len;
+
+    if (len > MVX_FW_LOG_RECORD_MAX)
+        return false;
+
+    for (i = 0, len = 0; i < count; i++) {
+        memcpy(fw->log_buf + len, vec[i].iov_base, vec[i].iov_len);
+        len += vec[i].iov_len;
+    }
+
+    if (kfifo_in(&fw->log_fifo, fw->log_buf, len) == 0)
+        atomic_inc(&fw->log_dropped);
+
+    return true;
+}
+
+void mvx_fw_log_kick(struct mvx_fw *fw)
+{
+    if (fw->log_buf != NULL && !kfifo_is_empty(&fw->log_fifo))
+        queue_work(system_wq, &fw->log_work);
+}
+
 int mvx_fw_construct(struct mvx_fw *fw,
              struct mvx_fw_bin *fw_bin,
              struct mvx_mmu *mmu,
@@ -617,6 +739,8 @@ int mvx_fw_construct(struct mvx_fw *fw,
 
 void mvx_fw_destruct(struct mvx_fw *fw)
 {
+    fw_log_term(fw);
+
     if (IS_ENABLED(CONFIG_DEBUG_FS))
         debugfs_remove_recursive(fw->dentry);
 
@@ -37,10 +37,12 @@
  ****************************************************************************/
 
 #include <linux/hashtable.h>
+#include <linux/kfifo.h>
 #include <linux/kref.h>
 #include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/seq_file.h>
+#include <linux/workqueue.h>
 #include "mvx_if.h"
 #include "mvx_buffer.h"
 
@@ -965,6 +967,13 @@ enum mvx_fw_region {
  *                      address to 'struct mvx_mmu_pages' object.
  * @msg_pending:    A subset of the messages that we are waiting for a
  *                      response to.
+ * @sync_count:        Number of message queue cache maintenance operations.
+ * @sync_ns:        Time spent in message queue cache maintenance.
+ * @log_fifo:        Firmware interface log records of a message batch.
+ * @log_buf:        Scratch buffer assembling a record for @log_fifo.
+ * @log_out:        Scratch buffer of @log_work.
+ * @log_work:        Writes @log_fifo to the log once the batch is over.
+ * @log_dropped:    Records that did not fit in @log_fifo.
  * @ops:        Public firmware interface.
  * @ops_priv:        Private firmware interface.
  *
@@ -1007,6 +1016,16 @@ struct mvx_fw {
     uint32_t host_output_buf_sum;
     uint32_t switched_in;
     uint32_t job_dequeued;
+    bool batch;
+    unsigned int batch_synced;
+    unsigned int batch_dirty;
+    uint64_t sync_count;
+    uint64_t sync_ns;
+    struct kfifo_rec_ptr_2 log_fifo;
+    void *log_buf;
+    void *log_out;
+    struct work_struct log_work;
+    atomic_t log_dropped;
 
     struct {
         /**
@@ -1044,6 +1063,22 @@ struct mvx_fw {
         int (*get_message)(struct mvx_fw *fw,
                    struct mvx_fw_msg *msg);
 
+        /**
+         * begin_batch() - Start reading messages in a batch.
+         * @fw:        Pointer to firmware object.
+         *
+         * Until end_batch() is called, each message and buffer queue is
+         * synchronized from the firmware once, on its first read, and
+         * read positions are not written back.
+         */
+        void (*begin_batch)(struct mvx_fw *fw);
+
+        /**
+         * end_batch() - Write back read positions of a message batch.
+         * @fw:        Pointer to firmware object.
+         */
+        void (*end_batch)(struct mvx_fw *fw);
+
         /**
          * put_message() - Write message to firmware message queue.
          * @fw:        Pointer to firmware object.
@@ -42,6 +42,7 @@
 #include <linux/mm.h>
 #include <linux/firmware.h>
 #include <linux/kthread.h>
+#include <linux/slab.h>
 #include <linux/version.h>
 #include "mvx_log_group.h"
 #include "mvx_firmware_cache.h"
@@ -49,6 +50,7 @@
 #include "mvx_mmu.h"
 #include "mvx_secure.h"
 #include "mvx_seq.h"
+#include "mvx_sim.h"
 
 /****************************************************************************
  * Defines
@@ -58,6 +60,8 @@
 
 #define MVX_SECURE_NUMCORES             4
 
+#define MVX_FW_POOL_MAX                 8
+
 /****************************************************************************
  * Private functions
  ****************************************************************************/
@@ -175,16 +179,122 @@ static struct mvx_fw_bin *kobj_to_fw_bin(struct kobject *kobj)
     return container_of(kobj, struct mvx_fw_bin, kobj);
 }
 
+/**
+ * image_free() - Free a pre-warmed firmware image.
+ */
+static void image_free(struct mvx_fw_image *image)
+{
+    if (!IS_ERR_OR_NULL(image->text))
+        mvx_mmu_free_pages(image->text);
+
+    if (!IS_ERR_OR_NULL(image->bss))
+        mvx_mmu_free_pages(image->bss);
+
+    if (!IS_ERR_OR_NULL(image->bss_shared))
+        mvx_mmu_free_pages(image->bss_shared);
+
+    kfree(image);
+}
+
+/**
+ * image_create() - Allocate the firmware memory of one instance.
+ *
+ * Allocates the same pages as fw_map() and copies the firmware binary into
+ * the text segment.
+ */
+static struct mvx_fw_image *image_create(struct mvx_fw_bin *fw_bin,
+                     unsigned int ncores)
+{
+    const uint8_t *data = fw_bin->nonsecure.fw->data;
+    size_t size = fw_bin->nonsecure.header->text_length;
+    struct mvx_fw_image *image;
+    unsigned int i;
+    int ret;
+
+    image = kzalloc(sizeof(*image), GFP_KERNEL);
+    if (image == NULL)
+        return ERR_PTR(-ENOMEM);
+
+    image->ncores = ncores;
+
+    image->text = mvx_mmu_alloc_pages(fw_bin->dev,
+                      fw_bin->nonsecure.text_cnt, 0,
+                      GFP_KERNEL);
+    if (IS_ERR(image->text)) {
+        ret = PTR_ERR(image->text);
+        goto free_image;
+    }
+
+    image->bss = mvx_mmu_alloc_pages(fw_bin->dev,
+                     fw_bin->nonsecure.bss_cnt * ncores, 0,
+                     GFP_KERNEL | __GFP_ZERO);
+    if (IS_ERR(image->bss)) {
+        ret = PTR_ERR(image->bss);
+        goto free_image;
+    }
+
+    image->bss_shared = mvx_mmu_alloc_pages(fw_bin->dev,
+                        fw_bin->nonsecure.sbss_cnt, 0,
+                        GFP_KERNEL | __GFP_ZERO);
+    if (IS_ERR(image->bss_shared)) {
+        ret = PTR_ERR(image->bss_shared);
+        goto free_image;
+    }
+
+    for (i = 0; i < image->text->count && size > 0; i++) {
+        size_t n = min_t(size_t, size, MVE_PAGE_SIZE);
+        phys_addr_t pa = image->text->pages[i];
+
+        memcpy(phys_to_virt(pa), data, n);
+        dma_sync_single_for_device(fw_bin->dev, pa, n, DMA_TO_DEVICE);
+
+        data += n;
+        size -= n;
+    }
+
+    return image;
+
+free_image:
+    image_free(image);
+
+    return ERR_PTR(ret);
+}
+
+/**
+ * pool_target() - Number of images the pool of a firmware binary should hold.
+ *
+ * Only loaded non secure binaries that are still valid and have been used at
+ * least once are pre-warmed.
+ */
+static unsigned int pool_target(struct mvx_fw_cache *cache,
+                struct mvx_fw_bin *fw_bin)
+{
+    if (fw_bin->securevideo != false ||
+        IS_ERR_OR_NULL(fw_bin->nonsecure.fw) ||
+        fw_bin->pool_ncores == 0 ||
+        atomic_read(&fw_bin->flush_cnt) != atomic_read(&cache->flush_cnt))
+        return 0;
+
+    return READ_ONCE(cache->pool_size);
+}
+
 /**
  * fw_bin_destroy() - Destroy instance of firmware binary.
  */
 static void fw_bin_destroy(struct kobject *kobj)
 {
     struct mvx_fw_bin *fw_bin = kobj_to_fw_bin(kobj);
+    struct mvx_fw_image *image;
+    struct mvx_fw_image *tmp;
 
     MVX_LOG_PRINT(&mvx_log_if, MVX_LOG_INFO,
               "Releasing firmware binary. bin=0x%px.", fw_bin);
 
+    list_for_each_entry_safe(image, tmp, &fw_bin->pool, head) {
+        list_del(&image->head);
+        image_free(image);
+    }
+
     if (fw_bin->securevideo == false &&
         IS_ERR_OR_NULL(fw_bin->nonsecure.fw) == false)
         release_firmware(fw_bin->nonsecure.fw);
@@ -406,16 +516,27 @@ static ssize_t dirty_show(struct kobject *kobj,
     return scnprintf(buf, PAGE_SIZE, "%d\n", dirty);
 }
 
+static ssize_t pool_show(struct kobject *kobj,
+             struct kobj_attribute *attr,
+             char *buf)
+{
+    struct mvx_fw_bin *fw_bin = kobj_to_fw_bin(kobj);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(fw_bin->pool_count));
+}
+
 static struct kobj_attribute path_attr = __ATTR_RO(path);
 static struct kobj_attribute count_attr = __ATTR_RO(count);
 static struct kobj_attribute hw_ver = __ATTR_RO(hw_ver);
 static struct kobj_attribute dirty_attr = __ATTR_RO(dirty);
+static struct kobj_attribute pool_attr = __ATTR_RO(pool);
 
 static struct attribute *mvx_fw_bin_attrs[] = {
     &path_attr.attr,
     &count_attr.attr,
     &hw_ver.attr,
     &dirty_attr.attr,
+    &pool_attr.attr,
     NULL
 };
 ATTRIBUTE_GROUPS(mvx_fw_bin);
@@ -452,6 +573,7 @@ static struct mvx_fw_bin *fw_bin_create(struct mvx_fw_cache *cache,
     mutex_init(&fw_bin->mutex);
     INIT_LIST_HEAD(&fw_bin->cache_head);
     INIT_LIST_HEAD(&fw_bin->event_list);
+    INIT_LIST_HEAD(&fw_bin->pool);
 
     fw_bin->securevideo = securevideo;
     if (securevideo != false)
@@ -478,6 +600,9 @@ static struct mvx_fw_bin *fw_bin_create(struct mvx_fw_cache *cache,
             cache->secure, fw_bin->filename, MVX_SECURE_NUMCORES,
             fw_bin,
             secure_request_firmware_done);
+    else if (mvx_sim_get(fw_bin->dev) != NULL)
+        ret = mvx_sim_request_firmware_nowait(fw_bin->dev, fw_bin,
+                              request_firmware_done);
     else
         ret = request_firmware_nowait(THIS_MODULE, true,
                           fw_bin->filename,
@@ -586,8 +711,49 @@ static ssize_t cache_flush_store(struct kobject *kobj,
 static struct kobj_attribute cache_flush =
     __ATTR(flush, 0600, cache_flush_show, cache_flush_store);
 
+/**
+ * pool_size_show() - Number of pre-warmed images kept per firmware binary.
+ */
+static ssize_t pool_size_show(struct kobject *kobj,
+                  struct kobj_attribute *attr,
+                  char *buf)
+{
+    struct mvx_fw_cache *cache = kobj_to_fw_cache(kobj);
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(cache->pool_size));
+}
+
+/**
+ * pool_size_store() - Resize the pre-warmed image pools.
+ */
+static ssize_t pool_size_store(struct kobject *kobj,
+                   struct kobj_attribute *attr,
+                   const char *buf,
+                   size_t size)
+{
+    struct mvx_fw_cache *cache = kobj_to_fw_cache(kobj);
+    unsigned int pool_size;
+    int ret;
+
+    ret = kstrtouint(buf, 0, &pool_size);
+    if (ret != 0)
+        return ret;
+
+    if (pool_size > MVX_FW_POOL_MAX)
+        return -EINVAL;
+
+    WRITE_ONCE(cache->pool_size, pool_size);
+    queue_work(system_wq, &cache->pool_work);
+
+    return size;
+}
+
+static struct kobj_attribute cache_pool_size =
+    __ATTR(pool_size, 0600, pool_size_show, pool_size_store);
+
 static struct attribute *mvx_fw_cache_attrs[] = {
     &cache_flush.attr,
+    &cache_pool_size.attr,
     NULL
 };
 ATTRIBUTE_GROUPS(mvx_fw_cache);
@@ -606,7 +772,14 @@ static struct kobj_type cache_ktype = {
     .default_groups = mvx_fw_cache_groups,
 };
 
-static void cache_update(struct mvx_fw_cache *cache)
+/**
+ * cache_update() - Release firmware binaries no longer in use.
+ *
+ * Unused binaries with a pre-warmed image pool are kept, unless release_all
+ * is set.
+ */
+static void cache_update(struct mvx_fw_cache *cache,
+             bool release_all)
 {
     struct mvx_fw_bin *fw_bin;
     struct mvx_fw_bin *tmp;
@@ -620,13 +793,90 @@ static void cache_update(struct mvx_fw_cache *cache)
         int ref;
 
         ref = kref_read(&fw_bin->kobj.kref);
-        if (ref == 1)
+        if (ref == 1 &&
+            (release_all || pool_target(cache, fw_bin) == 0))
             kobject_put(&fw_bin->kobj);
     }
 
     mutex_unlock(&cache->mutex);
 }
 
+/**
+ * pool_work() - Refill and trim the pre-warmed image pools.
+ *
+ * Images are allocated one at a time without holding the cache mutex, so
+ * that sessions looking up firmware binaries are not blocked.
+ */
+static void pool_work(struct work_struct *work)
+{
+    struct mvx_fw_cache *cache =
+        container_of(work, struct mvx_fw_cache, pool_work);
+    struct mvx_fw_image *image;
+    struct mvx_fw_image *tmp;
+
+    while (true) {
+        struct mvx_fw_bin *fw_bin = NULL;
+        struct mvx_fw_bin *bin;
+        unsigned int ncores = 0;
+        LIST_HEAD(trim);
+
+        mutex_lock(&cache->mutex);
+
+        list_for_each_entry(bin, &cache->fw_bin_list, cache_head) {
+            unsigned int target = pool_target(cache, bin);
+
+            list_for_each_entry_safe(image, tmp, &bin->pool, head) {
+                if (bin->pool_count > target ||
+                    image->ncores != bin->pool_ncores) {
+                    list_move(&image->head, &trim);
+                    bin->pool_count--;
+                }
+            }
+
+            if (fw_bin == NULL && bin->pool_count < target) {
+                fw_bin = bin;
+                ncores = bin->pool_ncores;
+                kobject_get(&fw_bin->kobj);
+            }
+        }
+
+        mutex_unlock(&cache->mutex);
+
+        list_for_each_entry_safe(image, tmp, &trim, head) {
+            list_del(&image->head);
+            image_free(image);
+        }
+
+        if (fw_bin == NULL)
+            break;
+
+        image = image_create(fw_bin, ncores);
+        if (!IS_ERR(image)) {
+            mutex_lock(&cache->mutex);
+            if (fw_bin->pool_count < pool_target(cache, fw_bin) &&
+                fw_bin->pool_ncores == ncores) {
+                list_add_tail(&image->head, &fw_bin->pool);
+                fw_bin->pool_count++;
+                image = NULL;
+            }
+
+            mutex_unlock(&cache->mutex);
+
+            if (image != NULL)
+                image_free(image);
+        }
+
+        mvx_fw_cache_put(cache, fw_bin);
+
+        if (IS_ERR(image)) {
+            MVX_LOG_PRINT(&mvx_log_if, MVX_LOG_WARNING,
+                      "Failed to pre-warm firmware image. ret=%ld.",
+                      PTR_ERR(image));
+            break;
+        }
+    }
+}
+
 static int cache_thread(void *v)
 {
     struct mvx_fw_cache *cache = (struct mvx_fw_cache *)v;
@@ -634,7 +884,7 @@ static int cache_thread(void *v)
     while (!wait_event_interruptible_timeout(cache->wait_queue,
                 kthread_should_stop(),
                 msecs_to_jiffies(CACHE_CLEANUP_INTERVAL_MS))) {
-        cache_update(cache);
+        cache_update(cache, false);
     }
 
     return 0;
@@ -657,6 +907,8 @@ int mvx_fw_cache_construct(struct mvx_fw_cache *cache,
     atomic_set(&cache->flush_cnt, 0);
     mutex_init(&cache->mutex);
     INIT_LIST_HEAD(&cache->fw_bin_list);
+    cache->pool_size = 0;
+    INIT_WORK(&cache->pool_work, pool_work);
 
     ret = kobject_init_and_add(&cache->kobj, &cache_ktype,
                    kobj_parent, "fw_cache");
@@ -678,7 +930,9 @@ kobj_put:
 
 void mvx_fw_cache_destruct(struct mvx_fw_cache *cache)
 {
-    cache_update(cache);
+    WRITE_ONCE(cache->pool_size, 0);
+    cancel_work_sync(&cache->pool_work);
+    cache_update(cache, true);
     kobject_put(&cache->kobj);
 }
 
@@ -738,6 +992,57 @@ void mvx_fw_cache_put(struct mvx_fw_cache *cache,
         mutex_unlock(&cache->mutex);
 }
 
+int mvx_fw_cache_claim_image(struct mvx_fw_cache *cache,
+                 const struct mvx_fw_bin *fw_bin,
+                 unsigned int ncores,
+                 struct mvx_fw_image *image)
+{
+    struct mvx_fw_image *claimed = NULL;
+    struct mvx_fw_bin *bin;
+    int ret;
+
+    if (fw_bin->securevideo != false)
+        return -ENOENT;
+
+    ret = mutex_lock_interruptible(&cache->mutex);
+    if (ret != 0)
+        return ret;
+
+    list_for_each_entry(bin, &cache->fw_bin_list, cache_head) {
+        if (bin != fw_bin)
+            continue;
+
+        bin->pool_ncores = ncores;
+        claimed = list_first_entry_or_null(&bin->pool,
+                           struct mvx_fw_image, head);
+        if (claimed != NULL) {
+            list_del(&claimed->head);
+            bin->pool_count--;
+        }
+
+        break;
+    }
+
+    mutex_unlock(&cache->mutex);
+
+    if (READ_ONCE(cache->pool_size) > 0)
+        queue_work(system_wq, &cache->pool_work);
+
+    if (claimed == NULL)
+        return -ENOENT;
+
+    if (claimed->ncores != ncores) {
+        image_free(claimed);
+        return -ENOENT;
+    }
+
+    *image = *claimed;
+    INIT_LIST_HEAD(&image->head);
+    kfree(claimed);
+
+    return 0;
+}
+
 void mvx_fw_cache_log(struct mvx_fw_bin *fw_bin,
               struct mvx_client_session *csession)
 {
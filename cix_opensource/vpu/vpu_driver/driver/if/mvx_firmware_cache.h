@@ -40,6 +40,7 @@
 #include <linux/kobject.h>
 #include <linux/list.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
 #include "mvx_if.h"
 
 /****************************************************************************
@@ -49,11 +50,15 @@
 struct device;
 struct firmware;
 struct mvx_client_session;
+struct mvx_mmu_pages;
 struct mvx_secure;
 struct mvx_secure_firmware;
 
 /**
  * struct mvx_fw_cache - Firmware cache.
+ * @pool_size:        Number of pre-warmed firmware images kept per
+ *                      firmware binary. Configured through sysfs.
+ * @pool_work:        Work refilling and trimming the image pools.
  *
  * There is exactly one firmware context per device. It keeps track of the
  * firmware binaries.
@@ -68,6 +73,28 @@ struct mvx_fw_cache {
     atomic_t flush_cnt;
     struct task_struct *cache_thread;
     wait_queue_head_t wait_queue;
+    unsigned int pool_size;
+    struct work_struct pool_work;
+};
+
+/**
+ * struct mvx_fw_image - Pre-warmed firmware memory.
+ * @head:        Used by the firmware cache.
+ * @ncores:        Number of cores the BSS segment was allocated for.
+ * @text:        Text segment, with the firmware binary copied in.
+ * @bss:        Zeroed BSS segment for all cores.
+ * @bss_shared:        Zeroed shared BSS segment.
+ *
+ * Holds the pages a non secure firmware instance maps into its MMU. Images
+ * are allocated in the background, so that a session starting a stream only
+ * has to map the pages.
+ */
+struct mvx_fw_image {
+    struct list_head head;
+    unsigned int ncores;
+    struct mvx_mmu_pages *text;
+    struct mvx_mmu_pages *bss;
+    struct mvx_mmu_pages *bss_shared;
 };
 
 /**
@@ -110,6 +137,11 @@ struct mvx_fw_header {
 
 /**
  * struct mvx_fw_bin - Structure describing a loaded firmware binary.
+ * @pool:        List of pre-warmed firmware images. Protected by the
+ *                      cache mutex.
+ * @pool_count:        Number of images in the pool.
+ * @pool_ncores:    Number of cores of the last instance that claimed an
+ *                      image. 0 until the first claim.
  *
  * Multiple sessions may share the same firmware binary.
  */
@@ -126,6 +158,9 @@ struct mvx_fw_bin {
     struct mvx_hw_ver hw_ver;
     atomic_t flush_cnt;
     bool securevideo;
+    struct list_head pool;
+    unsigned int pool_count;
+    unsigned int pool_ncores;
     struct {
         const struct firmware *fw;
         const struct mvx_fw_header *header;
@@ -226,6 +261,24 @@ int mvx_fw_cache_get(struct mvx_fw_cache *cache,
 void mvx_fw_cache_put(struct mvx_fw_cache *cache,
               struct mvx_fw_bin *fw_bin);
 
+/**
+ * mvx_fw_cache_claim_image() - Claim a pre-warmed firmware image.
+ * @cache:    Pointer to firmware cache.
+ * @fw_bin:    Pointer to firmware binary.
+ * @ncores:    Number of cores the image must have been allocated for.
+ * @image:    Filled in with the pages of the claimed image. The caller
+ *              owns the pages on success.
+ *
+ * A claimed image is replaced in the background, as long as the pool size
+ * is not 0.
+ *
+ * Return: 0 on success, -ENOENT if no matching image was available.
+ */
+int mvx_fw_cache_claim_image(struct mvx_fw_cache *cache,
+                 const struct mvx_fw_bin *fw_bin,
+                 unsigned int ncores,
+                 struct mvx_fw_image *image);
+
 /**
  * mvx_fw_cache_log() - Log firmware binary to ram log.
  * @fw_bin:    Pointer to firmware binary.
@@ -76,6 +76,30 @@ int mvx_fw_construct(struct mvx_fw *fw,
              struct mvx_client_session *csession,
              unsigned int core_mask);
 
+/**
+ * mvx_fw_log_defer() - Queue a firmware interface log record until the
+ *            message batch is over.
+ * @fw:        Pointer to firmware object.
+ * @vec:    Scatter vector of the record.
+ * @count:    Number of entries in @vec.
+ *
+ * Must be called with the firmware mutex held. The records are written to
+ * the log by a work item queued by mvx_fw_log_kick(), so formatting and
+ * copying them stays out of the interrupt handling.
+ *
+ * Return: true if the record was queued, false if it has to be logged by
+ *         the caller.
+ */
+bool mvx_fw_log_defer(struct mvx_fw *fw,
+              struct iovec *vec,
+              unsigned int count);
+
+/**
+ * mvx_fw_log_kick() - Have the deferred log records written.
+ * @fw:        Pointer to firmware object.
+ */
+void mvx_fw_log_kick(struct mvx_fw *fw);
+
 /****************************************************************************
  * Firmware v2
  ****************************************************************************/
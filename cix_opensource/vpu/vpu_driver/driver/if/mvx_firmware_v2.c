@@ -62,15 +62,17 @@ static bool is_afbc(unsigned int format)
 
 /**
  * log_message() - Log a message.
- * @session:        Pointer to session.
+ * @fw:            Pointer to firmware object.
  * @channel:        The type of the firmware interface message;
  *            message, input buffer, output buffer or RPC
  * @direction:        The type of the firmware interface message;
  *            host->firmware or firware->host.
  * @msg_header:        The header of the message.
  * @data:        Pointer to the message data.
+ *
+ * Inside a message batch the record is deferred, see mvx_fw_log_defer().
  */
-static void log_message(struct mvx_session *session,
+static void log_message(struct mvx_fw *fw,
             enum mvx_log_fwif_channel channel,
             enum mvx_log_fwif_direction direction,
             struct mve_msg_header *msg_header,
@@ -94,7 +96,7 @@ static void log_message(struct mvx_session *session,
     fwif.version_minor = 0;
     fwif.channel = channel;
     fwif.direction = direction;
-    fwif.session = (uintptr_t)session;
+    fwif.session = (uintptr_t)fw->session;
 
     vec[0].iov_base = &header;
     vec[0].iov_len = sizeof(header);
@@ -108,6 +110,9 @@ static void log_message(struct mvx_session *session,
     vec[3].iov_base = data;
     vec[3].iov_len = msg_header->size;
 
+    if (fw->batch && mvx_fw_log_defer(fw, vec, 4))
+        return;
+
     MVX_LOG_DATA(&mvx_log_fwif_if, MVX_LOG_INFO, vec, 4);
 }
 
@@ -365,6 +370,63 @@ static uint32_t sum32n(volatile uint32_t *data,
     return sum;
 }
 
+/**
+ * queue_bit() - Bit identifying a host communication area in a batch mask.
+ */
+static unsigned int queue_bit(struct mvx_fw *fw,
+                  struct mve_comm_area_host *host)
+{
+    if (host == fw->msg_host)
+        return BIT(0);
+    else if (host == fw->buf_in_host)
+        return BIT(1);
+
+    return BIT(2);
+}
+
+/**
+ * sync_for_cpu() - Invalidate part of a communication area, accounting the
+ *            time spent in the firmware performance counters.
+ */
+static void sync_for_cpu(struct mvx_fw *fw,
+             void *addr,
+             size_t size)
+{
+    ktime_t start = ktime_get();
+
+    dma_sync_single_for_cpu(fw->dev, virt_to_phys(addr), size,
+                DMA_FROM_DEVICE);
+    fw->sync_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+    fw->sync_count++;
+}
+
+/**
+ * sync_for_device() - Clean part of a communication area, accounting the
+ *               time spent in the firmware performance counters.
+ */
+static void sync_for_device(struct mvx_fw *fw,
+                void *addr,
+                size_t size)
+{
+    ktime_t start = ktime_get();
+
+    dma_sync_single_for_device(fw->dev, virt_to_phys(addr), size,
+                   DMA_TO_DEVICE);
+    fw->sync_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+    fw->sync_count++;
+}
+
+static void write_rpos(struct mvx_fw *fw,
+               struct mve_comm_area_host *host)
+{
+    /*
+     * Make sure the read pointer has been written before the cache is
+     * flushed.
+     */
+    wmb();
+    sync_for_device(fw, &host->out_rpos, sizeof(host->out_rpos));
+}
+
 /**
  * read_message() - Read message from firmware message queue.
  * @fw:        Pointer to firmware object.
@@ -397,9 +459,11 @@ static int read_message(struct mvx_fw *fw,
         goto out;
     }
 
-    dma_sync_single_for_cpu(fw->dev,
-                virt_to_phys(mve),
-                MVE_PAGE_SIZE, DMA_FROM_DEVICE);
+    if (fw->batch == false || (fw->batch_synced & queue_bit(fw, host)) == 0) {
+        sync_for_cpu(fw, mve, MVE_PAGE_SIZE);
+        if (fw->batch)
+            fw->batch_synced |= queue_bit(fw, host);
+    }
 
     rpos = host->out_rpos;
     prev_rpos = rpos;
@@ -491,21 +555,17 @@ static int read_message(struct mvx_fw *fw,
     rpos = read32n(mve->out_data, rpos, data, header.size);
     host->out_rpos = rpos;
 
-    /*
-     * Make sure the read pointer has been written before the cache is
-     * flushed.
-     */
-    wmb();
-    dma_sync_single_for_device(fw->dev,
-                   virt_to_phys(&host->out_rpos),
-                   sizeof(host->out_rpos), DMA_TO_DEVICE);
+    if (fw->batch)
+        fw->batch_dirty |= queue_bit(fw, host);
+    else
+        write_rpos(fw, host);
 
     *code = header.code;
     *size = header.size;
 
     /* Log firmware message. */
     MVX_LOG_EXECUTE(&mvx_log_fwif_if, MVX_LOG_INFO,
-            log_message(fw->session, channel,
+            log_message(fw, channel,
                     MVX_LOG_FWIF_DIRECTION_FIRMWARE_TO_HOST,
                     &header, data));
 
@@ -574,9 +634,7 @@ static int write_message(struct mvx_fw *fw,
         goto out;
     }
 
-    dma_sync_single_for_cpu(fw->dev,
-                virt_to_phys(&mve->in_rpos),
-                sizeof(mve->in_rpos), DMA_FROM_DEVICE);
+    sync_for_cpu(fw, &mve->in_rpos, sizeof(mve->in_rpos));
 
     wpos = host->in_wpos;
 
@@ -643,9 +701,7 @@ static int write_message(struct mvx_fw *fw,
      * flushed.
      */
     wmb();
-    dma_sync_single_for_device(fw->dev,
-                   virt_to_phys(host),
-                   MVE_PAGE_SIZE, DMA_TO_DEVICE);
+    sync_for_device(fw, host, MVE_PAGE_SIZE);
 
     host->in_wpos = wpos;
 
@@ -654,13 +710,11 @@ static int write_message(struct mvx_fw *fw,
      * flushed.
      */
     wmb();
-    dma_sync_single_for_device(fw->dev,
-                   virt_to_phys(&host->in_wpos),
-                   sizeof(host->in_wpos), DMA_TO_DEVICE);
+    sync_for_device(fw, &host->in_wpos, sizeof(host->in_wpos));
 
     /* Log firmware message. */
     MVX_LOG_EXECUTE(&mvx_log_fwif_if, MVX_LOG_INFO,
-            log_message(fw->session, channel,
+            log_message(fw, channel,
                     MVX_LOG_FWIF_DIRECTION_HOST_TO_FIRMWARE,
                     &header, data));
 
@@ -1216,12 +1270,47 @@ static int get_message_v2(struct mvx_fw *fw,
                   ((struct mve_comm_area_mve *)(fw->msg_mve))->out_wpos);
         msg->code = MVX_FW_CODE_UNKNOWN;
         ret = EAGAIN;
+
+        /* The retry has to see the queue as the firmware wrote it. */
+        mutex_lock(&fw->mutex);
+        fw->batch_synced &= ~queue_bit(fw, fw->msg_host);
+        mutex_unlock(&fw->mutex);
         break;
     }
 
     return ret;
 }
 
+static void begin_batch_v2(struct mvx_fw *fw)
+{
+    mutex_lock(&fw->mutex);
+    fw->batch = true;
+    fw->batch_synced = 0;
+    fw->batch_dirty = 0;
+    mutex_unlock(&fw->mutex);
+}
+
+static void end_batch_v2(struct mvx_fw *fw)
+{
+    mutex_lock(&fw->mutex);
+
+    if (fw->batch_dirty & BIT(0))
+        write_rpos(fw, fw->msg_host);
+
+    if (fw->batch_dirty & BIT(1))
+        write_rpos(fw, fw->buf_in_host);
+
+    if (fw->batch_dirty & BIT(2))
+        write_rpos(fw, fw->buf_out_host);
+
+    fw->batch = false;
+    fw->batch_synced = 0;
+    fw->batch_dirty = 0;
+    mutex_unlock(&fw->mutex);
+
+    mvx_fw_log_kick(fw);
+}
+
 static int put_buffer_general(struct mvx_fw *fw,
                 struct mve_comm_area_host *host,
                 struct mve_comm_area_mve *mve,
@@ -3898,6 +3987,8 @@ int mvx_fw_construct_v2(struct mvx_fw *fw,
     fw->ops.unmap_protocol = unmap_protocol_v2;
     fw->ops.get_region = get_region_v2;
     fw->ops.get_message = get_message_v2;
+    fw->ops.begin_batch = begin_batch_v2;
+    fw->ops.end_batch = end_batch_v2;
     fw->ops.put_message = put_message_v2;
     fw->ops.handle_rpc = handle_rpc_v2;
     fw->ops.handle_fw_ram_print = handle_fw_ram_print_v2;
@@ -62,6 +62,9 @@
 #define MAX_RT_FPS_FRAMES (1 << 9)
 #define FPS_SKIP_FRAMES 200
 
+/* Maximum number of firmware messages read before read positions are released. */
+#define MVX_FW_MSG_BATCH 32
+
 /****************************************************************************
  * Private variables
  ****************************************************************************/
@@ -842,6 +845,7 @@ static int switch_in(struct mvx_session *session)
 
     MVX_SESSION_INFO(session, "Switch in.");
     watchdog_start(session, session_watchdog_timeout, true);
+    session->perf.switch_in_req_at = ktime_get();
 
     ret = session->client_ops->switch_in(session->csession);
     if (ret != 0) {
@@ -962,6 +966,7 @@ static int fw_switch_out(struct mvx_session *session)
     unsigned int idle_count = session->idle_count;
     int ret;
 
+    session->fw_switch_out_at = ktime_get();
     ret = fw_send_msg_simple(session, MVX_FW_CODE_SWITCH_OUT,
                  "Switch out");
 
@@ -2535,6 +2540,8 @@ static int map_buffer(struct mvx_session *session,
     enum mvx_fw_region region;
     int ret;
     mvx_mmu_va *next_va;
+    ktime_t start;
+
     ret = mutex_lock_interruptible(&session->fw.mem_mutex);
     if (ret != 0) {
         MVX_LOG_PRINT(&mvx_log_if, MVX_LOG_ERROR,
@@ -2559,6 +2566,7 @@ static int map_buffer(struct mvx_session *session,
         return ret;
     }
 
+    start = ktime_get();
     ret = mvx_buffer_map(buf, begin, end, next_va,
                         session->port[dir].size);
     if (ret != 0) {
@@ -2566,6 +2574,9 @@ static int map_buffer(struct mvx_session *session,
         return ret;
     }
 
+    session->perf.map_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+    session->perf.map_count++;
+
     mutex_unlock(&session->fw.mem_mutex);
     return 0;
 }
@@ -2829,6 +2840,18 @@ static int queue_buffer(struct mvx_session *session,
     port->buffer_count++;
     port->buffers_in_window++;
     port->flushed = false;
+
+    session->perf.buffers++;
+    if (buf->queued_at != 0) {
+        uint64_t latency = ktime_to_ns(ktime_sub(ktime_get(),
+                             buf->queued_at));
+
+        session->perf.queue_ns += latency;
+        session->perf.queue_max_ns = max(session->perf.queue_max_ns,
+                         latency);
+        buf->queued_at = 0;
+    }
+
     ret = send_irq(session);
     if (ret != 0)
         goto send_error;
@@ -3839,6 +3862,7 @@ int mvx_session_qbuf(struct mvx_session *session,
         return session->error;
 
     buf->in_flags = buf->flags;
+    buf->queued_at = ktime_get();
 
     if (is_fw_loaded(session) == false ||
         session->port[dir].is_flushing != false ||
@@ -4252,6 +4276,10 @@ static void mvx_handle_buffer(struct mvx_session *session, struct mvx_fw_msg *ms
                 (void)mvx_buffer_filled_set(buf, i, output->size[i], 0);
         }
     }
+    if (buf->dir == MVX_DIR_OUTPUT && buf->planes[0].filled > 0 &&
+        (!session->is_encoder || (buf->flags & MVX_BUFFER_EOF)))
+        session->hw_frames++;
+
     if (send_buffer_event)
         session->event(session, MVX_SESSION_EVENT_BUFFER, buf);
 
@@ -4563,6 +4591,13 @@ static void mvx_handle_state_change(struct mvx_session *session, struct mvx_fw_m
 
 static void mvx_handle_switch_in(struct mvx_session *session, struct mvx_fw_msg *msg)
 {
+    session->fw_switched_in_at = ktime_get();
+    session->perf.switch_in_count++;
+    if (session->perf.switch_in_req_at != 0) {
+        session->perf.switch_in_wait_ns += ktime_to_ns(ktime_sub(
+            session->fw_switched_in_at, session->perf.switch_in_req_at));
+        session->perf.switch_in_req_at = 0;
+    }
     watchdog_start(session, session_watchdog_timeout, true);
 }
 
@@ -4570,6 +4605,11 @@ static void mvx_handle_switch_out(struct mvx_session *session, struct mvx_fw_msg
 {
     MVX_SESSION_INFO(session, "Firmware rsp: Switched out.");
 
+    session->perf.switch_out_count++;
+    if (session->fw_switched_in_at != 0)
+        session->perf.hw_ns += ktime_to_ns(ktime_sub(ktime_get(),
+                                 session->fw_switched_in_at));
+
     watchdog_stop(session);
     switch_out_rsp(session);
 
@@ -4638,6 +4678,9 @@ static void handle_fw_message(struct mvx_session *session,
 void mvx_session_irq(struct mvx_if_session *isession)
 {
     struct mvx_session *session = mvx_if_session_to_session(isession);
+    unsigned int timeout_ms;
+    unsigned int count;
+    unsigned int batch;
     int ret;
     int retry;
 
@@ -4652,36 +4695,59 @@ void mvx_session_irq(struct mvx_if_session *isession)
 
 #define GET_MSG_MAX_RETRY 10
     retry = 0;
+    count = 0;
     do {
-        struct mvx_fw_msg msg;
-        unsigned int timeout_ms = session->watchdog_count > 0 ?
-            session_watchdog_timeout * session->watchdog_count :
-            session_watchdog_timeout;
-
-        watchdog_update(session, timeout_ms);
+        /*
+         * Drain the queues in batches. Within a batch each queue is
+         * synchronized from the firmware once and the read positions are
+         * written back when the batch ends. A new batch is started as long
+         * as the previous one returned messages, to pick up messages the
+         * firmware queued in the meantime. A message read again stays in
+         * the batch, get_message() synchronizes its queue again.
+         */
+        batch = 0;
+        session->fw.ops.begin_batch(&session->fw);
+        do {
+            struct mvx_fw_msg msg;
+
+            ret = session->fw.ops.get_message(&session->fw, &msg);
+            if (ret < 0) {
+                session->fw.ops.end_batch(&session->fw);
+                send_event_error(session, ret);
+                return;
+            } else if (ret == EAGAIN) {
+                retry++;
+                if (retry <= GET_MSG_MAX_RETRY)
+                    continue;
 
-        ret = session->fw.ops.get_message(&session->fw, &msg);
-        if (ret < 0) {
-            send_event_error(session, ret);
-            return;
-        } else if (ret == EAGAIN) {
-            retry++;
-            if (retry > GET_MSG_MAX_RETRY) {
                 MVX_LOG_PRINT(&mvx_log_if, MVX_WAR_LOG_LEVEL,
                         "Unknown fw message code.");
                 ret = -EINVAL;
-            } else {
+                break;
+            }
+
+            if (retry > 0)
                 MVX_LOG_PRINT(&mvx_log_if, MVX_WAR_LOG_LEVEL,
-                        "Retry %d", retry);
-                continue;
+                        "Retried %d times.", retry);
+
+            retry = 0;
+
+            if (ret > 0) {
+                handle_fw_message(session, &msg);
+                batch++;
             }
-        }
+        } while (ret > 0 && session->error == 0 &&
+             batch < MVX_FW_MSG_BATCH);
+        session->fw.ops.end_batch(&session->fw);
+        count += batch;
+    } while (ret >= 0 && batch > 0 && session->error == 0);
 
-        retry = 0;
+    timeout_ms = session->watchdog_count > 0 ?
+        session_watchdog_timeout * session->watchdog_count :
+        session_watchdog_timeout;
+    watchdog_update(session, timeout_ms);
 
-        if (ret > 0)
-            handle_fw_message(session, &msg);
-    } while (ret > 0 && session->error == 0);
+    MVX_SESSION_DEBUG(session, "IRQ handled %u messages.", count);
 
     ret = session->fw.ops.handle_fw_ram_print(&session->fw);
     if (ret < 0) {
@@ -5628,6 +5694,19 @@ int mvx_session_set_jpeg_quality_chroma(struct mvx_session *session,
 }
 
 
+void mvx_session_get_perf(struct mvx_session *session,
+              struct mvx_session_perf *perf,
+              uint64_t *frames)
+{
+    /* Snapshot under the mutex the irq handler updates them with. */
+    mutex_lock(session->isession.mutex);
+    *perf = session->perf;
+    perf->sync_count += session->fw.sync_count;
+    perf->sync_ns += session->fw.sync_ns;
+    *frames = session->hw_frames;
+    mutex_unlock(session->isession.mutex);
+}
+
 int mvx_session_get_color_desc(struct mvx_session *session,
                    struct mvx_fw_color_desc *color_desc)
 {
@@ -6522,6 +6601,7 @@ int mvx_session_set_job_frames(struct mvx_session *session,
         return -EBUSY;
 
     session->job_frames = val;
+    session->job_frames_set = true;
 
     return 0;
 }
@@ -37,6 +37,7 @@
  ****************************************************************************/
 
 #include <linux/kref.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/mutex.h>
 #include <linux/types.h>
@@ -249,6 +250,39 @@ struct mvx_session_format_map {
     uint32_t to8_pixelformat;
 };
 
+/**
+ * struct mvx_session_perf - Session performance counters.
+ * @buffers:        Number of buffers handed to the firmware.
+ * @queue_ns:        Sum of latencies from client queue to firmware.
+ * @queue_max_ns:    Largest latency from client queue to firmware.
+ * @switch_in_count:    Number of firmware switch in responses.
+ * @switch_out_count:    Number of firmware switch out responses.
+ * @switch_in_wait_ns:    Time from switch in request to firmware response.
+ * @switch_in_req_at:    Time of the pending switch in request, or 0.
+ * @hw_ns:        Time the session has been switched in on a core.
+ * @sync_count:        Number of buffer cache maintenance operations.
+ * @sync_ns:        Time spent in buffer cache maintenance.
+ * @map_count:        Number of buffer MMU map operations.
+ * @map_ns:        Time spent mapping buffers.
+ *
+ * Counters are protected by the session mutex and are cumulative for the
+ * lifetime of the session.
+ */
+struct mvx_session_perf {
+    uint64_t buffers;
+    uint64_t queue_ns;
+    uint64_t queue_max_ns;
+    uint64_t switch_in_count;
+    uint64_t switch_out_count;
+    uint64_t switch_in_wait_ns;
+    ktime_t switch_in_req_at;
+    uint64_t hw_ns;
+    uint64_t sync_count;
+    uint64_t sync_ns;
+    uint64_t map_count;
+    uint64_t map_ns;
+};
+
 /**
  * struct mvx_session - Session instance.
  * @dev:        Pointer to device.
@@ -311,6 +345,12 @@ struct mvx_session_format_map {
  * @resync_interval:    JPEG resync interval.
  * @jpeg_quality:    JPEG quality level.
  * @color_desc:        HDR color description.
+ * @job_frames:        Frames per firmware job, 0 for unlimited.
+ * @job_frames_set:    Job frames set by client, not adapted by scheduler.
+ * @fw_switched_in_at:    Time of the last firmware switch in response.
+ * @fw_switch_out_at:    Time of the last firmware switch out request.
+ * @hw_frames:        Number of frames completed by the hardware.
+ * @perf:        Performance counters.
  *
  * There is one session for each file handle that has been opened from the
  * video device.
@@ -456,6 +496,11 @@ struct mvx_session {
     struct mvx_crop_cfg crop;
     struct mvx_osd_info osd_info;
     uint32_t job_frames;
+    bool job_frames_set;
+    ktime_t fw_switched_in_at;
+    ktime_t fw_switch_out_at;
+    uint64_t hw_frames;
+    struct mvx_session_perf perf;
     uint32_t force_key_frame;
     bool pending_switch_out;
     bool is_encoder;
@@ -1244,6 +1289,19 @@ int mvx_session_set_jpeg_quality_chroma(struct mvx_session *session,
 int mvx_session_get_color_desc(struct mvx_session *session,
                    struct mvx_fw_color_desc *color_desc);
 
+/**
+ * mvx_session_get_perf() - Get session performance counters.
+ * @session:    Session.
+ * @perf:    Performance counters, including firmware queue maintenance.
+ * @frames:    Number of frames processed by the hardware.
+ *
+ * Takes the session mutex, so the counters are a consistent snapshot. Must
+ * not be called with the session mutex held.
+ */
+void mvx_session_get_perf(struct mvx_session *session,
+              struct mvx_session_perf *perf,
+              uint64_t *frames);
+
 /**
  * mvx_session_set_color_desc() - Set color description.
  * @session:    Pointer to session.
@@ -986,6 +986,13 @@ static int get_volatile_ctrl(struct v4l2_ctrl *ctrl)
     case V4L2_CID_MVE_VIDEO_MAX_BUFFERS_FOR_CAPTURE:
         ctrl->val = vsession->session.port[MVX_DIR_OUTPUT].buffer_max;
         break;
+    case V4L2_CID_MVE_VIDEO_PERF_COUNTERS: {
+        struct v4l2_mvx_perf_counters perf;
+
+        mvx_v4l2_session_get_perf(vsession, &perf);
+        memcpy(ctrl->p_new.p_u32, &perf, sizeof(perf));
+        break;
+    }
 #if KERNEL_VERSION(5, 15, 0) <= LINUX_VERSION_CODE
     case V4L2_CID_COLORIMETRY_HDR10_CLL_INFO:
         mvx_v4l2_session_get_hdr10_cll_info(vsession,
@@ -1127,6 +1134,40 @@ static int mvx_v4l2_ctrls_init_hdr10(struct v4l2_ctrl_handler *hnd,
     return 0;
 }
 
+/**
+ * mvx_v4l2_ctrls_init_perf() - Create read only performance counter control.
+ * @hnd:    V4L2 handler.
+ *
+ * The counters are exposed as an array of 32 bit words holding a
+ * struct v4l2_mvx_perf_counters.
+ *
+ * Return: 0 on success, else error code.
+ */
+static int mvx_v4l2_ctrls_init_perf(struct v4l2_ctrl_handler *hnd)
+{
+    struct v4l2_ctrl_config cfg;
+    struct v4l2_ctrl *ctrl;
+
+    memset(&cfg, 0, sizeof(cfg));
+
+    cfg.id = V4L2_CID_MVE_VIDEO_PERF_COUNTERS;
+    cfg.ops = &ctrl_ops;
+    cfg.type = V4L2_CTRL_TYPE_U32;
+    cfg.name = "performance counters";
+    cfg.min = 0;
+    cfg.max = U32_MAX;
+    cfg.def = 0;
+    cfg.step = 1;
+    cfg.dims[0] = sizeof(struct v4l2_mvx_perf_counters) / sizeof(__u32);
+    cfg.flags = V4L2_CTRL_FLAG_READ_ONLY | V4L2_CTRL_FLAG_VOLATILE;
+
+    ctrl = v4l2_ctrl_new_custom(hnd, &cfg, NULL);
+    if (ctrl == NULL)
+        return -EINVAL;
+
+    return 0;
+}
+
 /****************************************************************************
  * Exported functions
  ****************************************************************************/
@@ -1321,6 +1362,10 @@ int mvx_v4l2_ctrls_init_dec(struct v4l2_ctrl_handler *hnd)
     if (ctrl == NULL)
         goto handler_free;
 
+    ret = mvx_v4l2_ctrls_init_perf(hnd);
+    if (ret != 0)
+        goto handler_free;
+
     ret = v4l2_ctrl_handler_setup(hnd);
     if (ret != 0)
         goto handler_free;
@@ -2105,6 +2150,10 @@ int mvx_v4l2_ctrls_init_enc(struct v4l2_ctrl_handler *hnd)
     if (ctrl == NULL)
         goto handler_free;
 
+    ret = mvx_v4l2_ctrls_init_perf(hnd);
+    if (ret != 0)
+        goto handler_free;
+
     ret = v4l2_ctrl_handler_setup(hnd);
     if (ret != 0)
         goto handler_free;
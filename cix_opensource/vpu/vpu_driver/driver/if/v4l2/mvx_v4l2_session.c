@@ -276,18 +276,46 @@ static int port_debugfs_init(struct device *dev,
     return 0;
 }
 
+static ssize_t session_perf_read(struct file *file,
+                 char __user *user_buffer,
+                 size_t count,
+                 loff_t *position)
+{
+    struct mvx_v4l2_session *vsession = file->private_data;
+    struct v4l2_mvx_perf_counters perf;
+
+    mvx_v4l2_session_get_perf(vsession, &perf);
+
+    return simple_read_from_buffer(user_buffer, count, position,
+                       &perf, sizeof(perf));
+}
+
+static const struct file_operations session_perf_fops = {
+    .open   = simple_open,
+    .read   = session_perf_read,
+    .llseek = default_llseek
+};
+
 static int session_debugfs_init(struct mvx_v4l2_session *session,
                 struct dentry *parent)
 {
     int ret;
     char name[20];
     int i;
+    struct dentry *dentry;
 
     scnprintf(name, sizeof(name), "%px", &session->session);
     session->dentry = debugfs_create_dir(name, parent);
     if (IS_ERR_OR_NULL(session->dentry))
         return -ENOMEM;
 
+    dentry = debugfs_create_file("perf", 0400, session->dentry, session,
+                     &session_perf_fops);
+    if (IS_ERR_OR_NULL(dentry)) {
+        ret = -ENOMEM;
+        goto remove_dentry;
+    }
+
     for (i = 0; i < MVX_DIR_MAX; i++) {
         struct mvx_v4l2_port *vport = &session->port[i];
         struct mvx_session_port *mport = &session->session.port[i];
@@ -370,8 +398,12 @@ static struct vb2_buffer *merge_bitstream(struct mvx_v4l2_session *vsession,
                     struct mvx_v4l2_buffer *vbuf)
 {
     struct vb2_buffer *vb = NULL;
+    struct mvx_session_perf *perf = &vsession->session.perf;
+    ktime_t start = ktime_get();
 
     mvx_buffer_synch(&vbuf->buf, DMA_FROM_DEVICE);
+    perf->sync_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+    perf->sync_count++;
     if (vsession->frame_bits_buf == NULL) {
         vsession->frame_bits_buf = vbuf;
         MVX_SESSION_INFO(&vsession->session,
@@ -873,6 +905,30 @@ int mvx_v4l2_session_set_enc_lambda_scale(struct mvx_v4l2_session *vsession,
     return 0;
 }
 
+void mvx_v4l2_session_get_perf(struct mvx_v4l2_session *vsession,
+                   struct v4l2_mvx_perf_counters *perf)
+{
+    struct mvx_session_perf sperf;
+    uint64_t frames;
+
+    mvx_session_get_perf(&vsession->session, &sperf, &frames);
+
+    memset(perf, 0, sizeof(*perf));
+    perf->version = V4L2_MVX_PERF_COUNTERS_VERSION;
+    perf->frames = frames;
+    perf->buffers = sperf.buffers;
+    perf->queue_ns = sperf.queue_ns;
+    perf->queue_max_ns = sperf.queue_max_ns;
+    perf->switch_in_count = sperf.switch_in_count;
+    perf->switch_out_count = sperf.switch_out_count;
+    perf->switch_in_wait_ns = sperf.switch_in_wait_ns;
+    perf->hw_ns = sperf.hw_ns;
+    perf->sync_count = sperf.sync_count;
+    perf->sync_ns = sperf.sync_ns;
+    perf->map_count = sperf.map_count;
+    perf->map_ns = sperf.map_ns;
+}
+
 #if KERNEL_VERSION(5, 15, 0) <= LINUX_VERSION_CODE
 int mvx_v4l2_session_get_hdr10_cll_info(struct mvx_v4l2_session *vsession,
                     struct v4l2_ctrl_hdr10_cll_info *hdr)
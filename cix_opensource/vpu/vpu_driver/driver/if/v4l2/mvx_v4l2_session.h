@@ -250,6 +250,14 @@ int mvx_v4l2_session_set_color_info(struct mvx_v4l2_session *vsession,
                     struct v4l2_pix_format_mplane *pix);
 int mvx_v4l2_session_set_enc_lambda_scale(struct mvx_v4l2_session *vsession,
                     struct v4l2_mvx_lambda_scale *lambda_scale);
+
+/**
+ * mvx_v4l2_session_get_perf() - Get session performance counters.
+ * @vsession:    Pointer to v4l2 session.
+ * @perf:    Performance counters.
+ */
+void mvx_v4l2_session_get_perf(struct mvx_v4l2_session *vsession,
+                   struct v4l2_mvx_perf_counters *perf);
 #if KERNEL_VERSION(5, 15, 0) <= LINUX_VERSION_CODE
 int mvx_v4l2_session_get_hdr10_cll_info(struct mvx_v4l2_session *vsession,
                     struct v4l2_ctrl_hdr10_cll_info *hdr);
@@ -480,6 +480,7 @@ enum v4l2_cid_mve_video {
     V4L2_CID_MVE_VIDEO_ENC_INTER_IPENALTY_ANGULAR,
     V4L2_CID_MVE_VIDEO_ENC_INTER_IPENALTY_PLANAR,
     V4L2_CID_MVE_VIDEO_ENC_INTER_IPENALTY_DC,
+    V4L2_CID_MVE_VIDEO_PERF_COUNTERS,
 };
 
 #define V4L2_SESSION_PRIORITY_PREEMPTION 0
@@ -658,4 +659,30 @@ struct v4l2_mvx_lambda_scale{
     unsigned short lambda_scale_b_nonref_q8;
     unsigned short lambda_scale_sqrt_b_nonref_q8;
 };
+
+/*
+ * Per session performance counters, returned by the read only array control
+ * V4L2_CID_MVE_VIDEO_PERF_COUNTERS (as __u32 words) and by the binary debugfs
+ * file 'perf' in the session directory. All times are in nanoseconds and all
+ * counters are cumulative since the session was opened.
+ */
+#define V4L2_MVX_PERF_COUNTERS_VERSION 1
+
+struct v4l2_mvx_perf_counters {
+    __u32 version;
+    __u32 reserved;
+    __u64 frames;            /* Frames processed by the hardware. */
+    __u64 buffers;           /* Buffers handed to the firmware. */
+    __u64 queue_ns;          /* Sum of QBUF to firmware latencies. */
+    __u64 queue_max_ns;      /* Worst QBUF to firmware latency. */
+    __u64 switch_in_count;
+    __u64 switch_out_count;
+    __u64 switch_in_wait_ns; /* Time from switch in request to firmware ack. */
+    __u64 hw_ns;             /* Time spent switched in on a core. */
+    __u64 sync_count;        /* Cache maintenance operations. */
+    __u64 sync_ns;
+    __u64 map_count;         /* Buffer MMU map operations. */
+    __u64 map_ns;
+};
+
 #endif /* _MVX_V4L2_CONTROLS_H_ */
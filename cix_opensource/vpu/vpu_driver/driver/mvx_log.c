@@ -42,10 +42,14 @@
 #include <linux/dcache.h>
 #include <linux/export.h>
 #include <linux/fs.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
 #include <linux/poll.h>
 #include <linux/namei.h>
 #include <linux/sched.h>
+#include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/timekeeping.h>
 #include <linux/un.h>
 #include <linux/version.h>
 #include <linux/vmalloc.h>
@@ -68,6 +72,39 @@ void mvx_sched_get_realtime_fps(struct list_head *sessions);
  * Types
  ******************************************************************************/
 
+/**
+ * struct drain_ram_record - Header of a record in a per CPU RAM drain ring.
+ * @length:        Length of the message following the header. Is 4 byte
+ *            aligned.
+ * @reserved:        Always 0.
+ * @stamp:        Monotonic time stamp in nanoseconds.
+ */
+struct drain_ram_record {
+    uint32_t length;
+    uint32_t reserved;
+    uint64_t stamp;
+};
+
+/**
+ * struct drain_ram_reader - File handle state of a per CPU RAM drain.
+ * @drain:        The per CPU RAM drain.
+ * @mutex:        Serializes reads through the file handle.
+ * @start_stamp:    Records older than this are skipped.
+ * @msg:        Message being copied to user space.
+ * @msg_len:        Length of message.
+ * @msg_off:        Number of bytes of message already copied.
+ * @pos:        Read position in the ring of each CPU.
+ */
+struct drain_ram_reader {
+    struct mvx_log_drain_ram_pcpu *drain;
+    struct mutex mutex;
+    uint64_t start_stamp;
+    char *msg;
+    size_t msg_len;
+    size_t msg_off;
+    size_t pos[];
+};
+
 /******************************************************************************
  * Variables
  ******************************************************************************/
@@ -628,6 +665,330 @@ static int drain_ram_open(struct inode *inode,
     return 0;
 }
 
+/**
+ * ring_write() - Copy data into a per CPU ring.
+ */
+static void ring_write(struct mvx_log_drain_ram_cpu *ring,
+               size_t size,
+               size_t pos,
+               const void *data,
+               size_t len)
+{
+    while (len > 0) {
+        size_t offset = pos & (size - 1);
+        size_t n = min(len, size - offset);
+
+        memcpy(&ring->buf[offset], data, n);
+
+        pos += n;
+        data += n;
+        len -= n;
+    }
+}
+
+/**
+ * ring_read() - Copy data out of a per CPU ring.
+ */
+static void ring_read(struct mvx_log_drain_ram_cpu *ring,
+              size_t size,
+              size_t pos,
+              void *data,
+              size_t len)
+{
+    while (len > 0) {
+        size_t offset = pos & (size - 1);
+        size_t n = min(len, size - offset);
+
+        memcpy(data, &ring->buf[offset], n);
+
+        pos += n;
+        data += n;
+        len -= n;
+    }
+}
+
+/**
+ * reader_pending() - Check if any ring has unread records.
+ * @reader:        Pointer to reader.
+ */
+static bool reader_pending(struct drain_ram_reader *reader)
+{
+    int cpu;
+
+    if (reader->msg_off < reader->msg_len)
+        return true;
+
+    for_each_possible_cpu(cpu) {
+        struct mvx_log_drain_ram_cpu *ring =
+            per_cpu_ptr(reader->drain->cpu, cpu);
+
+        if (reader->pos[cpu] < smp_load_acquire(&ring->head))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * reader_peek() - Read the header of the next record in the ring of a CPU.
+ * @reader:        Pointer to reader.
+ * @cpu:        CPU of the ring.
+ * @rec:        Filled in with the record header.
+ *
+ * Records overwritten by the writer are skipped.
+ *
+ * Return: True if a record is available, else false.
+ */
+static bool reader_peek(struct drain_ram_reader *reader,
+            int cpu,
+            struct drain_ram_record *rec)
+{
+    struct mvx_log_drain_ram_cpu *ring =
+        per_cpu_ptr(reader->drain->cpu, cpu);
+    size_t size = reader->drain->buffer_size;
+
+    while (true) {
+        size_t pos = reader->pos[cpu];
+        size_t tail;
+
+        if (pos >= smp_load_acquire(&ring->head))
+            return false;
+
+        tail = READ_ONCE(ring->tail);
+        if (pos < tail) {
+            reader->pos[cpu] = tail;
+            continue;
+        }
+
+        ring_read(ring, size, pos, rec, sizeof(*rec));
+
+        /* The header is valid if the writer did not release it meanwhile. */
+        smp_rmb();
+        tail = READ_ONCE(ring->tail);
+        if (pos >= tail)
+            return true;
+
+        reader->pos[cpu] = tail;
+    }
+}
+
+/**
+ * reader_next() - Fetch the oldest unread message of all rings.
+ * @reader:        Pointer to reader.
+ *
+ * Return: True if a message was fetched, else false.
+ */
+static bool reader_next(struct drain_ram_reader *reader)
+{
+    struct mvx_log_drain_ram_pcpu *drain = reader->drain;
+
+    while (true) {
+        struct mvx_log_drain_ram_cpu *ring;
+        struct drain_ram_record rec;
+        struct drain_ram_record next;
+        int best = -1;
+        size_t pos;
+        int cpu;
+
+        for_each_possible_cpu(cpu) {
+            if (reader_peek(reader, cpu, &rec) == false)
+                continue;
+
+            if (best < 0 || rec.stamp < next.stamp) {
+                best = cpu;
+                next = rec;
+            }
+        }
+
+        if (best < 0)
+            return false;
+
+        ring = per_cpu_ptr(drain->cpu, best);
+        pos = reader->pos[best];
+
+        ring_read(ring, drain->buffer_size, pos + sizeof(next),
+              reader->msg, next.length);
+
+        /* Drop the message if the writer overwrote it while copying. */
+        smp_rmb();
+        if (READ_ONCE(ring->tail) > pos) {
+            reader->pos[best] = READ_ONCE(ring->tail);
+            continue;
+        }
+
+        reader->pos[best] = pos + sizeof(next) + next.length;
+
+        if (next.stamp < reader->start_stamp)
+            continue;
+
+        reader->msg_len = next.length;
+        reader->msg_off = 0;
+
+        return true;
+    }
+}
+
+/**
+ * drain_ram_pcpu_read_msg() - Read of the per CPU RAM file.
+ * @file:        File pointer.
+ * @user_buffer:    The user space buffer that is read to.
+ * @count:        The maximum number of bytes to read.
+ * @position:        The current position in the buffer.
+ */
+static ssize_t drain_ram_pcpu_read_msg(struct file *file,
+                       char __user *user_buffer,
+                       size_t count,
+                       loff_t *position)
+{
+    struct drain_ram_reader *reader = file->private_data;
+    ssize_t n = 0;
+    int ret;
+
+    ret = mutex_lock_interruptible(&reader->mutex);
+    if (ret != 0)
+        return -EINTR;
+
+    while (n < count) {
+        size_t length;
+
+        if (reader->msg_off == reader->msg_len &&
+            reader_next(reader) == false) {
+            if (n > 0)
+                break;
+
+            if (file->f_flags & O_NONBLOCK) {
+                n = -EAGAIN;
+                break;
+            }
+
+            /* Block until there is data available. */
+            ret = wait_event_interruptible(reader->drain->queue,
+                               reader_pending(reader));
+            if (ret != 0) {
+                n = -EINTR;
+                break;
+            }
+
+            continue;
+        }
+
+        length = min(count - n, reader->msg_len - reader->msg_off);
+        if (copy_to_user(&user_buffer[n],
+                 &reader->msg[reader->msg_off], length) != 0) {
+            if (n == 0)
+                n = -EFAULT;
+
+            break;
+        }
+
+        reader->msg_off += length;
+        n += length;
+    }
+
+    if (n > 0)
+        *position += n;
+
+    mutex_unlock(&reader->mutex);
+
+    return n;
+}
+
+/**
+ * drain_ram_pcpu_msg_poll() - Handle poll.
+ * @file:        File pointer.
+ * @wait:        The poll table to which the wait queue is added.
+ */
+static unsigned int drain_ram_pcpu_msg_poll(struct file *file,
+                        poll_table *wait)
+{
+    struct drain_ram_reader *reader = file->private_data;
+    unsigned int mask = 0;
+
+    poll_wait(file, &reader->drain->queue, wait);
+
+    if (reader_pending(reader))
+        mask |= POLLIN | POLLRDNORM;
+
+    return mask;
+}
+
+/**
+ * drain_ram_pcpu_ioctl() - Handle IOCTL.
+ * @file:        File pointer.
+ * @cmd:        The value of the command to be handled.
+ * @arg:        Extra argument.
+ */
+static long drain_ram_pcpu_ioctl(struct file *file,
+                 unsigned int cmd,
+                 unsigned long arg)
+{
+    struct drain_ram_reader *reader = file->private_data;
+
+    switch (cmd) {
+    case MVX_LOG_IOCTL_CLEAR:
+        WRITE_ONCE(reader->drain->read_stamp, ktime_get_mono_fast_ns());
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/**
+ * drain_ram_pcpu_open() - Open file handle function.
+ * @inode:        The inode associated with the file.
+ * @file:        Pointer to the opened file.
+ *
+ * Return: 0 on success, else error code.
+ */
+static int drain_ram_pcpu_open(struct inode *inode,
+                   struct file *file)
+{
+    struct mvx_log_drain_ram_pcpu *drain = get_inode_private(file, 1);
+    struct drain_ram_reader *reader;
+    int cpu;
+
+    reader = kzalloc(struct_size(reader, pos, nr_cpu_ids), GFP_KERNEL);
+    if (reader == NULL)
+        return -ENOMEM;
+
+    reader->msg = vmalloc(drain->buffer_size);
+    if (reader->msg == NULL) {
+        kfree(reader);
+        return -ENOMEM;
+    }
+
+    reader->drain = drain;
+    reader->start_stamp = READ_ONCE(drain->read_stamp);
+    mutex_init(&reader->mutex);
+
+    for_each_possible_cpu(cpu)
+        reader->pos[cpu] = READ_ONCE(per_cpu_ptr(drain->cpu, cpu)->tail);
+
+    file->private_data = reader;
+
+    return 0;
+}
+
+/**
+ * drain_ram_pcpu_release() - Release file handle function.
+ * @inode:        The inode associated with the file.
+ * @file:        Pointer to the file.
+ *
+ * Return: 0 Always succeeds.
+ */
+static int drain_ram_pcpu_release(struct inode *inode,
+                  struct file *file)
+{
+    struct drain_ram_reader *reader = file->private_data;
+
+    vfree(reader->msg);
+    kfree(reader);
+
+    return 0;
+}
+
 /******************************************************************************
  * External interface
  ******************************************************************************/
@@ -905,7 +1266,7 @@ static void drain_ram_print(struct mvx_log_drain *drain,
     vec[1].iov_base = buf;
     vec[1].iov_len = n;
 
-    drain_ram_data(drain, severity, vec, 2);
+    drain->data(drain, severity, vec, 2);
 }
 
 static void drain_ram_reset(struct mvx_log_drain *drain)
@@ -996,6 +1357,206 @@ error:
     return ret;
 }
 
+static void drain_ram_pcpu_data(struct mvx_log_drain *drain,
+                enum mvx_log_severity severity,
+                struct iovec *vec,
+                size_t count)
+{
+    struct mvx_log_drain_ram_pcpu *drain_ram =
+        (struct mvx_log_drain_ram_pcpu *)drain;
+    struct mvx_log_drain_ram_cpu *ring;
+    struct drain_ram_record rec;
+    unsigned long flags;
+    size_t i;
+    size_t length;
+    size_t size;
+    size_t pos;
+    size_t tail;
+
+    if (!IS_ENABLED(CONFIG_DEBUG_FS))
+        return;
+
+    /* Calculate the total length of the output. */
+    for (i = 0, length = 0; i < count; ++i)
+        length += vec[i].iov_len;
+
+    /* Round up to next 32-bit boundary. */
+    length = (length + 3) & ~3;
+    size = sizeof(rec) + length;
+
+    if (size > drain_ram->buffer_size) {
+        pr_err(
+            "MVX: Logged data larger than output buffer. length=%zu, buffer_length=%zu.\n",
+            length,
+            drain_ram->buffer_size);
+        return;
+    }
+
+    rec.length = length;
+    rec.reserved = 0;
+
+    /*
+     * Only this CPU writes to its ring. Disabling interrupts keeps records
+     * logged from interrupt context from interleaving.
+     */
+    local_irq_save(flags);
+
+    ring = this_cpu_ptr(drain_ram->cpu);
+    rec.stamp = ktime_get_mono_fast_ns();
+    pos = ring->head;
+
+    /* Release the oldest records that are about to be overwritten. */
+    tail = ring->tail;
+    while (pos + size - tail > drain_ram->buffer_size) {
+        struct drain_ram_record old;
+
+        ring_read(ring, drain_ram->buffer_size, tail, &old, sizeof(old));
+        tail += sizeof(old) + old.length;
+    }
+
+    if (tail != ring->tail) {
+        WRITE_ONCE(ring->tail, tail);
+
+        /* Publish the new tail before the records are overwritten. */
+        smp_wmb();
+    }
+
+    ring_write(ring, drain_ram->buffer_size, pos, &rec, sizeof(rec));
+    pos += sizeof(rec);
+
+    /* Loop over scatter input. */
+    for (i = 0; i < count; ++i) {
+        ring_write(ring, drain_ram->buffer_size, pos, vec[i].iov_base,
+               vec[i].iov_len);
+        pos += vec[i].iov_len;
+    }
+
+    /* Publish the record. Length has already been 4 byte aligned. */
+    smp_store_release(&ring->head, ring->head + size);
+
+    local_irq_restore(flags);
+
+    if (wq_has_sleeper(&drain_ram->queue))
+        wake_up_interruptible(&drain_ram->queue);
+}
+
+static void drain_ram_pcpu_reset(struct mvx_log_drain *drain)
+{
+    struct mvx_log_drain_ram_pcpu *drain_ram =
+        (struct mvx_log_drain_ram_pcpu *)drain;
+
+    /* Records cannot be removed without locking out the writers. */
+    WRITE_ONCE(drain_ram->read_stamp, ktime_get_mono_fast_ns());
+}
+
+int mvx_log_drain_ram_pcpu_construct(struct mvx_log_drain_ram_pcpu *drain,
+                     size_t buffer_size)
+{
+    int cpu;
+    int ret;
+
+    ret = drain_construct(&drain->base, drain_ram_print,
+                  drain_ram_pcpu_data, drain_ram_pcpu_reset);
+    if (ret != 0)
+        return ret;
+
+    if (!IS_ENABLED(CONFIG_DEBUG_FS)) {
+        pr_info("MVX: No Debugfs no RAM drain.\n");
+        return 0;
+    }
+
+    if (!is_power_of_2(buffer_size))
+        return -EINVAL;
+
+    drain->cpu = alloc_percpu(struct mvx_log_drain_ram_cpu);
+    if (drain->cpu == NULL)
+        return -ENOMEM;
+
+    for_each_possible_cpu(cpu) {
+        struct mvx_log_drain_ram_cpu *ring = per_cpu_ptr(drain->cpu, cpu);
+
+        ring->buf = vmalloc(buffer_size);
+        if (ring->buf == NULL) {
+            ret = -ENOMEM;
+            goto free_rings;
+        }
+    }
+
+    drain->buffer_size = buffer_size;
+    drain->read_stamp = 0;
+    init_waitqueue_head(&drain->queue);
+
+    return 0;
+
+free_rings:
+    for_each_possible_cpu(cpu)
+        vfree(per_cpu_ptr(drain->cpu, cpu)->buf);
+
+    free_percpu(drain->cpu);
+    drain->cpu = NULL;
+
+    return ret;
+}
+
+void mvx_log_drain_ram_pcpu_destruct(struct mvx_log_drain_ram_pcpu *drain)
+{
+    int cpu;
+
+    if (IS_ENABLED(CONFIG_DEBUG_FS) && drain->cpu != NULL) {
+        for_each_possible_cpu(cpu)
+            vfree(per_cpu_ptr(drain->cpu, cpu)->buf);
+
+        free_percpu(drain->cpu);
+        drain->cpu = NULL;
+    }
+
+    drain_destruct(&drain->base);
+}
+
+int mvx_log_drain_ram_pcpu_add(struct mvx_log *log,
+                   const char *name,
+                   struct mvx_log_drain_ram_pcpu *drain)
+{
+    static const struct file_operations drain_ram_pcpu_msg = {
+        .read           = drain_ram_pcpu_read_msg,
+        .poll           = drain_ram_pcpu_msg_poll,
+        .open           = drain_ram_pcpu_open,
+        .release        = drain_ram_pcpu_release,
+        .unlocked_ioctl = drain_ram_pcpu_ioctl
+    };
+    struct dentry *dentry;
+    int ret;
+
+    if (!IS_ENABLED(CONFIG_DEBUG_FS)) {
+        pr_info(
+            "MVX: Debugfs is not enabled. RAM drain dirs are not created.\n");
+        return 0;
+    }
+
+    if (drain->cpu == NULL)
+        return -ENOMEM;
+
+    ret = mvx_log_drain_add(log, name, &drain->base);
+    if (ret != 0)
+        return ret;
+
+    /* Create dentry. */
+    dentry = debugfs_create_file("msg", 0600, drain->base.dentry, NULL,
+                     &drain_ram_pcpu_msg);
+    if (IS_ERR_OR_NULL(dentry)) {
+        pr_err("MVX: Failed to create '%s/msg.\n", name);
+        ret = -ENOMEM;
+        goto error;
+    }
+
+    return 0;
+
+error:
+    debugfs_remove_recursive(drain->base.dentry);
+
+    return ret;
+}
+
 #ifdef MVX_LOG_FTRACE_ENABLE
 static void drain_ftrace_print(struct mvx_log_drain *drain,
                    enum mvx_log_severity severity,
@@ -236,6 +236,41 @@ struct mvx_log_drain_ram {
     struct semaphore sem;
 };
 
+/**
+ * struct mvx_log_drain_ram_cpu - Ring buffer of one CPU in a per CPU RAM drain.
+ * @buf:        Pointer to ring buffer.
+ * @head:        Write position. Only updated by the owning CPU.
+ * @tail:        Position of the oldest record that has not been
+ *            overwritten. Only updated by the owning CPU.
+ */
+struct mvx_log_drain_ram_cpu {
+    char *buf;
+    size_t head;
+    size_t tail;
+};
+
+/**
+ * struct mvx_log_drain_ram_pcpu - Structure describing a per CPU RAM drain.
+ * @base:        Base class.
+ * @cpu:        Per CPU ring buffers.
+ * @buffer_size:    Size of each ring buffer. Must be power of 2.
+ * @read_stamp:        Records older than this are skipped when a new file
+ *            handle is opened. Is updated when the buffer is cleared.
+ * @queue:        Wait queue for blocking IO.
+ *
+ * Writers only touch the ring of the CPU they run on, with interrupts
+ * disabled, and never block. Every record is time stamped. Readers merge
+ * the rings in time stamp order and produce the same stream of messages as
+ * the RAM drain.
+ */
+struct mvx_log_drain_ram_pcpu {
+    struct mvx_log_drain base;
+    struct mvx_log_drain_ram_cpu __percpu *cpu;
+    size_t buffer_size;
+    uint64_t read_stamp;
+    wait_queue_head_t queue;
+};
+
 /**
  * struct mvx_log_group - Structure describing log group. The log group filters
  *              which log messages that shall be forwarded to the
@@ -364,6 +399,35 @@ int mvx_log_drain_ram_add(struct mvx_log *log,
               const char *name,
               struct mvx_log_drain_ram *drain);
 
+/**
+ * mvx_log_drain_ram_pcpu_construct() - Per CPU RAM drain constructor.
+ * @drain:        Pointer to drain.
+ * @buffer_size:    The size of the ring buffer of each CPU.
+ *
+ * Return: 0 on success, else error code.
+ */
+int mvx_log_drain_ram_pcpu_construct(struct mvx_log_drain_ram_pcpu *drain,
+                     size_t buffer_size);
+
+/**
+ * mvx_log_drain_ram_pcpu_destruct() - Per CPU RAM drain destructor.
+ * @drain:        Pointer to drain.
+ */
+void mvx_log_drain_ram_pcpu_destruct(struct mvx_log_drain_ram_pcpu *drain);
+
+/**
+ * mvx_log_drain_ram_pcpu_add() - Derived function to add per CPU RAM drain to
+ *                log.
+ * @log:        Pointer to log.
+ * @name:        Name of drain.
+ * @drain:        Pointer to drain.
+ *
+ * Return: 0 on success, else error code.
+ */
+int mvx_log_drain_ram_pcpu_add(struct mvx_log *log,
+                   const char *name,
+                   struct mvx_log_drain_ram_pcpu *drain);
+
 #ifdef MVX_LOG_FTRACE_ENABLE
 
 /**
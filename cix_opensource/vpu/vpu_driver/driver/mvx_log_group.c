@@ -55,7 +55,7 @@
 static struct mvx_log log;
 
 static struct mvx_log_drain drain_dmesg_if;
-static struct mvx_log_drain_ram drain_ram0_if;
+static struct mvx_log_drain_ram_pcpu drain_ram0_if;
 static struct mvx_log_drain_ram drain_ram1_if;
 
 #ifdef MVX_LOG_FTRACE_ENABLE
@@ -189,8 +189,8 @@ int mvx_log_group_init(const char *entry_name)
     if (ret != 0)
         goto delete_log_entry;
 
-    mvx_log_drain_ram_construct(&drain_ram0_if, 64 * 1024);
-    ret = mvx_log_drain_ram_add(&log, "ram0", &drain_ram0_if);
+    mvx_log_drain_ram_pcpu_construct(&drain_ram0_if, 64 * 1024);
+    ret = mvx_log_drain_ram_pcpu_add(&log, "ram0", &drain_ram0_if);
     if (ret != 0)
         goto delete_dmesg_drain;
 
@@ -273,7 +273,7 @@ delete_ram1_drain:
     mvx_log_drain_ram_destruct(&drain_ram1_if);
 
 delete_ram_drain:
-    mvx_log_drain_ram_destruct(&drain_ram0_if);
+    mvx_log_drain_ram_pcpu_destruct(&drain_ram0_if);
 
 delete_dmesg_drain:
     mvx_log_drain_dmesg_destruct(&drain_dmesg_if);
@@ -307,7 +307,7 @@ void mvx_log_group_deinit(void)
 #endif /* MVX_LOG_FTRACE_ENABLE */
 
     mvx_log_drain_ram_destruct(&drain_ram1_if);
-    mvx_log_drain_ram_destruct(&drain_ram0_if);
+    mvx_log_drain_ram_pcpu_destruct(&drain_ram0_if);
     mvx_log_drain_dmesg_destruct(&drain_dmesg_if);
 
     mvx_log_destruct(&log);